@@ -1,43 +1,382 @@
 #include "server.h"
 #include "handler.h"
 #include "postgresql.h"
-#include "random.h"
+#include "shortcode.h"
+#include "counter.h"
+#include "settings.h"
+#include "export.h"
+#include "importer.h"
+#include "snapshot.h"
+#include "logStore.h"
+#include <cstdlib>
+#include <fstream>
 #include <iostream>
+#include <string_view>
 
 #include "Config.h"
 
 
-int main() {
-	std::cout << "url shortening service\n";
+namespace {
+    // Writes every url to stdout as the COPY sends it, over a connection of its own
+    int ExportUrls(const Settings::Config& settings, Export::Format format) {
+        const auto& db{ settings.database };
+        try {
+            PostgreSQL::Database database{
+                PostgreSQL::ConnectionConfig{ db.host, db.user, db.password, db.name, db.port },
+                std::make_shared<PostgreSQL::PGClient>(),
+                PostgreSQL::PoolConfig{ 1, 1, db.acquireTimeout } };
 
-    auto const address = net::ip::make_address(__ADDRESS_SERVER);
-    auto const port = static_cast<unsigned short>(__PORT_SERVER);
+            auto stream{ database.CopyOut(Export::CopyQuery(format)) };
+            std::string chunk{ };
+            for (bool isMore{ true }; isMore; ) {
+                chunk.clear();
+                isMore = stream -> Read(chunk, settings.handler.exportChunkSize);
+                std::cout.write(chunk.data(), chunk.size());
+            }
+            std::cout.flush();
+        }
+        catch (const std::exception& e) {
+            std::cerr << "Export failed: " << e.what() << "\n";
+            return EXIT_FAILURE;
+        }
 
-    Server<http::string_body> server{ address, port, 2 };
+        return std::cout ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
 
-    PostgreSQL::ConnectionConfig config{ __HOST_DATABASE,
-        __USER_DATABASE,
-        __PASSWORD_DATABASE,
-        __NAME_DATABASE,
-        __PORT_DATABASE };
+    // Writes the snapshot file read-only replicas serve, over a connection of its own.
+    // The file is renamed over path when it is complete, so running replicas pick it up on their next check.
+    int BuildSnapshot(const Settings::Config& settings, const std::string& path) {
+        const auto& db{ settings.database };
+        try {
+            PostgreSQL::Database database{
+                PostgreSQL::ConnectionConfig{ db.host, db.user, db.password, db.name, db.port },
+                std::make_shared<PostgreSQL::PGClient>(),
+                PostgreSQL::PoolConfig{ 1, 1, db.acquireTimeout } };
 
+            std::size_t rows{ Snapshot::BuildFromDatabase(database, path, settings.handler.exportChunkSize) };
+            std::cerr << "Wrote " << rows << " urls to " << path << "\n";
+        }
+        catch (const std::exception& e) {
+            std::cerr << "Snapshot failed: " << e.what() << "\n";
+            return EXIT_FAILURE;
+        }
+
+        return EXIT_SUCCESS;
+    }
+
+    // Quoted as RFC 4180 asks when it holds a delimiter, a quote or a line break
+    std::string CsvField(std::string_view value) {
+        if (value.find_first_of(",\"\r\n") == std::string_view::npos) {
+            return std::string{ value };
+        }
+
+        std::string field{ "\"" };
+        for (char c : value) {
+            field += c;
+            if (c == '"') {
+                field += '"';
+            }
+        }
+        field += '"';
+        return field;
+    }
+
+    // Copies the urls of the input ("-" for stdin) into the table with their codes and writes the
+    // rows that were not imported to rejectsPath as CSV. The next chunk is read only once the
+    // database has taken the last one, so a large file is never held in memory.
+    int ImportUrls(const Settings::Config& settings, Import::Format format,
+        std::string_view inputPath, const char* rejectsPath) {
+        std::ifstream file{ };
+        std::istream* input{ &std::cin };
+        if (inputPath != "-") {
+            file.open(std::string{ inputPath }, std::ios::binary);
+            if (!file) {
+                std::cerr << "Import failed: cannot open " << inputPath << "\n";
+                return EXIT_FAILURE;
+            }
+            input = &file;
+        }
+
+        std::ofstream rejects{ rejectsPath, std::ios::binary };
+        if (!rejects) {
+            std::cerr << "Import failed: cannot create " << rejectsPath << "\n";
+            return EXIT_FAILURE;
+        }
+        rejects << "line,reason,value\n";
+
+        const auto& db{ settings.database };
+        try {
+            PostgreSQL::Database database{
+                PostgreSQL::ConnectionConfig{ db.host, db.user, db.password, db.name, db.port },
+                std::make_shared<PostgreSQL::PGClient>(),
+                PostgreSQL::PoolConfig{ 1, 1, db.acquireTimeout } };
+
+            // Codes the service could allocate are refused, it would hand them out again
+            ShortCode::Encoder encoder{ settings.code.key };
+            Import::Importer importer{ database, format,
+                [&rejects](const Import::Reject& reject) {
+                    rejects << reject.line << ',' << CsvField(reject.reason) << ',' << CsvField(reject.value) << '\n';
+                },
+                &encoder, Import::ImportConfig{ .chunkSize = settings.handler.importChunkSize } };
+
+            std::string chunk(settings.handler.importChunkSize, '\0');
+            while (input -> read(chunk.data(), chunk.size()) || input -> gcount() > 0) {
+                importer.Write(std::string_view{ chunk.data(), static_cast<std::size_t>(input -> gcount()) });
+            }
+            if (input -> bad()) {
+                throw std::runtime_error("The input could not be read.");
+            }
+
+            Import::Summary summary{ importer.Finish() };
+            std::cerr << "Imported " << summary.imported << " of " << summary.rows << " rows, "
+                << summary.rejected << " rejected\n";
+        }
+        catch (const std::exception& e) {
+            std::cerr << "Import failed: " << e.what() << "\n";
+            return EXIT_FAILURE;
+        }
+
+        rejects.flush();
+        return rejects ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+}
+
+
+int main(int argc, char* argv[]) {
+    // URLShortener [settings] runs the service,
+    // URLShortener --export ndjson|csv [settings] writes every url to stdout and exits,
+    // URLShortener --import ndjson|csv <input|-> <rejects> [settings] loads urls with their codes and exits,
+    // URLShortener --snapshot <output> [settings] writes a snapshot file for read-only replicas and exits
+    const std::string_view mode{ argc > 1 ? argv[1] : "" };
+    const bool isExport{ mode == "--export" };
+    const bool isImport{ mode == "--import" };
+    const bool isSnapshot{ mode == "--snapshot" };
+    std::optional<Export::Format> exportFormat{ };
+    std::optional<Import::Format> importFormat{ };
+    if (isExport) {
+        exportFormat = argc > 2 ? Export::ParseFormat(argv[2]) : std::nullopt;
+        if (!exportFormat) {
+            std::cerr << "Usage: " << argv[0] << " --export ndjson|csv [settings]\n";
+            return EXIT_FAILURE;
+        }
+    }
+    else if (isImport) {
+        importFormat = argc > 4 ? Import::ParseFormat(argv[2]) : std::nullopt;
+        if (!importFormat) {
+            std::cerr << "Usage: " << argv[0] << " --import ndjson|csv <input|-> <rejects> [settings]\n";
+            return EXIT_FAILURE;
+        }
+    }
+    else if (isSnapshot) {
+        if (argc < 3) {
+            std::cerr << "Usage: " << argv[0] << " --snapshot <output> [settings]\n";
+            return EXIT_FAILURE;
+        }
+    }
+    else {
+        std::cout << "url shortening service\n";
+    }
+    const int settingsArg{ isExport || isSnapshot ? 3 : isImport ? 5 : 1 };
+
+    // Config.h holds the defaults of the build, the settings file (first argument or
+    // URL_SHORTENER_CONFIG) and URL_SHORTENER_SECTION_NAME variables override them.
+    Settings::Config settings{ Settings::Defaults() };
+    settings.server.address = __ADDRESS_SERVER;
+    settings.server.port = static_cast<std::uint16_t>(__PORT_SERVER);
+    settings.database.host = __HOST_DATABASE;
+    settings.database.user = __USER_DATABASE;
+    settings.database.password = __PASSWORD_DATABASE;
+    settings.database.name = __NAME_DATABASE;
+    settings.database.port = __PORT_DATABASE;
+
+    try {
+        const char* path{ argc > settingsArg ? argv[settingsArg] : std::getenv("URL_SHORTENER_CONFIG") };
+        settings = Settings::Load(settings, path ? path : "");
+    }
+    catch (const std::exception& e) {
+        std::cerr << "Invalid settings: " << e.what() << "\n";
+        return EXIT_FAILURE;
+    }
+
+    if (isExport) {
+        return ExportUrls(settings, *exportFormat);
+    }
+    if (isImport) {
+        return ImportUrls(settings, *importFormat, argv[3], argv[4]);
+    }
+    if (isSnapshot) {
+        return BuildSnapshot(settings, argv[2]);
+    }
+
+    ServerConfig serverConfig{ };
+    serverConfig.threads = settings.server.threads;
+    serverConfig.mode = settings.server.ioMode == "per_thread" ? IoMode::PerThread : IoMode::Shared;
+    serverConfig.pinThreads = settings.server.pinThreads;
+    serverConfig.session.readTimeout = settings.server.readTimeout;
+    serverConfig.session.keepAliveTimeout = settings.server.keepAliveTimeout;
+    serverConfig.session.bodyLimit = settings.server.bodyLimit;
+    serverConfig.session.headerLimit = settings.server.headerLimit;
+    serverConfig.session.pipelineLimit = settings.server.pipelineLimit;
+    serverConfig.session.maxWriteSize = settings.server.maxWriteSize;
+
+    // SIGTERM drains the open connections, then Run returns
+    serverConfig.handleSignals = true;
+    serverConfig.drainTimeout = settings.server.drainTimeout;
+
+    // Requests and responses take their memory from the arena of their session
+    using HttpServer = Server<ArenaStringBody, ArenaFields>;
+    HttpServer server{ net::ip::make_address(settings.server.address), settings.server.port, serverConfig };
+
+    HandlerConfig handlerConfig{ };
+    handlerConfig.prettyPrint = settings.handler.prettyPrint;
+    handlerConfig.redirect.status = static_cast<http::status>(settings.handler.redirectStatus);
+    handlerConfig.redirect.cacheControl = settings.handler.cacheControl;
+    handlerConfig.batch.maxUrls = settings.handler.batchMaxUrls;
+    handlerConfig.batch.rowsPerStatement = settings.handler.batchRowsPerStatement;
+    handlerConfig.batch.maxCodes = settings.handler.batchMaxCodes;
+    handlerConfig.exportChunkSize = settings.handler.exportChunkSize;
+    handlerConfig.importChunkSize = settings.handler.importChunkSize;
+    handlerConfig.importMaxRejects = settings.handler.importMaxRejects;
+    handlerConfig.adminThreads = settings.handler.adminThreads;
+    handlerConfig.adminToken = settings.handler.adminToken;
+
+    using RequestType = http::request<ArenaStringBody, ArenaFields>;
+
+    // A replica answers lookups from the mapped snapshot and never opens a database connection
+    if (!settings.snapshot.path.empty()) {
+        std::shared_ptr<Snapshot::Store> snapshot{ };
+        try {
+            snapshot = std::make_shared<Snapshot::Store>(settings.snapshot.path,
+                Snapshot::StoreConfig{ settings.snapshot.reloadInterval, settings.snapshot.verifyChecksum },
+                spdlog::default_logger());
+        }
+        catch (const std::exception& e) {
+            std::cerr << "Invalid snapshot: " << e.what() << "\n";
+            return EXIT_FAILURE;
+        }
+        snapshot -> Start();
+
+        auto handler = std::make_shared<HttpHandler<ArenaStringBody, ArenaFields>>(
+            snapshot,
+            "server_handler",
+            handlerConfig);
+
+        HttpServer::CoroutineHandler func = [handler](RequestType req) -> net::awaitable<http::message_generator> {
+            return handler -> HandleAsync(std::move(req));
+        };
+
+        server.Run(func);
+        snapshot -> Stop();
+
+        spdlog::apply_all([](const std::shared_ptr<spdlog::logger>& logger) { logger -> flush(); });
+
+        return EXIT_SUCCESS;
+    }
+
+    // Hot short codes are served without a storage round trip
+    auto cache = std::make_shared<UrlCache>(settings.cache.capacity, settings.cache.shards);
+
+    Counter::FlushConfig flushConfig{ };
+    flushConfig.interval = settings.counter.flushInterval;
+    flushConfig.maxBatchSize = settings.counter.maxBatchSize;
+    flushConfig.flushOnShutdown = true;
+
+    // A single node keeps its urls in a log file of its own and never opens a database connection
+    if (settings.storage.backend == "log") {
+        std::shared_ptr<LogStore::UrlRepository> store{ };
+        try {
+            store = std::make_shared<LogStore::UrlRepository>(settings.storage.path,
+                ShortCode::Encoder{ settings.code.key },
+                LogStore::StoreConfig{ .syncWrites = settings.storage.syncWrites, .counts = flushConfig },
+                spdlog::default_logger());
+        }
+        catch (const std::exception& e) {
+            std::cerr << "Invalid url log: " << e.what() << "\n";
+            return EXIT_FAILURE;
+        }
+        store -> Start();
+
+        auto handler = std::make_shared<HttpHandler<ArenaStringBody, ArenaFields>>(
+            store,
+            "server_handler",
+            cache,
+            handlerConfig);
+
+        HttpServer::CoroutineHandler func = [handler](RequestType req) -> net::awaitable<http::message_generator> {
+            return handler -> HandleAsync(std::move(req));
+        };
+
+        server.Run(func);
+
+        int status{ EXIT_SUCCESS };
+        try {
+            store -> Stop();
+        }
+        catch (const std::exception&) {
+            status = EXIT_FAILURE; // already logged by the counter
+        }
+
+        spdlog::apply_all([](const std::shared_ptr<spdlog::logger>& logger) { logger -> flush(); });
+
+        return status;
+    }
+
+    const auto& db{ settings.database };
+    PostgreSQL::ConnectionConfig config{ db.host, db.user, db.password, db.name, db.port };
+
+    PostgreSQL::PoolConfig poolConfig{ db.poolMin, db.poolMax, db.acquireTimeout };
+    poolConfig.healthCheckInterval = db.healthCheckInterval;
+
+    PostgreSQL::PipelineConfig pipelineConfig{ };
+    pipelineConfig.connections = db.pipelineConnections;
+
+    // Queries are driven by the io_context of the thread that starts them, so a slow one does not hold an io thread.
     std::unique_ptr<IDatabase> database{ std::make_unique<PostgreSQL::Database>(
-        config, std::make_shared<PostgreSQL::PGClient>()) };
+        config, std::make_shared<PostgreSQL::PGClient>(), server.GetExecutors(), poolConfig, pipelineConfig) };
 
-    auto handler = std::make_shared<HttpHandler<http::string_body>>(
+    // Accesses are written in batches over a connection of their own, reads stay plain SELECTs
+    auto counter = std::make_shared<Counter::AccessCounter>(
+        std::make_unique<PostgreSQL::Database>(config, std::make_shared<PostgreSQL::PGClient>()),
+        flushConfig,
+        spdlog::default_logger());
+    counter -> Start();
+
+    // Short codes are leased in blocks over a connection of their own.
+    // Every instance writing to the same table has to use the same key.
+    ShortCode::LeaseConfig leaseConfig{ };
+    leaseConfig.blockSize = settings.code.blockSize;
+
+    auto codes = std::make_shared<ShortCode::Allocator>(
+        std::make_unique<PostgreSQL::Database>(config, std::make_shared<PostgreSQL::PGClient>()),
+        ShortCode::Encoder{ settings.code.key },
+        leaseConfig);
+
+    auto handler = std::make_shared<HttpHandler<ArenaStringBody, ArenaFields>>(
         std::move(database), 
         "server_handler", 
-        Random::StringGenerator());
+        codes,
+        cache,
+        counter,
+        handlerConfig);
 
-    using RequestType = http::request<http::string_body, http::basic_fields<std::allocator<char>>>;
-    
-    auto func_lambda = [handler](auto&& req) ->  http::message_generator {
-        return handler -> operator()(std::move(req));
+    auto func_lambda = [handler](RequestType req) -> net::awaitable<http::message_generator> {
+        return handler -> HandleAsync(std::move(req));
     };
 
-    std::function<http::message_generator(RequestType&&)> func = func_lambda;
+    HttpServer::CoroutineHandler func = func_lambda;
 
     server.Run(func);
 
-    return EXIT_SUCCESS;
+    // The counts recorded by the drained requests go out with the last batch
+    int status{ EXIT_SUCCESS };
+    try {
+        counter -> Stop();
+    }
+    catch (const std::exception&) {
+        status = EXIT_FAILURE; // already logged by the counter
+    }
+
+    spdlog::apply_all([](const std::shared_ptr<spdlog::logger>& logger) { logger -> flush(); });
+
+    return status;
 }
\ No newline at end of file
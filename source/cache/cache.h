@@ -0,0 +1,328 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+
+namespace Cache {
+	struct Stats {
+		std::uint64_t hits{ };
+		std::uint64_t misses{ };
+		std::uint64_t evictions{ };
+		std::size_t size{ };
+		std::size_t capacity{ };
+	};
+
+
+	// Bounded key -> value cache split into independently locked shards.
+	// Every shard is a segmented LRU: new keys land in the probation segment and are
+	// promoted to the protected segment on their second hit, so one-off lookups
+	// cannot flush the hot links out of the cache.
+	//
+	// A value read from the storage while it is being changed must not be cached after the change
+	// invalidated its key. Take GetVersion(key) before the read and store the value with PutIfUnchanged,
+	// it is dropped if its shard erased a key since.
+	template <typename Value>
+	class ShardedLruCache {
+	public:
+
+		ShardedLruCache(std::size_t capacity, std::size_t countShards = 16);
+
+		std::optional<Value> Get(std::string_view key);
+
+		void Put(std::string_view key, Value value);
+
+		// Version of the shard of key, it changes with every Erase or Clear of the shard
+		std::uint64_t GetVersion(std::string_view key) const;
+
+		// Put if the shard of key is still at version, returns whether the value was stored
+		bool PutIfUnchanged(std::string_view key, Value value, std::uint64_t version);
+
+		void Erase(std::string_view key);
+
+		void Clear();
+
+		Stats GetStats() const;
+
+	private:
+
+		// Allows std::string_view lookups without building a std::string key
+		struct StringHash {
+			using is_transparent = void;
+
+			std::size_t operator()(std::string_view key) const {
+				return std::hash<std::string_view>{ }(key);
+			}
+		};
+
+		class Shard {
+		public:
+
+			explicit Shard(std::size_t capacity);
+
+			std::optional<Value> Get(std::string_view key);
+
+			void Put(std::string_view key, Value value);
+
+			std::uint64_t GetVersion() const;
+
+			bool PutIfUnchanged(std::string_view key, Value value, std::uint64_t version);
+
+			void Erase(std::string_view key);
+
+			void Clear();
+
+			void AddStats(Stats& stats) const;
+
+		private:
+
+			enum class Segment { Probation, Protected };
+
+			struct Entry {
+				std::string key;
+				Value value;
+				Segment segment;
+			};
+
+			using List = std::list<Entry>;
+
+			// Caller holds m_mutex
+			void Insert(std::string_view key, Value value);
+
+			void Promote(typename List::iterator it);
+
+			void Evict();
+
+		private:
+			const std::size_t m_capacity;
+			const std::size_t m_protectedCapacity;
+
+			mutable std::mutex m_mutex{ };
+			List m_probation{ };
+			List m_protected{ };
+			std::unordered_map<std::string, typename List::iterator, StringHash, std::equal_to<>> m_index{ };
+
+			std::uint64_t m_hits{ };
+			std::uint64_t m_misses{ };
+			std::uint64_t m_evictions{ };
+			std::uint64_t m_version{ };
+		};
+
+		Shard& GetShard(std::string_view key) const {
+			return *m_shards[StringHash{ }(key) % m_shards.size()];
+		}
+
+	private:
+		std::size_t m_capacity{ };
+		std::vector<std::unique_ptr<Shard>> m_shards{ };
+	};
+
+
+	template <typename Value>
+	ShardedLruCache<Value>::ShardedLruCache(std::size_t capacity, std::size_t countShards)
+		: m_capacity{ capacity }
+	{
+		if (countShards == 0) {
+			throw std::invalid_argument("The number of shards cannot be zero.");
+		}
+
+		if (capacity < countShards) {
+			throw std::invalid_argument("The capacity cannot be less than the number of shards.");
+		}
+
+		m_shards.reserve(countShards);
+		for (std::size_t i{ 0 }; i < countShards; ++i) {
+			// The remainder is spread over the first shards
+			std::size_t shardCapacity{ capacity / countShards + (i < capacity % countShards ? 1 : 0) };
+			m_shards.emplace_back(std::make_unique<Shard>(shardCapacity));
+		}
+	}
+
+	template <typename Value>
+	std::optional<Value> ShardedLruCache<Value>::Get(std::string_view key) {
+		return GetShard(key).Get(key);
+	}
+
+	template <typename Value>
+	void ShardedLruCache<Value>::Put(std::string_view key, Value value) {
+		GetShard(key).Put(key, std::move(value));
+	}
+
+	template <typename Value>
+	std::uint64_t ShardedLruCache<Value>::GetVersion(std::string_view key) const {
+		return GetShard(key).GetVersion();
+	}
+
+	template <typename Value>
+	bool ShardedLruCache<Value>::PutIfUnchanged(std::string_view key, Value value, std::uint64_t version) {
+		return GetShard(key).PutIfUnchanged(key, std::move(value), version);
+	}
+
+	template <typename Value>
+	void ShardedLruCache<Value>::Erase(std::string_view key) {
+		GetShard(key).Erase(key);
+	}
+
+	template <typename Value>
+	void ShardedLruCache<Value>::Clear() {
+		for (auto& shard : m_shards) {
+			shard -> Clear();
+		}
+	}
+
+	template <typename Value>
+	Stats ShardedLruCache<Value>::GetStats() const {
+		Stats stats{ };
+		stats.capacity = m_capacity;
+		for (const auto& shard : m_shards) {
+			shard -> AddStats(stats);
+		}
+
+		return stats;
+	}
+
+
+	template <typename Value>
+	ShardedLruCache<Value>::Shard::Shard(std::size_t capacity)
+		: m_capacity{ capacity }
+		, m_protectedCapacity{ capacity * 4 / 5 } // 80% protected, 20% probation
+	{
+		m_index.reserve(capacity);
+	}
+
+	template <typename Value>
+	std::optional<Value> ShardedLruCache<Value>::Shard::Get(std::string_view key) {
+		std::lock_guard<std::mutex> lock{ m_mutex };
+
+		auto found{ m_index.find(key) };
+		if (found == m_index.end()) {
+			++m_misses;
+			return std::nullopt;
+		}
+
+		++m_hits;
+		Promote(found -> second);
+		return found -> second -> value;
+	}
+
+	template <typename Value>
+	void ShardedLruCache<Value>::Shard::Put(std::string_view key, Value value) {
+		std::lock_guard<std::mutex> lock{ m_mutex };
+		Insert(key, std::move(value));
+	}
+
+	template <typename Value>
+	std::uint64_t ShardedLruCache<Value>::Shard::GetVersion() const {
+		std::lock_guard<std::mutex> lock{ m_mutex };
+		return m_version;
+	}
+
+	template <typename Value>
+	bool ShardedLruCache<Value>::Shard::PutIfUnchanged(std::string_view key, Value value, std::uint64_t version) {
+		std::lock_guard<std::mutex> lock{ m_mutex };
+		if (m_version != version) {
+			return false;
+		}
+
+		Insert(key, std::move(value));
+		return true;
+	}
+
+	template <typename Value>
+	void ShardedLruCache<Value>::Shard::Insert(std::string_view key, Value value) {
+		auto found{ m_index.find(key) };
+		if (found != m_index.end()) {
+			found -> second -> value = std::move(value);
+			Promote(found -> second);
+			return;
+		}
+
+		if (m_index.size() >= m_capacity) {
+			Evict();
+		}
+
+		m_probation.push_front(Entry{ std::string{ key }, std::move(value), Segment::Probation });
+		m_index.emplace(m_probation.front().key, m_probation.begin());
+	}
+
+	template <typename Value>
+	void ShardedLruCache<Value>::Shard::Erase(std::string_view key) {
+		std::lock_guard<std::mutex> lock{ m_mutex };
+
+		// Also when the key is not cached, a lookup may be about to put it
+		++m_version;
+		auto found{ m_index.find(key) };
+		if (found == m_index.end()) {
+			return;
+		}
+
+		auto it{ found -> second };
+		m_index.erase(found);
+		if (it -> segment == Segment::Protected) {
+			m_protected.erase(it);
+		}
+		else {
+			m_probation.erase(it);
+		}
+	}
+
+	template <typename Value>
+	void ShardedLruCache<Value>::Shard::Clear() {
+		std::lock_guard<std::mutex> lock{ m_mutex };
+
+		++m_version;
+		m_index.clear();
+		m_probation.clear();
+		m_protected.clear();
+	}
+
+	template <typename Value>
+	void ShardedLruCache<Value>::Shard::AddStats(Stats& stats) const {
+		std::lock_guard<std::mutex> lock{ m_mutex };
+
+		stats.hits += m_hits;
+		stats.misses += m_misses;
+		stats.evictions += m_evictions;
+		stats.size += m_index.size();
+	}
+
+	template <typename Value>
+	void ShardedLruCache<Value>::Shard::Promote(typename List::iterator it) {
+		if (it -> segment == Segment::Protected) {
+			m_protected.splice(m_protected.begin(), m_protected, it);
+			return;
+		}
+
+		it -> segment = Segment::Protected;
+		m_protected.splice(m_protected.begin(), m_probation, it);
+
+		// The coldest protected entry gets a second chance in probation
+		if (m_protected.size() > m_protectedCapacity) {
+			auto last{ std::prev(m_protected.end()) };
+			last -> segment = Segment::Probation;
+			m_probation.splice(m_probation.begin(), m_protected, last);
+		}
+	}
+
+	template <typename Value>
+	void ShardedLruCache<Value>::Shard::Evict() {
+		List& victims{ m_probation.empty() ? m_protected : m_probation };
+		if (victims.empty()) {
+			return;
+		}
+
+		m_index.erase(victims.back().key);
+		victims.pop_back();
+		++m_evictions;
+	}
+}
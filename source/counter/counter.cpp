@@ -0,0 +1,233 @@
+#include <algorithm>
+#include <atomic>
+#include <utility>
+
+#include <spdlog/fmt/fmt.h>
+
+#include "counter.h"
+
+
+namespace Counter {
+	AccessCounter::AccessCounter(std::unique_ptr<IDatabase> database,
+		FlushConfig config,
+		LoggerPtr logger,
+		std::size_t countShards)
+		: m_database{ std::move(database) }
+		, m_config{ config }
+		, m_logger{ std::move(logger) }
+		, m_shards(countShards != 0 ? countShards : std::max(1u, std::thread::hardware_concurrency()))
+	{
+		if (!m_database) {
+			throw std::invalid_argument("The database cannot be null.");
+		}
+
+		m_writer = [this](const Batch& batch) { WriteBatch(batch); };
+		CheckConfig();
+	}
+
+	void AccessCounter::CheckConfig() const {
+		if (!m_writer) {
+			throw std::invalid_argument("The writer cannot be null.");
+		}
+
+		if (m_config.maxBatchSize == 0) {
+			throw std::invalid_argument("The batch size cannot be zero.");
+		}
+	}
+
+	AccessCounter::~AccessCounter() {
+		try {
+			Stop();
+		}
+		catch (...) {
+			// Stop() already logged the failed flush
+		}
+	}
+
+	void AccessCounter::Start() {
+		std::lock_guard<std::mutex> lock{ m_stopMutex };
+		if (!m_isStopped) {
+			return;
+		}
+
+		m_isStopped = false;
+		m_flusher = std::thread{ &AccessCounter::Run, this };
+	}
+
+	void AccessCounter::Stop() {
+		{
+			std::lock_guard<std::mutex> lock{ m_stopMutex };
+			if (m_isStopped) {
+				return;
+			}
+
+			m_isStopped = true;
+		}
+
+		m_stopCondition.notify_all();
+		m_flusher.join();
+
+		if (m_config.flushOnShutdown) {
+			try {
+				Flush();
+			}
+			catch (const std::exception& e) {
+				if (m_logger) {
+					m_logger -> error("Exception: access counts were lost on shutdown: {}", e.what());
+				}
+
+				throw;
+			}
+		}
+	}
+
+	void AccessCounter::Record(std::string_view shortCode, std::uint64_t count) {
+		Shard& shard{ GetLocalShard() };
+		std::lock_guard<std::mutex> lock{ shard.mutex };
+
+		auto found{ shard.counts.find(shortCode) };
+		if (found != shard.counts.end()) {
+			found -> second += count;
+		}
+		else {
+			shard.counts.emplace(shortCode, count);
+		}
+	}
+
+	std::uint64_t AccessCounter::Pending(std::string_view shortCode) const {
+		std::uint64_t count{ 0 };
+		for (const auto& shard : m_shards) {
+			std::lock_guard<std::mutex> lock{ shard.mutex };
+
+			auto found{ shard.counts.find(shortCode) };
+			if (found != shard.counts.end()) {
+				count += found -> second;
+			}
+		}
+
+		return count;
+	}
+
+	std::size_t AccessCounter::Flush() {
+		std::lock_guard<std::mutex> lock{ m_flushMutex };
+
+		Counts pending{ TakePending() };
+		if (pending.empty()) {
+			return 0;
+		}
+
+		// Rows are updated in short code order, so concurrent flushes lock them in the same order and cannot deadlock
+		Batch ordered{ pending.cbegin(), pending.cend() };
+		std::ranges::sort(ordered, { }, &Batch::value_type::first);
+
+		Batch batch{ };
+		batch.reserve(std::min(ordered.size(), m_config.maxBatchSize));
+
+		// First count of the batch being written, the ones before it are stored
+		auto unwritten{ ordered.cbegin() };
+		try {
+			for (auto it{ ordered.cbegin() }; it != ordered.cend(); ++it) {
+				batch.emplace_back(*it);
+
+				if (batch.size() == m_config.maxBatchSize) {
+					m_writer(batch);
+					batch.clear();
+					unwritten = std::next(it);
+				}
+			}
+
+			if (!batch.empty()) {
+				m_writer(batch);
+			}
+		}
+		catch (...) {
+			// Written batches were added to the stored counts, putting them back would count them twice
+			Restore(unwritten, ordered.cend());
+			throw;
+		}
+
+		return pending.size();
+	}
+
+	std::string AccessCounter::BuildUpdateQuery(std::size_t rows) {
+		std::string query{ "UPDATE urls SET accesscount = urls.accesscount + v.hits FROM (VALUES " };
+		for (std::size_t i{ 0 }; i < rows; ++i) {
+			if (i != 0) {
+				query += ", ";
+			}
+
+			query += fmt::format("(${}::text, ${}::bigint)", 2 * i + 1, 2 * i + 2);
+		}
+		query += ") AS v(shortcode, hits) WHERE urls.shortcode = v.shortcode;";
+
+		return query;
+	}
+
+	AccessCounter::Shard& AccessCounter::GetLocalShard() {
+		// Threads are spread over the shards in the order they first record an access
+		static std::atomic<std::size_t> nextThread{ 0 };
+		thread_local const std::size_t threadIndex{ nextThread++ };
+
+		return m_shards[threadIndex % m_shards.size()];
+	}
+
+	AccessCounter::Counts AccessCounter::TakePending() {
+		Counts pending{ };
+		for (auto& shard : m_shards) {
+			Counts counts{ };
+			{
+				std::lock_guard<std::mutex> lock{ shard.mutex };
+				counts.swap(shard.counts);
+			}
+
+			if (pending.empty()) {
+				pending = std::move(counts);
+				continue;
+			}
+
+			for (auto& [shortCode, count] : counts) {
+				pending[shortCode] += count;
+			}
+		}
+
+		return pending;
+	}
+
+	void AccessCounter::Restore(Batch::const_iterator first, Batch::const_iterator last) {
+		for (; first != last; ++first) {
+			Record(first -> first, first -> second);
+		}
+	}
+
+	void AccessCounter::WriteBatch(const Batch& batch) {
+		std::vector<std::pair<std::string, std::string>> params{ };
+		params.reserve(batch.size() * 2);
+		for (const auto& [shortCode, count] : batch) {
+			params.emplace_back(fmt::format("${}", params.size() + 1), shortCode);
+			params.emplace_back(fmt::format("${}", params.size() + 1), std::to_string(count));
+		}
+
+		m_database -> Execute(BuildUpdateQuery(batch.size()), params);
+	}
+
+	void AccessCounter::Run() {
+		std::unique_lock<std::mutex> lock{ m_stopMutex };
+		while (!m_isStopped) {
+			m_stopCondition.wait_for(lock, m_config.interval, [this]() { return m_isStopped; });
+			if (m_isStopped) {
+				break;
+			}
+
+			lock.unlock();
+			try {
+				Flush();
+			}
+			catch (const std::exception& e) {
+				if (m_logger) {
+					m_logger -> error("Exception: access counts flush failed, retrying next interval: {}", e.what());
+				}
+			}
+			lock.lock();
+		}
+	}
+}
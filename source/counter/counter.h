@@ -0,0 +1,139 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <concepts>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include <spdlog/spdlog.h>
+
+#include "IDatabase.h"
+
+
+namespace Counter {
+	struct FlushConfig {
+		// How often the background flusher writes the pending counts
+		std::chrono::milliseconds interval{ 1000 };
+
+		// Rows per UPDATE statement, bounds the number of bind parameters
+		std::size_t maxBatchSize{ 1000 };
+
+		// Write the pending counts on Stop(), otherwise they are dropped
+		bool flushOnShutdown{ true };
+	};
+
+
+	// Collects link accesses in memory and writes them to urls.accesscount in batches.
+	// Every thread records into its own shard, so the read path never touches the urls row
+	// and a hot link costs one map increment instead of a row lock per request.
+	class AccessCounter {
+	public:
+
+		using LoggerPtr = std::shared_ptr<spdlog::logger>;
+
+		// Short codes with the accesses recorded since the last flush, at most FlushConfig::maxBatchSize
+		using Batch = std::vector<std::pair<std::string_view, std::uint64_t>>;
+
+		// Adds a batch to the stored counts, throws if it could not
+		using Writer = std::function<void(const Batch&)>;
+
+		// countShards == 0 picks one shard per hardware thread
+		AccessCounter(std::unique_ptr<IDatabase> database,
+			FlushConfig config = { },
+			LoggerPtr logger = nullptr,
+			std::size_t countShards = 0);
+
+		// Counts kept by other storage, writer(const Batch&) is called by Flush
+		template <std::invocable<const Batch&> Func>
+		explicit AccessCounter(Func writer,
+			FlushConfig config = { },
+			LoggerPtr logger = nullptr,
+			std::size_t countShards = 0)
+			: m_writer{ std::move(writer) }
+			, m_config{ config }
+			, m_logger{ std::move(logger) }
+			, m_shards(countShards != 0 ? countShards : std::max(1u, std::thread::hardware_concurrency()))
+		{
+			CheckConfig();
+		}
+
+		AccessCounter(const AccessCounter&) = delete;
+		AccessCounter& operator=(const AccessCounter&) = delete;
+
+		~AccessCounter();
+
+		// Starts the background flusher
+		void Start();
+
+		// Stops the flusher, then flushes the pending counts if FlushConfig::flushOnShutdown is set
+		void Stop();
+
+		void Record(std::string_view shortCode, std::uint64_t count = 1);
+
+		// Accesses recorded but not yet written to the database
+		std::uint64_t Pending(std::string_view shortCode) const;
+
+		// Writes all pending counts, returns the number of distinct short codes written.
+		// If a write throws the counts not written yet are put back and the exception is rethrown.
+		std::size_t Flush();
+
+		// UPDATE ... FROM (VALUES ($1, $2), ...) for the given number of rows
+		static std::string BuildUpdateQuery(std::size_t rows);
+
+	private:
+
+		struct StringHash {
+			using is_transparent = void;
+
+			std::size_t operator()(std::string_view key) const {
+				return std::hash<std::string_view>{ }(key);
+			}
+		};
+
+		using Counts = std::unordered_map<std::string, std::uint64_t, StringHash, std::equal_to<>>;
+
+		// Aligned to a cache line, so threads recording into neighbouring shards do not share one
+		struct alignas(64) Shard {
+			mutable std::mutex mutex{ };
+			Counts counts{ };
+		};
+
+		// Throws std::invalid_argument for a missing writer or a zero batch size
+		void CheckConfig() const;
+
+		Shard& GetLocalShard();
+
+		Counts TakePending();
+
+		// Records the counts again, for the ones a failed flush did not write
+		void Restore(Batch::const_iterator first, Batch::const_iterator last);
+
+		void WriteBatch(const Batch& batch);
+
+		void Run();
+
+	private:
+		std::unique_ptr<IDatabase> m_database;
+		Writer m_writer;
+		FlushConfig m_config;
+		LoggerPtr m_logger;
+		std::vector<Shard> m_shards;
+
+		// Serializes flushes, Flush() may be called while the flusher is running
+		std::mutex m_flushMutex{ };
+
+		std::mutex m_stopMutex{ };
+		std::condition_variable m_stopCondition{ };
+		bool m_isStopped{ true };
+		std::thread m_flusher{ };
+	};
+}
@@ -1,28 +1,204 @@
 #pragma once
 
+#include <chrono>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <memory>
 #include <string>
 #include <string_view>
+#include <type_traits>
+#include <utility>
 #include <vector>
 
+#include <boost/asio/async_result.hpp>
+#include <boost/asio/associated_executor.hpp>
+#include <boost/asio/dispatch.hpp>
+
+
+
+// Handle of a statement registered with IDatabase::Prepare, valid for the lifetime of the database
+struct StatementHandle {
+    std::size_t id{ };
+};
+
+
+// Rows of a query result, read in place. Strings are views into the result and stay valid
+// as long as the view does. Accessors throw if the column has another type or the value is NULL.
+class IResultView {
+public:
+
+    virtual ~IResultView() = default;
+
+    virtual int Rows() const = 0;
+    virtual int Columns() const = 0;
+
+    virtual bool IsNull(int row, int col) const = 0;
+
+    // text, varchar, json and jsonb columns
+    virtual std::string_view GetString(int row, int col) const = 0;
+
+    // Integer columns of any width
+    virtual std::int64_t GetInt64(int row, int col) const = 0;
+
+    virtual std::chrono::system_clock::time_point GetTimestamp(int row, int col) const = 0;
+};
+
+
+// Output of a COPY ... TO STDOUT, read while the server is sending it, so the rows are never
+// held all at once. The stream keeps its connection until the copy is over or it is destroyed.
+class ICopyOutStream {
+public:
+
+    virtual ~ICopyOutStream() = default;
+
+    // Appends whole rows to buffer until it holds at least size bytes or the copy is over.
+    // Returns false once the last row has been read. Throws if the copy fails.
+    virtual bool Read(std::string& buffer, std::size_t size) = 0;
+};
+
+
+// Input of a COPY ... FROM STDIN. A write blocks while the server is behind, so the caller
+// does not read its own input faster than the database takes it.
+class ICopyInStream {
+public:
+
+    virtual ~ICopyInStream() = default;
+
+    // Sends data in the format of the COPY command, rows may be split anywhere. Throws if the copy failed.
+    virtual void Write(std::string_view data) = 0;
+
+    // Ends the input. Throws if the server rejected it, then nothing is copied.
+    virtual void Finish() = 0;
+};
 
 
 class IDatabase {
 public:
 
     using SqlParams = const std::vector<std::pair<std::string, std::string>>&;
+    using QueryCallback = std::function<void(std::exception_ptr, std::vector<std::string>)>;
+    using ResultViewPtr = std::unique_ptr<IResultView>;
+    using ViewCallback = std::function<void(std::exception_ptr, ResultViewPtr)>;
+    using CopyOutPtr = std::unique_ptr<ICopyOutStream>;
+    using CopyInPtr = std::unique_ptr<ICopyInStream>;
 
     virtual ~IDatabase() = default;
     virtual void Connect() = 0;
     virtual void Disconnect() = 0;
+
+    // Parses and plans the statement once per connection, it is then executed by handle
+    virtual StatementHandle Prepare(std::string_view query) = 0;
+
     virtual void Execute(std::string_view query, SqlParams params) = 0;
+    virtual void Execute(StatementHandle statement, SqlParams params) = 0;
 
     virtual std::vector<std::string> ExecuteQuery(std::string_view query, SqlParams params) = 0;
+    virtual std::vector<std::string> ExecuteQuery(StatementHandle statement, SqlParams params) = 0;
+
+    // Same as ExecuteQuery, but the rows are read in place instead of being copied into strings
+    virtual ResultViewPtr ExecuteQueryView(std::string_view query, SqlParams params) = 0;
+    virtual ResultViewPtr ExecuteQueryView(StatementHandle statement, SqlParams params) = 0;
+
+    // A converter taking const IResultView& reads the result in place,
+    // one taking std::vector<std::string> gets the rows as ExecuteQuery returns them.
     template <typename Response, typename Func>
     Response Query(std::string_view query, SqlParams params, Func converter) {
-        return converter(ExecuteQuery(query, params));
+        if constexpr (IsViewConverter<Func>) {
+            return converter(*ExecuteQueryView(query, params));
+        }
+        else {
+            return converter(ExecuteQuery(query, params));
+        }
+    }
+
+    template <typename Response, typename Func>
+    Response Query(StatementHandle statement, SqlParams params, Func converter) {
+        if constexpr (IsViewConverter<Func>) {
+            return converter(*ExecuteQueryView(statement, params));
+        }
+        else {
+            return converter(ExecuteQuery(statement, params));
+        }
+    }
+
+    // Sends the query without blocking the calling thread.
+    // The callback receives either an exception or the rows, as ExecuteQuery would return them.
+    virtual void ExecuteQueryAsync(std::string_view query, SqlParams params, QueryCallback callback) = 0;
+    virtual void ExecuteQueryAsync(StatementHandle statement, SqlParams params, QueryCallback callback) = 0;
+
+    virtual void ExecuteQueryViewAsync(std::string_view query, SqlParams params, ViewCallback callback) = 0;
+    virtual void ExecuteQueryViewAsync(StatementHandle statement, SqlParams params, ViewCallback callback) = 0;
+
+    // Asio-style wrapper over ExecuteQueryAsync: the completion handler is invoked
+    // on its associated executor (e.g. the session strand) with signature void(std::exception_ptr, Response).
+    template <typename Response, typename Func, typename CompletionToken>
+    auto AsyncQuery(std::string_view query, SqlParams params, Func converter, CompletionToken&& token) {
+        return InitiateAsyncQuery<Response>(std::string{ query }, params, std::move(converter),
+            std::forward<CompletionToken>(token));
     }
 
+    template <typename Response, typename Func, typename CompletionToken>
+    auto AsyncQuery(StatementHandle statement, SqlParams params, Func converter, CompletionToken&& token) {
+        return InitiateAsyncQuery<Response>(statement, params, std::move(converter),
+            std::forward<CompletionToken>(token));
+    }
+
+    // Starts a COPY ... TO STDOUT, the rows are then read from the stream. Reads block the calling thread.
+    virtual CopyOutPtr CopyOut(std::string_view query) = 0;
+
+    // Starts a COPY ... FROM STDIN, the rows are then written to the stream. Writes block the calling thread.
+    virtual CopyInPtr CopyIn(std::string_view query) = 0;
+
     virtual void BeginTransaction() = 0;
     virtual void CommitTransaction() = 0;
     virtual void RollbackTransaction() = 0;
-};
\ No newline at end of file
+
+private:
+
+    template <typename Func>
+    static constexpr bool IsViewConverter{ std::is_invocable_v<Func&, const IResultView&> };
+
+    // Command is either the SQL text (owned, it has to outlive the initiation) or a StatementHandle
+    template <typename Response, typename Command, typename Func, typename CompletionToken>
+    auto InitiateAsyncQuery(Command command, SqlParams params, Func converter, CompletionToken&& token) {
+        return boost::asio::async_initiate<CompletionToken, void(std::exception_ptr, Response)>(
+            [this](auto handler, Command command,
+                std::vector<std::pair<std::string, std::string>> params, Func converter) {
+                auto sharedHandler{ std::make_shared<decltype(handler)>(std::move(handler)) };
+
+                auto onResult{ [sharedHandler, converter = std::move(converter)](
+                    std::exception_ptr error, auto data) mutable {
+                    Response response{ };
+                    if (!error) {
+                        try {
+                            if constexpr (std::is_same_v<decltype(data), ResultViewPtr>) {
+                                response = converter(*data);
+                            }
+                            else {
+                                response = converter(std::move(data));
+                            }
+                        }
+                        catch (...) {
+                            error = std::current_exception();
+                        }
+                    }
+
+                    auto executor{ boost::asio::get_associated_executor(*sharedHandler) };
+                    boost::asio::dispatch(executor,
+                        [sharedHandler, error, response = std::move(response)]() mutable {
+                            (*sharedHandler)(error, std::move(response));
+                        });
+                } };
+
+                if constexpr (IsViewConverter<Func>) {
+                    ExecuteQueryViewAsync(command, params, ViewCallback{ std::move(onResult) });
+                }
+                else {
+                    ExecuteQueryAsync(command, params, QueryCallback{ std::move(onResult) });
+                }
+            },
+            token, std::move(command), std::vector<std::pair<std::string, std::string>>{ params },
+            std::move(converter));
+    }
+};
@@ -1,8 +1,39 @@
 #include "postgresql.h"
+#include <algorithm>
 #include <memory>
 
 namespace PostgreSQL {
 
+    namespace {
+        // Type oids from the server's pg_type.h, which libpq does not ship
+        constexpr Oid OID_BOOL{ 16 };
+        constexpr Oid OID_NAME{ 19 };
+        constexpr Oid OID_INT8{ 20 };
+        constexpr Oid OID_INT2{ 21 };
+        constexpr Oid OID_INT4{ 23 };
+        constexpr Oid OID_TEXT{ 25 };
+        constexpr Oid OID_JSON{ 114 };
+        constexpr Oid OID_BPCHAR{ 1042 };
+        constexpr Oid OID_VARCHAR{ 1043 };
+        constexpr Oid OID_TIMESTAMP{ 1114 };
+        constexpr Oid OID_TIMESTAMPTZ{ 1184 };
+        constexpr Oid OID_JSONB{ 3802 };
+
+        // Binary timestamps count microseconds from 2000-01-01 00:00:00 UTC
+        constexpr std::chrono::seconds POSTGRES_EPOCH{ 946'684'800 };
+
+        // Integers are sent in network byte order, narrower ones are sign-extended
+        std::int64_t ReadBigEndian(std::string_view bytes) {
+            std::uint64_t value{ 0 };
+            for (unsigned char byte : bytes) {
+                value = (value << 8) | byte;
+            }
+
+            const int shift{ 64 - 8 * static_cast<int>(bytes.size()) };
+            return static_cast<std::int64_t>(value << shift) >> shift;
+        }
+    }
+
     ConnectionConfig::ConnectionConfig(std::string_view host,
         std::string_view user,
         std::string_view pass,
@@ -44,22 +75,154 @@ namespace PostgreSQL {
         return std::make_pair(keywords, values);
     }
 
+    ResultView::ResultView(PGresultPtr result, std::shared_ptr<IPGClient> client)
+        : m_client{ std::move(client) }
+        , m_result{ std::move(result) }
+        , m_rows{ m_client -> PQntuples(m_result.get()) }
+        , m_columns{ m_client -> PQnfields(m_result.get()) }
+    {
+
+    }
+
+    int ResultView::Rows() const {
+        return m_rows;
+    }
+
+    int ResultView::Columns() const {
+        return m_columns;
+    }
+
+    bool ResultView::IsNull(int row, int col) const {
+        return m_client -> PQgetisnull(m_result.get(), row, col) != 0;
+    }
+
+    std::string_view ResultView::GetString(int row, int col) const {
+        std::string_view bytes{ GetBytes(row, col) };
+        switch (m_client -> PQftype(m_result.get(), col)) {
+        case OID_TEXT:
+        case OID_VARCHAR:
+        case OID_BPCHAR:
+        case OID_NAME:
+        case OID_JSON:
+            return bytes;
+        case OID_JSONB:
+            // The text of the document follows a format version byte
+            if (bytes.empty() || bytes.front() != 1) {
+                throw ResultError("Unsupported jsonb format version.");
+            }
+
+            return bytes.substr(1);
+        default:
+            throw ResultError("Column " + std::to_string(col) + " is not a string.");
+        }
+    }
+
+    std::int64_t ResultView::GetInt64(int row, int col) const {
+        std::string_view bytes{ GetBytes(row, col) };
+
+        std::size_t size{ };
+        switch (m_client -> PQftype(m_result.get(), col)) {
+        case OID_BOOL: size = 1; break;
+        case OID_INT2: size = 2; break;
+        case OID_INT4: size = 4; break;
+        case OID_INT8: size = 8; break;
+        default:
+            throw ResultError("Column " + std::to_string(col) + " is not an integer.");
+        }
+
+        if (bytes.size() != size) {
+            throw ResultError("Column " + std::to_string(col) + " has an invalid binary value.");
+        }
+
+        return ReadBigEndian(bytes);
+    }
+
+    std::chrono::system_clock::time_point ResultView::GetTimestamp(int row, int col) const {
+        std::string_view bytes{ GetBytes(row, col) };
+
+        const Oid type{ m_client -> PQftype(m_result.get(), col) };
+        if ((type != OID_TIMESTAMP && type != OID_TIMESTAMPTZ) || bytes.size() != 8) {
+            throw ResultError("Column " + std::to_string(col) + " is not a timestamp.");
+        }
+
+        return std::chrono::system_clock::time_point{ std::chrono::duration_cast<std::chrono::system_clock::duration>(
+            POSTGRES_EPOCH + std::chrono::microseconds{ ReadBigEndian(bytes) }) };
+    }
+
+    std::string_view ResultView::GetBytes(int row, int col) const {
+        if (row < 0 || row >= m_rows || col < 0 || col >= m_columns) {
+            throw ResultError("Row or column out of range.");
+        }
+
+        if (IsNull(row, col)) {
+            throw ResultError("Column " + std::to_string(col) + " is NULL.");
+        }
+
+        return std::string_view{ m_client -> PQgetvalue(m_result.get(), row, col),
+            static_cast<std::size_t>(m_client -> PQgetlength(m_result.get(), row, col)) };
+    }
+
     Database::Database(
         const ConnectionConfig& config,
         std::shared_ptr<IPGClient> client,
-        int countConn
+        PoolConfig poolConfig
     )
         : m_config{ config }
         , m_client{ client }
         , m_pool{ 
             m_config.GetConnectionStringParams(), 
             client,
-            countConn
+            poolConfig
           }
     {
 
     }
 
+    Database::Database(
+        const ConnectionConfig& config,
+        std::shared_ptr<IPGClient> client,
+        net::any_io_executor executor,
+        PoolConfig poolConfig,
+        PipelineConfig pipelineConfig
+    )
+        : Database{ config, client, std::vector<net::any_io_executor>{ executor }, poolConfig, pipelineConfig }
+    {
+
+    }
+
+    Database::Database(
+        const ConnectionConfig& config,
+        std::shared_ptr<IPGClient> client,
+        std::vector<net::any_io_executor> executors,
+        PoolConfig poolConfig,
+        PipelineConfig pipelineConfig
+    )
+        : Database{ config, client, poolConfig }
+    {
+        if (executors.empty()) {
+            throw std::invalid_argument("The database needs at least one executor.");
+        }
+
+        m_executors = std::move(executors);
+
+#if defined(BOOST_ASIO_HAS_POSIX_STREAM_DESCRIPTOR)
+        for (std::size_t i{ 0 }; i < pipelineConfig.connections; ++i) {
+            m_pipelines.emplace_back(std::make_shared<Pipeline>(*this,
+                m_executors[i % m_executors.size()], pipelineConfig.maxQueued));
+        }
+#endif
+    }
+
+    Database::~Database() {
+#if defined(BOOST_ASIO_HAS_POSIX_STREAM_DESCRIPTOR)
+        for (auto& pipeline : m_pipelines) {
+            pipeline -> Close();
+        }
+#endif
+
+        m_client.reset();
+    }
+
     void Database::Connect() {
         auto params = m_config.GetConnectionStringParams();
 
@@ -102,29 +265,75 @@ namespace PostgreSQL {
         return values;
     }
 
-    void Database::Execute(std::string_view query, SqlParams params) {
+    StatementHandle Database::Prepare(std::string_view query) {
+#if defined(BOOST_ASIO_HAS_POSIX_STREAM_DESCRIPTOR)
+        if (m_isPipelining) {
+            throw PrepareError("Statements have to be prepared before the first asynchronous query.");
+        }
+#endif
+
+        return m_pool.Prepare(query);
+    }
+
+    PGresultPtr Database::Exec(CommandType type, std::string_view command, SqlParams params,
+        ExecStatusType expected, ResultFormat format) {
         auto lengths{ GetLengthsParams(params) };
         auto values{ GetValuesParams(params) };
 
         auto conn{ m_pool.Acquire() };
 
-        PGresultPtr resGuard{
-            m_client -> PQexecParams(conn.get(),
-                query.data(),
+        PGresult* res{ };
+        if (type == CommandType::Prepared) {
+            res = m_client -> PQexecPrepared(conn.get(),
+                command.data(),
+                params.size(),
+                values.data(),
+                lengths.data(),
+                nullptr,
+                static_cast<int>(format));
+        }
+        else {
+            res = m_client -> PQexecParams(conn.get(),
+                command.data(),
                 params.size(),
                 nullptr,
                 values.data(),
                 lengths.data(),
                 nullptr,
-                0), [&](PGresult* res) -> void {
-                    m_client -> PQclear(res);
-                }};
+                static_cast<int>(format));
+        }
+
+        // A result view may outlive the query, so the deleter keeps its own reference to the client
+        PGresultPtr resGuard{ res, [client = m_client](PGresult* res) -> void {
+            client -> PQclear(res);
+        } };
 
         std::string msg_error{ m_client -> PQerrorMessage(conn.get()) };
         m_pool.Release(std::move(conn));
-        if (m_client -> PQresultStatus(resGuard.get()) != PGRES_COMMAND_OK) {
+        if (m_client -> PQresultStatus(resGuard.get()) != expected) {
             throw ExecuteError(std::move(msg_error));
         }
+
+        return resGuard;
+    }
+
+    void Database::Execute(std::string_view query, SqlParams params) {
+        Exec(CommandType::Text, query, params, PGRES_COMMAND_OK);
+    }
+
+    void Database::Execute(StatementHandle statement, SqlParams params) {
+        Exec(CommandType::Prepared, m_pool.GetStatementName(statement), params, PGRES_COMMAND_OK);
+    }
+
+    std::size_t Database::GetExecutorIndex() {
+        for (std::size_t i{ 0 }; i < m_executors.size(); ++i) {
+            auto* executor{ m_executors[i].target<net::io_context::executor_type>() };
+            if (executor && executor -> running_in_this_thread()) {
+                return i;
+            }
+        }
+
+        return m_nextExecutor++ % m_executors.size();
     }
 
     std::vector<std::string> Database::ReadPostgresResult(PGresultPtr resGuard) {
@@ -135,12 +344,13 @@ namespace PostgreSQL {
             data.reserve(static_cast<std::size_t>(rows) * cols);
             for (int i{ 0 }; i < rows; ++i) {
                 for (int j{ 0 }; j < cols; ++j) {
-                    std::string str{ m_client -> PQgetvalue(resGuard.get(), i, j) };
-                    if (str.empty()) {
-                        str = STR_NULL;
+                    // PQgetvalue returns an empty string for NULL, which is a valid text value as well
+                    if (m_client -> PQgetisnull(resGuard.get(), i, j) != 0) {
+                        data.emplace_back(STR_NULL);
+                    }
+                    else {
+                        data.emplace_back(m_client -> PQgetvalue(resGuard.get(), i, j));
                     }
-
-                    data.emplace_back(std::move(str));
                 }
             }
         }
@@ -149,192 +359,1406 @@ namespace PostgreSQL {
     }
 
     std::vector<std::string> Database::ExecuteQuery(std::string_view query, SqlParams params) {
-        auto lengths{ GetLengthsParams(params) };
-        auto values{ GetValuesParams(params) };
-
-        auto conn{ m_pool.Acquire() };
-        PGresultPtr resGuard{ m_client -> PQexecParams(conn.get(),
-                query.data(),
-                params.size(),
-                nullptr,
-                values.data(),
-                lengths.data(),
-                nullptr,
-                0), [&](PGresult* res) { m_client -> PQclear(res); } };
-
-        std::string msg_error{ m_client -> PQerrorMessage(conn.get()) };
-        m_pool.Release(std::move(conn));
-        if (m_client -> PQresultStatus(resGuard.get()) != PGRES_TUPLES_OK) {
-            throw ExecuteError(std::move(msg_error));
-        }
+        return ReadPostgresResult(Exec(CommandType::Text, query, params, PGRES_TUPLES_OK));
+    }
 
-        return ReadPostgresResult(std::move(resGuard));
+    std::vector<std::string> Database::ExecuteQuery(StatementHandle statement, SqlParams params) {
+        return ReadPostgresResult(
+            Exec(CommandType::Prepared, m_pool.GetStatementName(statement), params, PGRES_TUPLES_OK));
     }
 
-    void Database::BeginTransaction() {
-        //Not necessary yet
-        throw std::runtime_error("Missing implementation");
+    IDatabase::ResultViewPtr Database::ExecuteQueryView(std::string_view query, SqlParams params) {
+        return std::make_unique<ResultView>(
+            Exec(CommandType::Text, query, params, PGRES_TUPLES_OK, ResultFormat::Binary), m_client);
     }
 
-    void Database::CommitTransaction() {
-        // Not necessary yet
-        throw std::runtime_error("Missing implementation");
+    IDatabase::ResultViewPtr Database::ExecuteQueryView(StatementHandle statement, SqlParams params) {
+        return std::make_unique<ResultView>(
+            Exec(CommandType::Prepared, m_pool.GetStatementName(statement), params, PGRES_TUPLES_OK, ResultFormat::Binary),
+            m_client);
     }
 
-    void Database::RollbackTransaction() {
-        // Not necessary yet
-        throw std::runtime_error("Missing implementation");
+    void Database::ExecuteQueryAsync(std::string_view query, SqlParams params, QueryCallback callback) {
+        ExecAsync(CommandType::Text, query, params, ResultFormat::Text, ToRowsCallback(std::move(callback)));
     }
 
-    PGconn* PGClient::PQconnectdbParams(
-        const char* const* keywords, 
-        const char* const* values, 
-        int expand_dbname
-    ) {
+    void Database::ExecuteQueryAsync(StatementHandle statement, SqlParams params, QueryCallback callback) {
+        ExecPreparedAsync(statement, params, ResultFormat::Text, ToRowsCallback(std::move(callback)));
+    }
 
-        return ::PQconnectdbParams(keywords, values, 0);
+    void Database::ExecuteQueryViewAsync(std::string_view query, SqlParams params, ViewCallback callback) {
+        ExecAsync(CommandType::Text, query, params, ResultFormat::Binary, ToViewCallback(std::move(callback)));
     }
 
-    PGresult* PGClient::PQexecParams(
-        PGconn* conn, 
-        const char* command, 
-        int nParams, 
-        const Oid* paramTypes, 
-        const char* const* paramValues, 
-        const int* paramLengths, 
-        const int* paramFormats, 
-        int resultFormat
-    ) {
-        return ::PQexecParams(conn, command, nParams, paramTypes, paramValues, 
-            paramLengths, paramFormats, resultFormat);
+    void Database::ExecuteQueryViewAsync(StatementHandle statement, SqlParams params, ViewCallback callback) {
+        ExecPreparedAsync(statement, params, ResultFormat::Binary, ToViewCallback(std::move(callback)));
     }
 
-    ConnStatusType PGClient::PQstatus(const PGconn* conn) {
-        return ::PQstatus(conn);
+    Database::ResultCallback Database::ToRowsCallback(QueryCallback callback) {
+        return [this, callback = std::move(callback)](std::exception_ptr error, PGresultPtr result) {
+            if (error) {
+                return callback(error, { });
+            }
+
+            callback(nullptr, ReadPostgresResult(std::move(result)));
+        };
     }
 
-    char* PGClient::PQerrorMessage(const PGconn* conn) {
-        return ::PQerrorMessage(conn);
+    Database::ResultCallback Database::ToViewCallback(ViewCallback callback) {
+        return [client = m_client, callback = std::move(callback)](std::exception_ptr error, PGresultPtr result) {
+            if (error) {
+                return callback(error, nullptr);
+            }
+
+            callback(nullptr, std::make_unique<ResultView>(std::move(result), client));
+        };
     }
 
-    void PGClient::PQfinish(PGconn* conn) {
-        if (conn != nullptr) {
-            ::PQfinish(conn);
-        }        
+    void Database::ExecPreparedAsync(StatementHandle statement, SqlParams params, ResultFormat format,
+        ResultCallback callback) {
+        std::string_view name{ };
+        try {
+            name = m_pool.GetStatementName(statement);
+        }
+        catch (...) {
+            callback(std::current_exception(), nullptr);
+            return;
+        }
 
+        ExecAsync(CommandType::Prepared, name, params, format, std::move(callback));
     }
 
-    void PGClient::PQreset(PGconn* conn) {
-        ::PQreset(conn);
+    void Database::ExecAsync(CommandType type, std::string_view command, SqlParams params, ResultFormat format,
+        ResultCallback callback) {
+#if defined(BOOST_ASIO_HAS_POSIX_STREAM_DESCRIPTOR)
+        if (!m_executors.empty()) {
+            std::size_t index{ GetExecutorIndex() };
+            if (!m_pipelines.empty()) {
+                m_isPipelining = true;
+
+                // Steps over the pipelines of the same executor when their number is a multiple of the executors
+                std::size_t next{ index + m_executors.size() * m_nextPipeline++ };
+                auto& pipeline{ m_pipelines[next % m_pipelines.size()] };
+                if (pipeline -> TrySubmit(type, command, params, format, callback)) {
+                    return;
+                }
+            }
+
+            // Waiting for a free connection does not hold the io thread either
+            auto executor{ m_executors[index] };
+            m_pool.AcquireAsync(executor, ConnectionPool::AcquireCallback{
+                [this, executor, type, format, command = std::string{ command },
+                    params = std::vector<std::pair<std::string, std::string>>{ params },
+                    callback = std::move(callback)](std::exception_ptr error, PGconnPtr conn) {
+                    if (error) {
+                        callback(error, nullptr);
+                        return;
+                    }
+
+                    std::make_shared<PendingQuery>(*this, executor, std::move(conn), callback)
+                        -> Start(type, command, params, format);
+                } });
+            return;
+        }
+#endif
+        // Nothing to wait on without an executor, so the query runs on the calling thread.
+        PGresultPtr result{ };
+        try {
+            result = Exec(type, command, params, PGRES_TUPLES_OK, format);
+        }
+        catch (...) {
+            callback(std::current_exception(), nullptr);
+            return;
+        }
+
+        callback(nullptr, std::move(result));
     }
 
-    ExecStatusType PGClient::PQresultStatus(const PGresult* res) {
-        return ::PQresultStatus(res);
+#if defined(BOOST_ASIO_HAS_POSIX_STREAM_DESCRIPTOR)
+    Database::PendingQuery::PendingQuery(Database& database, net::any_io_executor executor, PGconnPtr conn,
+        ResultCallback callback)
+        : m_database{ database }
+        , m_conn{ std::move(conn) }
+        , m_callback{ std::move(callback) }
+        , m_socket{ executor }
+    {
+
     }
 
-    void PGClient::PQclear(PGresult* res) {
-        ::PQclear(res);
+    void Database::PendingQuery::Start(CommandType type, std::string_view command, SqlParams params,
+        ResultFormat format) {
+        auto& client{ m_database.m_client };
+        auto lengths{ m_database.GetLengthsParams(params) };
+        auto values{ m_database.GetValuesParams(params) };
+
+        // libpq copies the parameters into its output buffer, so they may go out of scope after the send.
+        client -> PQsetnonblocking(m_conn.get(), 1);
+        int isSent{ };
+        if (type == CommandType::Prepared) {
+            isSent = client -> PQsendQueryPrepared(m_conn.get(),
+                command.data(),
+                params.size(),
+                values.data(),
+                lengths.data(),
+                nullptr,
+                static_cast<int>(format));
+        }
+        else {
+            isSent = client -> PQsendQueryParams(m_conn.get(),
+                command.data(),
+                params.size(),
+                nullptr,
+                values.data(),
+                lengths.data(),
+                nullptr,
+                static_cast<int>(format));
+        }
+
+        if (isSent == 0) {
+            return Complete(std::make_exception_ptr(
+                ExecuteError(client -> PQerrorMessage(m_conn.get()))));
+        }
+
+        boost::system::error_code ec;
+        m_socket.assign(client -> PQsocket(m_conn.get()), ec);
+        if (ec) {
+            return Complete(std::make_exception_ptr(ExecuteError(ec.message())));
+        }
+
+        DoFlush();
     }
 
-    int PGClient::PQntuples(const PGresult* res) {
-        return ::PQntuples(res);
+    void Database::PendingQuery::DoFlush() {
+        int flushed{ m_database.m_client -> PQflush(m_conn.get()) };
+        if (flushed == -1) {
+            return Complete(std::make_exception_ptr(
+                ExecuteError(m_database.m_client -> PQerrorMessage(m_conn.get()))));
+        }
+
+        if (flushed == 1) {
+            // The output buffer is not drained yet, wait until the socket accepts more data.
+            m_socket.async_wait(net::posix::stream_descriptor::wait_write,
+                [self = shared_from_this()](boost::system::error_code ec) {
+                    if (ec) {
+                        return self -> Complete(std::make_exception_ptr(ExecuteError(ec.message())));
+                    }
+
+                    self -> DoFlush();
+                });
+
+            return;
+        }
+
+        DoRead();
     }
 
-    int PGClient::PQnfields(const PGresult* res) {
-        return ::PQnfields(res);
+    void Database::PendingQuery::DoRead() {
+        m_socket.async_wait(net::posix::stream_descriptor::wait_read,
+            [self = shared_from_this()](boost::system::error_code ec) {
+                self -> OnRead(ec);
+            });
     }
 
-    char* PGClient::PQgetvalue(const PGresult* res, int row, int col) {
-        return ::PQgetvalue(res, row, col);
+    void Database::PendingQuery::OnRead(boost::system::error_code ec) {
+        if (ec) {
+            return Complete(std::make_exception_ptr(ExecuteError(ec.message())));
+        }
+
+        auto client{ m_database.m_client };
+        if (client -> PQconsumeInput(m_conn.get()) == 0) {
+            return Complete(std::make_exception_ptr(
+                ExecuteError(client -> PQerrorMessage(m_conn.get()))));
+        }
+
+        // PQgetResult only blocks while the connection is busy, so it is called only when it is not.
+        while (client -> PQisBusy(m_conn.get()) == 0) {
+            PGresult* res{ client -> PQgetResult(m_conn.get()) };
+            if (res == nullptr) {
+                std::string msg_error{ client -> PQerrorMessage(m_conn.get()) };
+                if (!m_result || client -> PQresultStatus(m_result.get()) != PGRES_TUPLES_OK) {
+                    return Complete(std::make_exception_ptr(ExecuteError(std::move(msg_error))));
+                }
+
+                return Complete(nullptr, std::move(m_result));
+            }
+
+            if (m_result) {
+                client -> PQclear(res);
+            }
+            else {
+                m_result = PGresultPtr{ res, [client](PGresult* res) { client -> PQclear(res); } };
+            }
+        }
+
+        DoRead();
     }
 
-    int PGClient::PQgetisnull(const PGresult* res, int row, int col) {
-        return ::PQgetisnull(res, row, col);
+    void Database::PendingQuery::Complete(std::exception_ptr error, PGresultPtr result) {
+        // The descriptor belongs to libpq, it must not be closed by Asio.
+        if (m_socket.is_open()) {
+            m_socket.release();
+        }
+
+        m_result.reset();
+        if (error) {
+            result.reset();
+        }
+
+        auto& client{ m_database.m_client };
+        client -> PQsetnonblocking(m_conn.get(), 0);
+        try {
+            // A wait that failed or was cancelled leaves the query in flight on a connection that still looks fine,
+            // it must not be handed to the next query
+            if (error && client -> PQtransactionStatus(m_conn.get()) != PQTRANS_IDLE) {
+                m_database.m_pool.Reset(std::move(m_conn));
+            }
+            else {
+                m_database.m_pool.Release(std::move(m_conn));
+            }
+        }
+        catch (...) {
+            if (!error) {
+                error = std::current_exception();
+            }
+        }
+
+        auto callback{ std::move(m_callback) };
+        callback(error, std::move(result));
     }
 
-    int PGClient::PQgetlength(const PGresult* res, int row, int col) {
-        return ::PQgetlength(res, row, col);
+    Database::PendingQuery::~PendingQuery() {
+        if (m_socket.is_open()) {
+            m_socket.release();
+        }
     }
 
-    ConnectionPool::ConnectionPool(const ConnectionParams& params, 
-        std::shared_ptr<IPGClient> client, int countConn
-    )
-        : m_client{ client }
-        , m_countConn{ countConn }
+    Database::Pipeline::Pipeline(Database& database, net::any_io_executor executor, std::size_t maxQueued)
+        : m_database{ database }
+        , m_strand{ net::make_strand(executor) }
+        , m_maxQueued{ maxQueued }
+        , m_socket{ m_strand }
     {
-        if (countConn < 1) {
-            throw ConnectionPoolError("Number of connections must be >= 1.");
-        }
 
-        Connect(params);
     }
 
-    void ConnectionPool::Connect(const ConnectionParams& params) {
-        std::lock_guard<std::mutex> lock(m_mutex);
+    bool Database::Pipeline::TrySubmit(CommandType type, std::string_view command, SqlParams params,
+        ResultFormat format, ResultCallback callback) {
+        if (m_countQueued.fetch_add(1) >= m_maxQueued) {
+            --m_countQueued;
+            return false;
+        }
 
-        auto keywords{ params.first.data()};
-        auto values{ params.second.data() };
-        m_connections.clear();
+        Query query{ type, std::string{ command }, std::vector<std::pair<std::string, std::string>>{ params },
+            format, std::move(callback) };
+        net::post(m_strand, [self = shared_from_this(), query = std::move(query)]() mutable {
+            self -> m_unsent.emplace_back(std::move(query));
+            if (!self -> m_isSendScheduled) {
+                // Queries submitted before the strand gets to the send go out in the same flush
+                self -> m_isSendScheduled = true;
+                net::post(self -> m_strand, [self]() {
+                    self -> DoSend();
+                });
+            }
+        });
 
-        for (int i = 0; i < m_countConn; ++i) {
-            PGconnPtr conn{ m_client -> PQconnectdbParams(keywords, values, 0), 
-                [&](PGconn* conn) -> void {
-                    m_client -> PQfinish(conn);
-                }};
+        return true;
+    }
 
-            if (m_client -> PQstatus(conn.get()) != CONNECTION_OK) {
-                m_connections.clear();
-                throw ConnectError(m_client -> PQerrorMessage(conn.get()));
-            }
+    void Database::Pipeline::Close() {
+        // The descriptor belongs to libpq, it must not be closed by Asio.
+        if (m_socket.is_open()) {
+            m_socket.release();
+        }
 
-            m_connections.emplace_back(std::move(conn));
+        if (!m_isConnected) {
+            return;
         }
-    }
 
-    void ConnectionPool::Disconnect() {
-        std::lock_guard<std::mutex> lock(m_mutex);
+        m_isConnected = false;
+        auto& client{ m_database.m_client };
+        const bool isIdle{ m_inFlight.empty() && client -> PQexitPipelineMode(m_conn.get()) != 0 };
+        client -> PQsetnonblocking(m_conn.get(), 0);
+        if (isIdle) {
+            m_database.m_pool.Release(std::move(m_conn));
+        }
+        else {
+            m_database.m_pool.Reset(std::move(m_conn));
+        }
+    }
 
-        for (auto& conn : m_connections) {
-            if (conn.get() != nullptr) {
-                m_client -> PQfinish(conn.get());
-                conn.reset(nullptr);
-            }
+    void Database::Pipeline::Connect() {
+        if (m_isConnecting) {
+            return;
         }
 
-        m_connections.clear();
+        m_isConnecting = true;
+        m_database.m_pool.AcquireAsync(m_strand, ConnectionPool::AcquireCallback{
+            [self = shared_from_this()](std::exception_ptr error, PGconnPtr conn) {
+                self -> OnConnected(error, std::move(conn));
+            } });
     }
 
-    PGconnPtr ConnectionPool::Acquire() {
-        const std::chrono::milliseconds waitInterval{ 100 }; // ToDo: Make it part of the customized interface 
-        const std::chrono::milliseconds maxWaitTime{ 500 };
-        const auto startTime = std::chrono::high_resolution_clock::now();
+    void Database::Pipeline::OnConnected(std::exception_ptr error, PGconnPtr conn) {
+        m_isConnecting = false;
+
+        auto& client{ m_database.m_client };
+        if (!error) {
+            boost::system::error_code ec;
+            if (client -> PQsetnonblocking(conn.get(), 1) != 0 || client -> PQenterPipelineMode(conn.get()) == 0) {
+                error = std::make_exception_ptr(ExecuteError(client -> PQerrorMessage(conn.get())));
+            }
+            else if (m_socket.assign(client -> PQsocket(conn.get()), ec); ec) {
+                error = std::make_exception_ptr(ExecuteError(ec.message()));
+            }
+
+            if (error) {
+                client -> PQsetnonblocking(conn.get(), 0);
+                m_database.m_pool.Reset(std::move(conn));
+            }
+        }
 
-        std::unique_lock<std::mutex> lock{ m_mutex };
-        while (m_connections.empty()) {
-            auto now = std::chrono::high_resolution_clock::now();
-            auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(now - startTime);
-            if (elapsed >= maxWaitTime) {
-                throw ConnectionPoolError{ "Timeout: Could not acquire a database connection from the pool within the allowed time." };
+        if (error) {
+            // Nothing to send the queries on
+            while (!m_unsent.empty()) {
+                Complete(m_unsent.front(), error);
+                m_unsent.pop_front();
             }
 
-            m_cond.wait_for(lock, waitInterval);
+            return;
         }
 
-        PGconnPtr conn{ std::move(m_connections.back()) };
-        m_connections.pop_back();
-        return conn;
+        m_conn = std::move(conn);
+        m_isConnected = true;
+        DoSend();
     }
 
-    void ConnectionPool::Release(PGconnPtr conn) {
-        if (m_client -> PQstatus(conn.get()) != CONNECTION_OK) {
-            m_client -> PQreset(conn.get());
-            if (m_client -> PQstatus(conn.get()) != CONNECTION_OK) {
-                throw ResetError(m_client -> PQerrorMessage(conn.get()));
-            }
+    void Database::Pipeline::DoSend() {
+        m_isSendScheduled = false;
+        if (m_unsent.empty()) {
+            return;
         }
 
-        Push(std::move(conn));
+        if (!m_isConnected) {
+            return Connect();
+        }
+
+        auto& client{ m_database.m_client };
+        while (!m_unsent.empty()) {
+            Query& query{ m_unsent.front() };
+            auto lengths{ m_database.GetLengthsParams(query.params) };
+            auto values{ m_database.GetValuesParams(query.params) };
+
+            int isSent{ };
+            if (query.type == CommandType::Prepared) {
+                isSent = client -> PQsendQueryPrepared(m_conn.get(),
+                    query.command.c_str(),
+                    query.params.size(),
+                    values.data(),
+                    lengths.data(),
+                    nullptr,
+                    static_cast<int>(query.format));
+            }
+            else {
+                isSent = client -> PQsendQueryParams(m_conn.get(),
+                    query.command.c_str(),
+                    query.params.size(),
+                    nullptr,
+                    values.data(),
+                    lengths.data(),
+                    nullptr,
+                    static_cast<int>(query.format));
+            }
 
-        m_cond.notify_one();
+            if (isSent == 0) {
+                auto error{ std::make_exception_ptr(ExecuteError(client -> PQerrorMessage(m_conn.get()))) };
+                Complete(query, error);
+                m_unsent.pop_front();
+                return Fail(error);
+            }
+
+            m_inFlight.emplace_back(std::move(query));
+            m_unsent.pop_front();
+
+            if (client -> PQpipelineSync(m_conn.get()) == 0) {
+                return Fail(std::make_exception_ptr(ExecuteError(client -> PQerrorMessage(m_conn.get()))));
+            }
+        }
+
+        DoFlush();
+        DoRead();
+    }
+
+    void Database::Pipeline::DoFlush() {
+        if (!m_isConnected || m_isWriting) {
+            return;
+        }
+
+        int flushed{ m_database.m_client -> PQflush(m_conn.get()) };
+        if (flushed == -1) {
+            return Fail(std::make_exception_ptr(ExecuteError(m_database.m_client -> PQerrorMessage(m_conn.get()))));
+        }
+
+        if (flushed == 1) {
+            // The read wait stays armed meanwhile, the server may block on its results until they are read
+            m_isWriting = true;
+            m_socket.async_wait(net::posix::stream_descriptor::wait_write,
+                [self = shared_from_this()](boost::system::error_code ec) {
+                    if (ec == net::error::operation_aborted) {
+                        return; // The socket was released, its state is reset already
+                    }
+
+                    self -> m_isWriting = false;
+                    if (ec) {
+                        return self -> Fail(std::make_exception_ptr(ExecuteError(ec.message())));
+                    }
+
+                    self -> DoFlush();
+                });
+        }
+    }
+
+    void Database::Pipeline::DoRead() {
+        if (!m_isConnected || m_isReading || m_inFlight.empty()) {
+            return;
+        }
+
+        m_isReading = true;
+        m_socket.async_wait(net::posix::stream_descriptor::wait_read,
+            [self = shared_from_this()](boost::system::error_code ec) {
+                if (ec == net::error::operation_aborted) {
+                    return;
+                }
+
+                self -> m_isReading = false;
+                self -> OnRead(ec);
+            });
+    }
+
+    void Database::Pipeline::OnRead(boost::system::error_code ec) {
+        if (ec) {
+            return Fail(std::make_exception_ptr(ExecuteError(ec.message())));
+        }
+
+        auto client{ m_database.m_client };
+        if (client -> PQconsumeInput(m_conn.get()) == 0) {
+            return Fail(std::make_exception_ptr(ExecuteError(client -> PQerrorMessage(m_conn.get()))));
+        }
+
+        // Results arrive in the order the queries were sent: the rows of a query, a null result,
+        // then the sync point that ends the query
+        while (!m_inFlight.empty() && client -> PQisBusy(m_conn.get()) == 0) {
+            Query& query{ m_inFlight.front() };
+            PGresult* res{ client -> PQgetResult(m_conn.get()) };
+            if (res == nullptr) {
+                if (query.isDone) {
+                    break; // The sync point has not arrived yet
+                }
+
+                query.isDone = true;
+                if (!query.result || client -> PQresultStatus(query.result.get()) != PGRES_TUPLES_OK) {
+                    std::string msg_error{ query.result ? client -> PQresultErrorMessage(query.result.get()) : "" };
+                    Complete(query, std::make_exception_ptr(ExecuteError(std::move(msg_error))));
+                }
+                else {
+                    Complete(query, nullptr, std::move(query.result));
+                }
+
+                continue;
+            }
+
+            PGresultPtr resGuard{ res, [client](PGresult* res) { client -> PQclear(res); } };
+            if (client -> PQresultStatus(res) == PGRES_PIPELINE_SYNC) {
+                m_inFlight.pop_front();
+                continue;
+            }
+
+            if (!query.result) {
+                query.result = std::move(resGuard);
+            }
+        }
+
+        DoFlush();
+        DoRead();
+    }
+
+    void Database::Pipeline::Complete(Query& query, std::exception_ptr error, PGresultPtr result) {
+        --m_countQueued;
+        query.result.reset();
+
+        auto callback{ std::move(query.callback) };
+        callback(error, std::move(result));
+    }
+
+    void Database::Pipeline::Fail(std::exception_ptr error) {
+        for (auto& query : m_inFlight) {
+            if (!query.isDone) {
+                Complete(query, error);
+            }
+        }
+        m_inFlight.clear();
+
+        // Releasing the descriptor cancels the pending waits
+        if (m_socket.is_open()) {
+            m_socket.release();
+        }
+        m_isReading = false;
+        m_isWriting = false;
+
+        if (m_isConnected) {
+            m_isConnected = false;
+            m_database.m_client -> PQsetnonblocking(m_conn.get(), 0);
+            m_database.m_pool.Reset(std::move(m_conn));
+        }
+
+        if (!m_unsent.empty()) {
+            Connect();
+        }
+    }
+#endif
+
+    PGconnPtr Database::StartCopy(std::string_view query, ExecStatusType expected) {
+        auto conn{ m_pool.Acquire() };
+
+        PGresultPtr resGuard{ m_client -> PQexecParams(conn.get(), std::string{ query }.c_str(),
+            0, nullptr, nullptr, nullptr, nullptr, static_cast<int>(ResultFormat::Text)),
+            [client = m_client](PGresult* res) -> void {
+                client -> PQclear(res);
+            } };
+
+        if (m_client -> PQresultStatus(resGuard.get()) != expected) {
+            std::string msg_error{ m_client -> PQerrorMessage(conn.get()) };
+            m_pool.Release(std::move(conn));
+            throw ExecuteError(std::move(msg_error));
+        }
+
+        return conn;
+    }
+
+    IDatabase::CopyOutPtr Database::CopyOut(std::string_view query) {
+        return std::make_unique<CopyOutStream>(m_pool, m_client, StartCopy(query, PGRES_COPY_OUT));
+    }
+
+    IDatabase::CopyInPtr Database::CopyIn(std::string_view query) {
+        return std::make_unique<CopyInStream>(m_pool, m_client, StartCopy(query, PGRES_COPY_IN));
+    }
+
+    CopyOutStream::CopyOutStream(ConnectionPool& pool, std::shared_ptr<IPGClient> client, PGconnPtr conn)
+        : m_pool{ pool }
+        , m_client{ std::move(client) }
+        , m_conn{ std::move(conn) }
+    {
+
+    }
+
+    bool CopyOutStream::Read(std::string& buffer, std::size_t size) {
+        while (m_conn && buffer.size() < size) {
+            char* row{ nullptr };
+            int length{ m_client -> PQgetCopyData(m_conn.get(), &row, 0) };
+            if (length > 0) {
+                buffer.append(row, length);
+                m_client -> PQfreemem(row);
+            }
+            else if (length == -1) {
+                Finish();
+            }
+            else {
+                std::string msg_error{ m_client -> PQerrorMessage(m_conn.get()) };
+                m_pool.Reset(std::move(m_conn));
+                throw ExecuteError(std::move(msg_error));
+            }
+        }
+
+        return m_conn != nullptr;
+    }
+
+    void CopyOutStream::Finish() {
+        // The status of the command follows the last row, then the result queue is empty
+        std::string msg_error{ };
+        bool isFailed{ false };
+        while (PGresult* res{ m_client -> PQgetResult(m_conn.get()) }) {
+            if (m_client -> PQresultStatus(res) != PGRES_COMMAND_OK) {
+                isFailed = true;
+                msg_error = m_client -> PQresultErrorMessage(res);
+            }
+            m_client -> PQclear(res);
+        }
+
+        m_pool.Release(std::move(m_conn));
+        if (isFailed) {
+            throw ExecuteError(std::move(msg_error));
+        }
+    }
+
+    CopyOutStream::~CopyOutStream() {
+        if (m_conn) {
+            m_pool.Reset(std::move(m_conn));
+        }
+    }
+
+    CopyInStream::CopyInStream(ConnectionPool& pool, std::shared_ptr<IPGClient> client, PGconnPtr conn)
+        : m_pool{ pool }
+        , m_client{ std::move(client) }
+        , m_conn{ std::move(conn) }
+    {
+
+    }
+
+    void CopyInStream::Write(std::string_view data) {
+        if (!m_conn) {
+            throw ExecuteError("The copy is over.");
+        }
+
+        // libpq takes an int, larger pieces are sent in parts
+        constexpr std::size_t MAX_PART{ 1 << 30 };
+        while (!data.empty()) {
+            std::string_view part{ data.substr(0, MAX_PART) };
+            if (m_client -> PQputCopyData(m_conn.get(), part.data(), static_cast<int>(part.size())) != 1) {
+                Fail(m_client -> PQerrorMessage(m_conn.get()));
+            }
+            data.remove_prefix(part.size());
+        }
+    }
+
+    void CopyInStream::Finish() {
+        if (!m_conn) {
+            throw ExecuteError("The copy is over.");
+        }
+
+        if (m_client -> PQputCopyEnd(m_conn.get(), nullptr) != 1) {
+            Fail(m_client -> PQerrorMessage(m_conn.get()));
+        }
+
+        // The server checks the rows once it has them all, the status of the command tells
+        std::string msg_error{ };
+        bool isFailed{ false };
+        while (PGresult* res{ m_client -> PQgetResult(m_conn.get()) }) {
+            if (m_client -> PQresultStatus(res) != PGRES_COMMAND_OK) {
+                isFailed = true;
+                msg_error = m_client -> PQresultErrorMessage(res);
+            }
+            m_client -> PQclear(res);
+        }
+
+        m_pool.Release(std::move(m_conn));
+        if (isFailed) {
+            throw ExecuteError(std::move(msg_error));
+        }
+    }
+
+    void CopyInStream::Fail(std::string error) {
+        m_pool.Reset(std::move(m_conn));
+        throw ExecuteError(std::move(error));
+    }
+
+    CopyInStream::~CopyInStream() {
+        if (m_conn) {
+            m_pool.Reset(std::move(m_conn));
+        }
+    }
+
+    void Database::BeginTransaction() {
+        //Not necessary yet
+        throw std::runtime_error("Missing implementation");
+    }
+
+    void Database::CommitTransaction() {
+        // Not necessary yet
+        throw std::runtime_error("Missing implementation");
+    }
+
+    void Database::RollbackTransaction() {
+        // Not necessary yet
+        throw std::runtime_error("Missing implementation");
+    }
+
+    PGconn* PGClient::PQconnectdbParams(
+        const char* const* keywords, 
+        const char* const* values, 
+        [[maybe_unused]] int expand_dbname
+    ) {
+
+        return ::PQconnectdbParams(keywords, values, 0);
+    }
+
+    PGresult* PGClient::PQexecParams(
+        PGconn* conn, 
+        const char* command, 
+        int nParams, 
+        const Oid* paramTypes, 
+        const char* const* paramValues, 
+        const int* paramLengths, 
+        const int* paramFormats, 
+        int resultFormat
+    ) {
+        return ::PQexecParams(conn, command, nParams, paramTypes, paramValues, 
+            paramLengths, paramFormats, resultFormat);
+    }
+
+    int PGClient::PQsendQueryParams(
+        PGconn* conn,
+        const char* command,
+        int nParams,
+        const Oid* paramTypes,
+        const char* const* paramValues,
+        const int* paramLengths,
+        const int* paramFormats,
+        int resultFormat
+    ) {
+        return ::PQsendQueryParams(conn, command, nParams, paramTypes, paramValues,
+            paramLengths, paramFormats, resultFormat);
+    }
+
+    int PGClient::PQsetnonblocking(PGconn* conn, int arg) {
+        return ::PQsetnonblocking(conn, arg);
+    }
+
+    int PGClient::PQflush(PGconn* conn) {
+        return ::PQflush(conn);
+    }
+
+    int PGClient::PQconsumeInput(PGconn* conn) {
+        return ::PQconsumeInput(conn);
+    }
+
+    int PGClient::PQisBusy(PGconn* conn) {
+        return ::PQisBusy(conn);
+    }
+
+    PGresult* PGClient::PQgetResult(PGconn* conn) {
+        return ::PQgetResult(conn);
+    }
+
+    int PGClient::PQsocket(const PGconn* conn) {
+        return ::PQsocket(conn);
+    }
+
+    PGresult* PGClient::PQprepare(
+        PGconn* conn,
+        const char* stmtName,
+        const char* query,
+        int nParams,
+        const Oid* paramTypes
+    ) {
+        return ::PQprepare(conn, stmtName, query, nParams, paramTypes);
+    }
+
+    PGresult* PGClient::PQexecPrepared(
+        PGconn* conn,
+        const char* stmtName,
+        int nParams,
+        const char* const* paramValues,
+        const int* paramLengths,
+        const int* paramFormats,
+        int resultFormat
+    ) {
+        return ::PQexecPrepared(conn, stmtName, nParams, paramValues,
+            paramLengths, paramFormats, resultFormat);
+    }
+
+    int PGClient::PQsendQueryPrepared(
+        PGconn* conn,
+        const char* stmtName,
+        int nParams,
+        const char* const* paramValues,
+        const int* paramLengths,
+        const int* paramFormats,
+        int resultFormat
+    ) {
+        return ::PQsendQueryPrepared(conn, stmtName, nParams, paramValues,
+            paramLengths, paramFormats, resultFormat);
+    }
+
+    int PGClient::PQenterPipelineMode(PGconn* conn) {
+        return ::PQenterPipelineMode(conn);
+    }
+
+    int PGClient::PQexitPipelineMode(PGconn* conn) {
+        return ::PQexitPipelineMode(conn);
+    }
+
+    int PGClient::PQpipelineSync(PGconn* conn) {
+        return ::PQpipelineSync(conn);
+    }
+
+    int PGClient::PQgetCopyData(PGconn* conn, char** buffer, int async) {
+        return ::PQgetCopyData(conn, buffer, async);
+    }
+
+    void PGClient::PQfreemem(void* ptr) {
+        ::PQfreemem(ptr);
+    }
+
+    int PGClient::PQputCopyData(PGconn* conn, const char* buffer, int nbytes) {
+        return ::PQputCopyData(conn, buffer, nbytes);
+    }
+
+    int PGClient::PQputCopyEnd(PGconn* conn, const char* errormsg) {
+        return ::PQputCopyEnd(conn, errormsg);
+    }
+
+    ConnStatusType PGClient::PQstatus(const PGconn* conn) {
+        return ::PQstatus(conn);
+    }
+
+    PGTransactionStatusType PGClient::PQtransactionStatus(const PGconn* conn) {
+        return ::PQtransactionStatus(conn);
+    }
+
+    char* PGClient::PQerrorMessage(const PGconn* conn) {
+        return ::PQerrorMessage(conn);
+    }
+
+    void PGClient::PQfinish(PGconn* conn) {
+        if (conn != nullptr) {
+            ::PQfinish(conn);
+        }        
+
+    }
+
+    void PGClient::PQreset(PGconn* conn) {
+        ::PQreset(conn);
+    }
+
+    ExecStatusType PGClient::PQresultStatus(const PGresult* res) {
+        return ::PQresultStatus(res);
+    }
+
+    char* PGClient::PQresultErrorMessage(const PGresult* res) {
+        return ::PQresultErrorMessage(res);
+    }
+
+    void PGClient::PQclear(PGresult* res) {
+        ::PQclear(res);
+    }
+
+    int PGClient::PQntuples(const PGresult* res) {
+        return ::PQntuples(res);
+    }
+
+    int PGClient::PQnfields(const PGresult* res) {
+        return ::PQnfields(res);
+    }
+
+    char* PGClient::PQgetvalue(const PGresult* res, int row, int col) {
+        return ::PQgetvalue(res, row, col);
+    }
+
+    int PGClient::PQgetisnull(const PGresult* res, int row, int col) {
+        return ::PQgetisnull(res, row, col);
+    }
+
+    int PGClient::PQgetlength(const PGresult* res, int row, int col) {
+        return ::PQgetlength(res, row, col);
+    }
+
+    Oid PGClient::PQftype(const PGresult* res, int col) {
+        return ::PQftype(res, col);
+    }
+
+    ConnectionPool::ConnectionPool(const ConnectionParams& params, 
+        std::shared_ptr<IPGClient> client, PoolConfig config
+    )
+        : m_config{ config }
+        , m_params{ params }
+        , m_client{ client }
+        , m_shards(std::clamp<std::size_t>(std::thread::hardware_concurrency(), 1,
+            static_cast<std::size_t>(std::max(config.maxSize, 1))))
+    {
+        if (m_config.maxSize < 1) {
+            throw ConnectionPoolError("Number of connections must be >= 1.");
+        }
+
+        if (m_config.minSize < 0 || m_config.minSize > m_config.maxSize) {
+            throw ConnectionPoolError("Minimum number of connections must be between 0 and the maximum.");
+        }
+
+        if (m_config.acquireTimeout.count() < 0) {
+            throw ConnectionPoolError("Acquire timeout cannot be negative.");
+        }
+
+        if (m_config.healthCheckInterval.count() < 0) {
+            throw ConnectionPoolError("Health check interval cannot be negative.");
+        }
+
+        if (m_config.reconnectBackoffMin.count() <= 0 || m_config.reconnectBackoffMax < m_config.reconnectBackoffMin) {
+            throw ConnectionPoolError("Reconnect backoff must be positive and the maximum not below the minimum.");
+        }
+
+        Connect(params);
+        m_maintenance = std::thread{ &ConnectionPool::Maintain, this };
+    }
+
+    ConnectionPool::~ConnectionPool() {
+        {
+            std::lock_guard<std::mutex> lock(m_maintenanceMutex);
+            m_isStopping = true;
+        }
+        m_maintenanceCond.notify_all();
+        if (m_maintenance.joinable()) {
+            m_maintenance.join();
+        }
+
+        // Asynchronous waiters hold their callbacks on foreign executors, they must not outlive the pool silently
+        std::lock_guard<std::mutex> lock(m_waitMutex);
+        while (!m_waiters.empty()) {
+            Complete(m_waiters.front(), nullptr,
+                std::make_exception_ptr(ConnectionPoolError{ "The connection pool was destroyed." }));
+            m_waiters.pop_front();
+        }
+        m_countWaiters = 0;
+    }
+
+    void ConnectionPool::Connect(const ConnectionParams& params) {
+        Disconnect();
+        {
+            std::lock_guard<std::mutex> lock(m_maintenanceMutex);
+            m_params = params;
+        }
+
+        std::vector<PGconnPtr> connections{ };
+        for (int i = 0; i < m_config.minSize; ++i) {
+            connections.emplace_back(NewConnection(params));
+        }
+
+        m_size += m_config.minSize;
+        for (auto& conn : connections) {
+            Push(std::move(conn));
+        }
+    }
+
+    void ConnectionPool::Disconnect() {
+        // Slots the maintenance thread is working on right now finish like connections still handed out
+        std::vector<PendingConnection> pending{ };
+        {
+            std::lock_guard<std::mutex> lock(m_maintenanceMutex);
+            pending.swap(m_pending);
+        }
+        m_size -= static_cast<int>(pending.size());
+
+        for (auto& shard : m_shards) {
+            std::vector<PGconnPtr> connections{ };
+            {
+                std::lock_guard<std::mutex> lock(shard.mutex);
+                connections.swap(shard.connections);
+            }
+
+            m_size -= static_cast<int>(connections.size());
+            std::lock_guard<std::mutex> lock(m_statementMutex);
+            for (auto& conn : connections) {
+                m_prepared.erase(conn.get());
+            }
+        }
+    }
+
+    int ConnectionPool::Count() {
+        std::size_t count{ 0 };
+        for (auto& shard : m_shards) {
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            count += shard.connections.size();
+        }
+
+        return static_cast<int>(count);
+    }
+
+    PGconnPtr ConnectionPool::Acquire() {
+        if (auto conn{ TryPop() }) {
+            return TakeReady(std::move(*conn));
+        }
+
+        // The new connection is opened in the background and handed to the oldest waiter
+        TryGrow();
+
+        auto waiter{ std::make_shared<Waiter>() };
+        std::unique_lock<std::mutex> lock{ m_waitMutex };
+        ++m_countWaiters;
+
+        // A connection may have been released before this waiter became visible to Release
+        if (auto conn{ TryPop() }) {
+            --m_countWaiters;
+            lock.unlock();
+            return TakeReady(std::move(*conn));
+        }
+
+        m_waiters.push_back(waiter);
+        if (!waiter -> cond.wait_for(lock, m_config.acquireTimeout, [&]() { return waiter -> isDone; })) {
+            m_waiters.erase(std::find(m_waiters.begin(), m_waiters.end(), waiter));
+            --m_countWaiters;
+            throw ConnectionPoolError{ "Timeout: Could not acquire a database connection from the pool within the allowed time." };
+        }
+
+        PGconnPtr conn{ std::move(waiter -> conn) };
+        lock.unlock();
+        return TakeReady(std::move(conn));
+    }
+
+    void ConnectionPool::AcquireAsync(net::any_io_executor executor, AcquireCallback callback) {
+        AcquireCallback onReady{ [this, callback = std::move(callback)](std::exception_ptr error, PGconnPtr conn) {
+            if (!error) {
+                try {
+                    conn = TakeReady(std::move(conn));
+                }
+                catch (...) {
+                    error = std::current_exception();
+                }
+            }
+
+            callback(error, std::move(conn));
+        } };
+
+        if (auto conn{ TryPop() }) {
+            net::post(executor, [onReady, conn = std::move(*conn)]() mutable {
+                onReady(nullptr, std::move(conn));
+            });
+            return;
+        }
+
+        TryGrow();
+
+        auto waiter{ std::make_shared<Waiter>() };
+        waiter -> callback = std::move(onReady);
+        waiter -> executor = executor;
+        waiter -> timer = std::make_shared<net::steady_timer>(executor, m_config.acquireTimeout);
+
+        // The wait starts before the waiter is visible, so Release only ever cancels a pending wait
+        waiter -> timer -> async_wait([this, waiter](boost::system::error_code ec) {
+            if (ec) {
+                return; // Served or the pool was destroyed
+            }
+
+            std::lock_guard<std::mutex> lock{ m_waitMutex };
+            auto found{ std::find(m_waiters.begin(), m_waiters.end(), waiter) };
+            if (waiter -> isDone || found == m_waiters.end()) {
+                return;
+            }
+
+            m_waiters.erase(found);
+            --m_countWaiters;
+            Complete(waiter, nullptr, std::make_exception_ptr(ConnectionPoolError{
+                "Timeout: Could not acquire a database connection from the pool within the allowed time." }));
+        });
+
+        std::lock_guard<std::mutex> lock{ m_waitMutex };
+        ++m_countWaiters;
+        if (auto conn{ TryPop() }) {
+            --m_countWaiters;
+            Complete(waiter, std::move(*conn));
+            return;
+        }
+
+        m_waiters.push_back(std::move(waiter));
+    }
+
+    void ConnectionPool::Release(PGconnPtr conn) {
+        // PQreset blocks for as long as the server is unreachable, so it never runs on the caller's thread
+        if (m_client -> PQstatus(conn.get()) != CONNECTION_OK) {
+            Schedule(PendingConnection{ std::move(conn) });
+            return;
+        }
+
+        Push(std::move(conn));
+    }
+
+    void ConnectionPool::Reset(PGconnPtr conn) {
+        Schedule(PendingConnection{ std::move(conn) });
+    }
+
+    StatementHandle ConnectionPool::Prepare(std::string_view query) {
+        StatementHandle statement{ };
+        {
+            std::lock_guard<std::mutex> lock(m_statementMutex);
+            statement.id = m_statements.size();
+            // Names are never reused, a failed registration may leave its name behind on some connections
+            m_statements.emplace_back(Statement{ "stmt_" + std::to_string(m_nextStatement++), std::string{ query } });
+        }
+
+        // Handing out a connection prepares the statement on it, so a broken statement fails here
+        try {
+            Release(Acquire());
+        }
+        catch (...) {
+            // Statements registered meanwhile follow this one, so it is marked instead of removed
+            std::lock_guard<std::mutex> lock(m_statementMutex);
+            m_statements[statement.id].isFailed = true;
+
+            throw;
+        }
+
+        return statement;
+    }
+
+    const std::string& ConnectionPool::GetStatementName(StatementHandle statement) {
+        std::lock_guard<std::mutex> lock(m_statementMutex);
+
+        if (statement.id >= m_statements.size() || m_statements[statement.id].isFailed) {
+            throw PrepareError("Unknown prepared statement.");
+        }
+
+        return m_statements[statement.id].name;
+    }
+
+    std::size_t ConnectionPool::GetLocalShard() const {
+        // Threads are spread over the shards in the order they first touch a pool
+        static std::atomic<std::size_t> nextThread{ 0 };
+        thread_local const std::size_t threadIndex{ nextThread++ };
+
+        return threadIndex % m_shards.size();
+    }
+
+    void ConnectionPool::Push(PGconnPtr conn) {
+        if (m_countWaiters.load() > 0) {
+            std::lock_guard<std::mutex> lock(m_waitMutex);
+            if (!m_waiters.empty()) {
+                auto waiter{ std::move(m_waiters.front()) };
+                m_waiters.pop_front();
+                --m_countWaiters;
+                Complete(waiter, std::move(conn));
+                return;
+            }
+        }
+
+        {
+            auto& shard{ m_shards[GetLocalShard()] };
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            shard.connections.emplace_back(std::move(conn));
+        }
+
+        // A waiter may have registered between the check above and the push
+        if (m_countWaiters.load() > 0) {
+            std::lock_guard<std::mutex> lock(m_waitMutex);
+            ServeWaiters();
+        }
+    }
+
+    std::optional<PGconnPtr> ConnectionPool::TryPop() {
+        const std::size_t local{ GetLocalShard() };
+        for (std::size_t i{ 0 }; i < m_shards.size(); ++i) {
+            auto& shard{ m_shards[(local + i) % m_shards.size()] };
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            if (!shard.connections.empty()) {
+                PGconnPtr conn{ std::move(shard.connections.back()) };
+                shard.connections.pop_back();
+                return conn;
+            }
+        }
+
+        return std::nullopt;
+    }
+
+    bool ConnectionPool::TryGrow() {
+        int size{ m_size.load() };
+        while (size < m_config.maxSize) {
+            if (m_size.compare_exchange_weak(size, size + 1)) {
+                Schedule(PendingConnection{ nullptr, true });
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    PGconnPtr ConnectionPool::NewConnection(const ConnectionParams& params) {
+        PGconnPtr conn{ m_client -> PQconnectdbParams(params.first.data(), params.second.data(), 0), 
+            [&](PGconn* conn) -> void {
+                m_client -> PQfinish(conn);
+            }};
+
+        if (m_client -> PQstatus(conn.get()) != CONNECTION_OK) {
+            throw ConnectError(m_client -> PQerrorMessage(conn.get()));
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(m_statementMutex);
+            m_prepared[conn.get()] = 0;
+        }
+
+        PrepareStatements(conn.get());
+        return conn;
+    }
+
+    void ConnectionPool::ServeWaiters() {
+        while (!m_waiters.empty()) {
+            auto conn{ TryPop() };
+            if (!conn) {
+                return;
+            }
+
+            auto waiter{ std::move(m_waiters.front()) };
+            m_waiters.pop_front();
+            --m_countWaiters;
+            Complete(waiter, std::move(*conn));
+        }
+    }
+
+    void ConnectionPool::Complete(const WaiterPtr& waiter, PGconnPtr conn, std::exception_ptr error) {
+        waiter -> isDone = true;
+        if (!waiter -> callback) {
+            waiter -> conn = std::move(conn);
+            waiter -> cond.notify_one();
+            return;
+        }
+
+        // The timer belongs to the waiter's executor, it is cancelled there
+        net::post(waiter -> executor, [timer = waiter -> timer]() {
+            timer -> cancel();
+        });
+        net::post(waiter -> executor, [callback = waiter -> callback, conn = std::move(conn), error]() mutable {
+            callback(error, std::move(conn));
+        });
+    }
+
+    void ConnectionPool::PrepareStatements(PGconn* conn) {
+        // The round trips run without the lock, statements registered meanwhile are picked up next time
+        std::size_t prepared{ };
+        std::vector<Statement> pending{ };
+        {
+            std::lock_guard<std::mutex> lock(m_statementMutex);
+            prepared = m_prepared[conn];
+            pending.assign(m_statements.begin() + std::min(prepared, m_statements.size()), m_statements.end());
+        }
+
+        for (const auto& statement : pending) {
+            if (!statement.isFailed) {
+                PGresultPtr resGuard{
+                    m_client -> PQprepare(conn, statement.name.c_str(), statement.query.c_str(), 0, nullptr),
+                    [&](PGresult* res) -> void {
+                        m_client -> PQclear(res);
+                    } };
+
+                if (m_client -> PQresultStatus(resGuard.get()) != PGRES_COMMAND_OK) {
+                    throw PrepareError(m_client -> PQerrorMessage(conn));
+                }
+            }
+
+            std::lock_guard<std::mutex> lock(m_statementMutex);
+            m_prepared[conn] = ++prepared;
+        }
+    }
+
+    PGconnPtr ConnectionPool::TakeReady(PGconnPtr conn) {
+        try {
+            PrepareStatements(conn.get());
+        }
+        catch (...) {
+            // A connection that broke meanwhile goes to the maintenance thread
+            Release(std::move(conn));
+            throw;
+        }
+
+        return conn;
+    }
+
+    void ConnectionPool::Schedule(PendingConnection pending) {
+        pending.retryAt = std::chrono::steady_clock::now();
+        {
+            std::lock_guard<std::mutex> lock(m_maintenanceMutex);
+            m_pending.emplace_back(std::move(pending));
+        }
+        m_maintenanceCond.notify_one();
+    }
+
+    void ConnectionPool::Maintain() {
+        using Clock = std::chrono::steady_clock;
+
+        const bool isCheckEnabled{ m_config.healthCheckInterval.count() > 0 };
+        auto nextCheck{ isCheckEnabled ? Clock::now() + m_config.healthCheckInterval : Clock::time_point::max() };
+
+        std::unique_lock<std::mutex> lock{ m_maintenanceMutex };
+        while (!m_isStopping) {
+            auto wakeAt{ nextCheck };
+            for (const auto& pending : m_pending) {
+                wakeAt = std::min(wakeAt, pending.retryAt);
+            }
+
+            m_maintenanceCond.wait_until(lock, wakeAt, [&]() {
+                return m_isStopping || std::any_of(m_pending.begin(), m_pending.end(), [](const auto& pending) {
+                    return pending.retryAt <= Clock::now();
+                });
+            });
+
+            if (m_isStopping) {
+                break;
+            }
+
+            const auto now{ Clock::now() };
+            auto notDue{ std::partition(m_pending.begin(), m_pending.end(), [now](const auto& pending) {
+                return pending.retryAt <= now;
+            }) };
+
+            std::vector<PendingConnection> due{ std::make_move_iterator(m_pending.begin()), std::make_move_iterator(notDue) };
+            m_pending.erase(m_pending.begin(), notDue);
+            ConnectionParams params{ m_params };
+            lock.unlock();
+
+            std::vector<PendingConnection> failed{ };
+            for (auto& pending : due) {
+                if (!Reconnect(pending, params)) {
+                    failed.emplace_back(std::move(pending));
+                }
+            }
+
+            if (now >= nextCheck) {
+                CheckIdleConnections();
+                nextCheck = Clock::now() + m_config.healthCheckInterval;
+            }
+
+            lock.lock();
+            std::move(failed.begin(), failed.end(), std::back_inserter(m_pending));
+        }
+    }
+
+    bool ConnectionPool::Reconnect(PendingConnection& pending, const ConnectionParams& params) {
+        try {
+            if (pending.isNew) {
+                pending.conn = NewConnection(params);
+                pending.isNew = false;
+            }
+            else {
+                m_client -> PQreset(pending.conn.get());
+                if (m_client -> PQstatus(pending.conn.get()) != CONNECTION_OK) {
+                    throw ResetError(m_client -> PQerrorMessage(pending.conn.get()));
+                }
+
+                // A new session has no prepared statements
+                std::lock_guard<std::mutex> lock(m_statementMutex);
+                m_prepared[pending.conn.get()] = 0;
+            }
+        }
+        catch (...) {
+            // The server is still unreachable, the slot stays reserved until a later attempt succeeds
+            const int shift{ std::min(pending.attempts++, 16) };
+            pending.retryAt = std::chrono::steady_clock::now()
+                + std::min(m_config.reconnectBackoffMax, m_config.reconnectBackoffMin * (1 << shift));
+            return false;
+        }
+
+        try {
+            PrepareStatements(pending.conn.get());
+        }
+        catch (const PrepareError&) {
+            // Acquire retries the remaining statements
+        }
+
+        Push(std::move(pending.conn));
+        return true;
+    }
+
+    void ConnectionPool::CheckIdleConnections() {
+        for (auto& shard : m_shards) {
+            std::vector<PGconnPtr> broken{ };
+            {
+                // PQconsumeInput does not block, it only reads what the server has already sent
+                std::lock_guard<std::mutex> lock(shard.mutex);
+                auto healthyEnd{ std::partition(shard.connections.begin(), shard.connections.end(), [this](const PGconnPtr& conn) {
+                    return m_client -> PQconsumeInput(conn.get()) != 0 && m_client -> PQstatus(conn.get()) == CONNECTION_OK;
+                }) };
+
+                broken.assign(std::make_move_iterator(healthyEnd), std::make_move_iterator(shard.connections.end()));
+                shard.connections.erase(healthyEnd, shard.connections.end());
+            }
+
+            for (auto& conn : broken) {
+                Schedule(PendingConnection{ std::move(conn) });
+            }
+        }
     }
-}
\ No newline at end of file
+}
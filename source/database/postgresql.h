@@ -1,23 +1,40 @@
 #pragma once
 
 
+#include <algorithm>
+#include <deque>
 #include <functional>
 #include <string>
 #include <string_view>
 #include <stdexcept>
 #include <iostream>
+#include <thread>
 #include <vector>
 #include <mutex>
 #include <condition_variable>
 #include <memory>
+#include <optional>
+#include <atomic>
+#include <chrono>
+#include <unordered_map>
 #include <libpq-fe.h>
 
+#include <boost/asio/any_io_executor.hpp>
+#include <boost/asio/async_result.hpp>
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/post.hpp>
+#include <boost/asio/steady_timer.hpp>
+#include <boost/asio/strand.hpp>
+#include <boost/asio/posix/stream_descriptor.hpp>
+
 
 #include "IDatabase.h"
 #include "postgresqlError.h"
 
 
 namespace PostgreSQL {
+    namespace net = boost::asio;
+
     using PGresultPtr = std::unique_ptr<PGresult, std::function<void(PGresult* res)>>;
     using PGconnPtr = std::unique_ptr<PGconn, std::function<void(PGconn* conn)>>;
     using ConnectionParams = std::pair<std::vector<const char*>, std::vector<const char*>>;
@@ -70,20 +87,79 @@ namespace PostgreSQL {
             int resultFormat
         ) = 0;
 
+        // Asynchronous command processing
+        virtual int PQsendQueryParams(
+            PGconn* conn,
+            const char* command,
+            int nParams,
+            const Oid* paramTypes,
+            const char* const* paramValues,
+            const int* paramLengths,
+            const int* paramFormats,
+            int resultFormat
+        ) = 0;
+        virtual int PQsetnonblocking(PGconn* conn, int arg) = 0;
+        virtual int PQflush(PGconn* conn) = 0;
+        virtual int PQconsumeInput(PGconn* conn) = 0;
+        virtual int PQisBusy(PGconn* conn) = 0;
+        virtual PGresult* PQgetResult(PGconn* conn) = 0;
+        virtual int PQsocket(const PGconn* conn) = 0;
+
+        // Prepared statements
+        virtual PGresult* PQprepare(
+            PGconn* conn,
+            const char* stmtName,
+            const char* query,
+            int nParams,
+            const Oid* paramTypes
+        ) = 0;
+        virtual PGresult* PQexecPrepared(
+            PGconn* conn,
+            const char* stmtName,
+            int nParams,
+            const char* const* paramValues,
+            const int* paramLengths,
+            const int* paramFormats,
+            int resultFormat
+        ) = 0;
+        virtual int PQsendQueryPrepared(
+            PGconn* conn,
+            const char* stmtName,
+            int nParams,
+            const char* const* paramValues,
+            const int* paramLengths,
+            const int* paramFormats,
+            int resultFormat
+        ) = 0;
+
+        // Pipeline mode
+        virtual int PQenterPipelineMode(PGconn* conn) = 0;
+        virtual int PQexitPipelineMode(PGconn* conn) = 0;
+        virtual int PQpipelineSync(PGconn* conn) = 0;
+
+        // COPY
+        virtual int PQgetCopyData(PGconn* conn, char** buffer, int async) = 0;
+        virtual void PQfreemem(void* ptr) = 0;
+        virtual int PQputCopyData(PGconn* conn, const char* buffer, int nbytes) = 0;
+        virtual int PQputCopyEnd(PGconn* conn, const char* errormsg) = 0;
+
         // Connection management
         virtual ConnStatusType PQstatus(const PGconn* conn) = 0;
+        virtual PGTransactionStatusType PQtransactionStatus(const PGconn* conn) = 0;
         virtual char* PQerrorMessage(const PGconn* conn) = 0;
         virtual void PQfinish(PGconn* conn) = 0;
         virtual void PQreset(PGconn* conn) = 0;
 
         // Working with the result
         virtual ExecStatusType PQresultStatus(const PGresult* res) = 0;
+        virtual char* PQresultErrorMessage(const PGresult* res) = 0;
         virtual void PQclear(PGresult* res) = 0;
         virtual int PQntuples(const PGresult* res) = 0;
         virtual int PQnfields(const PGresult* res) = 0;
         virtual char* PQgetvalue(const PGresult* res, int row, int col) = 0;
         virtual int PQgetisnull(const PGresult* res, int row, int col) = 0;
         virtual int PQgetlength(const PGresult* res, int row, int col) = 0;
+        virtual Oid PQftype(const PGresult* res, int col) = 0;
     };
 
     class PGClient : public IPGClient {
@@ -107,81 +183,545 @@ namespace PostgreSQL {
             int resultFormat
         ) override;
 
+        // Asynchronous command processing
+        int PQsendQueryParams(
+            PGconn* conn,
+            const char* command,
+            int nParams,
+            const Oid* paramTypes,
+            const char* const* paramValues,
+            const int* paramLengths,
+            const int* paramFormats,
+            int resultFormat
+        ) override;
+        int PQsetnonblocking(PGconn* conn, int arg) override;
+        int PQflush(PGconn* conn) override;
+        int PQconsumeInput(PGconn* conn) override;
+        int PQisBusy(PGconn* conn) override;
+        PGresult* PQgetResult(PGconn* conn) override;
+        int PQsocket(const PGconn* conn) override;
+
+        // Prepared statements
+        PGresult* PQprepare(
+            PGconn* conn,
+            const char* stmtName,
+            const char* query,
+            int nParams,
+            const Oid* paramTypes
+        ) override;
+        PGresult* PQexecPrepared(
+            PGconn* conn,
+            const char* stmtName,
+            int nParams,
+            const char* const* paramValues,
+            const int* paramLengths,
+            const int* paramFormats,
+            int resultFormat
+        ) override;
+        int PQsendQueryPrepared(
+            PGconn* conn,
+            const char* stmtName,
+            int nParams,
+            const char* const* paramValues,
+            const int* paramLengths,
+            const int* paramFormats,
+            int resultFormat
+        ) override;
+
+        // Pipeline mode
+        int PQenterPipelineMode(PGconn* conn) override;
+        int PQexitPipelineMode(PGconn* conn) override;
+        int PQpipelineSync(PGconn* conn) override;
+
+        // COPY
+        int PQgetCopyData(PGconn* conn, char** buffer, int async) override;
+        void PQfreemem(void* ptr) override;
+        int PQputCopyData(PGconn* conn, const char* buffer, int nbytes) override;
+        int PQputCopyEnd(PGconn* conn, const char* errormsg) override;
+
         // Connection management
         ConnStatusType PQstatus(const PGconn* conn) override;
+        PGTransactionStatusType PQtransactionStatus(const PGconn* conn) override;
         char* PQerrorMessage(const PGconn* conn) override;
         void PQfinish(PGconn* conn) override;
         void PQreset(PGconn* conn) override;
 
         // Working with the result
         ExecStatusType PQresultStatus(const PGresult* res) override;
+        char* PQresultErrorMessage(const PGresult* res) override;
         void PQclear(PGresult* res) override;
         int PQntuples(const PGresult* res) override;
         int PQnfields(const PGresult* res) override;
         char* PQgetvalue(const PGresult* res, int row, int col) override;
         int PQgetisnull(const PGresult* res, int row, int col) override;
         int PQgetlength(const PGresult* res, int row, int col) override;
+        Oid PQftype(const PGresult* res, int col) override;
+    };
+
+    struct PoolConfig {
+        PoolConfig() = default;
+
+        // A fixed-size pool
+        PoolConfig(int countConn)
+            : minSize{ countConn }
+            , maxSize{ countConn }
+        {
+        }
+
+        PoolConfig(int minSize, int maxSize, std::chrono::milliseconds acquireTimeout)
+            : minSize{ minSize }
+            , maxSize{ maxSize }
+            , acquireTimeout{ acquireTimeout }
+        {
+        }
+
+        // Connections opened by Connect, the pool grows on demand up to maxSize
+        int minSize{ 1 };
+        int maxSize{ 1 };
+
+        // How long Acquire waits for a released connection before it throws ConnectionPoolError
+        std::chrono::milliseconds acquireTimeout{ 500 };
+
+        // How often the maintenance thread validates idle connections, zero turns the check off
+        std::chrono::milliseconds healthCheckInterval{ 5000 };
+
+        // Delay between failed reconnect attempts, doubled after every failure up to the maximum
+        std::chrono::milliseconds reconnectBackoffMin{ 100 };
+        std::chrono::milliseconds reconnectBackoffMax{ 10000 };
+    };
+
+    // A result fetched in binary format: values are decoded from the wire representation of their column type,
+    // strings point into the PGresult without a copy.
+    class ResultView : public IResultView {
+    public:
+        ResultView(PGresultPtr result, std::shared_ptr<IPGClient> client);
+
+        int Rows() const override;
+        int Columns() const override;
+
+        bool IsNull(int row, int col) const override;
+
+        std::string_view GetString(int row, int col) const override;
+
+        std::int64_t GetInt64(int row, int col) const override;
+
+        std::chrono::system_clock::time_point GetTimestamp(int row, int col) const override;
+
+    private:
+
+        // The raw bytes of a value, throws ResultError if it is NULL
+        std::string_view GetBytes(int row, int col) const;
+
+    private:
+        std::shared_ptr<IPGClient> m_client;
+        PGresultPtr m_result;
+        int m_rows;
+        int m_columns;
+    };
+
+    // Asynchronous queries can share a few connections in libpq pipeline mode: the queries of concurrent
+    // requests are written back to back and flushed together, results come back in the same order.
+    struct PipelineConfig {
+        // Connections taken from the pool for pipelining, zero sends every query on a connection of its own
+        std::size_t connections{ 0 };
+
+        // Queries waiting on one pipelined connection, beyond that a query takes a connection of its own
+        std::size_t maxQueued{ 256 };
     };
 
     class ConnectionPool {
     public:
 
+        using AcquireCallback = std::function<void(std::exception_ptr, PGconnPtr)>;
+
         ConnectionPool(const ConnectionParams& params,
-            std::shared_ptr<IPGClient> client, int countConn = 1);
+            std::shared_ptr<IPGClient> client, PoolConfig config = { });
+
+        ConnectionPool(const ConnectionPool&) = delete;
+        ConnectionPool& operator=(const ConnectionPool&) = delete;
+
+        ~ConnectionPool();
 
         void Connect(const ConnectionParams& params);
 
         void Disconnect();
 
-        int Count() { 
-            std::lock_guard<std::mutex> lock(m_mutex);
-            return m_connections.size(); 
-        }
+        // Idle connections
+        int Count();
+
+        // Open connections, idle and handed out
+        int Size() const { return m_size.load(); }
 
         PGconnPtr Acquire();
 
+        // Completes on the executor once a connection is free, waiters are served in FIFO order.
+        // Nothing blocks while waiting, the deadline is an Asio timer.
+        void AcquireAsync(net::any_io_executor executor, AcquireCallback callback);
+
+        template <typename CompletionToken>
+        auto AcquireAsync(net::any_io_executor executor, CompletionToken&& token) {
+            return net::async_initiate<CompletionToken, void(std::exception_ptr, PGconnPtr)>(
+                [this](auto handler, net::any_io_executor executor) {
+                    auto sharedHandler{ std::make_shared<decltype(handler)>(std::move(handler)) };
+                    AcquireAsync(executor, AcquireCallback{
+                        [sharedHandler](std::exception_ptr error, PGconnPtr conn) {
+                            (*sharedHandler)(error, std::move(conn));
+                        } });
+                },
+                token, std::move(executor));
+        }
+
+        // Hands the connection to the oldest waiter, or returns it to the free list.
+        // A broken connection is left to the maintenance thread, Release never reconnects.
         void Release(PGconnPtr conn);
 
+        // Returns a connection left in an unknown state (e.g. with results still pending),
+        // the maintenance thread resets it before it is handed out again
+        void Reset(PGconnPtr conn);
+
+        // Registers the statement with the pool: it is validated on one connection right away,
+        // prepared on the others before they are handed out, and again after Connect or PQreset.
+        // A statement that fails the validation is never prepared again and its handle is not returned.
+        StatementHandle Prepare(std::string_view query);
+
+        const std::string& GetStatementName(StatementHandle statement);
+
     private:
 
-        void Push(PGconnPtr conn) {
-            std::lock_guard<std::mutex> lock(m_mutex);
-            m_connections.emplace_back(std::move(conn));
-        }
+        // Free connections are spread over shards, so threads releasing and acquiring
+        // connections at the same time rarely contend for the same mutex.
+        struct alignas(64) Shard {
+            std::mutex mutex{ };
+            std::vector<PGconnPtr> connections{ };
+        };
+
+        // A thread or an asynchronous operation waiting for a free connection
+        struct Waiter {
+            std::condition_variable cond{ };
+            PGconnPtr conn{ };
+            bool isDone{ false };
+
+            // Asynchronous waiters only
+            AcquireCallback callback{ };
+            net::any_io_executor executor{ };
+            std::shared_ptr<net::steady_timer> timer{ };
+        };
+
+        using WaiterPtr = std::shared_ptr<Waiter>;
+
+        // A slot of the pool without a usable connection: a broken connection to reset,
+        // or a connection still to be opened (the pool grows or replaces a lost one)
+        struct PendingConnection {
+            PGconnPtr conn{ };
+            bool isNew{ false };
+            int attempts{ 0 };
+            std::chrono::steady_clock::time_point retryAt{ };
+        };
+
+        std::size_t GetLocalShard() const;
+
+        void Push(PGconnPtr conn);
+
+        // Connections may be null (e.g. in tests), so "nothing free" is std::nullopt
+        std::optional<PGconnPtr> TryPop();
+
+        // Reserves a slot if the pool is below maxSize and lets the maintenance thread open it
+        bool TryGrow();
+
+        PGconnPtr NewConnection(const ConnectionParams& params);
+
+        // Hands the slot over to the maintenance thread
+        void Schedule(PendingConnection pending);
+
+        // The maintenance thread: reconnects pending slots with backoff and validates idle connections
+        void Maintain();
+
+        // Returns false if the slot has to be retried later
+        bool Reconnect(PendingConnection& pending, const ConnectionParams& params);
+
+        // Moves idle connections the server has closed to the pending slots
+        void CheckIdleConnections();
+
+        // Hands free connections to the waiters in FIFO order, m_waitMutex must be held
+        void ServeWaiters();
+
+        // Wakes the waiter or posts its callback, m_waitMutex must be held
+        void Complete(const WaiterPtr& waiter, PGconnPtr conn, std::exception_ptr error = nullptr);
+
+        // Prepares the statements registered after the last call for this connection
+        void PrepareStatements(PGconn* conn);
+
+        // Brings the prepared statements of a connection about to be handed out up to date,
+        // the connection is released again if that fails
+        PGconnPtr TakeReady(PGconnPtr conn);
+
+    private:
+        struct Statement {
+            std::string name;
+            std::string query;
+            bool isFailed{ false }; // the validation failed, the slot stays so later handles keep their index
+        };
+
+        PoolConfig m_config;
+        ConnectionParams m_params;
+        std::shared_ptr<IPGClient> m_client;
+
+        std::vector<Shard> m_shards;
+        std::atomic<int> m_size{ 0 };
+
+        std::mutex m_waitMutex{ };
+        std::deque<WaiterPtr> m_waiters{ };
+        std::atomic<std::size_t> m_countWaiters{ 0 };
+
+        // Pending slots still count in m_size, so the pool keeps its size while they are reconnected
+        std::mutex m_maintenanceMutex{ };
+        std::condition_variable m_maintenanceCond{ };
+        std::vector<PendingConnection> m_pending{ };
+        bool m_isStopping{ false };
+        std::thread m_maintenance{ };
+
+        // std::deque keeps the names in place while new statements are registered
+        std::mutex m_statementMutex{ };
+        std::deque<Statement> m_statements;
+        std::unordered_map<const PGconn*, std::size_t> m_prepared;
+        std::size_t m_nextStatement{ 0 };
+    };
+
+    // A COPY TO STDOUT running on a pooled connection. The rows are read in blocking mode, one at a time.
+    class CopyOutStream : public ICopyOutStream {
+    public:
+        CopyOutStream(ConnectionPool& pool, std::shared_ptr<IPGClient> client, PGconnPtr conn);
+
+        CopyOutStream(const CopyOutStream&) = delete;
+        CopyOutStream& operator=(const CopyOutStream&) = delete;
+
+        bool Read(std::string& buffer, std::size_t size) override;
+
+        // A copy left unfinished leaves the connection in COPY state, the pool resets it
+        ~CopyOutStream();
 
     private:
-        int m_countConn{ };
-        std::vector<PGconnPtr> m_connections;
 
+        // Takes the result of the command once the last row is read, throws ExecuteError if it failed
+        void Finish();
+
+    private:
+        ConnectionPool& m_pool;
         std::shared_ptr<IPGClient> m_client;
+        PGconnPtr m_conn; // null once the copy is over
+    };
+
+    // A COPY FROM STDIN running on a pooled connection. The connection is in blocking mode, so libpq
+    // waits for the socket to take its buffered data before it accepts more.
+    class CopyInStream : public ICopyInStream {
+    public:
+        CopyInStream(ConnectionPool& pool, std::shared_ptr<IPGClient> client, PGconnPtr conn);
+
+        CopyInStream(const CopyInStream&) = delete;
+        CopyInStream& operator=(const CopyInStream&) = delete;
+
+        void Write(std::string_view data) override;
+
+        void Finish() override;
 
-        std::mutex m_mutex{ };
-        std::condition_variable m_cond{ };
+        // An unfinished copy is rolled back by resetting the connection
+        ~CopyInStream();
+
+    private:
+
+        // The connection is in an unknown state, it goes back to the pool to be reset
+        [[noreturn]] void Fail(std::string error);
+
+    private:
+        ConnectionPool& m_pool;
+        std::shared_ptr<IPGClient> m_client;
+        PGconnPtr m_conn; // null once the copy is over
     };
 
     class Database : public IDatabase {
     public:
         Database(const ConnectionConfig& config,
             std::shared_ptr<IPGClient> client,
-            int countConn = 1);
+            PoolConfig poolConfig = { });
+
+        // The executor drives the sockets of asynchronous queries (usually the server io_context).
+        Database(const ConnectionConfig& config,
+            std::shared_ptr<IPGClient> client,
+            net::any_io_executor executor,
+            PoolConfig poolConfig = { },
+            PipelineConfig pipelineConfig = { });
+
+        // One executor per io_context of the server. A query is driven by the executor running
+        // on the calling thread, or by the next one in turn when the caller runs on none of them.
+        // Pipeline i runs on executor i % executors.size().
+        Database(const ConnectionConfig& config,
+            std::shared_ptr<IPGClient> client,
+            std::vector<net::any_io_executor> executors,
+            PoolConfig poolConfig = { },
+            PipelineConfig pipelineConfig = { });
 
         void Connect() override;
 
         void Disconnect() override;
 
+        // Throws PrepareError once an asynchronous query went to a pipeline, its connection would not know the statement
+        StatementHandle Prepare(std::string_view query) override;
+
         void Execute(std::string_view query, SqlParams params) override;
 
+        void Execute(StatementHandle statement, SqlParams params) override;
+
         std::vector<std::string> ExecuteQuery(std::string_view query, SqlParams params) override;
 
+        std::vector<std::string> ExecuteQuery(StatementHandle statement, SqlParams params) override;
+
+        // Uses the libpq non-blocking API when an executor is attached, otherwise falls back to ExecuteQuery.
+        void ExecuteQueryAsync(std::string_view query, SqlParams params, QueryCallback callback) override;
+
+        void ExecuteQueryAsync(StatementHandle statement, SqlParams params, QueryCallback callback) override;
+
+        // The view variants request results in binary format
+        ResultViewPtr ExecuteQueryView(std::string_view query, SqlParams params) override;
+
+        ResultViewPtr ExecuteQueryView(StatementHandle statement, SqlParams params) override;
+
+        void ExecuteQueryViewAsync(std::string_view query, SqlParams params, ViewCallback callback) override;
+
+        void ExecuteQueryViewAsync(StatementHandle statement, SqlParams params, ViewCallback callback) override;
+
+        // The streams hold a pooled connection, they must not outlive the database
+        CopyOutPtr CopyOut(std::string_view query) override;
+
+        CopyInPtr CopyIn(std::string_view query) override;
+
         void BeginTransaction() override;
 
         void CommitTransaction() override;
 
         void RollbackTransaction() override;
 
-        ~Database() {
-            m_client.reset();
+        ~Database();
+
+    private:
+
+        // How the command text is sent: as SQL or as the name of a prepared statement
+        enum class CommandType { Text, Prepared };
+
+        // The resultFormat argument of libpq
+        enum class ResultFormat { Text = 0, Binary = 1 };
+
+        // Completion of an asynchronous query, the result always has status PGRES_TUPLES_OK
+        using ResultCallback = std::function<void(std::exception_ptr, PGresultPtr)>;
+
+        // Runs the command on a pooled connection and throws ExecuteError unless the result has the expected status
+        PGresultPtr Exec(CommandType type, std::string_view command, SqlParams params, ExecStatusType expected,
+            ResultFormat format = ResultFormat::Text);
+
+        void ExecAsync(CommandType type, std::string_view command, SqlParams params, ResultFormat format,
+            ResultCallback callback);
+
+        // Resolves the statement name, or reports the unknown handle through the callback
+        void ExecPreparedAsync(StatementHandle statement, SqlParams params, ResultFormat format,
+            ResultCallback callback);
+
+        ResultCallback ToRowsCallback(QueryCallback callback);
+
+        ResultCallback ToViewCallback(ViewCallback callback);
+
+        // Starts the COPY command, the connection is returned once it is in the expected COPY state
+        PGconnPtr StartCopy(std::string_view query, ExecStatusType expected);
+
+#if defined(BOOST_ASIO_HAS_POSIX_STREAM_DESCRIPTOR)
+        // A single in-flight query: waits on the connection socket and completes through the callback.
+        class PendingQuery : public std::enable_shared_from_this<PendingQuery> {
+        public:
+            PendingQuery(Database& database, net::any_io_executor executor, PGconnPtr conn, ResultCallback callback);
+
+            void Start(CommandType type, std::string_view command, SqlParams params, ResultFormat format);
+
+            ~PendingQuery();
+
+        private:
+
+            void DoFlush();
+
+            void DoRead();
+
+            void OnRead(boost::system::error_code ec);
+
+            void Complete(std::exception_ptr error, PGresultPtr result = nullptr);
+
+        private:
+            Database& m_database;
+            PGconnPtr m_conn;
+            ResultCallback m_callback;
+            net::posix::stream_descriptor m_socket;
+            PGresultPtr m_result;
+        };
+
+        // A connection in pipeline mode shared by many asynchronous queries. Every query is followed
+        // by its own sync point, so a failing query does not abort the ones queued behind it.
+        // All state is touched on the strand only. The connection is held for the lifetime of the database
+        // and does not catch up on new statements, Database::Prepare refuses them after the first query.
+        class Pipeline : public std::enable_shared_from_this<Pipeline> {
+        public:
+            Pipeline(Database& database, net::any_io_executor executor, std::size_t maxQueued);
+
+            // Returns false if the pipeline is full, the caller then runs the query on its own connection
+            bool TrySubmit(CommandType type, std::string_view command, SqlParams params, ResultFormat format,
+                ResultCallback callback);
+
+            // Hands the connection back to the pool, the io_context must not be running any more
+            void Close();
+
+        private:
+            struct Query {
+                CommandType type;
+                std::string command;
+                std::vector<std::pair<std::string, std::string>> params;
+                ResultFormat format;
+                ResultCallback callback;
+                PGresultPtr result{ };
+
+                // All results arrived, the sync point is still to come
+                bool isDone{ false };
+            };
+
+            void Connect();
+
+            void OnConnected(std::exception_ptr error, PGconnPtr conn);
+
+            void DoSend();
+
+            void DoFlush();
+
+            void DoRead();
+
+            void OnRead(boost::system::error_code ec);
+
+            void Complete(Query& query, std::exception_ptr error, PGresultPtr result = nullptr);
+
+            // The connection is lost: the queries sent on it fail, the unsent ones wait for a new one
+            void Fail(std::exception_ptr error);
+
+        private:
+            Database& m_database;
+            net::strand<net::any_io_executor> m_strand;
+            const std::size_t m_maxQueued;
+            std::atomic<std::size_t> m_countQueued{ 0 };
+
+            PGconnPtr m_conn{ };
+            bool m_isConnected{ false };
+            bool m_isConnecting{ false };
+            bool m_isSendScheduled{ false };
+            bool m_isReading{ false };
+            bool m_isWriting{ false };
+            net::posix::stream_descriptor m_socket;
+
+            std::deque<Query> m_unsent{ };
+            std::deque<Query> m_inFlight{ };
         };
+#endif
 
     private:
 
@@ -190,10 +730,21 @@ namespace PostgreSQL {
         std::vector<const char*> GetValuesParams(SqlParams params);
         std::vector<std::string> ReadPostgresResult(PGresultPtr resGuard);
 
+        // Index of the executor running on this thread, or of the next one in turn
+        std::size_t GetExecutorIndex();
+
     private:
 
         ConnectionConfig m_config;
         std::shared_ptr<IPGClient> m_client;
         ConnectionPool m_pool;
+        std::vector<net::any_io_executor> m_executors{ };
+        std::atomic<std::size_t> m_nextExecutor{ 0 };
+
+#if defined(BOOST_ASIO_HAS_POSIX_STREAM_DESCRIPTOR)
+        std::vector<std::shared_ptr<Pipeline>> m_pipelines{ };
+        std::atomic<std::size_t> m_nextPipeline{ 0 };
+        std::atomic<bool> m_isPipelining{ false }; // a query went to a pipeline, no more statements
+#endif
     };
 }
\ No newline at end of file
@@ -85,4 +85,32 @@ namespace PostgreSQL {
 		{
 		}
 	};
+
+
+	class ResultError : public PostgreSQLError {
+	public:
+		ResultError(const std::string& msg)
+			: PostgreSQLError{ msg }
+		{
+		}
+
+		ResultError(const char* msg)
+			: PostgreSQLError{ msg }
+		{
+		}
+	};
+
+
+	class PrepareError : public PostgreSQLError {
+	public:
+		PrepareError(const std::string& msg)
+			: PostgreSQLError{ msg }
+		{
+		}
+
+		PrepareError(const char* msg)
+			: PostgreSQLError{ msg }
+		{
+		}
+	};
 }
\ No newline at end of file
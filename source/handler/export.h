@@ -0,0 +1,337 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <utility>
+
+#include <boost/asio/buffer.hpp>
+#include <boost/asio/post.hpp>
+#include <boost/beast/http.hpp>
+#include <boost/optional.hpp>
+
+#include "IDatabase.h"
+#include "bodyWaiter.h"
+
+
+namespace beast = boost::beast;
+namespace http = beast::http;
+
+
+// Dumps of the whole urls table. PostgreSQL writes them with COPY and they are passed on as they arrive.
+namespace Export {
+    enum class Format { Ndjson, Csv };
+
+    // "ndjson" or "csv"
+    inline std::optional<Format> ParseFormat(std::string_view name) {
+        if (name == "ndjson") {
+            return Format::Ndjson;
+        }
+        if (name == "csv") {
+            return Format::Csv;
+        }
+        return std::nullopt;
+    }
+
+    inline const char* ContentType(Format format) {
+        return format == Format::Csv ? "text/csv" : "application/x-ndjson";
+    }
+
+    // A json document per row, keyed by the column names like the API responses. The csv format with
+    // control characters as delimiter and quote never has to quote a json document, so the
+    // lines come out as PostgreSQL renders them, without the escaping of the text format.
+    inline constexpr const char* SQL_COPY_NDJSON{
+        "COPY (SELECT row_to_json(u) FROM (SELECT id, url, shortcode, createdat, updatedat, accesscount FROM urls) u) "
+        "TO STDOUT WITH (FORMAT csv, DELIMITER E'\\x01', QUOTE E'\\x02');" };
+
+    inline constexpr const char* SQL_COPY_CSV{
+        "COPY urls (id, url, shortcode, createdat, updatedat, accesscount) TO STDOUT WITH (FORMAT csv, HEADER);" };
+
+    inline const char* CopyQuery(Format format) {
+        return format == Format::Csv ? SQL_COPY_CSV : SQL_COPY_NDJSON;
+    }
+
+
+    // Chunks read ahead of a slow client, they bound the memory of one export
+    inline constexpr std::size_t QUEUED_CHUNKS{ 4 };
+
+    // Chunks of a COPY read on another thread, taken by the session writing the response.
+    // Neither side blocks: each one leaves a callback the other side calls once it can go on.
+    class ChunkQueue {
+    public:
+        enum class State { Ready, Waiting, Done, Failed };
+        enum class Room { Free, Full, Gone };
+
+        using Handler = std::function<void()>;
+
+        explicit ChunkQueue(std::size_t maxChunks)
+            : m_maxChunks{ std::max<std::size_t>(maxChunks, 1) }
+        {
+        }
+
+        // Free if a chunk can be pushed, Gone once the response is. Full keeps onRoom,
+        // it is called when the session takes a chunk or the response goes away.
+        Room Reserve(Handler onRoom) {
+            std::lock_guard<std::mutex> lock{ m_mutex };
+            if (m_isCancelled) {
+                return Room::Gone;
+            }
+            if (m_chunks.size() < m_maxChunks) {
+                return Room::Free;
+            }
+
+            m_onRoom = std::move(onRoom);
+            return Room::Full;
+        }
+
+        // After Reserve returned Free, a chunk pushed once the response is gone is dropped
+        void Push(std::string chunk) {
+            Handler onData{ };
+            {
+                std::lock_guard<std::mutex> lock{ m_mutex };
+                if (m_isCancelled) {
+                    return;
+                }
+
+                m_chunks.push_back(std::move(chunk));
+                onData = std::exchange(m_onData, nullptr);
+            }
+            Call(onData);
+        }
+
+        // The copy is over, with the error it failed with
+        void Finish(std::exception_ptr error = nullptr) {
+            Handler onData{ };
+            {
+                std::lock_guard<std::mutex> lock{ m_mutex };
+                m_isFinished = true;
+                m_error = error;
+                onData = std::exchange(m_onData, nullptr);
+            }
+            Call(onData);
+        }
+
+        // The chunks queued before a failure are taken first
+        State Pop(std::string& chunk) {
+            Handler onRoom{ };
+            {
+                std::lock_guard<std::mutex> lock{ m_mutex };
+                if (m_chunks.empty()) {
+                    if (!m_isFinished) {
+                        return State::Waiting;
+                    }
+                    return m_error ? State::Failed : State::Done;
+                }
+
+                chunk = std::move(m_chunks.front());
+                m_chunks.pop_front();
+                onRoom = std::exchange(m_onRoom, nullptr);
+            }
+            Call(onRoom);
+            return State::Ready;
+        }
+
+        // Calls onData once a chunk is pushed or the copy is over, at once if that happened already
+        void WaitForData(Handler onData) {
+            {
+                std::lock_guard<std::mutex> lock{ m_mutex };
+                if (m_chunks.empty() && !m_isFinished && !m_isCancelled) {
+                    m_onData = std::move(onData);
+                    return;
+                }
+            }
+            Call(onData);
+        }
+
+        // The copy waiting for room runs on to see the response is gone
+        void Cancel() {
+            Handler onRoom{ };
+            {
+                std::lock_guard<std::mutex> lock{ m_mutex };
+                m_isCancelled = true;
+                m_chunks.clear();
+                m_onData = nullptr;
+                onRoom = std::exchange(m_onRoom, nullptr);
+            }
+            Call(onRoom);
+        }
+
+    private:
+        static void Call(const Handler& handler) {
+            if (handler) {
+                handler();
+            }
+        }
+
+        const std::size_t m_maxChunks;
+        std::mutex m_mutex{ };
+        std::deque<std::string> m_chunks{ };
+        std::exception_ptr m_error{ };
+        bool m_isFinished{ false };
+        bool m_isCancelled{ false };
+        Handler m_onRoom{ };
+        Handler m_onData{ };
+    };
+
+    // The session end of a ChunkQueue, stops the copy if the response goes away before its end
+    class QueueReader {
+    public:
+        explicit QueueReader(std::shared_ptr<ChunkQueue> queue)
+            : m_queue{ std::move(queue) }
+        {
+        }
+
+        QueueReader(QueueReader&& other) noexcept = default;
+
+        QueueReader& operator=(QueueReader&& other) noexcept {
+            if (this != &other) {
+                Cancel();
+                m_queue = std::move(other.m_queue);
+            }
+            return *this;
+        }
+
+        ~QueueReader() {
+            Cancel();
+        }
+
+        ChunkQueue::State Pop(std::string& chunk) {
+            return m_queue -> Pop(chunk);
+        }
+
+        void WaitForData(ChunkQueue::Handler onData) {
+            m_queue -> WaitForData(std::move(onData));
+        }
+
+    private:
+        void Cancel() {
+            if (m_queue) {
+                m_queue -> Cancel();
+            }
+        }
+
+        std::shared_ptr<ChunkQueue> m_queue;
+    };
+
+    // Reads the copy into the queue until it is over or the response is gone. A full queue ends the turn
+    // and the next one is posted to executor once the session takes a chunk, so a slow client holds no thread.
+    template <class Executor>
+    void Pump(std::shared_ptr<ICopyOutStream> stream, std::shared_ptr<ChunkQueue> queue, std::size_t chunkSize,
+        Executor executor) {
+        try {
+            const auto onRoom{ [=]() {
+                boost::asio::post(executor, [=]() { Pump(stream, queue, chunkSize, executor); });
+            } };
+
+            for (;;) {
+                switch (queue -> Reserve(onRoom)) {
+                case ChunkQueue::Room::Free:
+                    break;
+                case ChunkQueue::Room::Full:
+                case ChunkQueue::Room::Gone:
+                    return;
+                }
+
+                std::string chunk{ };
+                const bool isMore{ stream -> Read(chunk, chunkSize) };
+                if (!chunk.empty()) {
+                    queue -> Push(std::move(chunk));
+                }
+                if (!isMore) {
+                    break;
+                }
+            }
+            queue -> Finish();
+        }
+        catch (...) {
+            queue -> Finish(std::current_exception());
+        }
+    }
+
+
+    // Response body pulling the rows of a COPY while the response is serialized. Every read
+    // becomes a chunk of a chunked response, so one chunk at a time is held in memory.
+    // The rows of a stream are read on the thread writing the response. With a reader they
+    // are read on another thread, and get() answers http::error::need_buffer until the next
+    // chunk is there. The waker of the session (bodyWaiter.h) is called once it is.
+    struct CopyBody {
+        struct value_type {
+            IDatabase::CopyOutPtr stream{ };
+            std::optional<QueueReader> reader{ };
+            std::size_t chunkSize{ 64 * 1024 };
+        };
+
+        class writer {
+        public:
+            using const_buffers_type = boost::asio::const_buffer;
+
+            template <bool isRequest, class Fields>
+            writer(const http::header<isRequest, Fields>&, value_type& body)
+                : m_body{ body }
+            {
+            }
+
+            void init(beast::error_code& ec) {
+                ec = { };
+            }
+
+            // A failing copy fails the write, the client sees the chunked body end without its last chunk
+            boost::optional<std::pair<const_buffers_type, bool>> get(beast::error_code& ec) {
+                ec = { };
+                if (m_body.reader) {
+                    return Pop(ec);
+                }
+
+                if (m_isDone || !m_body.stream) {
+                    return boost::none;
+                }
+
+                m_chunk.clear();
+                try {
+                    m_isDone = !m_body.stream -> Read(m_chunk, m_body.chunkSize);
+                }
+                catch (const std::exception&) {
+                    ec = boost::system::errc::make_error_code(boost::system::errc::io_error);
+                    return boost::none;
+                }
+
+                if (m_chunk.empty()) {
+                    return boost::none;
+                }
+
+                return std::make_pair(const_buffers_type{ m_chunk.data(), m_chunk.size() }, !m_isDone);
+            }
+
+        private:
+            boost::optional<std::pair<const_buffers_type, bool>> Pop(beast::error_code& ec) {
+                switch (m_body.reader -> Pop(m_chunk)) {
+                case ChunkQueue::State::Ready:
+                    return std::make_pair(const_buffers_type{ m_chunk.data(), m_chunk.size() }, true);
+                case ChunkQueue::State::Waiting:
+                    if (BodyWaiter* waiter{ BodyWaiter::Current() }) {
+                        m_body.reader -> WaitForData(waiter -> MakeWaker());
+                    }
+                    ec = http::error::need_buffer;
+                    return boost::none;
+                case ChunkQueue::State::Failed:
+                    ec = boost::system::errc::make_error_code(boost::system::errc::io_error);
+                    return boost::none;
+                case ChunkQueue::State::Done:
+                    break;
+                }
+                return boost::none;
+            }
+
+            value_type& m_body;
+            std::string m_chunk{ };
+            bool m_isDone{ false };
+        };
+    };
+}
@@ -1,37 +1,226 @@
 #pragma once 
 
 
-#include "format"
+#include <optional>
+#include <unordered_map>
+#include <vector>
 #include "postgresql.h"
+#include "postgresqlRepository.h"
 #include "url.h"
-#include "random.h"
+#include "urlJson.h"
+#include "shortcode.h"
+#include "cache.h"
+#include "counter.h"
+#include "router.h"
+#include "arena.h"
+#include "export.h"
+#include "importer.h"
+#include "snapshot.h"
 #include <nlohmann/json.hpp>
 #include "spdlog/spdlog.h"
+#include "spdlog/fmt/fmt.h"
 #include "spdlog/async.h" 
 #include "spdlog/sinks/basic_file_sink.h"
 #include <boost/beast/http.hpp>
+#include <boost/asio/async_result.hpp>
+#include <boost/asio/awaitable.hpp>
+#include <boost/asio/dispatch.hpp>
+#include <boost/asio/post.hpp>
+#include <boost/asio/thread_pool.hpp>
+#include <boost/asio/use_awaitable.hpp>
 
 
 using json = nlohmann::json;
 namespace beast = boost::beast;      
 namespace http = beast::http; 
+namespace net = boost::asio;
 using LoggerPtr = std::shared_ptr<spdlog::logger>;
+using UrlCache = Cache::ShardedLruCache<Url>; // short code -> row served by GET /shorten/{code}
+
+struct RedirectConfig {
+    // 301, 302, 307 or 308. Browsers cache permanent redirects, their repeat visits are not counted.
+    http::status status{ http::status::found };
+
+    // Cache-Control of the redirect, not sent when empty
+    std::string cacheControl{ };
+};
+
+struct BatchConfig {
+    // Larger batches are rejected with 400
+    std::size_t maxUrls{ 100'000 };
+
+    // Unique urls written per statement
+    std::size_t rowsPerStatement{ 1000 };
+
+    // Codes of a batch resolve, the misses are selected in one statement
+    std::size_t maxCodes{ 1000 };
+};
+
+struct HandlerConfig {
+    // Responses are compact JSON unless set
+    bool prettyPrint{ false };
+
+    // GET /{code}
+    RedirectConfig redirect{ };
+
+    // POST /shorten/batch and /resolve/batch
+    BatchConfig batch{ };
+
+    // GET /admin/export, bytes of rows per chunk of the response
+    std::size_t exportChunkSize{ 64 * 1024 };
+
+    // POST /admin/import, bytes of rows per write to the COPY
+    std::size_t importChunkSize{ 64 * 1024 };
+
+    // POST /admin/import, rejected rows listed in the response. The others are only counted.
+    std::size_t importMaxRejects{ 1000 };
+
+    // Threads running the exports and imports of HandleAsync, so their COPY does not hold an io thread.
+    // An export reads on while the client takes its rows, it gives the thread back whenever it waits for one.
+    std::size_t adminThreads{ 1 };
+
+    // /admin/export and /admin/import answer 403 unless the request has "Authorization: Bearer <adminToken>".
+    // Empty turns the admin endpoints off.
+    std::string adminToken{ };
+};
 
 template <class Body, class Allocator = http::basic_fields<std::allocator<char>>>
 class HttpHandler {
 public:
 
+    // Without a cache every lookup goes to the storage. Export and import need PostgreSQL::UrlRepository,
+    // with other storage they answer 404. Throws std::invalid_argument if the repository is null,
+    // the redirect status is not a redirect, a batch limit, a chunk size or the admin threads are zero.
+    HttpHandler(std::shared_ptr<IUrlRepository> repository,
+        std::string loggerName,
+        std::shared_ptr<UrlCache> cache = nullptr,
+        HandlerConfig config = { });
+
+    // The urls table of the database, see PostgreSQL::UrlRepository. Without a counter accesses are not counted.
     HttpHandler(std::unique_ptr<IDatabase> database,
         std::string loggerName,
-        const Random::StringGenerator& generator);
+        std::shared_ptr<ShortCode::Allocator> codes,
+        std::shared_ptr<UrlCache> cache = nullptr,
+        std::shared_ptr<Counter::AccessCounter> counter = nullptr,
+        HandlerConfig config = { });
+
+    // Read-only replica: GET /{code}, GET /shorten/{code} and /resolve/batch are answered from the snapshot,
+    // every other endpoint with 405. Accesses are not counted. Throws std::invalid_argument as above
+    // or if the snapshot is null.
+    HttpHandler(std::shared_ptr<Snapshot::Store> snapshot,
+        std::string loggerName,
+        HandlerConfig config = { });
 
     http::message_generator operator()(http::request<Body, Allocator>&& req);
 
+    // Coroutine variant of operator(): database waits suspend the coroutine instead of blocking the thread.
+    // Exports and imports run on the admin threads. The request is taken by value, it has to outlive the suspension points.
+    net::awaitable<http::message_generator> HandleAsync(http::request<Body, Allocator> req);
+
 private:
 
+    enum class Endpoint { CreateUrl, CreateUrls, ResolveUrls, CacheStats, Export, Import, FindUrl, UrlStats, UpdateUrl, DeleteUrl, Redirect };
+
+    static constexpr Routing::Router ROUTER{ std::array{
+        Routing::Route<Endpoint>{ http::verb::post, "/shorten", Endpoint::CreateUrl },
+        Routing::Route<Endpoint>{ http::verb::post, "/shorten/batch", Endpoint::CreateUrls },
+        Routing::Route<Endpoint>{ http::verb::post, "/resolve/batch", Endpoint::ResolveUrls },
+        Routing::Route<Endpoint>{ http::verb::get, "/resolve/batch", Endpoint::ResolveUrls },
+        Routing::Route<Endpoint>{ http::verb::get, "/admin/cache", Endpoint::CacheStats },
+        Routing::Route<Endpoint>{ http::verb::get, "/admin/export", Endpoint::Export },
+        Routing::Route<Endpoint>{ http::verb::post, "/admin/import", Endpoint::Import },
+        Routing::Route<Endpoint>{ http::verb::get, "/shorten/{}", Endpoint::FindUrl },
+        Routing::Route<Endpoint>{ http::verb::get, "/shorten/{}/stats", Endpoint::UrlStats },
+        Routing::Route<Endpoint>{ http::verb::put, "/shorten/{}", Endpoint::UpdateUrl },
+        Routing::Route<Endpoint>{ http::verb::delete_, "/shorten/{}", Endpoint::DeleteUrl },
+        Routing::Route<Endpoint>{ http::verb::get, "/{}", Endpoint::Redirect } } };
+
+    static Routing::Match<Endpoint> Route(const http::request<Body, Allocator>& req) {
+        return ROUTER.Find(req.method(), std::string_view{ req.target().data(), req.target().size() });
+    }
+
+    // Urls of POST /shorten/batch or codes of /resolve/batch, every distinct value once
+    struct Batch {
+        std::vector<std::string> unique{ };
+        std::vector<std::size_t> positions{ }; // index into unique for every input value
+        bool isNdjson{ false };
+
+        void Add(std::string value, std::unordered_map<std::string, std::size_t>& indexes) {
+            auto [it, isNew]{ indexes.try_emplace(std::move(value), unique.size()) };
+            if (isNew) {
+                unique.push_back(it -> first);
+            }
+            positions.push_back(it -> second);
+        }
+    };
+
+    // A json array, or one json value per line. Values are strings or objects with the string under key.
+    // Throws the json exceptions of the single create.
+    static Batch ParseBatch(std::string_view body, const char* key);
+
+    // The code parameters of GET /resolve/batch?code=...&code=...
+    static Batch ParseCodeQuery(std::string_view target);
+
+    // Calls func with the value of every non-empty name=value parameter of the query string
+    template <class Func>
+    static void ForEachQueryParam(std::string_view target, std::string_view name, Func&& func) {
+        std::size_t query{ target.find('?') };
+        target.remove_prefix(query == std::string_view::npos ? target.size() : query + 1);
+        while (!target.empty()) {
+            std::size_t end{ target.find('&') };
+            std::string_view param{ target.substr(0, end) };
+            target.remove_prefix(end == std::string_view::npos ? target.size() : end + 1);
+
+            if (param.size() > name.size() + 1 && param.starts_with(name) && param[name.size()] == '=') {
+                func(param.substr(name.size() + 1));
+            }
+        }
+    }
+
+    // Writes the urls in input order: a json array, or a line per url for NDJSON. Missing urls are null.
+    http::message_generator CreateBatchResponse(
+        http::request<Body, Allocator>&& req, const Batch& batch, const std::vector<std::optional<Url>>& urls);
+
+    // Stores the rows returned for unique urls [first, last) at their index
+    static void StoreBatchRows(const Batch& batch, std::size_t first, std::size_t last,
+        std::vector<Url>&& rows, std::vector<std::optional<Url>>& urls);
+
+    // Json bodies share the arena of the request fields when the session has one
+    using StringBody = std::conditional_t<UsesArena<Allocator>, ArenaStringBody, http::string_body>;
+
+    template <class ResponseBody>
+    static http::response<ResponseBody, Allocator> CreateResponse(
+        const http::request<Body, Allocator>& req, http::status status) {
+
+        std::pmr::memory_resource* arena{ std::pmr::get_default_resource() };
+        if constexpr (UsesArena<Allocator>) {
+            arena = req.get_allocator().resource();
+        }
+
+        auto res{ std::make_from_tuple<http::response<ResponseBody, Allocator>>(
+            ArenaMessageArgs<ResponseBody, Allocator>(arena)) };
+        res.result(status);
+        res.version(req.version());
+        res.keep_alive(req.keep_alive());
+
+        return res;
+    }
+
+    // Maps an exception thrown while processing a request to the error response
+    http::message_generator GenerateError(
+        http::request<Body, Allocator>&& req, std::exception_ptr error, std::string_view endpoint);
+
     http::message_generator CreateStandardResponse(
         http::request<Body, Allocator>&& req, http::status status, json&& body);
 
+    // The url is encoded straight into the response body
+    http::message_generator CreateStandardResponse(
+        http::request<Body, Allocator>&& req, http::status status, const Url& url, bool withAccessCount = false);
+
+    // Location header and an empty body, no JSON
+    http::message_generator CreateRedirectResponse(
+        http::request<Body, Allocator>&& req, const Url& url);
+
     http::message_generator CreateStandardResponse(
         http::request<Body, Allocator>&& req, http::status status);
 
@@ -46,53 +235,106 @@ private:
     // 405 Method Not Allowed
     http::message_generator GenerateMethodNotAllowed(
         http::request<Body, Allocator>&& req);
+
+    // 403 Forbidden
+    http::message_generator GenerateForbidden(
+        http::request<Body, Allocator>&& req);
+
+    // The request carries HandlerConfig::adminToken as its bearer token
+    bool IsAdmin(const http::request<Body, Allocator>& req) const;
   
-    std::string QuerySelectByShortCode(std::string_view shortCode);
+    // Serves the lookup from the cache, on a miss reads the storage and fills the cache
+    // unless the code was invalidated during the read
+    std::optional<Url> ResolveShortCode(std::string_view shortCode);
+
+    // Takes the cached codes of the batch, returns the others. versions gets the cache version of every code.
+    std::vector<std::string> ResolveCachedCodes(const Batch& batch, std::vector<std::optional<Url>>& urls,
+        std::vector<std::uint64_t>& versions);
+
+    // Stores the selected rows at the index of their code, fills the cache and counts the accesses.
+    // A row is cached only if its code was not invalidated since versions was taken.
+    void StoreResolvedRows(const Batch& batch, std::vector<Url>&& rows, std::vector<std::optional<Url>>& urls,
+        const std::vector<std::uint64_t>& versions);
+
+    // Codes of POST (json body) or GET (query) /resolve/batch
+    static Batch ReadCodeBatch(const http::request<Body, Allocator>& req) {
+        if (req.method() == http::verb::get) {
+            return ParseCodeQuery(std::string_view{ req.target().data(), req.target().size() });
+        }
+
+        return ParseBatch(std::string_view{ req.body().data(), req.body().size() }, "code");
+    }
+
+    void RecordAccess(std::string_view shortCode) {
+        m_repository -> RecordAccess(shortCode);
+    }
+
+    // Stats are read before their own access is recorded, the response counts it
+    static Url AddOwnAccess(const Url& stats) {
+        return Url{ stats.GetId(), stats.GetUri(), stats.GetShortCode(), stats.GetCreatedAt(), stats.GetUpdatedAt(),
+            stats.GetAccessCount() + 1 };
+    }
+
+    void InvalidateShortCode(std::string_view shortCode) {
+        if (m_cache) {
+            m_cache -> Erase(shortCode);
+        }
+    }
+
+    // Checks the config and opens the log, shared by the constructors
+    void Configure(const std::string& loggerName);
+
+    // Lookups of a read-only replica, they read the mapped snapshot and never block
+    http::message_generator HandleReadOnly(http::request<Body, Allocator>&& req, const Routing::Match<Endpoint>& route);
+
+    // Handle GET /admin/cache (hit/miss counters of the lookup cache)
+    http::message_generator GetCacheStats(http::request<Body, Allocator>&& req);
+
+    // Handle GET /admin/export?format=ndjson|csv (every url, streamed from a COPY as the response is written).
+    // Called on an admin thread with isQueued, the rows are then read there and queued for the session.
+    http::message_generator ExportUrls(http::request<Body, Allocator>&& req, bool isQueued = false);
+
+    // Handle POST /admin/import?format=ndjson|csv (urls with their codes, copied in with COPY FROM STDIN)
+    http::message_generator ImportUrls(http::request<Body, Allocator>&& req);
+
+    // Runs the blocking func() on the admin threads, the coroutine resumes on its own executor with the response
+    template <typename Func>
+    net::awaitable<http::message_generator> RunOnAdminThreads(Func func);
 
     // Handle POST /shorten (create a new url shorten)
     http::message_generator CreateShortenUrl(
         http::request<Body, Allocator>&& req);
 
-    http::message_generator HandlerMethodPost(http::request<Body, Allocator>&& req);
+    // Handle POST /shorten/batch (create the urls with one statement per BatchConfig::rowsPerStatement)
+    http::message_generator CreateShortenUrlBatch(
+        http::request<Body, Allocator>&& req);
+
+    // Handle POST and GET /resolve/batch (cache hits in process, the misses in one SELECT)
+    http::message_generator ResolveUrlBatch(
+        http::request<Body, Allocator>&& req);
 
     // Handle GET starts with /shorten/..
     http::message_generator FindUrlByShortCode(
         http::request<Body, Allocator>&& req, std::string_view shortCode);
 
-    std::string QueryFullStatsByShortCode(std::string_view shortCode);
+    // Handle GET /{code} (redirect to the url)
+    http::message_generator RedirectByShortCode(
+        http::request<Body, Allocator>&& req, std::string_view shortCode);
 
     // Handle GET starts with /shorten/../stats
     http::message_generator GetFullStatsByShortCode(
         http::request<Body, Allocator>&& req, std::string_view shortCode);
 
-    http::message_generator HandlerMethodGet(http::request<Body, Allocator>&& req);
-
-    std::string QueryUpdateUrlByShortCode(std::string_view url, std::string_view shortCode);
-
     // Handle PUT starts with /shorten/..
     http::message_generator UpdateByShortCode(
         http::request<Body, Allocator>&& req, std::string_view shortCode);
 
-    http::message_generator HandlerMethodPut(http::request<Body, Allocator>&& req);
-
-    bool QueryDeleteByShortCode(std::string_view shortCode) {
-        return m_database -> Query<bool>(
-            "DELETE FROM urls AS u WHERE u.shortcode = $1 RETURNING to_json(u.*);",
-            IDatabase::SqlParams{ { "$1", shortCode.data() } },
-            [](std::vector<std::string>&& data) -> bool {
-                if (data.empty()) {
-                    return false;
-                }
-
-                return true;
-            });
-    }
-
     // Handle DELETE starts with /shorten/...
     http::message_generator DeleteByShortCode(
         http::request<Body, Allocator>&& req, std::string_view shortCode) {
         try {
-            bool isDeleted = QueryDeleteByShortCode(shortCode);
+            bool isDeleted = m_repository -> Delete(shortCode);
+            InvalidateShortCode(shortCode);
 
             if (!isDeleted) {
                 return GenerateNotFound(std::move(req), "The short URL was not found.");
@@ -112,71 +354,325 @@ private:
         }
     }
 
-    http::message_generator HandlerMethodDelete(http::request<Body, Allocator>&& req) {
-        std::string target{ req.target() };
+    // Coroutine pipeline, mirrors the synchronous handlers above
 
-        const std::string pattern{ "/shorten/" };
-        if (target.starts_with(pattern)) {
-            std::string shortCode = target.substr(pattern.size());
-            return DeleteByShortCode(std::move(req), shortCode);
-        }
-        else {
-            return GenerateNotFound(std::move(req), "Endpoint was not found.");
-        }
-    }
+    net::awaitable<http::message_generator> CreateShortenUrlAsync(http::request<Body, Allocator> req);
+
+    net::awaitable<http::message_generator> CreateShortenUrlBatchAsync(http::request<Body, Allocator> req);
+
+    net::awaitable<http::message_generator> ResolveUrlBatchAsync(http::request<Body, Allocator> req);
+
+    // Coroutine counterpart of ResolveShortCode
+    net::awaitable<std::optional<Url>> ResolveShortCodeAsync(std::string shortCode);
+
+    net::awaitable<http::message_generator> FindUrlByShortCodeAsync(
+        http::request<Body, Allocator> req, std::string shortCode);
+
+    net::awaitable<http::message_generator> RedirectByShortCodeAsync(
+        http::request<Body, Allocator> req, std::string shortCode);
 
+    net::awaitable<http::message_generator> GetFullStatsByShortCodeAsync(
+        http::request<Body, Allocator> req, std::string shortCode);
+
+    net::awaitable<http::message_generator> UpdateByShortCodeAsync(
+        http::request<Body, Allocator> req, std::string shortCode);
+
+    net::awaitable<http::message_generator> DeleteByShortCodeAsync(
+        http::request<Body, Allocator> req, std::string shortCode);
 
 private:
-    std::unique_ptr<IDatabase> m_database;
+    std::shared_ptr<IUrlRepository> m_repository{ };
+    std::shared_ptr<PostgreSQL::UrlRepository> m_postgres{ }; // the repository if it is one, for export and import
     LoggerPtr m_logger;
-    Random::StringGenerator m_generator;
+    std::shared_ptr<UrlCache> m_cache;
+    std::shared_ptr<Snapshot::Store> m_snapshot{ };
+    HandlerConfig m_config{ };
+
+    // Only with PostgreSQL storage. Declared last, its threads are joined before the members they use go.
+    std::unique_ptr<net::thread_pool> m_adminThreads{ };
 };
 
 
 // public interface 
+template <class Body, class Allocator>
+HttpHandler<Body, Allocator>::HttpHandler(std::shared_ptr<IUrlRepository> repository,
+    std::string loggerName,
+    std::shared_ptr<UrlCache> cache,
+    HandlerConfig config)
+    : m_repository{ std::move(repository) }
+    , m_postgres{ std::dynamic_pointer_cast<PostgreSQL::UrlRepository>(m_repository) }
+    , m_cache{ std::move(cache) }
+    , m_config{ std::move(config) }
+{
+    if (!m_repository) {
+        throw std::invalid_argument("The repository cannot be null.");
+    }
+
+    Configure(loggerName);
+}
+
 template <class Body, class Allocator>
 HttpHandler<Body, Allocator>::HttpHandler(std::unique_ptr<IDatabase> database,
     std::string loggerName,
-    const Random::StringGenerator& generator)
-    : m_database{ std::move(database) }
-    , m_generator{ generator }
+    std::shared_ptr<ShortCode::Allocator> codes,
+    std::shared_ptr<UrlCache> cache,
+    std::shared_ptr<Counter::AccessCounter> counter,
+    HandlerConfig config)
+    : HttpHandler(std::make_shared<PostgreSQL::UrlRepository>(std::move(database), std::move(codes), std::move(counter)),
+        std::move(loggerName), std::move(cache), std::move(config))
+{
+}
+
+template <class Body, class Allocator>
+HttpHandler<Body, Allocator>::HttpHandler(std::shared_ptr<Snapshot::Store> snapshot,
+    std::string loggerName,
+    HandlerConfig config)
+    : m_snapshot{ std::move(snapshot) }
+    , m_config{ std::move(config) }
 {
-    std::string dir = std::format("logs/{}.txt", loggerName);
+    if (!m_snapshot) {
+        throw std::invalid_argument("The snapshot cannot be null.");
+    }
+
+    Configure(loggerName);
+}
+
+template <class Body, class Allocator>
+void HttpHandler<Body, Allocator>::Configure(const std::string& loggerName) {
+    http::status redirect{ m_config.redirect.status };
+    if (redirect != http::status::moved_permanently && redirect != http::status::found
+        && redirect != http::status::temporary_redirect && redirect != http::status::permanent_redirect) {
+        throw std::invalid_argument("The redirect status must be 301, 302, 307 or 308.");
+    }
+
+    if (m_config.batch.maxUrls == 0 || m_config.batch.rowsPerStatement == 0 || m_config.batch.maxCodes == 0) {
+        throw std::invalid_argument("The batch limits cannot be zero.");
+    }
+
+    if (m_config.exportChunkSize == 0 || m_config.importChunkSize == 0) {
+        throw std::invalid_argument("The export and import chunk sizes cannot be zero.");
+    }
+
+    if (m_config.adminThreads == 0) {
+        throw std::invalid_argument("The admin threads cannot be zero.");
+    }
+
+    if (m_postgres) {
+        m_adminThreads = std::make_unique<net::thread_pool>(m_config.adminThreads);
+    }
+
+    std::string dir = fmt::format("logs/{}.txt", loggerName);
     m_logger = spdlog::get(dir);
     if (!m_logger) {
         m_logger = spdlog::basic_logger_mt<spdlog::async_factory>(loggerName.c_str(), dir.c_str());
     }
 }
 
+// The short code is a view into the target, req stays alive until the response is built
 template <class Body, class Allocator>
 http::message_generator HttpHandler<Body, Allocator>::operator()(http::request<Body, Allocator>&& req) {
-    http::verb method{ req.method() };
-    if (method == http::verb::post) {
-        return HandlerMethodPost(std::move(req));
+    Routing::Match<Endpoint> route{ Route(req) };
+    if (route.status == Routing::Status::MethodNotAllowed) {
+        return GenerateMethodNotAllowed(std::move(req));
     }
-    else if (method == http::verb::get) {
-        return HandlerMethodGet(std::move(req));
+    else if (route.status == Routing::Status::NotFound) {
+        return GenerateNotFound(std::move(req), "Endpoint was not found.");
     }
-    else if (method == http::verb::put) {
-        return HandlerMethodPut(std::move(req));
+
+    if (m_snapshot) {
+        return HandleReadOnly(std::move(req), route);
     }
-    else if (method == http::verb::delete_) {
-        return HandlerMethodDelete(std::move(req));
+
+    switch (route.endpoint) {
+    case Endpoint::CreateUrl:
+        return CreateShortenUrl(std::move(req));
+    case Endpoint::CreateUrls:
+        return CreateShortenUrlBatch(std::move(req));
+    case Endpoint::ResolveUrls:
+        return ResolveUrlBatch(std::move(req));
+    case Endpoint::CacheStats:
+        return GetCacheStats(std::move(req));
+    case Endpoint::Export:
+        return ExportUrls(std::move(req));
+    case Endpoint::Import:
+        return ImportUrls(std::move(req));
+    case Endpoint::FindUrl:
+        return FindUrlByShortCode(std::move(req), route.param);
+    case Endpoint::UrlStats:
+        return GetFullStatsByShortCode(std::move(req), route.param);
+    case Endpoint::UpdateUrl:
+        return UpdateByShortCode(std::move(req), route.param);
+    case Endpoint::DeleteUrl:
+        return DeleteByShortCode(std::move(req), route.param);
+    case Endpoint::Redirect:
+        return RedirectByShortCode(std::move(req), route.param);
     }
-    else {
-        return GenerateMethodNotAllowed(std::move(req));
+
+    return GenerateNotFound(std::move(req), "Endpoint was not found.");
+}
+
+template <class Body, class Allocator>
+net::awaitable<http::message_generator> HttpHandler<Body, Allocator>::HandleAsync(http::request<Body, Allocator> req) {
+    Routing::Match<Endpoint> route{ Route(req) };
+    if (route.status == Routing::Status::MethodNotAllowed) {
+        co_return GenerateMethodNotAllowed(std::move(req));
     }
+    else if (route.status == Routing::Status::NotFound) {
+        co_return GenerateNotFound(std::move(req), "Endpoint was not found.");
+    }
+
+    if (m_snapshot) {
+        co_return HandleReadOnly(std::move(req), route);
+    }
+
+    // The coroutines own a copy of the short code (it fits the small string buffer),
+    // taken before req is moved
+    std::string shortCode{ route.param };
+    switch (route.endpoint) {
+    case Endpoint::CreateUrl:
+        co_return co_await CreateShortenUrlAsync(std::move(req));
+    case Endpoint::CreateUrls:
+        co_return co_await CreateShortenUrlBatchAsync(std::move(req));
+    case Endpoint::ResolveUrls:
+        co_return co_await ResolveUrlBatchAsync(std::move(req));
+    case Endpoint::CacheStats:
+        co_return GetCacheStats(std::move(req));
+    case Endpoint::Export:
+        if (!IsAdmin(req)) {
+            co_return GenerateForbidden(std::move(req));
+        }
+        co_return co_await RunOnAdminThreads([this, req = std::move(req)]() mutable { return ExportUrls(std::move(req), true); });
+    case Endpoint::Import:
+        if (!IsAdmin(req)) {
+            co_return GenerateForbidden(std::move(req));
+        }
+        co_return co_await RunOnAdminThreads([this, req = std::move(req)]() mutable { return ImportUrls(std::move(req)); });
+    case Endpoint::FindUrl:
+        co_return co_await FindUrlByShortCodeAsync(std::move(req), std::move(shortCode));
+    case Endpoint::UrlStats:
+        co_return co_await GetFullStatsByShortCodeAsync(std::move(req), std::move(shortCode));
+    case Endpoint::UpdateUrl:
+        co_return co_await UpdateByShortCodeAsync(std::move(req), std::move(shortCode));
+    case Endpoint::DeleteUrl:
+        co_return co_await DeleteByShortCodeAsync(std::move(req), std::move(shortCode));
+    case Endpoint::Redirect:
+        co_return co_await RedirectByShortCodeAsync(std::move(req), std::move(shortCode));
+    }
+
+    co_return GenerateNotFound(std::move(req), "Endpoint was not found.");
 }
 
 // private logic
+template <class Body, class Allocator>
+http::message_generator HttpHandler<Body, Allocator>::HandleReadOnly(
+    http::request<Body, Allocator>&& req, const Routing::Match<Endpoint>& route) {
+    try {
+        switch (route.endpoint) {
+        case Endpoint::FindUrl:
+        case Endpoint::Redirect: {
+            std::optional<Url> url{ m_snapshot -> Find(route.param) };
+            if (!url) {
+                return GenerateNotFound(std::move(req), "The short URL was not found.");
+            }
+
+            if (route.endpoint == Endpoint::Redirect) {
+                return CreateRedirectResponse(std::move(req), *url);
+            }
+            return CreateStandardResponse(std::move(req), http::status::ok, *url);
+        }
+        case Endpoint::ResolveUrls: {
+            Batch batch{ ReadCodeBatch(req) };
+            if (batch.positions.empty()) {
+                return GenerateBadRequest(std::move(req), "The batch is empty.");
+            }
+            if (batch.positions.size() > m_config.batch.maxCodes) {
+                return GenerateBadRequest(std::move(req), fmt::format("The batch has more than {} codes.", m_config.batch.maxCodes));
+            }
+
+            // One snapshot for the whole batch, a reload in between does not mix two of them
+            auto snapshot{ m_snapshot -> Current() };
+            std::vector<std::optional<Url>> urls(batch.unique.size());
+            for (std::size_t i{ 0 }; i < batch.unique.size(); ++i) {
+                urls[i] = snapshot -> Find(batch.unique[i]);
+            }
+
+            return CreateBatchResponse(std::move(req), batch, urls);
+        }
+        default: {
+            json body;
+            body["error"] = "This instance is a read-only replica.";
+            return CreateStandardResponse(std::move(req), http::status::method_not_allowed, std::move(body));
+        }
+        }
+    }
+    catch (...) {
+        return GenerateError(std::move(req), std::current_exception(), "read-only lookup");
+    }
+}
+
+template <class Body, class Allocator>
+http::message_generator HttpHandler<Body, Allocator>::GenerateError(
+    http::request<Body, Allocator>&& req, std::exception_ptr error, std::string_view endpoint) {
+    try {
+        std::rethrow_exception(error);
+    }
+    catch (const PostgreSQL::PostgreSQLError& e) {
+        m_logger->error("Exception: To process Database: {}", e.what());
+        return GenerateBadRequest(std::move(req), "Failed to process Database.");
+    }
+    catch (const json::parse_error& e) {
+        m_logger->error("Exception: JSON parsing error: {}", e.what());
+        return GenerateBadRequest(std::move(req), "Make sure that the request body has the correct JSON format.");
+    }
+    catch (const json::type_error& e) {
+        m_logger->error("Exception: Data type error: {}", e.what());
+        return GenerateBadRequest(std::move(req), "Check that the value of the 'url' key is a string.");
+    }
+    catch (const std::exception& e) {
+        m_logger->error("Exception: during {} request processing: {}", endpoint, e.what());
+        return GenerateBadRequest(std::move(req), "Failed to process request.");
+    }    catch (...) {
+        m_logger->error("Exception: during {} request processing: unknown exception", endpoint);
+        return GenerateBadRequest(std::move(req), "Failed to process request.");
+    }
+}
+
 template <class Body, class Allocator>
 http::message_generator HttpHandler<Body, Allocator>::CreateStandardResponse(
     http::request<Body, Allocator>&& req, http::status status, json&& body) {
 
-    http::response<http::string_body> res{ status, req.version() };
+    auto res{ CreateResponse<StringBody>(req, status) };
+    res.set(http::field::content_type, "application/json");
+    res.body() = body.dump(m_config.prettyPrint ? 4 : -1);
+    res.prepare_payload();
+
+    return res;
+}
+
+template <class Body, class Allocator>
+http::message_generator HttpHandler<Body, Allocator>::CreateStandardResponse(
+    http::request<Body, Allocator>&& req, http::status status, const Url& url, bool withAccessCount) {
+
+    auto res{ CreateResponse<StringBody>(req, status) };
     res.set(http::field::content_type, "application/json");
-    res.keep_alive(req.keep_alive());
-    res.body() = body.dump(4);
+
+    UrlJson::Format format{ withAccessCount, m_config.prettyPrint };
+    res.body().resize(UrlJson::Size(url, format));
+    UrlJson::Write(url, format, res.body().data());
+    res.prepare_payload();
+
+    return res;
+}
+
+template <class Body, class Allocator>
+http::message_generator HttpHandler<Body, Allocator>::CreateRedirectResponse(
+    http::request<Body, Allocator>&& req, const Url& url) {
+
+    auto res{ CreateResponse<http::empty_body>(req, m_config.redirect.status) };
+    res.set(http::field::location, beast::string_view{ url.GetUri().data(), url.GetUri().size() });
+    if (!m_config.redirect.cacheControl.empty()) {
+        res.set(http::field::cache_control, m_config.redirect.cacheControl);
+    }
     res.prepare_payload();
 
     return res;
@@ -186,8 +682,7 @@ template <class Body, class Allocator>
 http::message_generator HttpHandler<Body, Allocator>::CreateStandardResponse(
     http::request<Body, Allocator>&& req, http::status status) {
 
-    http::response<http::empty_body> res{ status, req.version() };
-    res.keep_alive(req.keep_alive());
+    auto res{ CreateResponse<http::empty_body>(req, status) };
     res.prepare_payload();
 
     return res;
@@ -224,73 +719,267 @@ http::message_generator HttpHandler<Body, Allocator>::GenerateMethodNotAllowed(
 }
 
 template <class Body, class Allocator>
-std::string HttpHandler<Body, Allocator>::QuerySelectByShortCode(std::string_view shortCode) {
-    return m_database->Query<std::string>(
-        "UPDATE urls SET accesscount = accesscount + 1 WHERE shortcode = $1 "
-        "RETURNING to_json(urls.*)::jsonb - 'accesscount';",
-        IDatabase::SqlParams{ { "$1", shortCode.data() } },
-        [](std::vector<std::string>&& data) -> std::string {
-            if (data.empty()) {
-                return { }; // Return an empty string if nothing is found.
+http::message_generator HttpHandler<Body, Allocator>::GenerateForbidden(
+    http::request<Body, Allocator>&& req) {
+    json json;
+    json["error"] = "The admin token is missing or wrong.";
+    return CreateStandardResponse(std::move(req),
+        http::status::forbidden,
+        std::move(json));
+}
+
+template <class Body, class Allocator>
+bool HttpHandler<Body, Allocator>::IsAdmin(const http::request<Body, Allocator>& req) const {
+    constexpr std::string_view SCHEME{ "Bearer " };
+    const std::string& token{ m_config.adminToken };
+    auto field{ req.find(http::field::authorization) };
+    if (token.empty() || field == req.end()) {
+        return false;
+    }
+
+    std::string_view value{ field -> value().data(), field -> value().size() };
+    if (!value.starts_with(SCHEME) || value.size() - SCHEME.size() != token.size()) {
+        return false;
+    }
+    value.remove_prefix(SCHEME.size());
+
+    // Every byte is compared, so the time taken does not tell how much of the token matched
+    unsigned char difference{ 0 };
+    for (std::size_t i{ 0 }; i < token.size(); ++i) {
+        difference |= static_cast<unsigned char>(value[i] ^ token[i]);
+    }
+    return difference == 0;
+}
+
+template <class Body, class Allocator>
+std::optional<Url> HttpHandler<Body, Allocator>::ResolveShortCode(std::string_view shortCode) {
+    std::uint64_t version{ };
+    if (m_cache) {
+        if (auto cached{ m_cache -> Get(shortCode) }) {
+            RecordAccess(shortCode);
+            return cached;
+        }
+        version = m_cache -> GetVersion(shortCode);
+    }
+
+    std::optional<Url> url{ m_repository -> Resolve(shortCode) };
+    if (url) {
+        RecordAccess(shortCode);
+        if (m_cache) {
+            m_cache -> PutIfUnchanged(shortCode, *url, version);
+        }
+    }
+
+    return url;
+}
+
+template <class Body, class Allocator>
+std::vector<std::string> HttpHandler<Body, Allocator>::ResolveCachedCodes(
+    const Batch& batch, std::vector<std::optional<Url>>& urls, std::vector<std::uint64_t>& versions) {
+    std::vector<std::string> misses{ };
+    versions.assign(batch.unique.size(), 0);
+    for (std::size_t i{ 0 }; i < batch.unique.size(); ++i) {
+        if (m_cache) {
+            urls[i] = m_cache -> Get(batch.unique[i]);
+            if (!urls[i]) {
+                versions[i] = m_cache -> GetVersion(batch.unique[i]);
             }
+        }
+        if (!urls[i]) {
+            misses.push_back(batch.unique[i]);
+        }
+    }
 
-            return std::move(data.front()); // Return JSON if found.
-        });
+    return misses;
 }
 
 template <class Body, class Allocator>
-http::message_generator HttpHandler<Body, Allocator>::CreateShortenUrl(
-    http::request<Body, Allocator>&& req) {
-    if (req.body().empty()) {
-        return GenerateBadRequest(std::move(req), "Empty request body.");
+void HttpHandler<Body, Allocator>::StoreResolvedRows(const Batch& batch, std::vector<Url>&& rows,
+    std::vector<std::optional<Url>>& urls, const std::vector<std::uint64_t>& versions) {
+    if (!rows.empty()) {
+        std::unordered_map<std::string_view, std::size_t> indexes{ };
+        for (std::size_t i{ 0 }; i < batch.unique.size(); ++i) {
+            indexes.emplace(batch.unique[i], i);
+        }
+
+        for (Url& row : rows) {
+            auto it{ indexes.find(row.GetShortCode()) };
+            if (it == indexes.end()) {
+                continue;
+            }
+
+            if (m_cache) {
+                m_cache -> PutIfUnchanged(it -> first, row, versions[it -> second]);
+            }
+            urls[it -> second].emplace(std::move(row));
+        }
+    }
+
+    // Every occurrence is a lookup, as if the codes were resolved one by one
+    for (std::size_t index : batch.positions) {
+        if (urls[index]) {
+            RecordAccess(batch.unique[index]);
+        }
+    }
+}
+
+template <class Body, class Allocator>
+http::message_generator HttpHandler<Body, Allocator>::GetCacheStats(http::request<Body, Allocator>&& req) {
+    if (!m_cache) {
+        return GenerateNotFound(std::move(req), "The cache is disabled.");
+    }
+
+    Cache::Stats stats{ m_cache -> GetStats() };
+    json body;
+    body["hits"] = stats.hits;
+    body["misses"] = stats.misses;
+    body["evictions"] = stats.evictions;
+    body["size"] = stats.size;
+    body["capacity"] = stats.capacity;
+
+    return CreateStandardResponse(std::move(req), http::status::ok, std::move(body));
+}
+
+template <class Body, class Allocator>
+http::message_generator HttpHandler<Body, Allocator>::ExportUrls(http::request<Body, Allocator>&& req, bool isQueued) {
+    if (!IsAdmin(req)) {
+        return GenerateForbidden(std::move(req));
+    }
+
+    if (!m_postgres) {
+        return GenerateNotFound(std::move(req), "Export needs PostgreSQL storage.");
     }
 
     try {
-        json j{ json::parse(req.body()) };
-        std::string url{ j.at("url").get<std::string>() };
+        std::optional<Export::Format> format{ Export::Format::Ndjson };
+        ForEachQueryParam(std::string_view{ req.target().data(), req.target().size() }, "format",
+            [&](std::string_view name) { format = Export::ParseFormat(name); });
+        if (!format) {
+            return GenerateBadRequest(std::move(req), "The format has to be ndjson or csv.");
+        }
 
-        std::string body = m_database->Query<std::string>(
-            "UPDATE urls SET accesscount = accesscount + 1 WHERE url = $1 "
-            "RETURNING to_json(urls.*)::jsonb - 'accesscount';",
-            IDatabase::SqlParams{ std::make_pair(std::string{ "$1" }, url) },
-            [](std::vector<std::string>&& data) -> std::string {
-                if (data.empty()) {
-                    return { };
-                }
+        IDatabase::CopyOutPtr stream{ m_postgres -> GetDatabase().CopyOut(Export::CopyQuery(*format)) };
 
-                return std::move(data.front()); // returns a single string containing json
+        auto res{ CreateResponse<Export::CopyBody>(req, http::status::ok) };
+        res.set(http::field::content_type, Export::ContentType(*format));
+        // HTTP/1.0 has no chunks, the end of the body is the end of the connection there
+        if (req.version() >= 11) {
+            res.chunked(true);
+        }
+        else {
+            res.keep_alive(false);
+        }
+        res.body().chunkSize = m_config.exportChunkSize;
+        if (isQueued && m_adminThreads) {
+            // Read on after this job has handed the response to the session
+            auto queue{ std::make_shared<Export::ChunkQueue>(Export::QUEUED_CHUNKS) };
+            res.body().reader.emplace(queue);
+            net::post(*m_adminThreads, [queue, stream = std::shared_ptr<ICopyOutStream>{ std::move(stream) },
+                chunkSize = m_config.exportChunkSize, executor = m_adminThreads -> get_executor()]() {
+                Export::Pump(stream, queue, chunkSize, executor);
             });
+        }
+        else {
+            res.body().stream = std::move(stream);
+        }
 
-        bool notCreated = body.empty();
-        http::status status = http::status::created; // Default status is created
+        return res;
+    }
+    catch (...) {
+        return GenerateError(std::move(req), std::current_exception(), "GET /admin/export");
+    }
+}
+
+template <class Body, class Allocator>
+http::message_generator HttpHandler<Body, Allocator>::ImportUrls(http::request<Body, Allocator>&& req) {
+    if (!IsAdmin(req)) {
+        return GenerateForbidden(std::move(req));
+    }
 
-        if (notCreated) {
-            bool isFound{ false };
-            std::string shortCode{ };
-            while (!isFound) {
-                shortCode = m_generator.Generate();
+    if (!m_postgres) {
+        return GenerateNotFound(std::move(req), "Import needs PostgreSQL storage.");
+    }
 
-                isFound = QuerySelectByShortCode(shortCode).empty();
+    std::optional<Import::Format> format{ Import::Format::Ndjson };
+    ForEachQueryParam(std::string_view{ req.target().data(), req.target().size() }, "format",
+        [&](std::string_view name) { format = Import::ParseFormat(name); });
+    if (!format) {
+        return GenerateBadRequest(std::move(req), "The format has to be ndjson or csv.");
+    }
+
+    try {
+        // A file of bad rows would make a response as large as itself
+        json rejects = json::array();
+        auto onReject{ [this, &rejects](const Import::Reject& reject) {
+            if (rejects.size() < m_config.importMaxRejects) {
+                rejects.push_back({ { "line", reject.line }, { "reason", reject.reason }, { "value", reject.value } });
             }
+        } };
+
+        // The body is already in memory, it is fed in chunks so the COPY stays as large as with a file
+        Import::Importer importer{ m_postgres -> GetDatabase(), *format, onReject, &m_postgres -> GetEncoder(),
+            Import::ImportConfig{ .chunkSize = m_config.importChunkSize } };
+        std::string_view data{ req.body().data(), req.body().size() };
+        while (!data.empty()) {
+            std::string_view chunk{ data.substr(0, m_config.importChunkSize) };
+            importer.Write(chunk);
+            data.remove_prefix(chunk.size());
+        }
+        Import::Summary summary{ importer.Finish() };
+
+        json body;
+        body["rows"] = summary.rows;
+        body["imported"] = summary.imported;
+        body["rejected"] = summary.rejected;
+        body["rejects"] = std::move(rejects);
 
-            // If the shortcode is missing, we can bind it to the url.
-            body = m_database->Query<std::string>(
-                "INSERT INTO urls (url, shortcode) VALUES ($1, $2) "
-                "RETURNING to_json(urls.*)::jsonb - 'accesscount';",
-                IDatabase::SqlParams{
-                    std::make_pair(std::string{ "$1" }, std::move(url)),
-                    std::make_pair(std::string{ "$2" }, std::move(shortCode)) },
-                    [](std::vector<std::string>&& data) -> std::string {
-                    return std::move(data.front()); // returns a single string containing json
+        return CreateStandardResponse(std::move(req), http::status::ok, std::move(body));
+    }
+    catch (const std::invalid_argument& e) {
+        return GenerateBadRequest(std::move(req), e.what());
+    }
+    catch (...) {
+        return GenerateError(std::move(req), std::current_exception(), "POST /admin/import");
+    }
+}
+
+template <class Body, class Allocator>
+template <typename Func>
+net::awaitable<http::message_generator> HttpHandler<Body, Allocator>::RunOnAdminThreads(Func func) {
+    // Without PostgreSQL storage the endpoints answer 404 at once
+    if (!m_adminThreads) {
+        co_return func();
+    }
+
+    co_return co_await net::async_initiate<const net::use_awaitable_t<>&, void(http::message_generator)>(
+        [this](auto handler, Func func) {
+            net::post(*m_adminThreads, [handler = std::move(handler), func = std::move(func)]() mutable {
+                http::message_generator res{ func() };
+                auto executor{ net::get_associated_executor(handler) };
+                net::dispatch(executor, [handler = std::move(handler), res = std::move(res)]() mutable {
+                    std::move(handler)(std::move(res));
                 });
-        }
-        else {
-            status = http::status::ok; // Set status to OK if the URL already exists
-        }
+            });
+        },
+        net::use_awaitable, std::move(func));
+}
+
+template <class Body, class Allocator>
+http::message_generator HttpHandler<Body, Allocator>::CreateShortenUrl(
+    http::request<Body, Allocator>&& req) {
+    if (req.body().empty()) {
+        return GenerateBadRequest(std::move(req), "Empty request body.");
+    }
+
+    try {
+        json j{ json::parse(req.body()) };
+        std::string url{ j.at("url").get<std::string>() };
+
+        CreatedUrl created{ m_repository -> Create(url) };
 
         return CreateStandardResponse(std::move(req),
-            status,
-            json::parse(std::move(body)));
+            created.isCreated ? http::status::created : http::status::ok,
+            created.url);
     }
     catch (const PostgreSQL::PostgreSQLError& e) {
         m_logger->error("Exception: To process Database: {}", e.what());
@@ -311,13 +1000,168 @@ http::message_generator HttpHandler<Body, Allocator>::CreateShortenUrl(
 }
 
 template <class Body, class Allocator>
-http::message_generator HttpHandler<Body, Allocator>::HandlerMethodPost(http::request<Body, Allocator>&& req) {
-    std::string target{ req.target() };
-    if (target == "/shorten") {
-        return CreateShortenUrl(std::move(req));
+typename HttpHandler<Body, Allocator>::Batch HttpHandler<Body, Allocator>::ParseBatch(
+    std::string_view body, const char* key) {
+    Batch batch{ };
+    std::unordered_map<std::string, std::size_t> indexes{ };
+
+    auto add{ [&](const json& entry) {
+        batch.Add(entry.is_string() ? entry.get<std::string>() : entry.at(key).get<std::string>(), indexes);
+    } };
+
+    std::size_t start{ body.find_first_not_of(" \t\r\n") };
+    if (start != std::string_view::npos && body[start] == '[') {
+        json entries = json::parse(body);
+        for (const json& entry : entries) {
+            add(entry);
+        }
+        return batch;
     }
-    else {
-        return GenerateNotFound(std::move(req), "Endpoint was not found.");
+
+    batch.isNdjson = true;
+    while (!body.empty()) {
+        std::size_t end{ body.find('\n') };
+        std::string_view line{ body.substr(0, end) };
+        body.remove_prefix(end == std::string_view::npos ? body.size() : end + 1);
+
+        if (line.find_first_not_of(" \t\r") != std::string_view::npos) {
+            add(json::parse(line));
+        }
+    }
+
+    return batch;
+}
+
+template <class Body, class Allocator>
+typename HttpHandler<Body, Allocator>::Batch HttpHandler<Body, Allocator>::ParseCodeQuery(std::string_view target) {
+    Batch batch{ };
+    std::unordered_map<std::string, std::size_t> indexes{ };
+
+    // Codes are base62, they are never percent-encoded
+    ForEachQueryParam(target, "code", [&](std::string_view code) {
+        batch.Add(std::string{ code }, indexes);
+    });
+
+    return batch;
+}
+
+template <class Body, class Allocator>
+void HttpHandler<Body, Allocator>::StoreBatchRows(const Batch& batch, std::size_t first, std::size_t last,
+    std::vector<Url>&& rows, std::vector<std::optional<Url>>& urls) {
+    std::unordered_map<std::string_view, std::size_t> indexes{ };
+    for (std::size_t i{ first }; i < last; ++i) {
+        indexes.emplace(batch.unique[i], i);
+    }
+
+    for (Url& row : rows) {
+        auto it{ indexes.find(row.GetUri()) };
+        if (it != indexes.end()) {
+            urls[it -> second].emplace(std::move(row));
+        }
+    }
+
+    for (std::size_t i{ first }; i < last; ++i) {
+        if (!urls[i]) {
+            throw std::runtime_error(fmt::format("No row was returned for {}.", batch.unique[i]));
+        }
+    }
+}
+
+template <class Body, class Allocator>
+http::message_generator HttpHandler<Body, Allocator>::CreateBatchResponse(
+    http::request<Body, Allocator>&& req, const Batch& batch, const std::vector<std::optional<Url>>& urls) {
+
+    auto res{ CreateResponse<StringBody>(req, http::status::ok) };
+    res.set(http::field::content_type, batch.isNdjson ? "application/x-ndjson" : "application/json");
+
+    // NDJSON needs a document per line
+    UrlJson::Format format{ false, m_config.prettyPrint && !batch.isNdjson };
+    const char separator{ batch.isNdjson ? '\n' : ',' };
+
+    // The body is sized once, then every document is written in place
+    std::size_t size{ batch.isNdjson ? 0 : std::size_t{ 2 } };
+    constexpr std::string_view NONE{ "null" };
+    for (std::size_t index : batch.positions) {
+        size += (urls[index] ? UrlJson::Size(*urls[index], format) : NONE.size()) + 1;
+    }
+
+    auto& body{ res.body() };
+    body.resize(size);
+    char* out{ body.data() };
+    if (!batch.isNdjson) {
+        *out++ = '[';
+    }
+    for (std::size_t i{ 0 }; i < batch.positions.size(); ++i) {
+        const std::optional<Url>& url{ urls[batch.positions[i]] };
+        out = url ? out + UrlJson::Write(*url, format, out) : std::copy(NONE.begin(), NONE.end(), out);
+        if (batch.isNdjson || i + 1 != batch.positions.size()) {
+            *out++ = separator;
+        }
+    }
+    if (!batch.isNdjson) {
+        *out++ = ']';
+    }
+    body.resize(out - body.data());
+    res.prepare_payload();
+
+    return res;
+}
+
+template <class Body, class Allocator>
+http::message_generator HttpHandler<Body, Allocator>::CreateShortenUrlBatch(
+    http::request<Body, Allocator>&& req) {
+    try {
+        Batch batch{ ParseBatch(std::string_view{ req.body().data(), req.body().size() }, "url") };
+        if (batch.positions.empty()) {
+            return GenerateBadRequest(std::move(req), "The batch is empty.");
+        }
+        if (batch.positions.size() > m_config.batch.maxUrls) {
+            return GenerateBadRequest(std::move(req), fmt::format("The batch has more than {} urls.", m_config.batch.maxUrls));
+        }
+
+        std::vector<std::optional<Url>> urls(batch.unique.size());
+        for (std::size_t first{ 0 }; first < batch.unique.size(); first += m_config.batch.rowsPerStatement) {
+            const std::size_t last{ std::min(first + m_config.batch.rowsPerStatement, batch.unique.size()) };
+
+            std::vector<Url> rows{ m_repository -> Create(
+                IUrlRepository::Strings{ batch.unique }.subspan(first, last - first)) };
+
+            StoreBatchRows(batch, first, last, std::move(rows), urls);
+        }
+
+        return CreateBatchResponse(std::move(req), batch, urls);
+    }
+    catch (...) {
+        return GenerateError(std::move(req), std::current_exception(), "POST /shorten/batch");
+    }
+}
+
+template <class Body, class Allocator>
+http::message_generator HttpHandler<Body, Allocator>::ResolveUrlBatch(
+    http::request<Body, Allocator>&& req) {
+    try {
+        Batch batch{ ReadCodeBatch(req) };
+        if (batch.positions.empty()) {
+            return GenerateBadRequest(std::move(req), "The batch is empty.");
+        }
+        if (batch.positions.size() > m_config.batch.maxCodes) {
+            return GenerateBadRequest(std::move(req), fmt::format("The batch has more than {} codes.", m_config.batch.maxCodes));
+        }
+
+        std::vector<std::optional<Url>> urls(batch.unique.size());
+        std::vector<std::uint64_t> versions{ };
+        std::vector<std::string> misses{ ResolveCachedCodes(batch, urls, versions) };
+
+        std::vector<Url> rows{ };
+        if (!misses.empty()) {
+            rows = m_repository -> BatchResolve(misses);
+        }
+        StoreResolvedRows(batch, std::move(rows), urls, versions);
+
+        return CreateBatchResponse(std::move(req), batch, urls);
+    }
+    catch (...) {
+        return GenerateError(std::move(req), std::current_exception(), "/resolve/batch");
     }
 }
 
@@ -325,15 +1169,15 @@ template <class Body, class Allocator>
 http::message_generator HttpHandler<Body, Allocator>::FindUrlByShortCode(
     http::request<Body, Allocator>&& req, std::string_view shortCode) {
     try {
-        std::string body = QuerySelectByShortCode(shortCode);
+        std::optional<Url> url = ResolveShortCode(shortCode);
 
-        if (body.empty()) {
+        if (!url) {
             return GenerateNotFound(std::move(req), "The short URL was not found.");
         }
 
         return CreateStandardResponse(std::move(req),
             http::status::ok,
-            json::parse(std::move(body)));
+            *url);
     }
     catch (const PostgreSQL::PostgreSQLError& e) {
         m_logger->error("Exception: To process Database: {}", e.what());
@@ -346,32 +1190,37 @@ http::message_generator HttpHandler<Body, Allocator>::FindUrlByShortCode(
 }
 
 template <class Body, class Allocator>
-std::string HttpHandler<Body, Allocator>::QueryFullStatsByShortCode(std::string_view shortCode) {
-    return m_database->Query<std::string>(
-        "UPDATE urls SET accesscount = accesscount + 1 WHERE shortcode = $1 RETURNING to_json(urls.*);",
-        IDatabase::SqlParams{ { "$1", shortCode.data() } },
-        [](std::vector<std::string>&& data) -> std::string {
-            if (data.empty()) {
-                return { }; // Return an empty string if nothing is found.
-            }
+http::message_generator HttpHandler<Body, Allocator>::RedirectByShortCode(
+    http::request<Body, Allocator>&& req, std::string_view shortCode) {
+    try {
+        std::optional<Url> url = ResolveShortCode(shortCode);
+
+        if (!url) {
+            return GenerateNotFound(std::move(req), "The short URL was not found.");
+        }
 
-            return std::move(data.front()); // Return JSON if found.
-        });
+        return CreateRedirectResponse(std::move(req), *url);
+    }
+    catch (...) {
+        return GenerateError(std::move(req), std::current_exception(), "GET /");
+    }
 }
 
 template <class Body, class Allocator>
 http::message_generator HttpHandler<Body, Allocator>::GetFullStatsByShortCode(
     http::request<Body, Allocator>&& req, std::string_view shortCode) {
     try {
-        std::string body = QueryFullStatsByShortCode(shortCode);
+        std::optional<Url> stats = m_repository -> Stats(shortCode);
 
-        if (body.empty()) {
+        if (!stats) {
             return GenerateNotFound(std::move(req), "The short URL was not found.");
         }
 
+        RecordAccess(shortCode);
         return CreateStandardResponse(std::move(req),
             http::status::ok,
-            json::parse(std::move(body)));
+            AddOwnAccess(*stats),
+            true);
     }
     catch (const PostgreSQL::PostgreSQLError& e) {
         m_logger->error("Exception: To process Database: {}", e.what());
@@ -383,42 +1232,6 @@ http::message_generator HttpHandler<Body, Allocator>::GetFullStatsByShortCode(
     }
 }
 
-template <class Body, class Allocator>
-http::message_generator HttpHandler<Body, Allocator>::HandlerMethodGet(http::request<Body, Allocator>&& req) {
-    std::string target{ req.target() };
-
-    const std::string patternStart{ "/shorten/" };
-    const std::string patternEnd{ "/stats" };
-    if (target.starts_with(patternStart) && !target.ends_with(patternEnd)) {
-        std::string shortCode = target.substr(patternStart.size());
-        return FindUrlByShortCode(std::move(req), shortCode);
-    }
-    else if (target.starts_with(patternStart) && target.ends_with(patternEnd)) {
-        std::string shortCode = target.substr(patternStart.size(),
-            target.size() - (patternStart.size() + patternEnd.size()));
-
-        return GetFullStatsByShortCode(std::move(req), shortCode);
-    }
-    else {
-        return GenerateNotFound(std::move(req), "Endpoint was not found.");
-    }
-}
-
-template <class Body, class Allocator>
-std::string HttpHandler<Body, Allocator>::QueryUpdateUrlByShortCode(std::string_view url, std::string_view shortCode) {
-    return m_database->Query<std::string>(
-        "UPDATE urls SET accesscount = accesscount + 1, url = $1 WHERE shortcode = $2 "
-        "RETURNING to_json(urls.*)::jsonb - 'accesscount';",
-        IDatabase::SqlParams{ { "$1", url.data() }, { "$2", shortCode.data() } },
-        [](std::vector<std::string>&& data) -> std::string {
-            if (data.empty()) {
-                return { }; // Return an empty string if nothing is found.
-            }
-
-            return std::move(data.front()); // Return JSON if found.
-        });
-}
-
 template <class Body, class Allocator>
 http::message_generator HttpHandler<Body, Allocator>::UpdateByShortCode(
     http::request<Body, Allocator>&& req, std::string_view shortCode) {
@@ -430,15 +1243,16 @@ http::message_generator HttpHandler<Body, Allocator>::UpdateByShortCode(
         json j{ json::parse(req.body()) };
         std::string url{ j.at("url").get<std::string>() };
 
-        std::string body = QueryUpdateUrlByShortCode(url, shortCode);
+        std::optional<Url> updated = m_repository -> Update(shortCode, url);
+        InvalidateShortCode(shortCode);
 
-        if (body.empty()) {
+        if (!updated) {
             return GenerateNotFound(std::move(req), "The short code was not found.");
         }
 
         return CreateStandardResponse(std::move(req),
             http::status::ok,
-            json::parse(std::move(body)));
+            *updated);
     }
     catch (const PostgreSQL::PostgreSQLError& e) {
         m_logger->error("Exception: To process Database: {}", e.what());
@@ -458,16 +1272,211 @@ http::message_generator HttpHandler<Body, Allocator>::UpdateByShortCode(
     }
 }
 
+
+// coroutine pipeline
 template <class Body, class Allocator>
-http::message_generator HttpHandler<Body, Allocator>::HandlerMethodPut(http::request<Body, Allocator>&& req) {
-    std::string target{ req.target() };
+net::awaitable<http::message_generator> HttpHandler<Body, Allocator>::CreateShortenUrlAsync(
+    http::request<Body, Allocator> req) {
+    if (req.body().empty()) {
+        co_return GenerateBadRequest(std::move(req), "Empty request body.");
+    }
 
-    const std::string pattern{ "/shorten/" };
-    if (target.starts_with(pattern)) {
-        std::string shortCode = target.substr(pattern.size());
-        return UpdateByShortCode(std::move(req), shortCode);
+    try {
+        json j = json::parse(req.body());
+        std::string url{ j.at("url").get<std::string>() };
+
+        std::optional<CreatedUrl> created{ co_await m_repository -> AsyncCreate(std::move(url), net::use_awaitable) };
+
+        co_return CreateStandardResponse(std::move(req),
+            created.value().isCreated ? http::status::created : http::status::ok,
+            created -> url);
     }
-    else {
-        return GenerateNotFound(std::move(req), "Endpoint was not found.");
+    catch (...) {
+        co_return GenerateError(std::move(req), std::current_exception(), "POST /shorten");
+    }
+}
+
+template <class Body, class Allocator>
+net::awaitable<http::message_generator> HttpHandler<Body, Allocator>::CreateShortenUrlBatchAsync(
+    http::request<Body, Allocator> req) {
+    try {
+        Batch batch{ ParseBatch(std::string_view{ req.body().data(), req.body().size() }, "url") };
+        if (batch.positions.empty()) {
+            co_return GenerateBadRequest(std::move(req), "The batch is empty.");
+        }
+        if (batch.positions.size() > m_config.batch.maxUrls) {
+            co_return GenerateBadRequest(std::move(req), fmt::format("The batch has more than {} urls.", m_config.batch.maxUrls));
+        }
+
+        std::vector<std::optional<Url>> urls(batch.unique.size());
+        for (std::size_t first{ 0 }; first < batch.unique.size(); first += m_config.batch.rowsPerStatement) {
+            const std::size_t last{ std::min(first + m_config.batch.rowsPerStatement, batch.unique.size()) };
+
+            std::vector<std::string> chunk(batch.unique.begin() + first, batch.unique.begin() + last);
+            std::vector<Url> rows{ co_await m_repository -> AsyncCreate(std::move(chunk), net::use_awaitable) };
+
+            StoreBatchRows(batch, first, last, std::move(rows), urls);
+        }
+
+        co_return CreateBatchResponse(std::move(req), batch, urls);
+    }
+    catch (...) {
+        co_return GenerateError(std::move(req), std::current_exception(), "POST /shorten/batch");
+    }
+}
+
+template <class Body, class Allocator>
+net::awaitable<http::message_generator> HttpHandler<Body, Allocator>::ResolveUrlBatchAsync(
+    http::request<Body, Allocator> req) {
+    try {
+        Batch batch{ ReadCodeBatch(req) };
+        if (batch.positions.empty()) {
+            co_return GenerateBadRequest(std::move(req), "The batch is empty.");
+        }
+        if (batch.positions.size() > m_config.batch.maxCodes) {
+            co_return GenerateBadRequest(std::move(req), fmt::format("The batch has more than {} codes.", m_config.batch.maxCodes));
+        }
+
+        std::vector<std::optional<Url>> urls(batch.unique.size());
+        std::vector<std::uint64_t> versions{ };
+        std::vector<std::string> misses{ ResolveCachedCodes(batch, urls, versions) };
+
+        std::vector<Url> rows{ };
+        if (!misses.empty()) {
+            rows = co_await m_repository -> AsyncBatchResolve(std::move(misses), net::use_awaitable);
+        }
+        StoreResolvedRows(batch, std::move(rows), urls, versions);
+
+        co_return CreateBatchResponse(std::move(req), batch, urls);
+    }
+    catch (...) {
+        co_return GenerateError(std::move(req), std::current_exception(), "/resolve/batch");
+    }
+}
+
+template <class Body, class Allocator>
+net::awaitable<std::optional<Url>> HttpHandler<Body, Allocator>::ResolveShortCodeAsync(std::string shortCode) {
+    std::uint64_t version{ };
+    if (m_cache) {
+        if (auto cached{ m_cache -> Get(shortCode) }) {
+            RecordAccess(shortCode);
+            co_return cached;
+        }
+        version = m_cache -> GetVersion(shortCode);
+    }
+
+    // An update or delete that finishes while the read is suspended invalidates the code, the row is then not cached
+    std::optional<Url> url{ co_await m_repository -> AsyncResolve(shortCode, net::use_awaitable) };
+    if (url) {
+        RecordAccess(shortCode);
+        if (m_cache) {
+            m_cache -> PutIfUnchanged(shortCode, *url, version);
+        }
+    }
+
+    co_return url;
+}
+
+template <class Body, class Allocator>
+net::awaitable<http::message_generator> HttpHandler<Body, Allocator>::FindUrlByShortCodeAsync(
+    http::request<Body, Allocator> req, std::string shortCode) {
+    try {
+        std::optional<Url> url{ co_await ResolveShortCodeAsync(std::move(shortCode)) };
+
+        if (!url) {
+            co_return GenerateNotFound(std::move(req), "The short URL was not found.");
+        }
+
+        co_return CreateStandardResponse(std::move(req),
+            http::status::ok,
+            *url);
+    }
+    catch (...) {
+        co_return GenerateError(std::move(req), std::current_exception(), "GET /shorten/");
+    }
+}
+
+template <class Body, class Allocator>
+net::awaitable<http::message_generator> HttpHandler<Body, Allocator>::RedirectByShortCodeAsync(
+    http::request<Body, Allocator> req, std::string shortCode) {
+    try {
+        std::optional<Url> url{ co_await ResolveShortCodeAsync(std::move(shortCode)) };
+
+        if (!url) {
+            co_return GenerateNotFound(std::move(req), "The short URL was not found.");
+        }
+
+        co_return CreateRedirectResponse(std::move(req), *url);
+    }
+    catch (...) {
+        co_return GenerateError(std::move(req), std::current_exception(), "GET /");
+    }
+}
+
+template <class Body, class Allocator>
+net::awaitable<http::message_generator> HttpHandler<Body, Allocator>::GetFullStatsByShortCodeAsync(
+    http::request<Body, Allocator> req, std::string shortCode) {
+    try {
+        std::optional<Url> stats{ co_await m_repository -> AsyncStats(shortCode, net::use_awaitable) };
+
+        if (!stats) {
+            co_return GenerateNotFound(std::move(req), "The short URL was not found.");
+        }
+
+        RecordAccess(shortCode);
+        co_return CreateStandardResponse(std::move(req),
+            http::status::ok,
+            AddOwnAccess(*stats),
+            true);
+    }
+    catch (...) {
+        co_return GenerateError(std::move(req), std::current_exception(), "GET /shorten/");
+    }
+}
+
+template <class Body, class Allocator>
+net::awaitable<http::message_generator> HttpHandler<Body, Allocator>::UpdateByShortCodeAsync(
+    http::request<Body, Allocator> req, std::string shortCode) {
+    if (req.body().empty()) {
+        co_return GenerateBadRequest(std::move(req), "Empty request body.");
+    }
+
+    try {
+        json j = json::parse(req.body());
+        std::string url{ j.at("url").get<std::string>() };
+
+        std::optional<Url> updated{ co_await m_repository -> AsyncUpdate(shortCode, std::move(url), net::use_awaitable) };
+        InvalidateShortCode(shortCode);
+
+        if (!updated) {
+            co_return GenerateNotFound(std::move(req), "The short code was not found.");
+        }
+
+        co_return CreateStandardResponse(std::move(req),
+            http::status::ok,
+            *updated);
+    }
+    catch (...) {
+        co_return GenerateError(std::move(req), std::current_exception(), "PUT /shorten/");
+    }
+}
+
+template <class Body, class Allocator>
+net::awaitable<http::message_generator> HttpHandler<Body, Allocator>::DeleteByShortCodeAsync(
+    http::request<Body, Allocator> req, std::string shortCode) {
+    try {
+        bool isDeleted{ co_await m_repository -> AsyncDelete(shortCode, net::use_awaitable) };
+        InvalidateShortCode(shortCode);
+
+        if (!isDeleted) {
+            co_return GenerateNotFound(std::move(req), "The short URL was not found.");
+        }
+
+        co_return CreateStandardResponse(
+            std::move(req),
+            http::status::no_content);
+    }
+    catch (...) {
+        co_return GenerateError(std::move(req), std::current_exception(), "Delete /shorten/");
     }
 }
\ No newline at end of file
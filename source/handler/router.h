@@ -0,0 +1,142 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <string_view>
+
+#include <boost/beast/http/verb.hpp>
+
+
+namespace Routing {
+    using Verb = boost::beast::http::verb;
+
+    // Stands for one non-empty path segment, which is passed to the endpoint
+    inline constexpr std::string_view PARAM{ "{}" };
+
+    template <typename Endpoint>
+    struct Route {
+        Verb method;
+        std::string_view pattern; // "/shorten/{}/stats"
+        Endpoint endpoint;
+    };
+
+    enum class Status { Found, NotFound, MethodNotAllowed };
+
+    template <typename Endpoint>
+    struct Match {
+        Status status{ Status::NotFound };
+        Endpoint endpoint{ };
+        std::string_view param{ }; // points into the target
+    };
+
+    // Takes the segment after the leading '/' off path
+    constexpr bool NextSegment(std::string_view& path, std::string_view& segment) {
+        if (path.empty() || path.front() != '/') {
+            return false;
+        }
+
+        path.remove_prefix(1);
+        std::size_t end{ path.find('/') };
+        segment = path.substr(0, end);
+        path.remove_prefix(end == std::string_view::npos ? path.size() : end);
+        return true;
+    }
+
+    constexpr bool IsValidPattern(std::string_view pattern) {
+        int params{ 0 };
+        std::string_view segment{ };
+        while (NextSegment(pattern, segment)) {
+            if (segment.empty() || (segment != PARAM && segment.find_first_of("{}?") != std::string_view::npos)) {
+                return false;
+            }
+
+            params += segment == PARAM;
+        }
+
+        return pattern.empty() && params <= 1;
+    }
+
+
+    // Fixed route table, compiled into the literal text around the parameter of every pattern,
+    // so matching a route is a length check and two memcmp calls. Routes without a parameter
+    // are tried first, so "/admin/cache" is not taken for "/{}/cache"; a path that only matches
+    // under other methods is reported as MethodNotAllowed.
+    template <typename Endpoint, std::size_t N>
+    class Router {
+    public:
+
+        // Every pattern starts with '/', has no empty segments and at most one parameter
+        consteval explicit Router(std::array<Route<Endpoint>, N> routes) {
+            std::size_t next{ 0 };
+            for (bool hasParam : { false, true }) {
+                for (const auto& route : routes) {
+                    std::string_view pattern{ route.pattern };
+                    if (!IsValidPattern(pattern)) {
+                        throw "Invalid route pattern"; // not a constant expression, fails the build
+                    }
+
+                    std::size_t param{ pattern.find(PARAM) };
+                    if ((param != std::string_view::npos) != hasParam) {
+                        continue;
+                    }
+
+                    CompiledRoute& compiled{ m_routes[next++] };
+                    compiled.method = route.method;
+                    compiled.endpoint = route.endpoint;
+                    compiled.hasParam = hasParam;
+                    compiled.prefix = pattern.substr(0, param);
+                    if (hasParam) {
+                        compiled.suffix = pattern.substr(param + PARAM.size());
+                    }
+                }
+            }
+        }
+
+        // The query string of the target is ignored. The parameter is a view into the target.
+        constexpr Match<Endpoint> Find(Verb method, std::string_view target) const {
+            std::string_view path{ target.substr(0, target.find('?')) };
+
+            std::string_view param{ };
+            for (const CompiledRoute& route : m_routes) {
+                if (route.method == method && route.Matches(path, param)) {
+                    return Match<Endpoint>{ Status::Found, route.endpoint, param };
+                }
+            }
+
+            // Only a miss pays for the second pass
+            for (const CompiledRoute& route : m_routes) {
+                if (route.Matches(path, param)) {
+                    return Match<Endpoint>{ Status::MethodNotAllowed };
+                }
+            }
+
+            return { };
+        }
+
+    private:
+
+        struct CompiledRoute {
+            Verb method{ };
+            Endpoint endpoint{ };
+            std::string_view prefix{ }; // the whole pattern when there is no parameter
+            std::string_view suffix{ };
+            bool hasParam{ false };
+
+            constexpr bool Matches(std::string_view path, std::string_view& param) const {
+                if (!hasParam) {
+                    return path == prefix;
+                }
+
+                if (path.size() <= prefix.size() + suffix.size() || !path.starts_with(prefix) || !path.ends_with(suffix)) {
+                    return false;
+                }
+
+                param = path.substr(prefix.size(), path.size() - prefix.size() - suffix.size());
+                return param.find('/') == std::string_view::npos;
+            }
+        };
+
+    private:
+        std::array<CompiledRoute, N> m_routes{ };
+    };
+}
@@ -0,0 +1,399 @@
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <stdexcept>
+#include <utility>
+
+#include <nlohmann/json.hpp>
+#include <spdlog/fmt/fmt.h>
+
+#include "importer.h"
+
+
+namespace Import {
+	namespace {
+		using json = nlohmann::json;
+
+		constexpr std::string_view CODE_CHARS{
+			"0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz_-" };
+
+		constexpr std::string_view UTF8_BOM{ "\xEF\xBB\xBF" };
+
+		// 63 bits, so the id fits the bigint column
+		std::int64_t NewImportId() {
+			std::random_device rd{ };
+			std::uint64_t id{ (std::uint64_t{ rd() } << 32) | rd() };
+			id ^= static_cast<std::uint64_t>(std::chrono::steady_clock::now().time_since_epoch().count());
+			return static_cast<std::int64_t>(id >> 1);
+		}
+
+		std::optional<std::string> GetString(const json& document, const char* key) {
+			auto it{ document.find(key) };
+			if (it == document.end() || !it -> is_string()) {
+				return std::nullopt;
+			}
+
+			return it -> get<std::string>();
+		}
+	}
+
+	std::optional<Format> ParseFormat(std::string_view name) {
+		if (name == "ndjson") {
+			return Format::Ndjson;
+		}
+		if (name == "csv") {
+			return Format::Csv;
+		}
+		return std::nullopt;
+	}
+
+	Importer::Importer(IDatabase& database, Format format, RejectCallback onReject,
+		const ShortCode::Encoder* encoder, ImportConfig config)
+		: m_database{ database }
+		, m_format{ format }
+		, m_onReject{ std::move(onReject) }
+		, m_encoder{ encoder }
+		, m_config{ std::move(config) }
+		, m_import{ NewImportId() }
+	{
+		if (m_config.chunkSize == 0) {
+			throw std::invalid_argument("The import chunk size cannot be zero.");
+		}
+
+		if (m_config.maxUrlLength == 0 || m_config.maxCodeLength == 0) {
+			throw std::invalid_argument("The url and code limits cannot be zero.");
+		}
+
+		m_database.Execute(fmt::format(
+			"CREATE UNLOGGED TABLE IF NOT EXISTS {} (import bigint NOT NULL, line bigint NOT NULL, "
+			"url text NOT NULL, shortcode text NOT NULL, reason text);", m_config.stagingTable), { });
+		m_database.Execute(fmt::format(
+			"CREATE INDEX IF NOT EXISTS {0}_import ON {0} (import, shortcode);", m_config.stagingTable), { });
+
+		m_copy = m_database.CopyIn(fmt::format(
+			"COPY {} (import, line, url, shortcode) FROM STDIN;", m_config.stagingTable));
+		m_chunk.reserve(m_config.chunkSize);
+	}
+
+	void Importer::Write(std::string_view data) {
+		if (!m_copy) {
+			throw std::logic_error("The import is finished.");
+		}
+
+		m_pending.append(data);
+		ProcessRows(false);
+	}
+
+	Summary Importer::Finish() {
+		if (!m_copy) {
+			throw std::logic_error("The import is finished.");
+		}
+
+		ProcessRows(true);
+		if (!m_chunk.empty()) {
+			m_copy -> Write(m_chunk);
+			m_chunk.clear();
+		}
+
+		m_copy -> Finish();
+		m_copy.reset();
+		m_isCopied = true;
+
+		const std::string& table{ m_config.stagingTable };
+		std::vector<std::pair<std::string, std::string>> params{ { "$1", std::to_string(m_import) } };
+
+		// Of the rows sharing a code the first one is kept
+		m_database.Execute(fmt::format(
+			"UPDATE {0} AS later SET reason = 'duplicate code' FROM {0} AS earlier "
+			"WHERE later.import = $1 AND earlier.import = $1 AND later.shortcode = earlier.shortcode "
+			"AND earlier.line < later.line;", table), params);
+
+		// Codes taken before the insert are skipped by NOT EXISTS, codes taken while it runs by ON CONFLICT.
+		// Both are marked in the same statement.
+		m_summary.imported = m_database.Query<std::size_t>(fmt::format(
+			"WITH inserted AS (INSERT INTO urls (url, shortcode) SELECT i.url, i.shortcode FROM {0} AS i "
+			"WHERE i.import = $1 AND i.reason IS NULL "
+			"AND NOT EXISTS (SELECT 1 FROM urls WHERE urls.shortcode = i.shortcode) "
+			"ORDER BY i.line ON CONFLICT DO NOTHING RETURNING shortcode), "
+			"taken AS (UPDATE {0} SET reason = 'code exists' WHERE import = $1 AND reason IS NULL "
+			"AND shortcode NOT IN (SELECT shortcode FROM inserted) RETURNING 1) "
+			"SELECT (SELECT count(*) FROM inserted), (SELECT count(*) FROM taken);", table), params,
+			[](const IResultView& rows) {
+				return rows.Rows() == 0 ? std::size_t{ 0 } : static_cast<std::size_t>(rows.GetInt64(0, 0));
+			});
+
+		ReadRejects();
+
+		m_database.Execute(fmt::format("DELETE FROM {} WHERE import = $1;", table), params);
+		m_isCopied = false;
+
+		return m_summary;
+	}
+
+	Importer::~Importer() {
+		try {
+			// An unfinished copy is rolled back by the server, only finished ones leave rows behind
+			m_copy.reset();
+			if (m_isCopied) {
+				m_database.Execute(fmt::format("DELETE FROM {} WHERE import = $1;", m_config.stagingTable),
+					{ { "$1", std::to_string(m_import) } });
+			}
+		}
+		catch (...) {
+		}
+	}
+
+	void Importer::ProcessRows(bool isEnd) {
+		std::size_t start{ 0 };
+		while (start < m_pending.size()) {
+			std::size_t end{ std::string_view::npos };
+			if (m_format == Format::Csv) {
+				// A newline inside quotes belongs to the field. Doubled quotes toggle twice.
+				for (; m_scanned < m_pending.size(); ++m_scanned) {
+					char c{ m_pending[m_scanned] };
+					if (c == '"') {
+						m_isQuoted = !m_isQuoted;
+					}
+					else if (c == '\n' && !m_isQuoted) {
+						end = m_scanned;
+						break;
+					}
+				}
+			}
+			else {
+				end = m_pending.find('\n', m_scanned);
+				m_scanned = end == std::string::npos ? m_pending.size() : end;
+			}
+
+			if (end == std::string::npos) {
+				if (!isEnd) {
+					break;
+				}
+				end = m_pending.size();
+			}
+
+			std::string_view row{ std::string_view{ m_pending }.substr(start, end - start) };
+			std::size_t line{ m_line };
+			m_line += std::count(row.begin(), row.end(), '\n') + 1;
+
+			start = end + 1;
+			m_scanned = start;
+			m_isQuoted = false;
+
+			if (row.ends_with('\r')) {
+				row.remove_suffix(1);
+			}
+			ProcessRow(row, line);
+		}
+
+		start = std::min(start, m_pending.size());
+		m_pending.erase(0, start);
+		m_scanned -= std::min(m_scanned, start);
+	}
+
+	void Importer::ProcessRow(std::string_view row, std::size_t line) {
+		if (line == 1 && row.starts_with(UTF8_BOM)) {
+			row.remove_prefix(UTF8_BOM.size());
+		}
+
+		if (row.find_first_not_of(" \t") == std::string_view::npos) {
+			return;
+		}
+
+		std::string url{ };
+		std::string code{ };
+		if (m_format == Format::Csv) {
+			auto fields{ SplitCsv(row) };
+			if (!m_urlColumn) {
+				auto column{ [&fields](std::string_view name) -> std::optional<std::size_t> {
+					if (fields) {
+						auto it{ std::find(fields -> begin(), fields -> end(), name) };
+						if (it != fields -> end()) {
+							return static_cast<std::size_t>(it - fields -> begin());
+						}
+					}
+					return std::nullopt;
+				} };
+
+				m_urlColumn = column("url");
+				m_codeColumn = column("shortcode");
+				if (!m_urlColumn || !m_codeColumn) {
+					throw std::invalid_argument("The CSV header needs a url and a shortcode column.");
+				}
+				return;
+			}
+
+			++m_summary.rows;
+			if (!fields) {
+				RejectRow(line, "invalid csv", row);
+				return;
+			}
+			if (fields -> size() <= std::max(*m_urlColumn, *m_codeColumn)) {
+				RejectRow(line, "missing field", row);
+				return;
+			}
+
+			url = std::move((*fields)[*m_urlColumn]);
+			code = std::move((*fields)[*m_codeColumn]);
+		}
+		else {
+			++m_summary.rows;
+			json document = json::parse(row, nullptr, false);
+			if (document.is_discarded() || !document.is_object()) {
+				RejectRow(line, "invalid json", row);
+				return;
+			}
+
+			auto documentUrl{ GetString(document, "url") };
+			auto documentCode{ GetString(document, "shortcode") };
+			if (!documentUrl || !documentCode) {
+				RejectRow(line, "missing field", row);
+				return;
+			}
+
+			url = std::move(*documentUrl);
+			code = std::move(*documentCode);
+		}
+
+		if (auto reason{ CheckUrl(url) }; !reason.empty()) {
+			RejectRow(line, reason, url);
+			return;
+		}
+		if (auto reason{ CheckCode(code) }; !reason.empty()) {
+			RejectRow(line, reason, code);
+			return;
+		}
+
+		Stage(line, url, code);
+	}
+
+	std::optional<std::vector<std::string>> Importer::SplitCsv(std::string_view record) {
+		std::vector<std::string> fields(1);
+		bool isQuoted{ false };
+		for (std::size_t i{ 0 }; i < record.size(); ++i) {
+			char c{ record[i] };
+			if (isQuoted) {
+				if (c != '"') {
+					fields.back() += c;
+				}
+				else if (i + 1 < record.size() && record[i + 1] == '"') {
+					fields.back() += '"';
+					++i;
+				}
+				else {
+					isQuoted = false;
+				}
+			}
+			else if (c == ',') {
+				fields.emplace_back();
+			}
+			else if (c == '"' && fields.back().empty()) {
+				isQuoted = true;
+			}
+			else {
+				fields.back() += c;
+			}
+		}
+
+		if (isQuoted) {
+			return std::nullopt;
+		}
+
+		return fields;
+	}
+
+	std::string_view Importer::CheckUrl(std::string_view url) const {
+		if (url.empty()) {
+			return "missing url";
+		}
+
+		if (url.size() > m_config.maxUrlLength) {
+			return "url too long";
+		}
+
+		// Spaces and control characters would have to be percent-encoded
+		for (unsigned char c : url) {
+			if (c <= 0x20 || c == 0x7f) {
+				return "invalid url";
+			}
+		}
+
+		return { };
+	}
+
+	std::string_view Importer::CheckCode(std::string_view code) const {
+		if (code.empty()) {
+			return "missing code";
+		}
+
+		if (code.size() > m_config.maxCodeLength || code.find_first_not_of(CODE_CHARS) != std::string_view::npos) {
+			return "invalid code";
+		}
+
+		if (m_encoder) {
+			try {
+				m_encoder -> Decode(code);
+				return "reserved code";
+			}
+			catch (const std::invalid_argument&) {
+			}
+		}
+
+		return { };
+	}
+
+	void Importer::RejectRow(std::size_t line, std::string_view reason, std::string_view value) {
+		++m_summary.rejected;
+		if (m_onReject) {
+			m_onReject(Reject{ line, std::string{ reason }, std::string{ value } });
+		}
+	}
+
+	void Importer::Stage(std::size_t line, std::string_view url, std::string_view code) {
+		// Text format: the url has no control characters left, only backslashes need escaping
+		m_chunk += fmt::format("{}\t{}\t", m_import, line);
+		for (char c : url) {
+			if (c == '\\') {
+				m_chunk += '\\';
+			}
+			m_chunk += c;
+		}
+		m_chunk += '\t';
+		m_chunk += code;
+		m_chunk += '\n';
+
+		if (m_chunk.size() >= m_config.chunkSize) {
+			m_copy -> Write(m_chunk);
+			m_chunk.clear();
+		}
+	}
+
+	void Importer::ReadRejects() {
+		auto stream{ m_database.CopyOut(fmt::format(
+			"COPY (SELECT line, reason, shortcode FROM {} WHERE import = {} AND reason IS NOT NULL ORDER BY line) "
+			"TO STDOUT;", m_config.stagingTable, m_import)) };
+
+		// Rows are "line\treason\tshortcode\n", none of the values needs escaping
+		std::string buffer{ };
+		bool isMore{ true };
+		while (isMore) {
+			isMore = stream -> Read(buffer, m_config.chunkSize);
+
+			std::size_t start{ 0 };
+			for (std::size_t end{ buffer.find('\n') }; end != std::string::npos; end = buffer.find('\n', start)) {
+				std::string_view row{ std::string_view{ buffer }.substr(start, end - start) };
+				start = end + 1;
+
+				std::size_t first{ row.find('\t') };
+				std::size_t second{ row.find('\t', first + 1) };
+				if (first == std::string_view::npos || second == std::string_view::npos) {
+					continue;
+				}
+
+				RejectRow(std::stoull(std::string{ row.substr(0, first) }),
+					row.substr(first + 1, second - first - 1), row.substr(second + 1));
+			}
+			buffer.erase(0, start);
+		}
+	}
+}
@@ -0,0 +1,117 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "IDatabase.h"
+#include "shortcode.h"
+
+
+// Bulk load of urls that keep their short codes, e.g. when links move over from another shortener
+namespace Import {
+	enum class Format { Ndjson, Csv };
+
+	// "ndjson" or "csv"
+	std::optional<Format> ParseFormat(std::string_view name);
+
+	// A row that was not imported
+	struct Reject {
+		std::size_t line{ };   // where the row starts in the input, from 1
+		std::string reason{ };
+		std::string value{ };  // the offending value, or the row if it could not be read
+	};
+
+	using RejectCallback = std::function<void(const Reject&)>;
+
+	struct Summary {
+		std::size_t rows{ 0 };
+		std::size_t imported{ 0 };
+		std::size_t rejected{ 0 };
+	};
+
+	struct ImportConfig {
+		// Bytes of COPY data per write to the database
+		std::size_t chunkSize{ 64 * 1024 };
+
+		std::size_t maxUrlLength{ 2048 };
+		std::size_t maxCodeLength{ 64 };
+
+		// Unlogged table the rows are copied into before they are checked against urls
+		std::string stagingTable{ "url_imports" };
+	};
+
+
+	// Rows are NDJSON documents or CSV records with "url" and "shortcode" fields (the CSV names them
+	// in its header), so an export can be imported again. They are checked while they are parsed
+	// and copied into the staging table with COPY FROM STDIN. Finish() then rejects the codes that
+	// repeat or are taken and inserts the other rows with one statement.
+	// Not thread-safe. Every import has rows of its own in the staging table, so imports may run side by side.
+	class Importer {
+	public:
+
+		// Codes the encoder could hand out are rejected, the allocator would give them to new urls later.
+		// Starts the COPY, throws the errors of the database.
+		Importer(IDatabase& database, Format format, RejectCallback onReject,
+			const ShortCode::Encoder* encoder = nullptr, ImportConfig config = { });
+
+		Importer(const Importer&) = delete;
+		Importer& operator=(const Importer&) = delete;
+
+		// Takes the next piece of the input, rows may be split anywhere. Blocks while the database catches up.
+		// Throws std::invalid_argument if the CSV header has no url or shortcode column.
+		void Write(std::string_view data);
+
+		// Ends the input and inserts the rows. The rejects are reported before it returns.
+		Summary Finish();
+
+		// Drops the staged rows
+		~Importer();
+
+	private:
+
+		// Cuts the complete rows off the pending input
+		void ProcessRows(bool isEnd);
+
+		void ProcessRow(std::string_view row, std::size_t line);
+
+		// Fields of a CSV record, quotes removed. Returns std::nullopt if the quotes do not match.
+		static std::optional<std::vector<std::string>> SplitCsv(std::string_view record);
+
+		// The reason a value is not accepted, empty if it is fine
+		std::string_view CheckUrl(std::string_view url) const;
+		std::string_view CheckCode(std::string_view code) const;
+
+		void RejectRow(std::size_t line, std::string_view reason, std::string_view value);
+
+		// Appends the row in COPY text format and sends full chunks
+		void Stage(std::size_t line, std::string_view url, std::string_view code);
+
+		// Reports the rows the database rejected, in input order
+		void ReadRejects();
+
+	private:
+		IDatabase& m_database;
+		Format m_format;
+		RejectCallback m_onReject;
+		const ShortCode::Encoder* m_encoder;
+		ImportConfig m_config;
+		std::int64_t m_import{ };          // id of the rows of this import in the staging table
+		IDatabase::CopyInPtr m_copy{ };
+		bool m_isCopied{ false };          // rows of this import are in the staging table
+
+		std::string m_pending{ };          // input after the last complete row
+		std::size_t m_scanned{ 0 };        // bytes of m_pending already searched for the row end
+		bool m_isQuoted{ false };          // CSV: m_scanned is inside quotes
+		std::size_t m_line{ 1 };           // line of the first pending byte
+		std::optional<std::size_t> m_urlColumn{ };
+		std::optional<std::size_t> m_codeColumn{ };
+
+		std::string m_chunk{ };
+		Summary m_summary{ };
+	};
+}
@@ -0,0 +1,146 @@
+#pragma once
+
+#include <boost/beast/http.hpp>
+
+#include <algorithm>
+#include <cstddef>
+#include <memory>
+#include <memory_resource>
+#include <string>
+#include <tuple>
+#include <type_traits>
+#include <vector>
+
+
+namespace beast = boost::beast;         // from <boost/beast.hpp>
+namespace http = beast::http;           // from <boost/beast/http.hpp>
+
+
+// Memory for the messages of one session. An allocation bumps a pointer in the current block,
+// a deallocation only counts, and a block is reused once everything allocated from it is freed.
+// The blocks are kept, so a keep-alive connection stops allocating after its first requests,
+// even while the response to one request is still written as the next one is read.
+// Not thread-safe: the messages have to be created and destroyed on the session strand.
+class Arena : public std::pmr::memory_resource {
+public:
+
+    explicit Arena(std::size_t blockSize = 16 * 1024)
+        : m_blockSize{ std::max<std::size_t>(blockSize, 256) }
+    {
+    }
+
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+
+    // Bytes held in blocks
+    std::size_t Capacity() const {
+        std::size_t capacity{ 0 };
+        for (const auto& block : m_blocks) {
+            capacity += block.size;
+        }
+        return capacity;
+    }
+
+private:
+
+    struct Block {
+        std::unique_ptr<std::byte[]> data;
+        std::size_t size{ };
+        std::size_t live{ 0 }; // allocations not freed yet
+    };
+
+    void* do_allocate(std::size_t bytes, std::size_t alignment) override {
+        if (void* ptr{ AllocateFrom(m_current, m_used, bytes, alignment) }) {
+            return ptr;
+        }
+
+        // Any block without live allocations will do, otherwise the arena grows
+        for (std::size_t i{ 0 }; i < m_blocks.size(); ++i) {
+            if (m_blocks[i].live != 0 || i == m_current) {
+                continue;
+            }
+
+            if (void* ptr{ AllocateFrom(i, 0, bytes, alignment) }) {
+                return ptr;
+            }
+        }
+
+        const std::size_t size{ std::max(m_blockSize, bytes + alignment) };
+        m_blocks.push_back(Block{ std::unique_ptr<std::byte[]>{ new std::byte[size] }, size });
+        return AllocateFrom(m_blocks.size() - 1, 0, bytes, alignment);
+    }
+
+    void do_deallocate(void* ptr, std::size_t, std::size_t) override {
+        for (std::size_t i{ 0 }; i < m_blocks.size(); ++i) {
+            Block& block{ m_blocks[i] };
+            std::byte* byte{ static_cast<std::byte*>(ptr) };
+            if (byte < block.data.get() || byte >= block.data.get() + block.size) {
+                continue;
+            }
+
+            if (--block.live == 0 && i == m_current) {
+                m_used = 0;
+            }
+            return;
+        }
+    }
+
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override {
+        return this == &other;
+    }
+
+    // Takes the memory after the first used bytes of the block
+    void* AllocateFrom(std::size_t index, std::size_t used, std::size_t bytes, std::size_t alignment) {
+        if (index >= m_blocks.size()) {
+            return nullptr;
+        }
+
+        Block& block{ m_blocks[index] };
+        void* ptr{ block.data.get() + used };
+        std::size_t space{ block.size - used };
+        if (!std::align(alignment, bytes, ptr, space)) {
+            return nullptr;
+        }
+
+        m_current = index;
+        m_used = block.size - space + bytes;
+        ++block.live;
+        return ptr;
+    }
+
+private:
+    std::vector<Block> m_blocks{ };
+    std::size_t m_blockSize{ };
+    std::size_t m_current{ 0 }; // block being filled
+    std::size_t m_used{ 0 };    // bytes taken from it
+};
+
+
+using ArenaAllocator = std::pmr::polymorphic_allocator<char>;
+using ArenaFields = http::basic_fields<ArenaAllocator>;
+using ArenaStringBody = http::basic_string_body<char, std::char_traits<char>, ArenaAllocator>;
+
+
+// Containers whose allocator can take its memory from an Arena
+template <class T>
+concept UsesArena = requires { typename T::allocator_type; }
+    && std::is_constructible_v<typename T::allocator_type, std::pmr::memory_resource*>;
+
+
+// Piecewise arguments for a message, or a parser of one: the body and the fields take their
+// memory from the arena when their allocator can, the others use their default allocator.
+template <class Body, class Fields>
+auto ArenaMessageArgs(std::pmr::memory_resource* arena) {
+    auto allocatorArgs{ [arena]<class T>(std::type_identity<T>) {
+        if constexpr (UsesArena<T>) {
+            return std::make_tuple(typename T::allocator_type{ arena });
+        }
+        else {
+            return std::tuple<>{ };
+        }
+    } };
+
+    return std::make_tuple(std::piecewise_construct,
+        allocatorArgs(std::type_identity<typename Body::value_type>{ }),
+        allocatorArgs(std::type_identity<Fields>{ }));
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <functional>
+#include <utility>
+
+
+// A response body without data ready answers http::error::need_buffer. The session serializing it
+// is the current waiter of its thread for that time: such a body takes a waker from it and calls
+// the waker, from any thread, once it has data again. The session then resumes the write.
+class BodyWaiter {
+public:
+    using Waker = std::function<void()>;
+
+    // Sets the current waiter of this thread for its lifetime
+    class Scope {
+    public:
+        explicit Scope(BodyWaiter& waiter)
+            : m_previous{ std::exchange(t_current, &waiter) }
+        {
+        }
+
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+
+        ~Scope() {
+            t_current = m_previous;
+        }
+
+    private:
+        BodyWaiter* m_previous;
+    };
+
+    // Null while no session is serializing a response on this thread
+    static BodyWaiter* Current() { return t_current; }
+
+    virtual Waker MakeWaker() = 0;
+
+protected:
+    ~BodyWaiter() = default;
+
+private:
+    static inline thread_local BodyWaiter* t_current{ nullptr };
+};
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+
+// The open connections of a server, so it can shut down without dropping requests.
+// A session registers a callback that winds it down and Stop() calls them all. Thread-safe.
+class Connections {
+public:
+
+    using Callback = std::function<void()>;
+
+    // Returns false if the server is stopping, the session should close right away then
+    bool Add(const void* session, Callback stop) {
+        std::lock_guard lock{ m_mutex };
+        if (m_isStopping) {
+            return false;
+        }
+
+        m_sessions.emplace(session, std::move(stop));
+        return true;
+    }
+
+    void Remove(const void* session) {
+        std::lock_guard lock{ m_mutex };
+        m_sessions.erase(session);
+    }
+
+    // Asks every session to finish the requests it has read and close
+    void Stop() {
+        std::vector<Callback> callbacks{ };
+        {
+            std::lock_guard lock{ m_mutex };
+            if (m_isStopping) {
+                return;
+            }
+
+            m_isStopping = true;
+            for (const auto& [session, stop] : m_sessions) {
+                callbacks.push_back(stop);
+            }
+        }
+
+        // Not called under the lock, a session may remove itself meanwhile
+        for (const auto& stop : callbacks) {
+            stop();
+        }
+    }
+
+    bool IsStopping() const {
+        std::lock_guard lock{ m_mutex };
+        return m_isStopping;
+    }
+
+    std::size_t Count() const {
+        std::lock_guard lock{ m_mutex };
+        return m_sessions.size();
+    }
+
+private:
+    mutable std::mutex m_mutex{ };
+    std::unordered_map<const void*, Callback> m_sessions{ };
+    bool m_isStopping{ false };
+};
@@ -29,22 +29,48 @@ namespace net = boost::asio;            // from <boost/asio.hpp>
 using tcp = boost::asio::ip::tcp;       // from <boost/asio/ip/tcp.hpp>
 
 
+#ifdef SO_REUSEPORT
+using ReusePort = net::detail::socket_option::boolean<SOL_SOCKET, SO_REUSEPORT>;
+inline constexpr bool SUPPORTS_REUSE_PORT{ true };
+#else
+inline constexpr bool SUPPORTS_REUSE_PORT{ false };
+#endif
+
+
+struct ListenerConfig {
+    // Several listeners bind the same endpoint and the kernel spreads the connections between them
+    bool reusePort{ false };
+
+    // Not needed when the io_context is run by a single thread
+    bool strandPerSession{ true };
+
+    SessionConfig session{ };
+
+    // Sessions register here to be drained on shutdown
+    std::shared_ptr<Connections> connections{ };
+};
+
+
 // Accepts incoming connections and launches the sessions
 template <class Body, class Allocator = http::basic_fields<std::allocator<char>>>
 class Listener : public std::enable_shared_from_this<Listener<Body, Allocator>> {
 public:
 
-    using HandlerPtr = std::shared_ptr<std::function<http::message_generator(http::request<Body, Allocator>)>>;
+    using HandlerPtr = typename Session<Body, Allocator>::Handlers;
     using LoggerPtr = std::shared_ptr<spdlog::logger>;
 
     Listener(net::io_context& ioc, 
         tcp::endpoint endpoint, 
         HandlerPtr handler, 
-        LoggerPtr logger);
+        LoggerPtr logger,
+        ListenerConfig config = { });
 
     // Start avoccepting incoming connections
     void Run();
 
+    // Closes the acceptor, the sessions it launched carry on. Thread-safe.
+    void Stop();
+
 private:
 
     void DoAccept();
@@ -57,6 +83,7 @@ private:
 
     HandlerPtr m_handler;
     LoggerPtr m_logger;
+    ListenerConfig m_config;
 };
 
 
@@ -65,11 +92,15 @@ Listener<Body, Allocator>::Listener(
     net::io_context& ioc,
     tcp::endpoint endpoint,
     HandlerPtr handler,
-    LoggerPtr logger)
+    LoggerPtr logger,
+    ListenerConfig config)
     : m_ioc(ioc)
-    , m_acceptor(net::make_strand(ioc))
+    , m_acceptor(config.strandPerSession
+        ? net::any_io_executor{ net::make_strand(ioc) }
+        : net::any_io_executor{ ioc.get_executor() })
     , m_handler(handler)
     , m_logger(logger)
+    , m_config(config)
 {
     beast::error_code ec;
 
@@ -77,28 +108,40 @@ Listener<Body, Allocator>::Listener(
     m_acceptor.open(endpoint.protocol(), ec);
     if (ec) {
         m_logger -> error(ec.what());
-        throw std::exception(ec.what().c_str());
+        throw beast::system_error{ ec };
     }
 
     // Allow address reuse
     m_acceptor.set_option(net::socket_base::reuse_address(true), ec);
     if (ec) {
         m_logger -> error(ec.what());
-        throw std::exception(ec.what().c_str());
+        throw beast::system_error{ ec };
+    }
+
+    if (m_config.reusePort) {
+#ifdef SO_REUSEPORT
+        m_acceptor.set_option(ReusePort{ true }, ec);
+#else
+        ec = net::error::operation_not_supported;
+#endif
+        if (ec) {
+            m_logger -> error(ec.what());
+            throw beast::system_error{ ec };
+        }
     }
 
     // Bind to the server address
     m_acceptor.bind(endpoint, ec);
     if (ec) {
         m_logger -> error(ec.what());
-        throw std::exception(ec.what().c_str());
+        throw beast::system_error{ ec };
     }
 
     // Start listening for connections
     m_acceptor.listen(net::socket_base::max_listen_connections, ec);
     if (ec) {
         m_logger -> error(ec.what());
-        throw std::exception(ec.what().c_str());
+        throw beast::system_error{ ec };
     }
 }
 
@@ -109,11 +152,25 @@ void Listener<Body, Allocator>::Run() {
 }
 
 
+template <class Body, class Allocator>
+void Listener<Body, Allocator>::Stop() {
+    net::dispatch(m_acceptor.get_executor(),
+        [self = this -> shared_from_this()]() {
+            beast::error_code ec;
+            self -> m_acceptor.close(ec);
+        });
+}
+
+
 template <class Body, class Allocator>
 void Listener<Body, Allocator>::DoAccept() {
-    // The new connection gets its own strand
+    // The new connection gets its own strand, unless the io_context has a single thread
+    auto executor{ m_config.strandPerSession
+        ? net::any_io_executor{ net::make_strand(m_ioc) }
+        : net::any_io_executor{ m_ioc.get_executor() } };
+
     m_acceptor.async_accept(
-        net::make_strand(m_ioc),
+        executor,
         beast::bind_front_handler(
             &Listener::OnAccept,
             this -> shared_from_this()));
@@ -121,6 +178,10 @@ void Listener<Body, Allocator>::DoAccept() {
 
 template <class Body, class Allocator>
 void Listener<Body, Allocator>::OnAccept(beast::error_code ec, tcp::socket socket) {
+    if (ec == net::error::operation_aborted) {
+        return; // Stopped
+    }
+
     if (ec) {
         m_logger->error(ec.what());
         return; // To avoid infinite loop
@@ -130,7 +191,9 @@ void Listener<Body, Allocator>::OnAccept(beast::error_code ec, tcp::socket socke
         auto session = std::make_shared<Session<Body, Allocator>>(
             std::move(socket),
             m_handler,
-            m_logger);
+            m_logger,
+            m_config.session,
+            m_config.connections);
 
         session->Run();
     }
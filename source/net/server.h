@@ -5,23 +5,37 @@
 #include <boost/beast/http.hpp>
 #include <boost/beast/version.hpp>
 #include <boost/asio/dispatch.hpp>
+#include <boost/asio/signal_set.hpp>
+#include <boost/asio/steady_timer.hpp>
 #include <boost/asio/strand.hpp>
 #include <boost/config.hpp>
 #include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <csignal>
 #include <cstdlib>
+#include <cstring>
 #include <functional>
 #include <iostream>
 #include <memory>
+#include <mutex>
+#include <optional>
 #include <string>
 #include <thread>
 #include <vector>
 #include <stdexcept>
 
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
 
 #include "spdlog/spdlog.h"
 #include "spdlog/async.h" //поддержка асинхронного ведения журнала.
 #include "spdlog/sinks/basic_file_sink.h"
 
+#include "connections.h"
 #include "listener.h"
 #include "session.h"
 
@@ -33,41 +47,140 @@ using tcp = boost::asio::ip::tcp;       // from <boost/asio/ip/tcp.hpp>
 
 using LoggerPtr = std::shared_ptr<spdlog::logger>;
 
+
+enum class IoMode {
+    // One io_context run by every thread behind a single acceptor
+    Shared,
+
+    // One io_context and one SO_REUSEPORT listener per thread,
+    // a connection stays on the thread that accepted it
+    PerThread
+};
+
+
+struct ServerConfig {
+    int threads{ 1 };
+    IoMode mode{ IoMode::Shared };
+
+    // Thread i runs on core i % hardware_concurrency (Linux only)
+    bool pinThreads{ false };
+
+    SessionConfig session{ };
+
+    // How long Shutdown() waits for the open connections before it stops the io threads
+    std::chrono::milliseconds drainTimeout{ 10'000 };
+
+    // SIGTERM and SIGINT start Shutdown()
+    bool handleSignals{ false };
+};
+
 template <class Body, class Allocator = http::basic_fields<std::allocator<char>>>
 class Server {
 public:
+    using ResponseCallback = typename Session<Body, Allocator>::ResponseCallback;
+    using Handler = std::function<http::message_generator(http::request<Body, Allocator>)>;
+    using AsyncHandler = std::function<void(http::request<Body, Allocator>, ResponseCallback)>;
+    using CoroutineHandler = std::function<net::awaitable<http::message_generator>(http::request<Body, Allocator>)>;
+
     Server(net::ip::address address, unsigned short port, int countThreads = 1);
 
-    void Run(const std::function<http::message_generator(
-        http::request<Body, Allocator>)>& handler);
+    Server(net::ip::address address, unsigned short port, ServerConfig config);
+
+    void Run(const Handler& handler);
 
+    // The handler passes the response to the callback instead of returning it,
+    // so it can wait for the database without holding an io thread.
+    void Run(const AsyncHandler& handler);
+
+    // Each request is handled by a coroutine co_spawned on the session strand.
+    void Run(const CoroutineHandler& handler);
+
+    // Stops accepting and lets every session answer the requests it has read with
+    // "Connection: close". The io threads stop once the sessions are gone or after
+    // ServerConfig::drainTimeout, then Run returns. Thread-safe, does not block.
+    void Shutdown();
+
+    // Shutdown(), then waits for the io threads started by Run
     void Stop();
 
+    // Executor of one server io_context. IoMode::Shared has a single one,
+    // IoMode::PerThread one per thread, index < CountContexts().
+    net::any_io_executor GetExecutor(std::size_t index = 0) { return m_contexts.at(index) -> get_executor(); }
+
+    // Executors of every io_context, so asynchronous database queries stay on the thread that started them
+    std::vector<net::any_io_executor> GetExecutors();
+
+    std::size_t CountContexts() const { return m_contexts.size(); }
+
     ~Server();
 
+private:
+
+    void RunListener(typename Session<Body, Allocator>::Handlers handler);
+
+    void RunThread(int index);
+
+    void PinThread(int index);
+
+    // Checks the open connections until none is left or the deadline passes
+    void Drain(std::chrono::steady_clock::time_point deadline);
+
+    void StopContexts();
+
 private:
 
     net::ip::address m_address{ };
     unsigned short m_port{ };
-    int m_countThreads{ };
-    net::io_context m_ioc{ };
+    ServerConfig m_config{ };
+    std::vector<std::unique_ptr<net::io_context>> m_contexts{ };
     std::vector<std::thread> m_threads{ };
     LoggerPtr m_logger{ };
+
+    std::shared_ptr<Connections> m_connections{ std::make_shared<Connections>() };
+    std::mutex m_listenersMutex{ };
+    std::vector<std::shared_ptr<Listener<Body, Allocator>>> m_listeners{ };
+    std::atomic<bool> m_isShuttingDown{ false };
+
+    // On the first io_context, declared after it to be destroyed first
+    std::optional<net::steady_timer> m_drainTimer{ };
+    std::optional<net::signal_set> m_signals{ };
 };
 
 
 
 template <class Body, class Allocator>
 Server<Body, Allocator>::Server(net::ip::address address, unsigned short port, int countThreads)
+    : Server{ address, port, ServerConfig{ countThreads } }
+{
+
+}
+
+
+template <class Body, class Allocator>
+Server<Body, Allocator>::Server(net::ip::address address, unsigned short port, ServerConfig config)
     : m_address{ address }
     , m_port{ port }
-    , m_countThreads{ countThreads }
-    , m_ioc{ countThreads }
+    , m_config{ config }
 {
-    if (countThreads < 1) {
+    if (m_config.threads < 1) {
         throw std::invalid_argument("The number of threads cannot be less than one");
     }
 
+    if (m_config.mode == IoMode::PerThread) {
+        if (!SUPPORTS_REUSE_PORT) {
+            throw std::invalid_argument("IoMode::PerThread needs SO_REUSEPORT");
+        }
+
+        for (int i{ 0 }; i < m_config.threads; ++i) {
+            m_contexts.push_back(std::make_unique<net::io_context>(1));
+        }
+    }
+    else {
+        m_contexts.push_back(std::make_unique<net::io_context>(m_config.threads));
+    }
+
+    m_drainTimer.emplace(*m_contexts.front());
+
     m_logger = spdlog::get("ServerBibBub");
     if (!m_logger) {
         m_logger = spdlog::basic_logger_mt<spdlog::async_factory>("ServerBibBub", "logs/server.txt");
@@ -77,30 +190,91 @@ Server<Body, Allocator>::Server(net::ip::address address, unsigned short port, i
 
 
 template <class Body, class Allocator>
-void Server<Body, Allocator>::Run(const std::function<http::message_generator(
-    http::request<Body, Allocator>)>& handler) {
+std::vector<net::any_io_executor> Server<Body, Allocator>::GetExecutors() {
+    std::vector<net::any_io_executor> executors{ };
+    executors.reserve(m_contexts.size());
+    for (auto& context : m_contexts) {
+        executors.push_back(context -> get_executor());
+    }
+
+    return executors;
+}
+
+
+
+template <class Body, class Allocator>
+void Server<Body, Allocator>::Run(const Handler& handler) {
+    Run(AsyncHandler{
+        [handler](http::request<Body, Allocator> req, ResponseCallback send) {
+            send(handler(std::move(req)));
+        } });
+}
+
+
+template <class Body, class Allocator>
+void Server<Body, Allocator>::Run(const AsyncHandler& handler) {
+    RunListener(std::make_shared<AsyncHandler>(handler));
+}
+
+
+template <class Body, class Allocator>
+void Server<Body, Allocator>::Run(const CoroutineHandler& handler) {
+    RunListener(std::make_shared<CoroutineHandler>(handler));
+}
+
+
+template <class Body, class Allocator>
+void Server<Body, Allocator>::RunListener(typename Session<Body, Allocator>::Handlers funcPtr) {
     try {
-        m_logger -> info("Server starting on {}:{}", m_address.to_string(), m_port);
+        const bool isPerThread{ m_config.mode == IoMode::PerThread };
+        m_logger -> info("Server starting on {}:{} with {} threads, {} io_context(s)",
+            m_address.to_string(), m_port, m_config.threads, m_contexts.size());
 
         auto endpoint{ net::ip::tcp::endpoint{ m_address, m_port } };
-        auto funcPtr{ std::make_shared<std::function<http::message_generator(http::request<Body, Allocator>)>>(handler) };
 
-        std::make_shared<Listener<Body, Allocator>>(
-            m_ioc,
-            endpoint,
-            funcPtr,
-            m_logger)->Run();
+        ListenerConfig listenerConfig{ };
+        listenerConfig.reusePort = isPerThread;
+        listenerConfig.strandPerSession = !isPerThread;
+        listenerConfig.session = m_config.session;
+        listenerConfig.connections = m_connections;
+
+        {
+            std::lock_guard lock{ m_listenersMutex };
+            if (m_isShuttingDown) {
+                return;
+            }
 
-        for (auto threadCounter{ m_countThreads - 1 }; threadCounter > 0; --threadCounter) {
+            for (auto& ioc : m_contexts) {
+                m_listeners.push_back(std::make_shared<Listener<Body, Allocator>>(
+                    *ioc,
+                    endpoint,
+                    funcPtr,
+                    m_logger,
+                    listenerConfig));
+                m_listeners.back()->Run();
+            }
+        }
+
+        if (m_config.handleSignals) {
+            m_signals.emplace(*m_contexts.front(), SIGINT, SIGTERM);
+            m_signals->async_wait([this](beast::error_code ec, int signal) {
+                if (!ec) {
+                    m_logger -> info("Signal {} received", signal);
+                    Shutdown();
+                }
+            });
+        }
+
+        for (int index{ 1 }; index < m_config.threads; ++index) {
             m_threads.emplace_back(
-                [this]
+                [this, index]
                 {
-                    m_ioc.run();
+                    RunThread(index);
                 });
         }
 
 
-        m_ioc.run();
+        RunThread(0);
     }
     catch (const std::exception& ex) {
         m_logger -> error("Exception during server start: {}", ex.what());
@@ -108,20 +282,100 @@ void Server<Body, Allocator>::Run(const std::function<http::message_generator(
 }
 
 template <class Body, class Allocator>
-void Server<Body, Allocator>::Stop() {
+void Server<Body, Allocator>::RunThread(int index) {
+    if (m_config.pinThreads) {
+        PinThread(index);
+    }
+
+    auto& ioc{ m_config.mode == IoMode::PerThread ? *m_contexts[index] : *m_contexts.front() };
+    ioc.run();
+}
+
+
+template <class Body, class Allocator>
+void Server<Body, Allocator>::PinThread(int index) {
+#ifdef __linux__
+    const unsigned cores{ std::max(1u, std::thread::hardware_concurrency()) };
+
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(static_cast<unsigned>(index) % cores, &set);
+
+    if (int error{ pthread_setaffinity_np(pthread_self(), sizeof(set), &set) }; error != 0) {
+        m_logger -> warn("Thread {} was not pinned: {}", index, std::strerror(error));
+    }
+#else
+    m_logger -> warn("Thread {} was not pinned: not supported on this platform", index);
+#endif
+}
+
+
+template <class Body, class Allocator>
+void Server<Body, Allocator>::Shutdown() {
+    if (m_isShuttingDown.exchange(true)) {
+        return;
+    }
+
+    m_logger -> info("Server shutting down, draining {} connections", m_connections -> Count());
+    {
+        std::lock_guard lock{ m_listenersMutex };
+        for (auto& listener : m_listeners) {
+            listener -> Stop();
+        }
+    }
+
+    m_connections -> Stop();
+    Drain(std::chrono::steady_clock::now() + m_config.drainTimeout);
+}
+
+
+template <class Body, class Allocator>
+void Server<Body, Allocator>::Drain(std::chrono::steady_clock::time_point deadline) {
+    m_drainTimer -> expires_after(std::chrono::milliseconds{ 10 });
+    m_drainTimer -> async_wait([this, deadline](beast::error_code ec) {
+        if (ec) {
+            return;
+        }
+
+        const std::size_t open{ m_connections -> Count() };
+        if (open != 0 && std::chrono::steady_clock::now() < deadline) {
+            return Drain(deadline);
+        }
+
+        if (open != 0) {
+            m_logger -> warn("Drain timeout, {} connections are dropped", open);
+        }
+        StopContexts();
+    });
+}
+
+
+template <class Body, class Allocator>
+void Server<Body, Allocator>::StopContexts() {
     m_logger -> info("Server stopping");
-    m_ioc.stop();
+    for (auto& ioc : m_contexts) {
+        ioc -> stop();
+    }
+}
+
+
+template <class Body, class Allocator>
+void Server<Body, Allocator>::Stop() {
+    Shutdown();
+
     for (auto& thread : m_threads) {
         if (thread.joinable()) {
             thread.join();
         }
     }
-
 }
 
 
 template <class Body, class Allocator>
 Server<Body, Allocator>::~Server() {
-    spdlog::drop("ServerBibBub");
     Stop();
+
+    // The logger writes in the background, the last messages are flushed before it is dropped
+    m_logger -> flush();
+    spdlog::drop("ServerBibBub");
 }
\ No newline at end of file
@@ -5,18 +5,29 @@
 #include <boost/beast/http.hpp>
 #include <boost/beast/version.hpp>
 #include <boost/asio/dispatch.hpp>
+#include <boost/asio/post.hpp>
 #include <boost/asio/strand.hpp>
+#include <boost/asio/awaitable.hpp>
+#include <boost/asio/co_spawn.hpp>
 #include <boost/config.hpp>
 
 #include <algorithm>
+#include <chrono>
+#include <cstdint>
 #include <cstdlib>
 #include <functional>
 #include <iostream>
 #include <memory>
+#include <optional>
 #include <string>
 #include <thread>
+#include <variant>
 #include <vector>
 
+#include "arena.h"
+#include "bodyWaiter.h"
+#include "connections.h"
+
 
 namespace beast = boost::beast;         // from <boost/beast.hpp>
 namespace http = beast::http;           // from <boost/beast/http.hpp>
@@ -24,70 +35,224 @@ namespace net = boost::asio;            // from <boost/asio.hpp>
 using tcp = boost::asio::ip::tcp;       // from <boost/asio/ip/tcp.hpp>
 
 
+struct SessionConfig {
+	// Deadline for the first request of a connection and for the body of every request
+	std::chrono::milliseconds readTimeout{ 30'000 };
+
+	// How long a kept-alive connection may wait for the header of its next request
+	std::chrono::milliseconds keepAliveTimeout{ 30'000 };
+
+	// Larger requests are answered with 413 and 431, the connection is closed
+	std::uint64_t bodyLimit{ 1024 * 1024 };
+	std::uint32_t headerLimit{ 8 * 1024 };
+
+	// Messages with arena fields or bodies (arena.h) take their memory from blocks of this size
+	std::size_t arenaBlockSize{ 16 * 1024 };
+
+	// Pipelined requests of one connection handled at the same time, one turns pipelining off
+	std::size_t pipelineLimit{ 16 };
+
+	// Responses ready in order are gathered into one write up to this size
+	std::size_t maxWriteSize{ 64 * 1024 };
+};
 
 
 template <class Body, class Allocator = http::basic_fields<std::allocator<char>>>
-class Session : public std::enable_shared_from_this<Session<Body, Allocator>> {
+class Session : public std::enable_shared_from_this<Session<Body, Allocator>>, private BodyWaiter {
 public:
 
     using LoggerPtr = std::shared_ptr<spdlog::logger>;
-	using HandlerPtr = std::shared_ptr<std::function<http::message_generator(http::request<Body, Allocator>)>>;
+	using ResponseCallback = std::function<void(http::message_generator)>;
+	using HandlerPtr = std::shared_ptr<std::function<void(http::request<Body, Allocator>, ResponseCallback)>>;
+	using CoroutineHandlerPtr = std::shared_ptr<std::function<
+		net::awaitable<http::message_generator>(http::request<Body, Allocator>)>>;
+	using Handlers = std::variant<HandlerPtr, CoroutineHandlerPtr>;
+	using Parser = http::request_parser<Body, typename Allocator::allocator_type>;
 
-	// Take ownership of the stream
-	Session(tcp::socket&& socket, HandlerPtr handler, LoggerPtr logger);
+	// Take ownership of the stream. The session registers with connections, if given, to be drained on shutdown.
+	Session(tcp::socket&& socket, Handlers handler, LoggerPtr logger, SessionConfig config = { },
+		std::shared_ptr<Connections> connections = nullptr);
 
 
 	void Run();
 
+	// Starts the next read if the pipeline has room for another request
+	void ReadNext();
+
 	void DoRead();
 
+	void OnReadHeader(beast::error_code ec, std::size_t bytes_transferred);
+
 	void OnRead(beast::error_code ec, std::size_t bytes_transferred);
 
-	void SendResponse(http::message_generator&& msg);
+	// Answers a request that broke a limit and closes the connection
+	void SendLimitExceeded(http::status status);
 
-	void OnWrite(bool keep_alive, beast::error_code ec,
-		std::size_t bytes_transferred);
+	// Runs the coroutine handler on the session strand and sends its response
+	net::awaitable<void> DoHandle(http::request<Body, Allocator> req, std::uint64_t sequence);
+
+	// A failed handler is answered with 500 in its turn, then the connection is closed
+	void OnHandle(std::uint64_t sequence, std::exception_ptr error);
+
+	// Queues the response to the request with this sequence number, responses are written in request order
+	void SendResponse(std::uint64_t sequence, http::message_generator&& msg);
+
+	// Serializes the responses ready at the front of the queue into one buffer and writes it
+	void DoWrite();
+
+	void OnWrite(beast::error_code ec, std::size_t bytes_transferred);
+
+	// A body without data ready calls it once it has some, the write goes on from the session strand
+	Waker MakeWaker() override;
+
+	// The server is shutting down: the requests read so far are answered with "Connection: close"
+	void OnStop();
 
 	void DoClose();
 
 	~Session();
 
+private:
+
+	bool IsIdle() const { return m_firstPending == m_nextSequence; }
+
+	// Deadline of the read or write about to start. The stream keeps a timer per direction and
+	// expires_after sets only the directions without a pending operation, so a read or write
+	// already in flight keeps its own deadline.
+	void SetDeadline(std::chrono::milliseconds timeout);
+
+	// Cancels the read of a connection that waits for its next request
+	void CloseIfWaiting();
+
+	// While stopping, the response to the last request read closes the connection
+	bool IsLastResponse() const;
+
+	// Replaces the Connection field of a serialized header with "Connection: close"
+	static void CloseConnection(std::string& serialized);
+
 private:
 	beast::flat_buffer m_buffer;
 	beast::tcp_stream m_stream;
-	HandlerPtr m_handler;
-	LoggerPtr m_logger;;
-	http::request<http::string_body> m_req;
+	Handlers m_handler;
+	LoggerPtr m_logger;
+	SessionConfig m_config;
+	Arena m_arena;
+	std::optional<Parser> m_parser;
+	bool m_isKeptAlive{ false };
+
+	// Ring of pipelineLimit slots, the response to request n waits in slot n % pipelineLimit
+	std::vector<std::optional<http::message_generator>> m_responses;
+	std::uint64_t m_firstPending{ 0 }; // oldest request without a written response
+	std::uint64_t m_nextSequence{ 0 };
+	beast::flat_buffer m_writeBuffer;
+	bool m_isReading{ false };
+	bool m_isWriting{ false };
+	bool m_isReadDone{ false }; // no more requests are read on this connection
+	bool m_isClosing{ false };  // the last response is being written
+	bool m_isPartial{ false };  // the front response is written over several writes
+	bool m_isWaitingBody{ false }; // the front response waits for its body to call the waker
+
+	std::shared_ptr<Connections> m_connections;
+	bool m_isStopping{ false };
 };
 
 
 template <class Body, class Allocator>
 Session<Body, Allocator>::Session(tcp::socket&& socket, 
-	HandlerPtr handler, 
-	LoggerPtr logger)
+	Handlers handler, 
+	LoggerPtr logger,
+	SessionConfig config,
+	std::shared_ptr<Connections> connections)
 	: m_stream(std::move(socket))
 	, m_handler(handler)
 	, m_logger(logger)
-	, m_req()
+	, m_config(config)
+	, m_arena(config.arenaBlockSize)
+	, m_responses(std::max<std::size_t>(config.pipelineLimit, 1))
+	, m_connections(std::move(connections))
 {
 
 }
 
 template <class Body, class Allocator>
 void Session<Body, Allocator>::Run() {
+	if (m_connections) {
+		std::weak_ptr<Session> weak{ this -> shared_from_this() };
+		bool isAdded{ m_connections -> Add(this, [weak]() {
+			if (auto self{ weak.lock() }) {
+				net::dispatch(self -> m_stream.get_executor(),
+					beast::bind_front_handler(&Session::OnStop, self));
+			}
+		}) };
+
+		// Accepted while the server was stopping
+		if (!isAdded) {
+			return DoClose();
+		}
+	}
+
 	net::dispatch(m_stream.get_executor(),
 		beast::bind_front_handler(
 			&Session::DoRead, 
 			this -> shared_from_this()));
 }
 
+
+template <class Body, class Allocator>
+void Session<Body, Allocator>::ReadNext() {
+	if (m_isReading || m_isReadDone || m_nextSequence - m_firstPending >= m_responses.size()) {
+		return;
+	}
+
+	// Pipelined requests that already arrived are still answered
+	if (m_isStopping && m_buffer.size() == 0) {
+		m_isReadDone = true;
+		if (IsIdle() && !m_isWriting) {
+			DoClose();
+		}
+		return;
+	}
+
+	// Pipelined requests are parsed as soon as their bytes are buffered. Otherwise the read waits
+	// for the last response, so the keep-alive timeout counts from there.
+	if (!IsIdle() && m_buffer.size() == 0) {
+		return;
+	}
+
+	DoRead();
+}
+
+
 template <class Body, class Allocator>
 void Session<Body, Allocator>::DoRead() {
-	m_req = { };
+	// The arena starts over once the previous request and response are gone
+	std::apply([this](auto&&... args) {
+		m_parser.emplace(std::forward<decltype(args)>(args)...);
+	}, ArenaMessageArgs<Body, Allocator>(&m_arena));
+	m_parser -> body_limit(m_config.bodyLimit);
+	m_parser -> header_limit(m_config.headerLimit);
+
+	const bool isWaiting{ m_isKeptAlive && IsIdle() && m_buffer.size() == 0 };
+	SetDeadline(isWaiting ? m_config.keepAliveTimeout : m_config.readTimeout);
+
+	m_isReading = true;
+	http::async_read_header(m_stream, m_buffer, *m_parser,
+		beast::bind_front_handler(
+			&Session::OnReadHeader,
+			this -> shared_from_this()));
+}
 
-	m_stream.expires_after(std::chrono::seconds(30));
 
-	http::async_read(m_stream, m_buffer, m_req,
+template <class Body, class Allocator>
+void Session<Body, Allocator>::OnReadHeader(beast::error_code ec, std::size_t bytes_transferred) {
+	// Requests without a body are complete with the header
+	if (ec || m_parser -> is_done()) {
+		return OnRead(ec, bytes_transferred);
+	}
+
+	SetDeadline(m_config.readTimeout);
+
+	http::async_read(m_stream, m_buffer, *m_parser,
 		beast::bind_front_handler(
 			&Session::OnRead,
 			this -> shared_from_this()));
@@ -97,9 +262,27 @@ void Session<Body, Allocator>::DoRead() {
 template <class Body, class Allocator>
 void Session<Body, Allocator>::OnRead(beast::error_code ec, std::size_t bytes_transferred) {
 	boost::ignore_unused(bytes_transferred);
+	m_isReading = false;
 
-	// This means they closed the connection
+	// This means they closed the connection, the pending responses are still written
 	if (ec == http::error::end_of_stream) {
+		m_isReadDone = true;
+		if (IsIdle() && !m_isWriting) {
+			DoClose();
+		}
+		return;
+	}
+
+	if (ec == http::error::body_limit) {
+		return SendLimitExceeded(http::status::payload_too_large);
+	}
+
+	if (ec == http::error::header_limit) {
+		return SendLimitExceeded(http::status::request_header_fields_too_large);
+	}
+
+	// Cancelled by OnStop
+	if (ec == net::error::operation_aborted && m_isStopping) {
 		return DoClose();
 	}
 
@@ -108,48 +291,274 @@ void Session<Body, Allocator>::OnRead(beast::error_code ec, std::size_t bytes_tr
 		return;
 	}
 
-	// Send the response
-	SendResponse(m_handler -> operator()(std::move(m_req)));
+	// The response before it closed the connection on shutdown
+	if (m_isReadDone) {
+		return;
+	}
+
+	auto req{ m_parser -> release() };
+	const std::uint64_t sequence{ m_nextSequence++ };
+
+	// The handlers copy keep-alive from the request, so the client learns from the response
+	// that the connection is closed, instead of from a reset on its next request
+	if (m_isStopping) {
+		req.keep_alive(false);
+	}
+	m_isReadDone = !req.keep_alive();
+
+	if (std::holds_alternative<CoroutineHandlerPtr>(m_handler)) {
+		// Database waits suspend the coroutine, the strand is free to serve other sessions meanwhile
+		net::co_spawn(m_stream.get_executor(),
+			DoHandle(std::move(req), sequence),
+			beast::bind_front_handler(
+				&Session::OnHandle,
+				this -> shared_from_this(),
+				sequence));
+	}
+	else {
+		// The handler may complete on a database thread, so the response is sent from the session strand
+		std::get<HandlerPtr>(m_handler) -> operator()(std::move(req),
+			[self = this -> shared_from_this(), sequence](http::message_generator msg) {
+				net::dispatch(self -> m_stream.get_executor(),
+					[self, sequence, msg = std::move(msg)]() mutable {
+						self -> SendResponse(sequence, std::move(msg));
+					});
+			});
+	}
+
+	ReadNext();
+}
+
+
+template <class Body, class Allocator>
+void Session<Body, Allocator>::SendLimitExceeded(http::status status) {
+	http::response<http::empty_body> res{ status, 11 };
+	res.keep_alive(false);
+	res.prepare_payload();
+
+	m_isReadDone = true;
+	SendResponse(m_nextSequence++, std::move(res));
+}
+
+
+template <class Body, class Allocator>
+net::awaitable<void> Session<Body, Allocator>::DoHandle(http::request<Body, Allocator> req, std::uint64_t sequence) {
+	auto& handler{ std::get<CoroutineHandlerPtr>(m_handler) };
+
+	SendResponse(sequence, co_await handler -> operator()(std::move(req)));
+}
+
+
+template <class Body, class Allocator>
+void Session<Body, Allocator>::OnHandle(std::uint64_t sequence, std::exception_ptr error) {
+	if (!error) {
+		return;
+	}
+
+	try {
+		std::rethrow_exception(error);
+	}
+	catch (const std::exception& e) {
+		m_logger -> error("Exception: request handler failed: {}", e.what());
+	}
+	catch (...) {
+		m_logger -> error("Exception: request handler failed with an unknown exception");
+	}
+
+	http::response<http::empty_body> res{ http::status::internal_server_error, 11 };
+	res.keep_alive(false);
+	res.prepare_payload();
+
+	m_isReadDone = true;
+	SendResponse(sequence, std::move(res));
+}
+
+
+template <class Body, class Allocator>
+void Session<Body, Allocator>::SendResponse(std::uint64_t sequence, http::message_generator&& msg) {
+	m_responses[sequence % m_responses.size()].emplace(std::move(msg));
+	DoWrite();
 }
 
 
 template <class Body, class Allocator>
-void Session<Body, Allocator>::SendResponse(http::message_generator&& msg) {
-	bool keep_alive = msg.keep_alive();
+void Session<Body, Allocator>::DoWrite() {
+	if (m_isWriting || m_isClosing || m_isWaitingBody) {
+		return;
+	}
 
-	// Write the response
-	beast::async_write(
+	// A body answering http::error::need_buffer takes a waker from this session
+	BodyWaiter::Scope bodyWaiter{ *this };
+	bool isBodyPending{ false };
+	m_writeBuffer.consume(m_writeBuffer.size());
+	while (!IsIdle() && m_writeBuffer.size() < m_config.maxWriteSize) {
+		auto& response{ m_responses[m_firstPending % m_responses.size()] };
+		if (!response) {
+			break; // the next response in order is not ready yet
+		}
+
+		// The header comes with the first buffers of a response
+		const bool isClose{ !m_isPartial && response -> keep_alive() && IsLastResponse() };
+		bool isStart{ !m_isPartial };
+
+		while (!response -> is_done() && m_writeBuffer.size() < m_config.maxWriteSize) {
+			beast::error_code ec;
+			auto buffers{ response -> prepare(ec) };
+			if (ec == http::error::need_buffer) {
+				isBodyPending = true;
+				break;
+			}
+			if (ec) {
+				m_logger -> error(ec.what());
+				return DoClose();
+			}
+
+			std::size_t size{ net::buffer_size(buffers) };
+			if (isStart && isClose) {
+				std::string serialized{ beast::buffers_to_string(buffers) };
+				CloseConnection(serialized);
+				m_writeBuffer.commit(net::buffer_copy(m_writeBuffer.prepare(serialized.size()), net::buffer(serialized)));
+			}
+			else {
+				m_writeBuffer.commit(net::buffer_copy(m_writeBuffer.prepare(size), buffers));
+			}
+			response -> consume(size);
+			isStart = false;
+		}
+
+		// A large body goes out over several writes
+		m_isPartial = !response -> is_done();
+		if (m_isPartial) {
+			break;
+		}
+
+		const bool keepAlive{ response -> keep_alive() && !isClose };
+		response.reset();
+		++m_firstPending;
+
+		if (!keepAlive) {
+			// This means we should close the connection, usually because
+			// the response indicated the "Connection: close" semantic.
+			m_isClosing = true;
+			m_isReadDone = true;
+			break;
+		}
+	}
+
+	// What is ready goes out first, the write completes into DoWrite again
+	if (m_writeBuffer.size() == 0) {
+		m_isWaitingBody = isBodyPending;
+		return;
+	}
+
+	SetDeadline(m_config.readTimeout);
+
+	m_isWriting = true;
+	net::async_write(
 		m_stream,
-		std::move(msg),
+		m_writeBuffer.data(),
 		beast::bind_front_handler(
 			&Session::OnWrite, 
-			this -> shared_from_this(), 
-			keep_alive));
+			this -> shared_from_this()));
 }
 
 
 template <class Body, class Allocator>
 void Session<Body, Allocator>::OnWrite(
-	bool keep_alive,
 	beast::error_code ec,
 	std::size_t bytes_transferred)
 {
 	boost::ignore_unused(bytes_transferred);
+	m_isWriting = false;
 
 	if (ec) {
 		m_logger -> error(ec.what());
 		return;
 	}
 
-	if (!keep_alive)
-	{
-		// This means we should close the connection, usually because
-		// the response indicated the "Connection: close" semantic.
+	if (m_isClosing || (m_isReadDone && IsIdle())) {
 		return DoClose();
 	}
 
+	// Responses that got ready during the write
+	m_isKeptAlive = true;
+	DoWrite();
+
 	// Read another request
-	DoRead();
+	ReadNext();
+
+	CloseIfWaiting();
+}
+
+
+template <class Body, class Allocator>
+BodyWaiter::Waker Session<Body, Allocator>::MakeWaker() {
+	// A waker kept by a body must not keep the session that owns the body alive
+	return [weak = this -> weak_from_this()]() {
+		if (auto self{ weak.lock() }) {
+			net::post(self -> m_stream.get_executor(), [self]() {
+				self -> m_isWaitingBody = false;
+				self -> DoWrite();
+			});
+		}
+	};
+}
+
+
+template <class Body, class Allocator>
+void Session<Body, Allocator>::SetDeadline(std::chrono::milliseconds timeout) {
+	m_stream.expires_after(timeout);
+}
+
+
+template <class Body, class Allocator>
+void Session<Body, Allocator>::OnStop() {
+	m_isStopping = true;
+	CloseIfWaiting();
+}
+
+
+template <class Body, class Allocator>
+void Session<Body, Allocator>::CloseIfWaiting() {
+	// The cancel would take a pending write with it, so that waits for OnWrite
+	if (!m_isStopping || !m_isReading || m_isWriting || m_buffer.size() != 0 || m_parser -> got_some()) {
+		return;
+	}
+
+	m_isReadDone = true;
+	m_stream.cancel();
+}
+
+
+template <class Body, class Allocator>
+bool Session<Body, Allocator>::IsLastResponse() const {
+	return m_isStopping
+		&& m_firstPending + 1 == m_nextSequence
+		&& m_buffer.size() == 0
+		&& (!m_isReading || !m_parser -> got_some());
+}
+
+
+template <class Body, class Allocator>
+void Session<Body, Allocator>::CloseConnection(std::string& serialized) {
+	std::size_t end{ serialized.find("\r\n\r\n") };
+	if (end == std::string::npos) {
+		return;
+	}
+
+	// line is the CRLF in front of a field, the first one ends the status line
+	std::size_t line{ serialized.find("\r\n") };
+	while (line < end) {
+		std::size_t next{ serialized.find("\r\n", line + 2) };
+		if (beast::iequals(beast::string_view{ serialized }.substr(line + 2, 11), "connection:")) {
+			serialized.erase(line, next - line);
+			end -= next - line;
+			continue;
+		}
+		line = next;
+	}
+
+	serialized.insert(end, "\r\nConnection: close");
 }
 
 
@@ -165,4 +574,8 @@ void Session<Body, Allocator>::DoClose() {
 template <class Body, class Allocator>
 Session<Body, Allocator>::~Session() {
 	DoClose();
-}
\ No newline at end of file
+
+	if (m_connections) {
+		m_connections -> Remove(this);
+	}
+}
@@ -1,18 +1,45 @@
+#include <algorithm>
+#include <bit>
 #include <stdexcept>
 #include <utility>
 
 
 #include "random.h"
 
-std::mt19937 Random::Generate() {
+namespace {
+	std::uint64_t SplitMix64(std::uint64_t& state) {
+		std::uint64_t value{ state += 0x9e3779b97f4a7c15 };
+		value = (value ^ (value >> 30)) * 0xbf58476d1ce4e5b9;
+		value = (value ^ (value >> 27)) * 0x94d049bb133111eb;
+		return value ^ (value >> 31);
+	}
+
+	// Uniform in [0, range): words below 2^64 mod range would make the low values more likely
+	std::uint64_t Bounded(Random::Xoshiro256& engine, std::uint64_t range) {
+		const std::uint64_t threshold{ (0 - range) % range };
+		for (;;) {
+			std::uint64_t value{ engine() };
+			if (value >= threshold) {
+				return value % range;
+			}
+		}
+	}
+}
+
+Random::Xoshiro256::Xoshiro256(std::uint64_t seed) {
+	for (auto& word : m_state) {
+		word = SplitMix64(seed);
+	}
+}
+
+std::uint64_t Random::Seed() {
 	std::random_device rd{ };
 
-	// Create seed_seq with clock and 7 Random numbers from std::random_device
-	std::seed_seq ss{
-		static_cast<std::seed_seq::result_type>(std::chrono::steady_clock::now().time_since_epoch().count()),
-			rd(), rd(), rd(), rd(), rd(), rd(), rd() };
+	// Clock and 64 bits from std::random_device, threads seeded at the same time still differ
+	std::uint64_t seed{ static_cast<std::uint64_t>(std::chrono::steady_clock::now().time_since_epoch().count()) };
+	seed ^= (static_cast<std::uint64_t>(rd()) << 32) | rd();
 
-	return std::mt19937{ ss };
+	return SplitMix64(seed);
 }
 
 
@@ -32,19 +59,31 @@ Random::StringGenerator::StringGenerator(int len_from, int len_to, std::vector<c
     if (m_to < m_from) {
         std::swap(m_from, m_to);
     }
+
+    m_bits = std::max(1, static_cast<int>(std::bit_width(m_chars.size() - 1)));
+    m_mask = (std::uint64_t{ 1 } << m_bits) - 1;
 }
 
 
 std::string Random::StringGenerator::Generate() {
-    std::string sequence{ };
+    Xoshiro256& engine{ Engine() };
+
+    const std::uint64_t range{ static_cast<std::uint64_t>(m_to - m_from) + 1 };
+    std::size_t len{ static_cast<std::size_t>(m_from) + static_cast<std::size_t>(Bounded(engine, range)) };
+    std::string sequence(len, '\0');
 
-    std::size_t len{ static_cast<std::size_t>(Random::Get(m_from, m_to)) };
-    sequence.reserve(len);
+    const std::uint64_t count{ m_chars.size() };
+    std::size_t filled{ 0 };
+    while (filled < len) {
+        std::uint64_t word{ engine() };
+        for (int used{ 0 }; used + m_bits <= 64 && filled < len; used += m_bits) {
+            std::uint64_t chunk{ word & m_mask };
+            word >>= m_bits;
 
-    int min{ 0 };
-    int max{ static_cast<int>(m_chars.size() - 1) };
-    for (std::size_t i{ 0 }; i < len; ++i) {
-        sequence += m_chars[static_cast<std::size_t>(Random::Get(min, max))];
+            if (chunk < count) {
+                sequence[filled++] = m_chars[chunk];
+            }
+        }
     }
 
     return sequence;
@@ -1,24 +1,63 @@
 #pragma once
 
+#include <array>
 #include <chrono>
+#include <cstdint>
 #include <random>
 #include <vector>
 #include <string>
 
 
 namespace Random {
-	// Returns a seeded Mersenne Twister
-	// Note: we'd prefer to return a std::seed_seq (to initialize a std::mt19937), but std::seed can't be copied, so it can't be returned by value.
-	// Instead, we'll create a std::mt19937, seed it, and then return the std::mt19937 (which can be copied).
-	std::mt19937 Generate();
+	// xoshiro256** by Blackman and Vigna: 32 bytes of state and a few cycles per 64-bit word.
+	// Satisfies UniformRandomBitGenerator, so it works with the std distributions.
+	// Not cryptographically secure.
+	class Xoshiro256 {
+	public:
+		using result_type = std::uint64_t;
+
+		// The seed is expanded into the full state with splitmix64
+		explicit Xoshiro256(std::uint64_t seed);
+
+		static constexpr result_type min() { return 0; }
+		static constexpr result_type max() { return ~result_type{ 0 }; }
+
+		result_type operator()() {
+			const std::uint64_t result{ Rotl(m_state[1] * 5, 7) * 9 };
+			const std::uint64_t t{ m_state[1] << 17 };
+
+			m_state[2] ^= m_state[0];
+			m_state[3] ^= m_state[1];
+			m_state[1] ^= m_state[2];
+			m_state[0] ^= m_state[3];
+			m_state[2] ^= t;
+			m_state[3] = Rotl(m_state[3], 45);
+
+			return result;
+		}
+
+	private:
+
+		static constexpr std::uint64_t Rotl(std::uint64_t x, int k) {
+			return (x << k) | (x >> (64 - k));
+		}
 
-	// Here's our global std::mt19937 object.
-	// The inline keyword means we only have one global instance for our whole program.
-	inline std::mt19937 mt{ Generate() }; // generates a seeded std::mt19937 and copies it into our global object
+	private:
+		std::array<std::uint64_t, 4> m_state{ };
+	};
+
+	// Seed from std::random_device mixed with the clock
+	std::uint64_t Seed();
+
+	// Every thread has an engine of its own, seeded on first use, so no call needs a lock
+	inline Xoshiro256& Engine() {
+		thread_local Xoshiro256 engine{ Seed() };
+		return engine;
+	}
 
 	// Generate a Random int between [min, max] (inclusive)
 	inline int Get(int min, int max) {
-		return std::uniform_int_distribution{ min, max }(mt);
+		return std::uniform_int_distribution{ min, max }(Engine());
 	}
 
 	// Generate a Random value between [min, max] (inclusive)
@@ -31,7 +70,7 @@ namespace Random {
 	// Sample call: Random::Get(1u, 6u);             // returns unsigned int
 	template <typename T>
 	T Get(T min, T max) {
-		return std::uniform_int_distribution<T>{ min, max }(mt);
+		return std::uniform_int_distribution<T>{ min, max }(Engine());
 	}
 
 	// Generate a Random value between [min, max] (inclusive)
@@ -59,6 +98,8 @@ namespace Random {
 			int len_to = 16,
 			std::vector<char> chars = StringGenerator::baseChars);
 
+		// Characters are drawn from whole 64-bit words of the thread's engine: every word is cut into
+		// chunks of just enough bits for the alphabet, chunks past the alphabet are rejected
 		std::string Generate();
 
 	private:
@@ -66,5 +107,7 @@ namespace Random {
 		int m_from{ };
 		int m_to{ };
 		const std::vector<char> m_chars{ };
+		int m_bits{ }; // bits per chunk
+		std::uint64_t m_mask{ };
 	};
 }
\ No newline at end of file
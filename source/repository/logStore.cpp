@@ -0,0 +1,645 @@
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <mutex>
+#include <stdexcept>
+#include <utility>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "logStore.h"
+
+
+namespace LogStore {
+	namespace {
+		constexpr char MAGIC[8]{ 'U', 'R', 'L', 'S', 'L', 'O', 'G', '\0' };
+		constexpr std::uint32_t VERSION{ 1 };
+
+		// Largest payload the store writes, a record past the end of the log claiming more is not a torn append
+		constexpr std::size_t MAX_RECORD_SIZE{ 16 * 1024 * 1024 };
+
+		struct Header {
+			char magic[8]{ };
+			std::uint32_t version{ };
+			std::uint32_t reserved{ };
+			std::uint64_t nextId{ };     // ids below it were handed out, rows of some may be gone
+		};
+
+		enum class RecordType : std::uint32_t { Put = 1, Delete = 2, Accesses = 3 };
+
+		struct RecordHeader {
+			std::uint64_t checksum{ };   // FNV-1a of the type and the payload
+			std::uint32_t size{ };       // of the payload
+			std::uint32_t type{ };
+		};
+
+		// Payload of Put, followed by the code and the url
+		struct PutFields {
+			std::int64_t id{ };
+			std::int64_t createdAt{ };   // microseconds since the epoch
+			std::int64_t updatedAt{ };
+			std::uint64_t accessCount{ };
+			std::uint32_t codeLength{ };
+			std::uint32_t urlLength{ };
+		};
+
+		// Payload of Accesses, followed by the code. Delete is the code alone.
+		struct AccessFields {
+			std::uint64_t accessCount{ };
+		};
+
+		static_assert(sizeof(Header) == 24 && sizeof(RecordHeader) == 16 && sizeof(PutFields) == 40,
+			"the layout is part of the file format");
+
+		constexpr std::uint64_t FNV_OFFSET{ 0xcbf29ce484222325 };
+		constexpr std::uint64_t FNV_PRIME{ 0x100000001b3 };
+
+		std::uint64_t Fnv1a(std::uint64_t hash, const char* data, std::size_t size) {
+			for (std::size_t i{ 0 }; i < size; ++i) {
+				hash = (hash ^ static_cast<unsigned char>(data[i])) * FNV_PRIME;
+			}
+			return hash;
+		}
+
+		std::uint64_t Checksum(std::uint32_t type, std::string_view payload) {
+			return Fnv1a(Fnv1a(FNV_OFFSET, reinterpret_cast<const char*>(&type), sizeof(type)),
+				payload.data(), payload.size());
+		}
+
+		// Timestamps are stored with microseconds, the precision PostgreSQL keeps as well
+		TimePointSys Now() {
+			return std::chrono::floor<std::chrono::microseconds>(std::chrono::system_clock::now());
+		}
+
+		std::int64_t ToMicroseconds(TimePointSys time) {
+			return std::chrono::duration_cast<std::chrono::microseconds>(time.time_since_epoch()).count();
+		}
+
+		TimePointSys FromMicroseconds(std::int64_t micros) {
+			return TimePointSys{ std::chrono::duration_cast<TimePointSys::duration>(std::chrono::microseconds{ micros }) };
+		}
+
+		std::runtime_error SystemError(std::string_view what, const std::string& path) {
+			return std::runtime_error(std::string{ what } + " " + path + ": " + std::strerror(errno));
+		}
+
+		template <typename Fields>
+		void AppendRecord(std::string& out, RecordType type, const Fields* fields,
+			std::string_view first, std::string_view second = { }) {
+			const std::size_t fieldsSize{ fields ? sizeof(Fields) : 0 };
+			if (fieldsSize + first.size() + second.size() > MAX_RECORD_SIZE) {
+				throw std::invalid_argument("Record of " + std::to_string(fieldsSize + first.size() + second.size())
+					+ " bytes is larger than " + std::to_string(MAX_RECORD_SIZE));
+			}
+
+			RecordHeader header{ 0, static_cast<std::uint32_t>(fieldsSize + first.size() + second.size()),
+				static_cast<std::uint32_t>(type) };
+
+			const std::size_t start{ out.size() };
+			out.append(reinterpret_cast<const char*>(&header), sizeof(header));
+			if (fields) {
+				out.append(reinterpret_cast<const char*>(fields), sizeof(Fields));
+			}
+			out.append(first);
+			out.append(second);
+
+			header.checksum = Checksum(header.type, std::string_view{ out }.substr(start + sizeof(header)));
+			std::memcpy(out.data() + start, &header, sizeof(header));
+		}
+
+		void WriteAll(int fd, std::string_view data, const std::string& path) {
+			while (!data.empty()) {
+				ssize_t written{ ::write(fd, data.data(), data.size()) };
+				if (written < 0) {
+					if (errno == EINTR) {
+						continue;
+					}
+					throw SystemError("Cannot write", path);
+				}
+				data.remove_prefix(static_cast<std::size_t>(written));
+			}
+		}
+
+		std::string ReadAll(int fd, std::size_t size, const std::string& path) {
+			std::string data(size, '\0');
+			std::size_t offset{ 0 };
+			while (offset < size) {
+				ssize_t count{ ::pread(fd, data.data() + offset, size - offset, static_cast<off_t>(offset)) };
+				if (count < 0) {
+					if (errno == EINTR) {
+						continue;
+					}
+					throw SystemError("Cannot read", path);
+				}
+				if (count == 0) {
+					break;
+				}
+				offset += static_cast<std::size_t>(count);
+			}
+			data.resize(offset);
+			return data;
+		}
+
+		// Makes a rename in the directory of path durable
+		void SyncDirectory(const std::string& path) {
+			std::string directory{ std::filesystem::path{ path }.parent_path().string() };
+			if (directory.empty()) {
+				directory = ".";
+			}
+
+			int fd{ ::open(directory.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC) };
+			if (fd < 0) {
+				throw SystemError("Cannot open", directory);
+			}
+
+			const int result{ ::fsync(fd) };
+			::close(fd);
+			if (result != 0) {
+				throw SystemError("Cannot sync", directory);
+			}
+		}
+
+		std::string EncodeHeader(std::uint64_t nextId) {
+			Header header{ };
+			std::copy(std::begin(MAGIC), std::end(MAGIC), header.magic);
+			header.version = VERSION;
+			header.nextId = nextId;
+			return std::string{ reinterpret_cast<const char*>(&header), sizeof(header) };
+		}
+	}
+
+	UrlRepository::UrlRepository(std::string path, ShortCode::Encoder encoder, StoreConfig config, LoggerPtr logger)
+		: m_path{ std::move(path) }
+		, m_encoder{ std::move(encoder) }
+		, m_config{ std::move(config) }
+		, m_logger{ std::move(logger) }
+	{
+		m_fd = ::open(m_path.c_str(), O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+		if (m_fd < 0) {
+			throw SystemError("Cannot open", m_path);
+		}
+
+		try {
+			struct stat info { };
+			if (::fstat(m_fd, &info) != 0) {
+				throw SystemError("Cannot stat", m_path);
+			}
+
+			if (info.st_size == 0) {
+				Append(EncodeHeader(0));
+			}
+			else {
+				std::string data{ ReadAll(m_fd, static_cast<std::size_t>(info.st_size), m_path) };
+				Header header{ };
+				if (data.size() >= sizeof(Header)) {
+					std::memcpy(&header, data.data(), sizeof(Header));
+				}
+				if (data.size() < sizeof(Header) || !std::equal(std::begin(MAGIC), std::end(MAGIC), header.magic)
+					|| header.version != VERSION) {
+					throw std::runtime_error("Not a url log of this version: " + m_path);
+				}
+
+				m_nextId = header.nextId;
+				m_size = Replay(std::string_view{ data });
+				if (m_size < data.size()) {
+					if (m_logger) {
+						m_logger -> warn("Cutting off {} bytes of a torn record at the end of {}", data.size() - m_size, m_path);
+					}
+					if (::ftruncate(m_fd, static_cast<off_t>(m_size)) != 0) {
+						throw SystemError("Cannot truncate", m_path);
+					}
+				}
+
+				std::uint64_t live{ sizeof(Header) };
+				for (const auto& [code, row] : m_rows) {
+					live += sizeof(RecordHeader) + sizeof(PutFields) + code.size() + row.url.size();
+				}
+				if (m_config.compactOnOpen && m_size > 2 * live) {
+					Compact();
+				}
+			}
+		}
+		catch (...) {
+			::close(m_fd);
+			throw;
+		}
+
+		m_counter = std::make_unique<Counter::AccessCounter>(
+			[this](const Counter::AccessCounter::Batch& batch) { WriteAccesses(batch); },
+			m_config.counts,
+			m_logger);
+	}
+
+	UrlRepository::~UrlRepository() {
+		try {
+			Stop();
+			if (m_config.counts.flushOnShutdown) {
+				FlushAccesses(); // Stop flushes only a counter that was started
+			}
+		}
+		catch (const std::exception& e) {
+			if (m_logger) {
+				m_logger -> error("Exception: access counts were lost on close: {}", e.what());
+			}
+		}
+
+		::close(m_fd);
+	}
+
+	std::size_t UrlRepository::Replay(std::string_view data) {
+		const auto corrupt{ [this](std::size_t offset) {
+			return std::runtime_error("Corrupt record at offset " + std::to_string(offset) + " of " + m_path);
+		} };
+
+		// A crash during an append leaves the last record running past the end of the log. A bad size
+		// in the middle runs past it too, so only a record the store could have written counts as torn.
+		const auto isTorn{ [data](std::size_t offset, const RecordHeader& header) {
+			if (data.find_first_not_of('\0', offset) == std::string_view::npos) {
+				return true;
+			}
+			if (header.size > MAX_RECORD_SIZE) {
+				return false;
+			}
+
+			PutFields fields{ };
+			std::string_view payload{ data.substr(offset + sizeof(header)) };
+			if (static_cast<RecordType>(header.type) == RecordType::Put && payload.size() >= sizeof(fields)) {
+				std::memcpy(&fields, payload.data(), sizeof(fields));
+				return header.size == sizeof(fields) + std::uint64_t{ fields.codeLength } + fields.urlLength;
+			}
+			return true;
+		} };
+
+		std::size_t offset{ sizeof(Header) };
+		while (offset < data.size()) {
+			RecordHeader header{ };
+			if (data.size() - offset < sizeof(header)) {
+				return offset;
+			}
+			std::memcpy(&header, data.data() + offset, sizeof(header));
+			if (header.size > data.size() - offset - sizeof(header)) {
+				if (isTorn(offset, header)) {
+					return offset;
+				}
+				throw corrupt(offset);
+			}
+
+			// A bad record in the middle is not a torn append, cutting it off would lose the rows after it.
+			// Blocks the kernel had not written back may read as zeros after a crash.
+			std::string_view payload{ data.substr(offset + sizeof(header), header.size) };
+			const std::size_t end{ offset + sizeof(header) + header.size };
+			if (Checksum(header.type, payload) != header.checksum) {
+				if (end == data.size() || data.find_first_not_of('\0', offset) == std::string_view::npos) {
+					return offset;
+				}
+				throw corrupt(offset);
+			}
+
+			switch (static_cast<RecordType>(header.type)) {
+			case RecordType::Put: {
+				PutFields fields{ };
+				if (payload.size() < sizeof(fields)) {
+					throw corrupt(offset);
+				}
+				std::memcpy(&fields, payload.data(), sizeof(fields));
+				payload.remove_prefix(sizeof(fields));
+				if (payload.size() != std::uint64_t{ fields.codeLength } + fields.urlLength) {
+					throw corrupt(offset);
+				}
+
+				std::string code{ payload.substr(0, fields.codeLength) };
+				if (auto found{ m_rows.find(code) }; found != m_rows.end()) {
+					Erase(found);
+				}
+				Insert(std::move(code), Row{ fields.id, std::string{ payload.substr(fields.codeLength) },
+					FromMicroseconds(fields.createdAt), FromMicroseconds(fields.updatedAt), fields.accessCount });
+				m_nextId = std::max(m_nextId, static_cast<std::uint64_t>(fields.id) + 1);
+				break;
+			}
+			case RecordType::Delete:
+				if (auto found{ m_rows.find(payload) }; found != m_rows.end()) {
+					Erase(found);
+				}
+				break;
+			case RecordType::Accesses: {
+				AccessFields fields{ };
+				if (payload.size() < sizeof(fields)) {
+					throw corrupt(offset);
+				}
+				std::memcpy(&fields, payload.data(), sizeof(fields));
+				if (auto found{ m_rows.find(payload.substr(sizeof(fields))) }; found != m_rows.end()) {
+					found -> second.accessCount = fields.accessCount;
+				}
+				break;
+			}
+			default:
+				throw corrupt(offset);
+			}
+
+			offset = end;
+		}
+
+		return offset;
+	}
+
+	UrlRepository::Rows::iterator UrlRepository::Insert(std::string code, Row row) {
+		auto inserted{ m_rows.emplace(std::move(code), std::move(row)).first };
+		m_codesByUrl.try_emplace(inserted -> second.url, inserted -> first);
+		return inserted;
+	}
+
+	void UrlRepository::Erase(Rows::iterator row) {
+		auto byUrl{ m_codesByUrl.find(row -> second.url) };
+		if (byUrl != m_codesByUrl.end() && byUrl -> second == row -> first) {
+			m_codesByUrl.erase(byUrl);
+		}
+		m_rows.erase(row);
+	}
+
+	void UrlRepository::Append(const std::string& records) {
+		try {
+			WriteAll(m_fd, records, m_path);
+			if (m_config.syncWrites && ::fdatasync(m_fd) != 0) {
+				throw SystemError("Cannot sync", m_path);
+			}
+		}
+		catch (...) {
+			// A partial record would be cut off on the next open, the ones after it with it
+			[[maybe_unused]] int result{ ::ftruncate(m_fd, static_cast<off_t>(m_size)) };
+			throw;
+		}
+
+		m_size += records.size();
+	}
+
+	Url UrlRepository::ToUrl(const std::string& code, const Row& row, std::uint64_t pending) {
+		return Url{ static_cast<Id>(row.id), row.url, code, row.createdAt, row.updatedAt,
+			static_cast<int>(row.accessCount + pending) };
+	}
+
+	CreatedUrl UrlRepository::Create(std::string_view url) {
+		std::lock_guard<std::mutex> appendLock{ m_appendMutex };
+		if (auto found{ m_codesByUrl.find(url) }; found != m_codesByUrl.end()) {
+			auto row{ m_rows.find(found -> second) };
+			return CreatedUrl{ ToUrl(row -> first, row -> second), false };
+		}
+
+		std::string code{ m_encoder.Encode(m_nextId) };
+		const TimePointSys now{ Now() };
+		Row row{ static_cast<std::int64_t>(m_nextId), std::string{ url }, now, now, 0 };
+
+		std::string record{ };
+		PutFields fields{ row.id, ToMicroseconds(now), ToMicroseconds(now), 0,
+			static_cast<std::uint32_t>(code.size()), static_cast<std::uint32_t>(url.size()) };
+		AppendRecord(record, RecordType::Put, &fields, code, url);
+		Append(record);
+		++m_nextId;
+
+		std::unique_lock<std::shared_mutex> lock{ m_mutex };
+		auto inserted{ Insert(std::move(code), std::move(row)) };
+		return CreatedUrl{ ToUrl(inserted -> first, inserted -> second), true };
+	}
+
+	// All new rows go out in one append
+	std::vector<Url> UrlRepository::Create(Strings urls) {
+		std::lock_guard<std::mutex> appendLock{ m_appendMutex };
+
+		std::vector<Url> rows{ };
+		rows.reserve(urls.size());
+		std::vector<std::pair<std::string, Row>> created{ };
+		std::unordered_map<std::string_view, std::size_t> createdByUrl{ }; // url -> index in created
+		std::vector<std::size_t> repeated{ };                               // urls given again in the batch
+		std::string records{ };
+		const TimePointSys now{ Now() };
+		for (const std::string& url : urls) {
+			if (auto found{ m_codesByUrl.find(url) }; found != m_codesByUrl.end()) {
+				auto row{ m_rows.find(found -> second) };
+				rows.push_back(ToUrl(row -> first, row -> second));
+				continue;
+			}
+			if (auto found{ createdByUrl.find(url) }; found != createdByUrl.end()) {
+				repeated.push_back(found -> second);
+				continue;
+			}
+
+			const std::uint64_t id{ m_nextId + created.size() };
+			std::string code{ m_encoder.Encode(id) };
+			PutFields fields{ static_cast<std::int64_t>(id), ToMicroseconds(now), ToMicroseconds(now), 0,
+				static_cast<std::uint32_t>(code.size()), static_cast<std::uint32_t>(url.size()) };
+			AppendRecord(records, RecordType::Put, &fields, code, url);
+			createdByUrl.emplace(url, created.size());
+			created.emplace_back(std::move(code), Row{ static_cast<std::int64_t>(id), url, now, now, 0 });
+		}
+
+		if (!created.empty()) {
+			Append(records);
+			m_nextId += created.size();
+		}
+
+		std::unique_lock<std::shared_mutex> lock{ m_mutex };
+		const std::size_t first{ rows.size() };
+		for (auto& [code, row] : created) {
+			auto inserted{ Insert(std::move(code), std::move(row)) };
+			rows.push_back(ToUrl(inserted -> first, inserted -> second));
+		}
+		for (std::size_t index : repeated) {
+			Url repeat{ rows[first + index] };
+			rows.push_back(std::move(repeat));
+		}
+
+		return rows;
+	}
+
+	std::optional<Url> UrlRepository::Resolve(std::string_view shortCode) {
+		std::shared_lock<std::shared_mutex> lock{ m_mutex };
+		auto found{ m_rows.find(shortCode) };
+		if (found == m_rows.end()) {
+			return std::nullopt;
+		}
+
+		return ToUrl(found -> first, found -> second);
+	}
+
+	std::vector<Url> UrlRepository::BatchResolve(Strings shortCodes) {
+		std::vector<Url> rows{ };
+		rows.reserve(shortCodes.size());
+
+		std::shared_lock<std::shared_mutex> lock{ m_mutex };
+		for (const std::string& shortCode : shortCodes) {
+			auto found{ m_rows.find(shortCode) };
+			if (found != m_rows.end()) {
+				rows.push_back(ToUrl(found -> first, found -> second));
+			}
+		}
+
+		return rows;
+	}
+
+	// As the UPDATE of the database does, changing the url counts as an access
+	std::optional<Url> UrlRepository::Update(std::string_view shortCode, std::string_view url) {
+		std::lock_guard<std::mutex> appendLock{ m_appendMutex };
+		auto found{ m_rows.find(shortCode) };
+		if (found == m_rows.end()) {
+			return std::nullopt;
+		}
+
+		Row row{ found -> second };
+		row.url = url;
+		row.updatedAt = Now();
+		++row.accessCount;
+
+		std::string record{ };
+		PutFields fields{ row.id, ToMicroseconds(row.createdAt), ToMicroseconds(row.updatedAt), row.accessCount,
+			static_cast<std::uint32_t>(shortCode.size()), static_cast<std::uint32_t>(url.size()) };
+		AppendRecord(record, RecordType::Put, &fields, shortCode, url);
+		Append(record);
+
+		std::unique_lock<std::shared_mutex> lock{ m_mutex };
+		std::string code{ found -> first };
+		Erase(found);
+		auto inserted{ Insert(std::move(code), std::move(row)) };
+		return ToUrl(inserted -> first, inserted -> second);
+	}
+
+	bool UrlRepository::Delete(std::string_view shortCode) {
+		std::lock_guard<std::mutex> appendLock{ m_appendMutex };
+		auto found{ m_rows.find(shortCode) };
+		if (found == m_rows.end()) {
+			return false;
+		}
+
+		std::string record{ };
+		AppendRecord<AccessFields>(record, RecordType::Delete, nullptr, shortCode);
+		Append(record);
+
+		std::unique_lock<std::shared_mutex> lock{ m_mutex };
+		Erase(found);
+		return true;
+	}
+
+	std::optional<Url> UrlRepository::Stats(std::string_view shortCode) {
+		std::shared_lock<std::shared_mutex> lock{ m_mutex };
+		auto found{ m_rows.find(shortCode) };
+		if (found == m_rows.end()) {
+			return std::nullopt;
+		}
+
+		return ToUrl(found -> first, found -> second, m_counter -> Pending(shortCode));
+	}
+
+	void UrlRepository::RecordAccess(std::string_view shortCode) {
+		m_counter -> Record(shortCode);
+	}
+
+	// A record holds the total, so only the last one of a code is needed
+	void UrlRepository::WriteAccesses(const Counter::AccessCounter::Batch& batch) {
+		std::lock_guard<std::mutex> appendLock{ m_appendMutex };
+
+		std::vector<std::pair<Row*, std::uint64_t>> totals{ };
+		totals.reserve(batch.size());
+		std::string records{ };
+		for (const auto& [shortCode, count] : batch) {
+			auto found{ m_rows.find(shortCode) };
+			if (found == m_rows.end()) {
+				continue; // deleted since the access
+			}
+
+			AccessFields fields{ found -> second.accessCount + count };
+			AppendRecord(records, RecordType::Accesses, &fields, shortCode);
+			totals.emplace_back(&found -> second, fields.accessCount);
+		}
+
+		if (records.empty()) {
+			return;
+		}
+
+		Append(records);
+
+		std::unique_lock<std::shared_mutex> lock{ m_mutex };
+		for (auto [row, total] : totals) {
+			row -> accessCount = total;
+		}
+	}
+
+	void UrlRepository::Start() {
+		m_counter -> Start();
+	}
+
+	void UrlRepository::Stop() {
+		if (m_counter) {
+			m_counter -> Stop();
+		}
+	}
+
+	std::size_t UrlRepository::FlushAccesses() {
+		return m_counter -> Flush();
+	}
+
+	// Lookups go on while the live rows are written, changes wait for the new log
+	void UrlRepository::Compact() {
+		std::lock_guard<std::mutex> appendLock{ m_appendMutex };
+
+		const std::string temporary{ m_path + ".tmp" };
+		int fd{ ::open(temporary.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644) };
+		if (fd < 0) {
+			throw SystemError("Cannot create", temporary);
+		}
+
+		std::uint64_t size{ 0 };
+		try {
+			constexpr std::size_t BYTES_PER_WRITE{ 1024 * 1024 };
+			std::string data{ EncodeHeader(m_nextId) };
+			for (const auto& [code, row] : m_rows) {
+				PutFields fields{ row.id, ToMicroseconds(row.createdAt), ToMicroseconds(row.updatedAt), row.accessCount,
+					static_cast<std::uint32_t>(code.size()), static_cast<std::uint32_t>(row.url.size()) };
+				AppendRecord(data, RecordType::Put, &fields, code, row.url);
+
+				if (data.size() >= BYTES_PER_WRITE) {
+					WriteAll(fd, data, temporary);
+					size += data.size();
+					data.clear();
+				}
+			}
+			WriteAll(fd, data, temporary);
+			size += data.size();
+
+			if (::fsync(fd) != 0) {
+				throw SystemError("Cannot sync", temporary);
+			}
+		}
+		catch (...) {
+			::close(fd);
+			::unlink(temporary.c_str());
+			throw;
+		}
+
+		::close(fd);
+		if (::rename(temporary.c_str(), m_path.c_str()) != 0) {
+			::unlink(temporary.c_str());
+			throw SystemError("Cannot rename over", m_path);
+		}
+		SyncDirectory(m_path);
+
+		// The renamed file is the log now, appends go to it
+		int compacted{ ::open(m_path.c_str(), O_RDWR | O_APPEND | O_CLOEXEC) };
+		if (compacted < 0) {
+			throw SystemError("Cannot open", m_path);
+		}
+		::close(m_fd);
+		m_fd = compacted;
+		m_size = size;
+
+		if (m_logger) {
+			m_logger -> info("Compacted {} to {} rows, {} bytes", m_path, m_rows.size(), m_size);
+		}
+	}
+
+	std::size_t UrlRepository::Size() const {
+		std::shared_lock<std::shared_mutex> lock{ m_mutex };
+		return m_rows.size();
+	}
+}
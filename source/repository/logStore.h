@@ -0,0 +1,142 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+#include <spdlog/spdlog.h>
+
+#include "repository.h"
+#include "shortcode.h"
+#include "counter.h"
+
+
+// Urls stored in process, for a single node that does not need a database server.
+// Every change is appended to a log file, and a hash index in memory holds every live row,
+// so a lookup never touches the disk. Opening the store replays the log into the index.
+//
+// Log layout, in the byte order of the host that wrote it:
+//   Header | records (RecordHeader + payload), the last record of a code wins
+namespace LogStore {
+	struct StoreConfig {
+		// fdatasync after every append, otherwise writes the kernel had not written back are lost with the host
+		bool syncWrites{ false };
+
+		// Rewrite the log on open once it is more than twice the size of its live rows
+		bool compactOnOpen{ true };
+
+		// Accesses are counted in memory and appended to the log in batches
+		Counter::FlushConfig counts{ };
+	};
+
+
+	class UrlRepository : public IUrlRepository {
+	public:
+
+		using LoggerPtr = std::shared_ptr<spdlog::logger>;
+
+		// Opens the log at path, or creates it. A torn record at the end, left by a crash during
+		// an append, is cut off. New codes are the encoded ids of the store, they never repeat.
+		// Throws std::runtime_error if the file cannot be opened, is not a log of this version
+		// or has a corrupt record before its end.
+		UrlRepository(std::string path, ShortCode::Encoder encoder, StoreConfig config = { }, LoggerPtr logger = nullptr);
+
+		UrlRepository(const UrlRepository&) = delete;
+		UrlRepository& operator=(const UrlRepository&) = delete;
+
+		// Appends the pending access counts if FlushConfig::flushOnShutdown is set
+		~UrlRepository();
+
+		CreatedUrl Create(std::string_view url) override;
+
+		std::vector<Url> Create(Strings urls) override;
+
+		std::optional<Url> Resolve(std::string_view shortCode) override;
+
+		std::vector<Url> BatchResolve(Strings shortCodes) override;
+
+		std::optional<Url> Update(std::string_view shortCode, std::string_view url) override;
+
+		bool Delete(std::string_view shortCode) override;
+
+		std::optional<Url> Stats(std::string_view shortCode) override;
+
+		void RecordAccess(std::string_view shortCode) override;
+
+		// Starts appending the access counts every FlushConfig::interval
+		void Start();
+
+		void Stop();
+
+		// Appends the access counts recorded since the last flush
+		std::size_t FlushAccesses();
+
+		// Writes the live rows to a new log and renames it over the old one
+		void Compact();
+
+		std::size_t Size() const;
+
+	private:
+
+		struct StringHash {
+			using is_transparent = void;
+
+			std::size_t operator()(std::string_view key) const {
+				return std::hash<std::string_view>{ }(key);
+			}
+		};
+
+		struct Row {
+			std::int64_t id{ };
+			std::string url{ };
+			TimePointSys createdAt{ };
+			TimePointSys updatedAt{ };
+			std::uint64_t accessCount{ }; // written to the log, pending ones are in m_counter
+		};
+
+		// Nodes do not move, so the views of m_codesByUrl stay valid until their row is erased
+		using Rows = std::unordered_map<std::string, Row, StringHash, std::equal_to<>>;
+
+		// Replays the records of data into the index, returns the size without a torn record at the end.
+		// Throws std::runtime_error for a corrupt record followed by others.
+		std::size_t Replay(std::string_view data);
+
+		// Row of the url under code, appends nothing. Caller holds m_mutex exclusively.
+		Rows::iterator Insert(std::string code, Row row);
+
+		void Erase(Rows::iterator row);
+
+		// Appends encoded records, restores the log size if the write fails. Caller holds m_appendMutex.
+		void Append(const std::string& records);
+
+		// Counter::AccessCounter::Writer of the store
+		void WriteAccesses(const Counter::AccessCounter::Batch& batch);
+
+		static Url ToUrl(const std::string& code, const Row& row, std::uint64_t pending = 0);
+
+	private:
+		std::string m_path;
+		ShortCode::Encoder m_encoder;
+		StoreConfig m_config;
+		LoggerPtr m_logger;
+
+		// Serializes the changes. A change reads the index and appends its records under it alone,
+		// then takes m_mutex exclusively only to publish them, so lookups do not wait for the disk.
+		std::mutex m_appendMutex{ };
+
+		// Lookups share the index, changes take it exclusively
+		mutable std::shared_mutex m_mutex{ };
+		int m_fd{ -1 };
+		std::uint64_t m_size{ 0 };   // bytes of the log
+		std::uint64_t m_nextId{ 0 };
+		Rows m_rows{ };
+		std::unordered_map<std::string_view, std::string_view> m_codesByUrl{ }; // url -> one of its codes
+
+		std::unique_ptr<Counter::AccessCounter> m_counter{ };
+	};
+}
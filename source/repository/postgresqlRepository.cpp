@@ -0,0 +1,361 @@
+#include <stdexcept>
+#include <unordered_set>
+#include <utility>
+
+#include "postgresqlRepository.h"
+#include "postgresqlError.h"
+
+
+namespace PostgreSQL {
+	namespace {
+		// Reads are plain SELECTs, accesses are counted by Counter::AccessCounter and written in batches.
+		// Rows are selected as typed columns in the order ReadUrl expects.
+
+		// Returns the existing row of every url or inserts it under the code allocated for it,
+		// the last column tells which one happened. urls.url is not unique, imports keep every code
+		// of a url, so no index arbitrates concurrent creates of the same url. They are serialized by
+		// a transaction advisory lock per url hash instead, taken in hash order so batches cannot deadlock.
+		// A single statement would check for the url with the snapshot from before the lock, each statement
+		// of the function takes a new one and sees the row of a create that held the lock before.
+		// Nothing is returned for a url whose code was taken before codes were allocated,
+		// running it again with the next code creates it.
+		constexpr const char* SQL_CREATE_FUNCTION{
+			"CREATE OR REPLACE FUNCTION urls_create(new_urls text[], new_codes text[]) "
+			"RETURNS TABLE (id urls.id%TYPE, url urls.url%TYPE, shortcode urls.shortcode%TYPE, "
+			"createdat urls.createdat%TYPE, updatedat urls.updatedat%TYPE, iscreated boolean) "
+			"LANGUAGE plpgsql AS $$\n"
+			"#variable_conflict use_column\n"
+			"DECLARE lock_key integer; "
+			"BEGIN "
+			"FOR lock_key IN SELECT DISTINCT hashtext(new_url) FROM unnest(new_urls) AS new_url ORDER BY 1 LOOP "
+			"PERFORM pg_advisory_xact_lock(lock_key); "
+			"END LOOP; "
+			"RETURN QUERY SELECT DISTINCT ON (urls.url) urls.id, urls.url, urls.shortcode, urls.createdat, urls.updatedat, false "
+			"FROM urls WHERE urls.url = ANY(new_urls) ORDER BY urls.url, urls.id; "
+			"RETURN QUERY WITH inserted AS (INSERT INTO urls (url, shortcode) "
+			"SELECT DISTINCT ON (input.url) input.url, input.shortcode FROM unnest(new_urls, new_codes) AS input(url, shortcode) "
+			"WHERE NOT EXISTS (SELECT 1 FROM urls WHERE urls.url = input.url) ON CONFLICT DO NOTHING "
+			"RETURNING urls.id, urls.url, urls.shortcode, urls.createdat, urls.updatedat) "
+			"SELECT inserted.*, true FROM inserted; "
+			"END $$;" };
+
+		// $1 is the url, $2 the code allocated for it
+		constexpr const char* SQL_CREATE_URL{
+			"SELECT * FROM urls_create(ARRAY[$1::text], ARRAY[$2::text]);" };
+
+		// $1 holds the urls, $2 the codes allocated for them (text[]).
+		// Returns a row for every url that did not conflict, in no particular order.
+		constexpr const char* SQL_CREATE_URLS{
+			"SELECT id, url, shortcode, createdat, updatedat FROM urls_create($1::text[], $2::text[]);" };
+
+		// Statements of a create that keeps conflicting, every one with new codes
+		constexpr int CREATE_ATTEMPTS{ 3 };
+
+		constexpr const char* SQL_UPDATE_URL_BY_SHORT_CODE{
+			"UPDATE urls SET accesscount = accesscount + 1, url = $1 WHERE shortcode = $2 "
+			"RETURNING id, url, shortcode, createdat, updatedat;" };
+
+		constexpr const char* SQL_DELETE_BY_SHORT_CODE{
+			"DELETE FROM urls WHERE shortcode = $1 RETURNING id;" };
+
+		constexpr const char* SQL_SELECT_BY_SHORT_CODE{
+			"SELECT id, url, shortcode, createdat, updatedat FROM urls WHERE shortcode = $1;" };
+
+		// Batch form of SQL_SELECT_BY_SHORT_CODE, $1 is a text[] of codes
+		constexpr const char* SQL_SELECT_BY_SHORT_CODES{
+			"SELECT id, url, shortcode, createdat, updatedat FROM urls WHERE shortcode = ANY($1::text[]);" };
+
+		constexpr const char* SQL_FULL_STATS_BY_SHORT_CODE{
+			"SELECT id, url, shortcode, createdat, updatedat, accesscount FROM urls WHERE shortcode = $1;" };
+
+
+		Url ReadUrl(const IResultView& rows, int row, int accessCount = 0) {
+			return Url{
+				static_cast<Id>(rows.GetInt64(row, 0)),
+				rows.GetString(row, 1),
+				rows.GetString(row, 2),
+				rows.GetTimestamp(row, 3),
+				rows.GetTimestamp(row, 4),
+				accessCount };
+		}
+
+		// Converter for queries that return a single url or nothing
+		std::optional<Url> FirstUrlOrEmpty(const IResultView& rows) {
+			if (rows.Rows() == 0) {
+				return std::nullopt; // Nothing is found.
+			}
+
+			return ReadUrl(rows, 0);
+		}
+
+		// Same as FirstUrlOrEmpty, with the access count in the last column
+		std::optional<Url> FirstStatsOrEmpty(const IResultView& rows) {
+			if (rows.Rows() == 0) {
+				return std::nullopt;
+			}
+
+			return ReadUrl(rows, 0, static_cast<int>(rows.GetInt64(0, 5)));
+		}
+
+		std::optional<CreatedUrl> ReadCreatedUrl(const IResultView& rows) {
+			if (rows.Rows() == 0) {
+				return std::nullopt;
+			}
+
+			return CreatedUrl{ ReadUrl(rows, 0), rows.GetInt64(0, 5) != 0 };
+		}
+
+		bool HasRows(const IResultView& rows) {
+			return rows.Rows() != 0;
+		}
+
+		std::vector<Url> ReadUrls(const IResultView& rows) {
+			std::vector<Url> urls{ };
+			urls.reserve(rows.Rows());
+			for (int row{ 0 }; row < rows.Rows(); ++row) {
+				urls.push_back(ReadUrl(rows, row));
+			}
+
+			return urls;
+		}
+
+		using Params = std::vector<std::pair<std::string, std::string>>;
+
+		Params CodeParams(std::string shortCode) {
+			return Params{ std::make_pair(std::string{ "$1" }, std::move(shortCode)) };
+		}
+
+		// The urls without a row, a later attempt creates them
+		std::vector<std::string> TakeMissingUrls(std::vector<std::string> urls, const std::vector<Url>& rows) {
+			std::unordered_set<std::string_view> found{ };
+			for (const Url& row : rows) {
+				found.insert(row.GetUri());
+			}
+
+			std::erase_if(urls, [&found](const std::string& url) { return found.contains(url); });
+			return urls;
+		}
+
+		ExecuteError CreateConflictError() {
+			return ExecuteError("The url kept conflicting with concurrent creates.");
+		}
+	}
+
+	UrlRepository::UrlRepository(std::unique_ptr<IDatabase> database,
+		std::shared_ptr<ShortCode::Allocator> codes,
+		std::shared_ptr<Counter::AccessCounter> counter)
+		: m_database{ std::move(database) }
+		, m_codes{ std::move(codes) }
+		, m_counter{ std::move(counter) }
+	{
+		if (!m_database) {
+			throw std::invalid_argument("The database cannot be null.");
+		}
+
+		if (!m_codes) {
+			throw std::invalid_argument("The code allocator cannot be null.");
+		}
+
+		m_database -> Execute(SQL_CREATE_FUNCTION, { });
+		m_statements.createUrl = m_database -> Prepare(SQL_CREATE_URL);
+		m_statements.createUrls = m_database -> Prepare(SQL_CREATE_URLS);
+		m_statements.updateUrlByShortCode = m_database -> Prepare(SQL_UPDATE_URL_BY_SHORT_CODE);
+		m_statements.deleteByShortCode = m_database -> Prepare(SQL_DELETE_BY_SHORT_CODE);
+		m_statements.selectByShortCode = m_database -> Prepare(SQL_SELECT_BY_SHORT_CODE);
+		m_statements.selectByShortCodes = m_database -> Prepare(SQL_SELECT_BY_SHORT_CODES);
+		m_statements.fullStatsByShortCode = m_database -> Prepare(SQL_FULL_STATS_BY_SHORT_CODE);
+	}
+
+	std::string UrlRepository::TextArray(Strings values) {
+		std::string array{ "{" };
+		for (std::size_t i{ 0 }; i < values.size(); ++i) {
+			if (i != 0) {
+				array += ',';
+			}
+
+			array += '"';
+			for (char c : values[i]) {
+				if (c == '"' || c == '\\') {
+					array += '\\';
+				}
+				array += c;
+			}
+			array += '"';
+		}
+		array += '}';
+
+		return array;
+	}
+
+	// The url is found or inserted in one statement, another one runs only after a conflict
+	CreatedUrl UrlRepository::Create(std::string_view url) {
+		for (int attempt{ 0 }; attempt < CREATE_ATTEMPTS; ++attempt) {
+			std::optional<CreatedUrl> created{ m_database -> Query<std::optional<CreatedUrl>>(
+				m_statements.createUrl,
+				Params{ std::make_pair(std::string{ "$1" }, std::string{ url }), std::make_pair(std::string{ "$2" }, m_codes -> Next()) },
+				&ReadCreatedUrl) };
+
+			if (created) {
+				return std::move(*created);
+			}
+		}
+
+		throw CreateConflictError();
+	}
+
+	std::vector<Url> UrlRepository::Create(Strings urls) {
+		std::vector<Url> rows{ };
+		std::vector<std::string> pending(urls.begin(), urls.end());
+		for (int attempt{ 0 }; attempt < CREATE_ATTEMPTS; ++attempt) {
+			std::vector<std::string> codes{ m_codes -> Next(pending.size()) };
+			std::vector<Url> created{ m_database -> Query<std::vector<Url>>(
+				m_statements.createUrls,
+				Params{ std::make_pair(std::string{ "$1" }, TextArray(pending)), std::make_pair(std::string{ "$2" }, TextArray(codes)) },
+				&ReadUrls) };
+
+			pending = TakeMissingUrls(std::move(pending), created);
+			rows.insert(rows.end(), std::make_move_iterator(created.begin()), std::make_move_iterator(created.end()));
+			if (pending.empty()) {
+				return rows;
+			}
+		}
+
+		throw CreateConflictError();
+	}
+
+	std::optional<Url> UrlRepository::Resolve(std::string_view shortCode) {
+		return m_database -> Query<std::optional<Url>>(
+			m_statements.selectByShortCode, CodeParams(std::string{ shortCode }), &FirstUrlOrEmpty);
+	}
+
+	std::vector<Url> UrlRepository::BatchResolve(Strings shortCodes) {
+		return m_database -> Query<std::vector<Url>>(
+			m_statements.selectByShortCodes, CodeParams(TextArray(shortCodes)), &ReadUrls);
+	}
+
+	std::optional<Url> UrlRepository::Update(std::string_view shortCode, std::string_view url) {
+		return m_database -> Query<std::optional<Url>>(
+			m_statements.updateUrlByShortCode,
+			Params{ { "$1", std::string{ url } }, { "$2", std::string{ shortCode } } },
+			&FirstUrlOrEmpty);
+	}
+
+	bool UrlRepository::Delete(std::string_view shortCode) {
+		return m_database -> Query<bool>(
+			m_statements.deleteByShortCode, CodeParams(std::string{ shortCode }), &HasRows);
+	}
+
+	std::optional<Url> UrlRepository::Stats(std::string_view shortCode) {
+		return AddPendingAccesses(m_database -> Query<std::optional<Url>>(
+			m_statements.fullStatsByShortCode, CodeParams(std::string{ shortCode }), &FirstStatsOrEmpty));
+	}
+
+	void UrlRepository::RecordAccess(std::string_view shortCode) {
+		if (m_counter) {
+			m_counter -> Record(shortCode);
+		}
+	}
+
+	std::optional<Url> UrlRepository::AddPendingAccesses(std::optional<Url> stats) const {
+		if (!stats || !m_counter) {
+			return stats;
+		}
+
+		return Url{ stats -> GetId(), stats -> GetUri(), stats -> GetShortCode(), stats -> GetCreatedAt(), stats -> GetUpdatedAt(),
+			stats -> GetAccessCount() + static_cast<int>(m_counter -> Pending(stats -> GetShortCode())) };
+	}
+
+	// The callbacks are the completion handlers of the queries, they run on the thread that read the result
+
+	void UrlRepository::CreateAsync(std::string url, Callback<std::optional<CreatedUrl>> callback) {
+		TryCreateAsync(std::move(url), std::move(callback), 1);
+	}
+
+	void UrlRepository::CreateAsync(std::vector<std::string> urls, Callback<std::vector<Url>> callback) {
+		TryCreateAsync(std::move(urls), { }, std::move(callback), 1);
+	}
+
+	// The codes are leased without blocking too, the io thread never waits for nextval
+
+	void UrlRepository::TryCreateAsync(std::string url, Callback<std::optional<CreatedUrl>> callback, int attempt) {
+		m_codes -> NextAsync(1, [this, url = std::move(url), callback = std::move(callback), attempt](
+			std::exception_ptr error, std::vector<std::string> codes) mutable {
+			if (error) {
+				return callback(error, std::nullopt);
+			}
+
+			Params params{ std::make_pair(std::string{ "$1" }, url), std::make_pair(std::string{ "$2" }, std::move(codes.front())) };
+			m_database -> AsyncQuery<std::optional<CreatedUrl>>(m_statements.createUrl, params, &ReadCreatedUrl,
+				[this, url = std::move(url), callback = std::move(callback), attempt](
+					std::exception_ptr error, std::optional<CreatedUrl> created) mutable {
+					if (error || created) {
+						return callback(error, std::move(created));
+					}
+					if (attempt == CREATE_ATTEMPTS) {
+						return callback(std::make_exception_ptr(CreateConflictError()), std::nullopt);
+					}
+
+					TryCreateAsync(std::move(url), std::move(callback), attempt + 1);
+				});
+		});
+	}
+
+	void UrlRepository::TryCreateAsync(std::vector<std::string> urls, std::vector<Url> rows,
+		Callback<std::vector<Url>> callback, int attempt) {
+		const std::size_t count{ urls.size() };
+		m_codes -> NextAsync(count, [this, urls = std::move(urls), rows = std::move(rows), callback = std::move(callback), attempt](
+			std::exception_ptr error, std::vector<std::string> codes) mutable {
+			if (error) {
+				return callback(error, std::vector<Url>{ });
+			}
+
+			Params params{ std::make_pair(std::string{ "$1" }, TextArray(urls)), std::make_pair(std::string{ "$2" }, TextArray(codes)) };
+			m_database -> AsyncQuery<std::vector<Url>>(m_statements.createUrls, params, &ReadUrls,
+				[this, urls = std::move(urls), rows = std::move(rows), callback = std::move(callback), attempt](
+					std::exception_ptr error, std::vector<Url> created) mutable {
+					if (error) {
+						return callback(error, std::vector<Url>{ });
+					}
+
+					urls = TakeMissingUrls(std::move(urls), created);
+					rows.insert(rows.end(), std::make_move_iterator(created.begin()), std::make_move_iterator(created.end()));
+					if (urls.empty()) {
+						return callback(nullptr, std::move(rows));
+					}
+					if (attempt == CREATE_ATTEMPTS) {
+						return callback(std::make_exception_ptr(CreateConflictError()), std::vector<Url>{ });
+					}
+
+					TryCreateAsync(std::move(urls), std::move(rows), std::move(callback), attempt + 1);
+				});
+		});
+	}
+
+	void UrlRepository::ResolveAsync(std::string shortCode, Callback<std::optional<Url>> callback) {
+		m_database -> AsyncQuery<std::optional<Url>>(
+			m_statements.selectByShortCode, CodeParams(std::move(shortCode)), &FirstUrlOrEmpty, std::move(callback));
+	}
+
+	void UrlRepository::BatchResolveAsync(std::vector<std::string> shortCodes, Callback<std::vector<Url>> callback) {
+		m_database -> AsyncQuery<std::vector<Url>>(
+			m_statements.selectByShortCodes, CodeParams(TextArray(shortCodes)), &ReadUrls, std::move(callback));
+	}
+
+	void UrlRepository::UpdateAsync(std::string shortCode, std::string url, Callback<std::optional<Url>> callback) {
+		Params params{ std::make_pair(std::string{ "$1" }, std::move(url)), std::make_pair(std::string{ "$2" }, std::move(shortCode)) };
+		m_database -> AsyncQuery<std::optional<Url>>(m_statements.updateUrlByShortCode, params, &FirstUrlOrEmpty, std::move(callback));
+	}
+
+	void UrlRepository::DeleteAsync(std::string shortCode, Callback<bool> callback) {
+		m_database -> AsyncQuery<bool>(
+			m_statements.deleteByShortCode, CodeParams(std::move(shortCode)), &HasRows, std::move(callback));
+	}
+
+	void UrlRepository::StatsAsync(std::string shortCode, Callback<std::optional<Url>> callback) {
+		m_database -> AsyncQuery<std::optional<Url>>(
+			m_statements.fullStatsByShortCode, CodeParams(std::move(shortCode)), &FirstStatsOrEmpty,
+			[this, callback = std::move(callback)](std::exception_ptr error, std::optional<Url> stats) {
+				callback(error, error ? std::move(stats) : AddPendingAccesses(std::move(stats)));
+			});
+	}
+}
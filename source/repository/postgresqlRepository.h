@@ -0,0 +1,90 @@
+#pragma once
+
+#include <memory>
+
+#include "repository.h"
+#include "IDatabase.h"
+#include "shortcode.h"
+#include "counter.h"
+
+
+namespace PostgreSQL {
+	// The urls table behind IUrlRepository. Every operation is one prepared statement,
+	// the asynchronous variants are driven by the executor of the database.
+	class UrlRepository : public IUrlRepository {
+	public:
+
+		// Without a counter accesses are not counted.
+		// Throws std::invalid_argument if the database or the code allocator is null.
+		UrlRepository(std::unique_ptr<IDatabase> database,
+			std::shared_ptr<ShortCode::Allocator> codes,
+			std::shared_ptr<Counter::AccessCounter> counter = nullptr);
+
+		CreatedUrl Create(std::string_view url) override;
+
+		std::vector<Url> Create(Strings urls) override;
+
+		std::optional<Url> Resolve(std::string_view shortCode) override;
+
+		std::vector<Url> BatchResolve(Strings shortCodes) override;
+
+		std::optional<Url> Update(std::string_view shortCode, std::string_view url) override;
+
+		bool Delete(std::string_view shortCode) override;
+
+		std::optional<Url> Stats(std::string_view shortCode) override;
+
+		void RecordAccess(std::string_view shortCode) override;
+
+		void CreateAsync(std::string url, Callback<std::optional<CreatedUrl>> callback) override;
+
+		void CreateAsync(std::vector<std::string> urls, Callback<std::vector<Url>> callback) override;
+
+		void ResolveAsync(std::string shortCode, Callback<std::optional<Url>> callback) override;
+
+		void BatchResolveAsync(std::vector<std::string> shortCodes, Callback<std::vector<Url>> callback) override;
+
+		void UpdateAsync(std::string shortCode, std::string url, Callback<std::optional<Url>> callback) override;
+
+		void DeleteAsync(std::string shortCode, Callback<bool> callback) override;
+
+		void StatsAsync(std::string shortCode, Callback<std::optional<Url>> callback) override;
+
+		// COPY of the export and import, they have no counterpart in other storage
+		IDatabase& GetDatabase() { return *m_database; }
+
+		const ShortCode::Encoder& GetEncoder() const { return m_codes -> GetEncoder(); }
+
+		// text[] literal of the values
+		static std::string TextArray(Strings values);
+
+	private:
+
+		// Handles of the statements, prepared once per pooled connection
+		struct Statements {
+			StatementHandle createUrl{ };
+			StatementHandle createUrls{ };
+			StatementHandle updateUrlByShortCode{ };
+			StatementHandle deleteByShortCode{ };
+			StatementHandle selectByShortCode{ };
+			StatementHandle selectByShortCodes{ };
+			StatementHandle fullStatsByShortCode{ };
+		};
+
+		// Runs the create statement again with new codes while it returns nothing, up to a few attempts
+		void TryCreateAsync(std::string url, Callback<std::optional<CreatedUrl>> callback, int attempt);
+
+		// rows are the ones created by the earlier attempts
+		void TryCreateAsync(std::vector<std::string> urls, std::vector<Url> rows,
+			Callback<std::vector<Url>> callback, int attempt);
+
+		// Counts recorded since the last flush are not in the database yet
+		std::optional<Url> AddPendingAccesses(std::optional<Url> stats) const;
+
+	private:
+		std::unique_ptr<IDatabase> m_database;
+		std::shared_ptr<ShortCode::Allocator> m_codes;
+		std::shared_ptr<Counter::AccessCounter> m_counter;
+		Statements m_statements{ };
+	};
+}
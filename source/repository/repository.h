@@ -0,0 +1,184 @@
+#pragma once
+
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include <boost/asio/async_result.hpp>
+#include <boost/asio/associated_executor.hpp>
+#include <boost/asio/dispatch.hpp>
+
+#include "url.h"
+
+
+struct CreatedUrl {
+    Url url;
+    bool isCreated{ };
+};
+
+
+// Storage of the urls in the terms of the service, so the handler does not depend on the SQL
+// of one database. Implementations allocate the short codes of the urls they create.
+// Every method throws if the storage fails.
+class IUrlRepository {
+public:
+
+    template <typename Response>
+    using Callback = std::function<void(std::exception_ptr, Response)>;
+
+    using Strings = std::span<const std::string>;
+
+    virtual ~IUrlRepository() = default;
+
+    // Returns the existing row of the url or creates it under a new code
+    virtual CreatedUrl Create(std::string_view url) = 0;
+
+    // Batch form of Create, the urls are distinct. Returns a row for every url, in no particular order.
+    virtual std::vector<Url> Create(Strings urls) = 0;
+
+    virtual std::optional<Url> Resolve(std::string_view shortCode) = 0;
+
+    // Rows of the codes that exist, in no particular order
+    virtual std::vector<Url> BatchResolve(Strings shortCodes) = 0;
+
+    // Points the code at another url. Returns the updated row, or nothing if the code does not exist.
+    virtual std::optional<Url> Update(std::string_view shortCode, std::string_view url) = 0;
+
+    // Returns false if the code does not exist
+    virtual bool Delete(std::string_view shortCode) = 0;
+
+    // The row with its access count, including accesses not written yet
+    virtual std::optional<Url> Stats(std::string_view shortCode) = 0;
+
+    // Counts a lookup of the code, must not block on the storage
+    virtual void RecordAccess(std::string_view shortCode) = 0;
+
+    // Callback variants, for storage that answers without holding the calling thread.
+    // By default they run the blocking method and call back before returning.
+
+    // The created url is empty only together with an exception
+    virtual void CreateAsync(std::string url, Callback<std::optional<CreatedUrl>> callback) {
+        Complete(std::move(callback), [&]() { return Create(url); });
+    }
+
+    virtual void CreateAsync(std::vector<std::string> urls, Callback<std::vector<Url>> callback) {
+        Complete(std::move(callback), [&]() { return Create(Strings{ urls }); });
+    }
+
+    virtual void ResolveAsync(std::string shortCode, Callback<std::optional<Url>> callback) {
+        Complete(std::move(callback), [&]() { return Resolve(shortCode); });
+    }
+
+    virtual void BatchResolveAsync(std::vector<std::string> shortCodes, Callback<std::vector<Url>> callback) {
+        Complete(std::move(callback), [&]() { return BatchResolve(Strings{ shortCodes }); });
+    }
+
+    virtual void UpdateAsync(std::string shortCode, std::string url, Callback<std::optional<Url>> callback) {
+        Complete(std::move(callback), [&]() { return Update(shortCode, url); });
+    }
+
+    virtual void DeleteAsync(std::string shortCode, Callback<bool> callback) {
+        Complete(std::move(callback), [&]() { return Delete(shortCode); });
+    }
+
+    virtual void StatsAsync(std::string shortCode, Callback<std::optional<Url>> callback) {
+        Complete(std::move(callback), [&]() { return Stats(shortCode); });
+    }
+
+    // Asio-style wrappers over the callback variants: the completion handler is invoked
+    // on its associated executor with signature void(std::exception_ptr, Response).
+    template <typename CompletionToken>
+    auto AsyncCreate(std::string url, CompletionToken&& token) {
+        return Initiate<std::optional<CreatedUrl>>([this, url = std::move(url)](
+            Callback<std::optional<CreatedUrl>> callback) mutable {
+            CreateAsync(std::move(url), std::move(callback));
+        }, std::forward<CompletionToken>(token));
+    }
+
+    template <typename CompletionToken>
+    auto AsyncCreate(std::vector<std::string> urls, CompletionToken&& token) {
+        return Initiate<std::vector<Url>>([this, urls = std::move(urls)](Callback<std::vector<Url>> callback) mutable {
+            CreateAsync(std::move(urls), std::move(callback));
+        }, std::forward<CompletionToken>(token));
+    }
+
+    template <typename CompletionToken>
+    auto AsyncResolve(std::string shortCode, CompletionToken&& token) {
+        return Initiate<std::optional<Url>>([this, shortCode = std::move(shortCode)](Callback<std::optional<Url>> callback) mutable {
+            ResolveAsync(std::move(shortCode), std::move(callback));
+        }, std::forward<CompletionToken>(token));
+    }
+
+    template <typename CompletionToken>
+    auto AsyncBatchResolve(std::vector<std::string> shortCodes, CompletionToken&& token) {
+        return Initiate<std::vector<Url>>([this, shortCodes = std::move(shortCodes)](Callback<std::vector<Url>> callback) mutable {
+            BatchResolveAsync(std::move(shortCodes), std::move(callback));
+        }, std::forward<CompletionToken>(token));
+    }
+
+    template <typename CompletionToken>
+    auto AsyncUpdate(std::string shortCode, std::string url, CompletionToken&& token) {
+        return Initiate<std::optional<Url>>([this, shortCode = std::move(shortCode), url = std::move(url)](
+            Callback<std::optional<Url>> callback) mutable {
+            UpdateAsync(std::move(shortCode), std::move(url), std::move(callback));
+        }, std::forward<CompletionToken>(token));
+    }
+
+    template <typename CompletionToken>
+    auto AsyncDelete(std::string shortCode, CompletionToken&& token) {
+        return Initiate<bool>([this, shortCode = std::move(shortCode)](Callback<bool> callback) mutable {
+            DeleteAsync(std::move(shortCode), std::move(callback));
+        }, std::forward<CompletionToken>(token));
+    }
+
+    template <typename CompletionToken>
+    auto AsyncStats(std::string shortCode, CompletionToken&& token) {
+        return Initiate<std::optional<Url>>([this, shortCode = std::move(shortCode)](Callback<std::optional<Url>> callback) mutable {
+            StatsAsync(std::move(shortCode), std::move(callback));
+        }, std::forward<CompletionToken>(token));
+    }
+
+protected:
+
+    // Calls back with the result of func or the exception it threw
+    template <typename Response, typename Func>
+    static void Complete(Callback<Response> callback, Func&& func) {
+        Response response{ };
+        std::exception_ptr error{ };
+        try {
+            response = func();
+        }
+        catch (...) {
+            error = std::current_exception();
+        }
+
+        callback(error, std::move(response));
+    }
+
+private:
+
+    // start(callback) begins the operation, the callback is moved to the executor of the handler
+    template <typename Response, typename Start, typename CompletionToken>
+    auto Initiate(Start start, CompletionToken&& token) {
+        return boost::asio::async_initiate<CompletionToken, void(std::exception_ptr, Response)>(
+            [](auto handler, Start start) {
+                auto sharedHandler{ std::make_shared<decltype(handler)>(std::move(handler)) };
+
+                start(Callback<Response>{ [sharedHandler](std::exception_ptr error, Response response) {
+                    auto executor{ boost::asio::get_associated_executor(*sharedHandler) };
+                    boost::asio::dispatch(executor,
+                        [sharedHandler, error, response = std::move(response)]() mutable {
+                            (*sharedHandler)(error, std::move(response));
+                        });
+                } });
+            },
+            token, std::move(start));
+    }
+};
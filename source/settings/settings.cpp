@@ -0,0 +1,307 @@
+#include "settings.h"
+
+#include <algorithm>
+#include <cctype>
+#include <charconv>
+#include <fstream>
+#include <limits>
+#include <set>
+#include <sstream>
+#include <stdexcept>
+#include <type_traits>
+
+#include <nlohmann/json.hpp>
+
+
+namespace Settings {
+	namespace {
+		// Calls visit(section, name, field) for every setting, the names are the json keys
+		template <typename Visitor>
+		void VisitFields(Config& config, Visitor&& visit) {
+			auto& server{ config.server };
+			visit("server", "address", server.address);
+			visit("server", "port", server.port);
+			visit("server", "threads", server.threads);
+			visit("server", "io_mode", server.ioMode);
+			visit("server", "pin_threads", server.pinThreads);
+			visit("server", "read_timeout_ms", server.readTimeout);
+			visit("server", "keep_alive_timeout_ms", server.keepAliveTimeout);
+			visit("server", "body_limit", server.bodyLimit);
+			visit("server", "header_limit", server.headerLimit);
+			visit("server", "pipeline_limit", server.pipelineLimit);
+			visit("server", "max_write_size", server.maxWriteSize);
+			visit("server", "drain_timeout_ms", server.drainTimeout);
+
+			auto& database{ config.database };
+			visit("database", "host", database.host);
+			visit("database", "user", database.user);
+			visit("database", "password", database.password);
+			visit("database", "name", database.name);
+			visit("database", "port", database.port);
+			visit("database", "pool_min", database.poolMin);
+			visit("database", "pool_max", database.poolMax);
+			visit("database", "acquire_timeout_ms", database.acquireTimeout);
+			visit("database", "health_check_interval_ms", database.healthCheckInterval);
+			visit("database", "pipeline_connections", database.pipelineConnections);
+
+			visit("storage", "backend", config.storage.backend);
+			visit("storage", "path", config.storage.path);
+			visit("storage", "sync_writes", config.storage.syncWrites);
+
+			visit("cache", "capacity", config.cache.capacity);
+			visit("cache", "shards", config.cache.shards);
+
+			visit("counter", "flush_interval_ms", config.counter.flushInterval);
+			visit("counter", "max_batch_size", config.counter.maxBatchSize);
+
+			visit("code", "key", config.code.key);
+			visit("code", "block_size", config.code.blockSize);
+
+			visit("handler", "pretty_print", config.handler.prettyPrint);
+			visit("handler", "redirect_status", config.handler.redirectStatus);
+			visit("handler", "cache_control", config.handler.cacheControl);
+			visit("handler", "batch_max_urls", config.handler.batchMaxUrls);
+			visit("handler", "batch_rows_per_statement", config.handler.batchRowsPerStatement);
+			visit("handler", "batch_max_codes", config.handler.batchMaxCodes);
+			visit("handler", "export_chunk_size", config.handler.exportChunkSize);
+			visit("handler", "import_chunk_size", config.handler.importChunkSize);
+			visit("handler", "import_max_rejects", config.handler.importMaxRejects);
+			visit("handler", "admin_threads", config.handler.adminThreads);
+			visit("handler", "admin_token", config.handler.adminToken);
+
+			visit("snapshot", "path", config.snapshot.path);
+			visit("snapshot", "reload_interval_ms", config.snapshot.reloadInterval);
+			visit("snapshot", "verify_checksum", config.snapshot.verifyChecksum);
+		}
+
+
+		std::invalid_argument InvalidValue(std::string_view section, std::string_view name, std::string_view value) {
+			std::ostringstream message{ };
+			message << "Invalid value \"" << value << "\" for setting " << section << "." << name;
+			return std::invalid_argument(message.str());
+		}
+
+
+		// Integers are decimal, or hexadecimal with a 0x prefix
+		template <typename Integer>
+		bool ParseInteger(std::string_view text, Integer& value) {
+			int base{ 10 };
+			if (text.size() > 2 && text[0] == '0' && (text[1] == 'x' || text[1] == 'X')) {
+				text.remove_prefix(2);
+				base = 16;
+			}
+
+			auto [end, error] { std::from_chars(text.data(), text.data() + text.size(), value, base) };
+			return !text.empty() && error == std::errc{ } && end == text.data() + text.size();
+		}
+
+
+		bool Parse(std::string_view text, std::string& value) {
+			value = text;
+			return true;
+		}
+
+		bool Parse(std::string_view text, bool& value) {
+			std::string lower{ text };
+			std::transform(lower.begin(), lower.end(), lower.begin(),
+				[](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+
+			if (lower == "true" || lower == "1" || lower == "yes" || lower == "on") {
+				value = true;
+				return true;
+			}
+
+			if (lower == "false" || lower == "0" || lower == "no" || lower == "off") {
+				value = false;
+				return true;
+			}
+
+			return false;
+		}
+
+		bool Parse(std::string_view text, std::chrono::milliseconds& value) {
+			std::chrono::milliseconds::rep count{ };
+			if (!ParseInteger(text, count) || count < 0) {
+				return false;
+			}
+
+			value = std::chrono::milliseconds{ count };
+			return true;
+		}
+
+		template <typename Integer>
+			requires std::is_integral_v<Integer>
+		bool Parse(std::string_view text, Integer& value) {
+			return ParseInteger(text, value);
+		}
+
+
+		std::string EnvironmentName(std::string_view section, std::string_view name) {
+			std::string variable{ "URL_SHORTENER_" };
+			for (std::string_view part : { section, std::string_view{ "_" }, name }) {
+				for (char c : part) {
+					variable += static_cast<char>(std::toupper(static_cast<unsigned char>(c)));
+				}
+			}
+
+			return variable;
+		}
+	}
+
+
+	Config Defaults(unsigned cores) {
+		const int threads{ static_cast<int>(std::max(1u, cores)) };
+
+		Config config{ };
+		config.server.threads = threads;
+
+		// One connection per core to start with, the pool grows under load
+		config.database.poolMin = threads;
+		config.database.poolMax = 4 * threads;
+
+		// Concurrent lookups share a few pipelined connections, the rest of the pool takes the overflow
+		config.database.pipelineConnections = static_cast<std::size_t>(std::max(1, threads / 4));
+
+		return config;
+	}
+
+
+	void ApplyJson(Config& config, std::string_view json) {
+		nlohmann::json document{ };
+		try {
+			document = nlohmann::json::parse(json);
+		}
+		catch (const nlohmann::json::parse_error& e) {
+			throw std::invalid_argument(std::string{ "Settings are not valid json: " } + e.what());
+		}
+
+		if (!document.is_object()) {
+			throw std::invalid_argument("Settings have to be a json object");
+		}
+
+		std::set<std::string> known{ };
+		VisitFields(config, [&](std::string_view section, std::string_view name, auto& field) {
+			known.insert(std::string{ section } + "." + std::string{ name });
+
+			auto sectionIt{ document.find(section) };
+			if (sectionIt == document.end() || !sectionIt -> is_object()) {
+				return;
+			}
+
+			auto valueIt{ sectionIt -> find(name) };
+			if (valueIt == sectionIt -> end()) {
+				return;
+			}
+
+			// Numbers and booleans go through the same parser as environment variables
+			const bool isString{ valueIt -> is_string() };
+			std::string text{ isString ? valueIt -> template get<std::string>() : valueIt -> dump() };
+
+			constexpr bool isStringField{ std::is_same_v<std::remove_cvref_t<decltype(field)>, std::string> };
+			if (valueIt -> is_structured() || (isStringField && !isString) || !Parse(text, field)) {
+				throw InvalidValue(section, name, text);
+			}
+		});
+
+		for (const auto& [section, values] : document.items()) {
+			if (!values.is_object()) {
+				throw std::invalid_argument("Settings section " + section + " has to be a json object");
+			}
+
+			for (const auto& [name, value] : values.items()) {
+				if (!known.contains(section + "." + name)) {
+					throw std::invalid_argument("Unknown setting " + section + "." + name);
+				}
+			}
+		}
+	}
+
+
+	void ApplyEnvironment(Config& config, const Environment& environment) {
+		VisitFields(config, [&](std::string_view section, std::string_view name, auto& field) {
+			const char* value{ environment(EnvironmentName(section, name).c_str()) };
+			if (value && !Parse(value, field)) {
+				throw InvalidValue(section, name, value);
+			}
+		});
+	}
+
+
+	void Validate(const Config& config) {
+		const auto& server{ config.server };
+		if (server.threads < 1) {
+			throw std::invalid_argument("server.threads cannot be less than one");
+		}
+
+		if (server.ioMode != "shared" && server.ioMode != "per_thread") {
+			throw std::invalid_argument("server.io_mode has to be shared or per_thread");
+		}
+
+		if (server.readTimeout.count() == 0 || server.keepAliveTimeout.count() == 0) {
+			throw std::invalid_argument("server timeouts have to be positive");
+		}
+
+		if (server.pipelineLimit == 0 || server.maxWriteSize == 0) {
+			throw std::invalid_argument("server.pipeline_limit and server.max_write_size have to be positive");
+		}
+
+		if (config.storage.backend != "postgresql" && config.storage.backend != "log") {
+			throw std::invalid_argument("storage.backend has to be postgresql or log");
+		}
+
+		if (config.storage.backend == "log" && config.storage.path.empty()) {
+			throw std::invalid_argument("storage.path is needed by the log backend");
+		}
+
+		const auto& database{ config.database };
+		if (database.poolMin < 1 || database.poolMax < database.poolMin) {
+			throw std::invalid_argument("database.pool_min has to be positive and not above database.pool_max");
+		}
+
+		if (config.cache.capacity == 0 || config.cache.shards == 0) {
+			throw std::invalid_argument("cache.capacity and cache.shards have to be positive");
+		}
+
+		switch (config.handler.redirectStatus) {
+		case 301: case 302: case 307: case 308:
+			break;
+		default:
+			throw std::invalid_argument("handler.redirect_status has to be 301, 302, 307 or 308");
+		}
+
+		if (config.handler.batchMaxUrls == 0 || config.handler.batchRowsPerStatement == 0 || config.handler.batchMaxCodes == 0) {
+			throw std::invalid_argument("handler.batch_max_urls, handler.batch_rows_per_statement and handler.batch_max_codes have to be positive");
+		}
+
+		if (config.handler.exportChunkSize == 0 || config.handler.importChunkSize == 0) {
+			throw std::invalid_argument("handler.export_chunk_size and handler.import_chunk_size have to be positive");
+		}
+
+		if (config.handler.adminThreads == 0) {
+			throw std::invalid_argument("handler.admin_threads has to be positive");
+		}
+
+		if (config.snapshot.reloadInterval.count() == 0) {
+			throw std::invalid_argument("snapshot.reload_interval_ms has to be positive");
+		}
+	}
+
+
+	Config Load(Config defaults, const std::string& path, const Environment& environment) {
+		if (!path.empty()) {
+			std::ifstream file{ path };
+			if (!file) {
+				throw std::runtime_error("Cannot read settings file " + path);
+			}
+
+			std::ostringstream text{ };
+			text << file.rdbuf();
+			ApplyJson(defaults, text.str());
+		}
+
+		ApplyEnvironment(defaults, environment);
+		Validate(defaults);
+
+		return defaults;
+	}
+}
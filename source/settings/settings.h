@@ -0,0 +1,123 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <thread>
+
+
+// Runtime settings of the service, so one binary can be tuned per host without a rebuild.
+// Every setting has a key "section.name" in the json file and an environment variable
+// URL_SHORTENER_SECTION_NAME, the variable wins over the file and the file over the defaults.
+namespace Settings {
+	struct Server {
+		std::string address{ "0.0.0.0" };
+		std::uint16_t port{ 8080 };
+
+		int threads{ 1 };
+		std::string ioMode{ "shared" }; // "shared" or "per_thread"
+		bool pinThreads{ false };
+
+		std::chrono::milliseconds readTimeout{ 30'000 };
+		std::chrono::milliseconds keepAliveTimeout{ 30'000 };
+		std::uint64_t bodyLimit{ 1024 * 1024 };
+		std::uint32_t headerLimit{ 8 * 1024 };
+		std::size_t pipelineLimit{ 16 };
+		std::size_t maxWriteSize{ 64 * 1024 };
+		std::chrono::milliseconds drainTimeout{ 10'000 };
+	};
+
+	struct Database {
+		std::string host{ "localhost" };
+		std::string user{ };
+		std::string password{ };
+		std::string name{ };
+		int port{ 5432 };
+
+		int poolMin{ 1 };
+		int poolMax{ 1 };
+		std::chrono::milliseconds acquireTimeout{ 500 };
+		std::chrono::milliseconds healthCheckInterval{ 5000 };
+		std::size_t pipelineConnections{ 0 };
+	};
+
+	struct Cache {
+		std::size_t capacity{ 100'000 };
+		std::size_t shards{ 16 };
+	};
+
+	struct Counter {
+		std::chrono::milliseconds flushInterval{ 1000 };
+		std::size_t maxBatchSize{ 1000 };
+	};
+
+	struct Code {
+		// Every instance writing to the same table has to use the same key
+		std::uint64_t key{ 0x2545'f491'4f6c'dd1d };
+		std::uint64_t blockSize{ 1000 };
+	};
+
+	struct Handler {
+		bool prettyPrint{ false };
+		int redirectStatus{ 302 };
+		std::string cacheControl{ };
+		std::size_t batchMaxUrls{ 100'000 };
+		std::size_t batchRowsPerStatement{ 1000 };
+		std::size_t batchMaxCodes{ 1000 };
+		std::size_t exportChunkSize{ 64 * 1024 };
+		std::size_t importChunkSize{ 64 * 1024 };
+		std::size_t importMaxRejects{ 1000 };
+		std::size_t adminThreads{ 1 };
+
+		// Bearer token of /admin/export and /admin/import, empty turns them off
+		std::string adminToken{ };
+	};
+
+	struct Snapshot {
+		// A snapshot file makes the instance a read-only replica that never connects to the database
+		std::string path{ };
+		std::chrono::milliseconds reloadInterval{ 1000 };
+		bool verifyChecksum{ false };
+	};
+
+	struct Storage {
+		// "postgresql", or "log" for the embedded store of a single node without a database server
+		std::string backend{ "postgresql" };
+		std::string path{ };
+		bool syncWrites{ false };
+	};
+
+	struct Config {
+		Server server{ };
+		Storage storage{ };
+		Database database{ };
+		Cache cache{ };
+		Counter counter{ };
+		Code code{ };
+		Handler handler{ };
+		Snapshot snapshot{ };
+	};
+
+
+	// Returns the value of an environment variable or nullptr
+	using Environment = std::function<const char*(const char*)>;
+
+	// io threads and pool size follow the number of cores
+	Config Defaults(unsigned cores = std::thread::hardware_concurrency());
+
+	// Throws std::invalid_argument for unknown keys and values of the wrong type or range
+	void ApplyJson(Config& config, std::string_view json);
+
+	void ApplyEnvironment(Config& config, const Environment& environment);
+
+	// Throws std::invalid_argument for settings the service cannot start with
+	void Validate(const Config& config);
+
+	// The json file at path (skipped if path is empty), then the environment, then Validate.
+	// Throws std::runtime_error if the file cannot be read.
+	Config Load(Config defaults, const std::string& path,
+		const Environment& environment = [](const char* name) { return std::getenv(name); });
+}
@@ -0,0 +1,342 @@
+#include <algorithm>
+#include <stdexcept>
+#include <utility>
+
+#include <spdlog/fmt/fmt.h>
+
+#include "shortcode.h"
+
+
+namespace ShortCode {
+	namespace {
+		std::uint64_t SplitMix64(std::uint64_t value) {
+			value += 0x9e3779b97f4a7c15;
+			value = (value ^ (value >> 30)) * 0xbf58476d1ce4e5b9;
+			value = (value ^ (value >> 27)) * 0x94d049bb133111eb;
+			return value ^ (value >> 31);
+		}
+
+		constexpr std::uint64_t BASE{ Encoder::ALPHABET.size() };
+
+		// SELECT nextval(...) returns the number of the next block
+		std::int64_t ReadBlock(const IResultView& rows) {
+			if (rows.Rows() != 1) {
+				throw std::runtime_error("nextval returned no block.");
+			}
+
+			return rows.GetInt64(0, 0);
+		}
+	}
+
+	Encoder::Encoder(std::uint64_t key, int bits)
+		: m_bits{ bits }
+		, m_halfMask{ (std::uint64_t{ 1 } << (bits / 2)) - 1 }
+	{
+		if (bits < 16 || bits > 58 || bits % 2 != 0) {
+			throw std::invalid_argument("The id bits must be even and between 16 and 58.");
+		}
+
+		// 62^10 > 2^58, so the loop cannot overflow
+		for (std::uint64_t reach{ 1 }; reach < Capacity(); reach *= BASE) {
+			++m_length;
+		}
+
+		for (int i{ 0 }; i < ROUNDS; ++i) {
+			key = SplitMix64(key);
+			m_keys[i] = key;
+		}
+	}
+
+	std::string Encoder::Encode(std::uint64_t id) const {
+		if (id >= Capacity()) {
+			throw std::out_of_range("The id is outside the code space.");
+		}
+
+		std::string code(m_length, ALPHABET[0]);
+		std::uint64_t value{ Permute(id) };
+		for (std::size_t i{ m_length }; i > 0 && value != 0; --i) {
+			code[i - 1] = ALPHABET[value % BASE];
+			value /= BASE;
+		}
+
+		return code;
+	}
+
+	std::uint64_t Encoder::Decode(std::string_view code) const {
+		if (code.size() != m_length) {
+			throw std::invalid_argument("The code has the wrong length.");
+		}
+
+		std::uint64_t value{ 0 };
+		for (char c : code) {
+			std::size_t digit{ ALPHABET.find(c) };
+			if (digit == std::string_view::npos) {
+				throw std::invalid_argument("The code contains a character outside the alphabet.");
+			}
+
+			value = value * BASE + digit;
+		}
+
+		if (value >= Capacity()) {
+			throw std::invalid_argument("The code is outside the code space.");
+		}
+
+		return Unpermute(value);
+	}
+
+	std::uint64_t Encoder::Round(std::uint64_t half, int round) const {
+		return SplitMix64(half ^ m_keys[round]) & m_halfMask;
+	}
+
+	// Balanced Feistel network over the two halves of the id, a bijection for any round function
+	std::uint64_t Encoder::Permute(std::uint64_t id) const {
+		const int half{ m_bits / 2 };
+		std::uint64_t left{ id >> half };
+		std::uint64_t right{ id & m_halfMask };
+
+		for (int i{ 0 }; i < ROUNDS; ++i) {
+			left ^= Round(right, i);
+			std::swap(left, right);
+		}
+
+		return (left << half) | right;
+	}
+
+	std::uint64_t Encoder::Unpermute(std::uint64_t value) const {
+		const int half{ m_bits / 2 };
+		std::uint64_t left{ value >> half };
+		std::uint64_t right{ value & m_halfMask };
+
+		for (int i{ ROUNDS - 1 }; i >= 0; --i) {
+			std::swap(left, right);
+			left ^= Round(right, i);
+		}
+
+		return (left << half) | right;
+	}
+
+
+	Allocator::Allocator(std::unique_ptr<IDatabase> database, Encoder encoder, LeaseConfig config)
+		: m_database{ std::move(database) }
+		, m_encoder{ encoder }
+		, m_config{ std::move(config) }
+	{
+		if (!m_database) {
+			throw std::invalid_argument("The database cannot be null.");
+		}
+
+		if (m_config.blockSize == 0) {
+			throw std::invalid_argument("The block size cannot be zero.");
+		}
+
+		m_database -> Execute(fmt::format("CREATE SEQUENCE IF NOT EXISTS {};", m_config.sequence), { });
+		m_nextBlock = m_database -> Prepare(fmt::format("SELECT nextval('{}');", m_config.sequence));
+	}
+
+	std::string Allocator::Next() {
+		return m_encoder.Encode(NextId());
+	}
+
+	std::uint64_t Allocator::NextId() {
+		return NextIds(1).front();
+	}
+
+	std::vector<std::string> Allocator::Next(std::size_t count) {
+		return Encode(NextIds(count));
+	}
+
+	void Allocator::NextAsync(std::size_t count, CodesCallback callback) {
+		std::vector<Waiter> ready{ };
+		bool isLeaseDue{ false };
+		{
+			std::lock_guard<std::mutex> lock{ m_mutex };
+			Waiter waiter{ count, { }, std::move(callback) };
+			waiter.ids.reserve(count);
+
+			// A later call does not take the ids an earlier one waits for
+			if (m_waiters.empty()) {
+				Take(waiter.ids, count);
+			}
+
+			if (waiter.ids.size() == count) {
+				ready.push_back(std::move(waiter));
+			}
+			else {
+				m_waiters.push_back(std::move(waiter));
+			}
+			isLeaseDue = IsLeaseDue();
+		}
+
+		if (isLeaseDue) {
+			LeaseAsync();
+		}
+		Complete(std::move(ready));
+	}
+
+	std::vector<std::uint64_t> Allocator::NextIds(std::size_t count) {
+		std::vector<std::uint64_t> ids{ };
+		ids.reserve(count);
+
+		std::unique_lock<std::mutex> lock{ m_mutex };
+		Take(ids, count);
+		while (ids.size() < count) {
+			if (m_isLeasing) {
+				m_leased.wait(lock);
+				Take(ids, count);
+				continue;
+			}
+
+			// The query runs without the lock, a lease completing on an io thread does not wait for it
+			m_isLeasing = true;
+			lock.unlock();
+
+			std::exception_ptr error{ };
+			Block block{ };
+			try {
+				block = ToBlock(m_database -> Query<std::int64_t>(m_nextBlock, { }, &ReadBlock));
+			}
+			catch (...) {
+				error = std::current_exception();
+			}
+
+			lock.lock();
+			std::vector<Waiter> done{ OnLeased(error, block) };
+			if (!done.empty()) {
+				lock.unlock();
+				Complete(std::move(done));
+				lock.lock();
+			}
+
+			if (error) {
+				std::rethrow_exception(error);
+			}
+			Take(ids, count);
+		}
+
+		// The block went to the waiters first, the ones still waiting need another
+		if (!m_waiters.empty() && !m_isLeasing) {
+			m_isLeasing = true;
+			lock.unlock();
+			LeaseAsync();
+		}
+
+		return ids;
+	}
+
+	void Allocator::Take(std::vector<std::uint64_t>& ids, std::size_t count) {
+		while (ids.size() < count && !m_blocks.empty()) {
+			Block& block{ m_blocks.front() };
+			while (ids.size() < count && block.next != block.end) {
+				ids.push_back(block.next++);
+				--m_available;
+			}
+
+			if (block.next == block.end) {
+				m_blocks.pop_front();
+			}
+		}
+	}
+
+	Allocator::Block Allocator::ToBlock(std::int64_t sequenceValue) const {
+		// Sequences start at 1, block n holds the ids [(n - 1) * blockSize, n * blockSize)
+		std::uint64_t index{ static_cast<std::uint64_t>(sequenceValue - 1) };
+		if (sequenceValue < 1 || index >= (m_encoder.Capacity() - 1) / m_config.blockSize + 1) {
+			throw std::out_of_range("The code space is exhausted.");
+		}
+
+		std::uint64_t next{ index * m_config.blockSize };
+		return Block{ next, std::min(next + m_config.blockSize, m_encoder.Capacity()) };
+	}
+
+	std::vector<std::string> Allocator::Encode(const std::vector<std::uint64_t>& ids) const {
+		// Encoding needs no lock
+		std::vector<std::string> codes{ };
+		codes.reserve(ids.size());
+		for (std::uint64_t id : ids) {
+			codes.push_back(m_encoder.Encode(id));
+		}
+
+		return codes;
+	}
+
+	void Allocator::LeaseAsync() {
+		m_database -> AsyncQuery<std::int64_t>(m_nextBlock, { }, &ReadBlock,
+			[this](std::exception_ptr error, std::int64_t sequenceValue) {
+				Block block{ };
+				if (!error) {
+					try {
+						block = ToBlock(sequenceValue);
+					}
+					catch (...) {
+						error = std::current_exception();
+					}
+				}
+
+				std::vector<Waiter> done{ };
+				bool isLeaseDue{ false };
+				{
+					std::lock_guard<std::mutex> lock{ m_mutex };
+					done = OnLeased(error, block);
+
+					// A failed lease is tried again by the next call, not in a loop
+					isLeaseDue = !error && IsLeaseDue();
+				}
+
+				if (isLeaseDue) {
+					LeaseAsync();
+				}
+				Complete(std::move(done));
+			});
+	}
+
+	std::vector<Allocator::Waiter> Allocator::OnLeased(std::exception_ptr error, Block block) {
+		m_isLeasing = false;
+		m_leased.notify_all();
+
+		std::vector<Waiter> done{ };
+		if (error) {
+			for (Waiter& waiter : m_waiters) {
+				waiter.error = error;
+				done.push_back(std::move(waiter));
+			}
+			m_waiters.clear();
+
+			return done;
+		}
+
+		m_blocks.push_back(block);
+		m_available += block.end - block.next;
+		while (!m_waiters.empty()) {
+			Waiter& waiter{ m_waiters.front() };
+			Take(waiter.ids, waiter.count);
+			if (waiter.ids.size() != waiter.count) {
+				break;
+			}
+
+			done.push_back(std::move(waiter));
+			m_waiters.pop_front();
+		}
+
+		return done;
+	}
+
+	bool Allocator::IsLeaseDue() {
+		if (m_isLeasing || (m_waiters.empty() && m_available >= (m_config.blockSize + 1) / 2)) {
+			return false;
+		}
+
+		m_isLeasing = true;
+		return true;
+	}
+
+	void Allocator::Complete(std::vector<Waiter> waiters) {
+		for (Waiter& waiter : waiters) {
+			if (waiter.error) {
+				waiter.callback(waiter.error, { });
+			}
+			else {
+				waiter.callback(nullptr, Encode(waiter.ids));
+			}
+		}
+	}
+}
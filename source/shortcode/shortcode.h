@@ -0,0 +1,145 @@
+#pragma once
+
+#include <array>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "IDatabase.h"
+
+
+namespace ShortCode {
+	// Bijection between ids and fixed length base62 codes.
+	// Ids are permuted by a keyed Feistel network first, so consecutive ids give unrelated codes
+	// and the next code cannot be guessed without the key.
+	class Encoder {
+	public:
+
+		static constexpr std::string_view ALPHABET{
+			"0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz" };
+
+		// Ids are in [0, 2^bits), bits is even and in [16, 58].
+		// Every process handing out codes for the same table has to use the same key and bits.
+		explicit Encoder(std::uint64_t key, int bits = 40);
+
+		// Number of distinct ids
+		std::uint64_t Capacity() const { return std::uint64_t{ 1 } << m_bits; }
+
+		// Smallest length that fits every permuted id
+		std::size_t Length() const { return m_length; }
+
+		// Throws std::out_of_range if id is not below Capacity()
+		std::string Encode(std::uint64_t id) const;
+
+		// Throws std::invalid_argument if code is not a code of this encoder
+		std::uint64_t Decode(std::string_view code) const;
+
+	private:
+
+		static constexpr int ROUNDS{ 4 };
+
+		std::uint64_t Round(std::uint64_t half, int round) const;
+
+		std::uint64_t Permute(std::uint64_t id) const;
+
+		std::uint64_t Unpermute(std::uint64_t value) const;
+
+	private:
+		int m_bits{ };
+		std::uint64_t m_halfMask{ };
+		std::size_t m_length{ };
+		std::array<std::uint64_t, ROUNDS> m_keys{ };
+	};
+
+
+	struct LeaseConfig {
+		// Ids leased per round trip to the database
+		std::uint64_t blockSize{ 1000 };
+
+		// Sequence numbering the blocks, created if it does not exist
+		std::string sequence{ "urls_code_block" };
+	};
+
+
+	// Hands out codes from blocks of ids leased from a database sequence.
+	// Every process leases blocks of its own, so codes never collide and creating a url
+	// needs no probing. Ids left in the block when the process stops are skipped.
+	class Allocator {
+	public:
+
+		Allocator(std::unique_ptr<IDatabase> database, Encoder encoder, LeaseConfig config = { });
+
+		Allocator(const Allocator&) = delete;
+		Allocator& operator=(const Allocator&) = delete;
+
+		using CodesCallback = std::function<void(std::exception_ptr, std::vector<std::string>)>;
+
+		// Leases the next block when the current one is used up, which blocks for one query
+		std::string Next();
+
+		std::uint64_t NextId();
+
+		// count codes in a row, leasing as many blocks as they need
+		std::vector<std::string> Next(std::size_t count);
+
+		// Never blocks, for the io threads: the codes come from the leased blocks, or from the lease they wait for.
+		// The next block is leased in the background once the current one is half used.
+		void NextAsync(std::size_t count, CodesCallback callback);
+
+		const Encoder& GetEncoder() const { return m_encoder; }
+
+	private:
+		struct Block {
+			std::uint64_t next{ }; // the ids [next, end) are still free
+			std::uint64_t end{ };
+		};
+
+		struct Waiter {
+			std::size_t count{ };
+			std::vector<std::uint64_t> ids{ };
+			CodesCallback callback{ };
+			std::exception_ptr error{ };
+		};
+
+		std::vector<std::uint64_t> NextIds(std::size_t count);
+
+		// Moves free ids to ids until it holds count, m_mutex must be held
+		void Take(std::vector<std::uint64_t>& ids, std::size_t count);
+
+		// Throws std::out_of_range once the code space is exhausted
+		Block ToBlock(std::int64_t sequenceValue) const;
+
+		std::vector<std::string> Encode(const std::vector<std::uint64_t>& ids) const;
+
+		void LeaseAsync();
+
+		// Adds the leased block and serves the waiters in order, or fails all of them. m_mutex must be held,
+		// the waiters returned are called once it is released.
+		std::vector<Waiter> OnLeased(std::exception_ptr error, Block block);
+
+		// Marks a background lease as started if one is due, m_mutex must be held
+		bool IsLeaseDue();
+
+		void Complete(std::vector<Waiter> waiters);
+
+	private:
+		std::unique_ptr<IDatabase> m_database;
+		Encoder m_encoder;
+		LeaseConfig m_config;
+		StatementHandle m_nextBlock{ };
+
+		std::mutex m_mutex{ };
+		std::condition_variable m_leased{ };
+		std::deque<Block> m_blocks{ };
+		std::uint64_t m_available{ 0 };  // free ids in m_blocks
+		bool m_isLeasing{ false };       // one lease at a time, the others wait for it
+		std::deque<Waiter> m_waiters{ }; // NextAsync calls waiting for a lease, in order
+	};
+}
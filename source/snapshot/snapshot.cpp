@@ -0,0 +1,430 @@
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <utility>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "snapshot.h"
+
+
+namespace Snapshot {
+	namespace {
+		constexpr char MAGIC[8]{ 'U', 'R', 'L', 'S', 'N', 'A', 'P', '\0' };
+		constexpr std::uint32_t VERSION{ 1 };
+		constexpr std::uint32_t MIN_BUCKET_BITS{ 4 };
+		constexpr std::uint32_t MAX_BUCKET_BITS{ 32 };
+
+		struct Header {
+			char magic[8]{ };
+			std::uint32_t version{ };
+			std::uint32_t bucketBits{ };
+			std::uint64_t count{ };
+			std::uint64_t stringsSize{ };
+			std::uint64_t checksum{ };   // FNV-1a of everything after the header
+			std::uint64_t reserved[3]{ };
+		};
+
+		struct Entry {
+			std::uint64_t hash{ };
+			std::int64_t id{ };
+			std::int64_t createdAt{ };   // microseconds since the epoch
+			std::int64_t updatedAt{ };
+			std::uint64_t offset{ };     // of the code in the strings, the url follows it
+			std::uint32_t codeLength{ };
+			std::uint32_t urlLength{ };
+		};
+
+		static_assert(sizeof(Header) == 64 && sizeof(Entry) == 48, "the layout is part of the file format");
+
+		constexpr std::uint64_t FNV_OFFSET{ 0xcbf29ce484222325 };
+		constexpr std::uint64_t FNV_PRIME{ 0x100000001b3 };
+
+		std::uint64_t Fnv1a(std::uint64_t hash, const char* data, std::size_t size) {
+			for (std::size_t i{ 0 }; i < size; ++i) {
+				hash = (hash ^ static_cast<unsigned char>(data[i])) * FNV_PRIME;
+			}
+			return hash;
+		}
+
+		// FNV-1a with a final mix, the bucket is taken from the high bits
+		std::uint64_t HashCode(std::string_view code) {
+			std::uint64_t hash{ Fnv1a(FNV_OFFSET, code.data(), code.size()) };
+			hash ^= hash >> 33;
+			hash *= 0xff51afd7ed558ccd;
+			return hash ^ (hash >> 33);
+		}
+
+		std::int64_t ToMicroseconds(TimePointSys time) {
+			return std::chrono::duration_cast<std::chrono::microseconds>(time.time_since_epoch()).count();
+		}
+
+		TimePointSys FromMicroseconds(std::int64_t micros) {
+			return TimePointSys{ std::chrono::duration_cast<TimePointSys::duration>(std::chrono::microseconds{ micros }) };
+		}
+
+		std::runtime_error SystemError(std::string_view what, const std::string& path) {
+			return std::runtime_error(std::string{ what } + " " + path + ": " + std::strerror(errno));
+		}
+
+		// Writes all of data and adds it to the checksum
+		void WriteAll(int fd, const void* data, std::size_t size, std::uint64_t& checksum, const std::string& path) {
+			const char* bytes{ static_cast<const char*>(data) };
+			checksum = Fnv1a(checksum, bytes, size);
+			while (size > 0) {
+				ssize_t written{ ::write(fd, bytes, size) };
+				if (written < 0) {
+					if (errno == EINTR) {
+						continue;
+					}
+					throw SystemError("Cannot write", path);
+				}
+				bytes += written;
+				size -= static_cast<std::size_t>(written);
+			}
+		}
+
+		// One field of a COPY text row, with the escapes PostgreSQL writes
+		std::string Unescape(std::string_view field) {
+			std::string value{ };
+			value.reserve(field.size());
+			for (std::size_t i{ 0 }; i < field.size(); ++i) {
+				if (field[i] != '\\' || i + 1 == field.size()) {
+					value += field[i];
+					continue;
+				}
+
+				switch (field[++i]) {
+				case 'b': value += '\b'; break;
+				case 'f': value += '\f'; break;
+				case 'n': value += '\n'; break;
+				case 'r': value += '\r'; break;
+				case 't': value += '\t'; break;
+				case 'v': value += '\v'; break;
+				default: value += field[i]; break;
+				}
+			}
+			return value;
+		}
+
+		constexpr const char* SQL_COPY_SNAPSHOT{
+			"COPY (SELECT id, shortcode, url, (extract(epoch FROM createdat) * 1000000)::bigint, "
+			"(extract(epoch FROM updatedat) * 1000000)::bigint FROM urls) TO STDOUT;" };
+	}
+
+	void Builder::Add(std::int64_t id, std::string_view shortCode, std::string_view url,
+		TimePointSys createdAt, TimePointSys updatedAt) {
+		m_entries.push_back(Row{ HashCode(shortCode), id, ToMicroseconds(createdAt), ToMicroseconds(updatedAt),
+			m_strings.size(), static_cast<std::uint32_t>(shortCode.size()), static_cast<std::uint32_t>(url.size()) });
+		m_strings.append(shortCode);
+		m_strings.append(url);
+	}
+
+	void Builder::Write(const std::string& path) {
+		// About one entry per bucket
+		std::uint32_t bits{ MIN_BUCKET_BITS };
+		while (bits < MAX_BUCKET_BITS && (std::uint64_t{ 1 } << bits) < m_entries.size()) {
+			++bits;
+		}
+
+		std::sort(m_entries.begin(), m_entries.end(), [](const Row& left, const Row& right) {
+			return left.hash < right.hash;
+		});
+
+		const std::uint64_t buckets{ std::uint64_t{ 1 } << bits };
+		std::vector<std::uint64_t> starts(buckets + 1, m_entries.size());
+		for (std::size_t i{ m_entries.size() }; i > 0; --i) {
+			starts[m_entries[i - 1].hash >> (64 - bits)] = i - 1;
+		}
+		// Empty buckets start where the next one does
+		for (std::size_t b{ buckets }; b > 0; --b) {
+			starts[b - 1] = std::min(starts[b - 1], starts[b]);
+		}
+
+		const std::string temporary{ path + ".tmp" };
+		int fd{ ::open(temporary.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644) };
+		if (fd < 0) {
+			throw SystemError("Cannot create", temporary);
+		}
+
+		try {
+			Header header{ };
+			std::copy(std::begin(MAGIC), std::end(MAGIC), header.magic);
+			header.version = VERSION;
+			header.bucketBits = bits;
+			header.count = m_entries.size();
+			header.stringsSize = m_strings.size();
+
+			// The header is written last, once the checksum of the rest is known
+			if (::lseek(fd, sizeof(Header), SEEK_SET) < 0) {
+				throw SystemError("Cannot seek in", temporary);
+			}
+
+			std::uint64_t checksum{ FNV_OFFSET };
+			WriteAll(fd, starts.data(), starts.size() * sizeof(std::uint64_t), checksum, temporary);
+
+			std::vector<Entry> entries{ };
+			constexpr std::size_t ENTRIES_PER_WRITE{ 4096 };
+			for (std::size_t first{ 0 }; first < m_entries.size(); first += ENTRIES_PER_WRITE) {
+				entries.clear();
+				std::size_t last{ std::min(first + ENTRIES_PER_WRITE, m_entries.size()) };
+				for (std::size_t i{ first }; i < last; ++i) {
+					const Row& row{ m_entries[i] };
+					entries.push_back(Entry{ row.hash, row.id, row.createdAt, row.updatedAt,
+						row.offset, row.codeLength, row.urlLength });
+				}
+				WriteAll(fd, entries.data(), entries.size() * sizeof(Entry), checksum, temporary);
+			}
+
+			WriteAll(fd, m_strings.data(), m_strings.size(), checksum, temporary);
+
+			header.checksum = checksum;
+			if (::pwrite(fd, &header, sizeof(Header), 0) != static_cast<ssize_t>(sizeof(Header))) {
+				throw SystemError("Cannot write", temporary);
+			}
+
+			if (::fsync(fd) != 0) {
+				throw SystemError("Cannot sync", temporary);
+			}
+		}
+		catch (...) {
+			::close(fd);
+			::unlink(temporary.c_str());
+			throw;
+		}
+
+		::close(fd);
+		if (::rename(temporary.c_str(), path.c_str()) != 0) {
+			::unlink(temporary.c_str());
+			throw SystemError("Cannot rename over", path);
+		}
+	}
+
+	std::size_t BuildFromDatabase(IDatabase& database, const std::string& path, std::size_t chunkSize) {
+		Builder builder{ };
+		auto stream{ database.CopyOut(SQL_COPY_SNAPSHOT) };
+
+		std::string buffer{ };
+		std::vector<std::string_view> fields{ };
+		for (bool isMore{ true }; isMore; ) {
+			isMore = stream -> Read(buffer, chunkSize);
+
+			// Reads return whole rows
+			std::size_t start{ 0 };
+			for (std::size_t end{ buffer.find('\n') }; end != std::string::npos; end = buffer.find('\n', start)) {
+				std::string_view row{ std::string_view{ buffer }.substr(start, end - start) };
+				start = end + 1;
+
+				fields.clear();
+				for (std::size_t first{ 0 }; ; ) {
+					std::size_t tab{ row.find('\t', first) };
+					fields.push_back(row.substr(first, tab - first));
+					if (tab == std::string_view::npos) {
+						break;
+					}
+					first = tab + 1;
+				}
+				if (fields.size() != 5) {
+					throw std::runtime_error("Unexpected row in the COPY output.");
+				}
+
+				builder.Add(std::stoll(std::string{ fields[0] }), Unescape(fields[1]), Unescape(fields[2]),
+					FromMicroseconds(std::stoll(std::string{ fields[3] })),
+					FromMicroseconds(std::stoll(std::string{ fields[4] })));
+			}
+			buffer.erase(0, start);
+		}
+
+		builder.Write(path);
+		return builder.Size();
+	}
+
+	std::shared_ptr<const File> File::Open(const std::string& path, bool verifyChecksum) {
+		int fd{ ::open(path.c_str(), O_RDONLY | O_CLOEXEC) };
+		if (fd < 0) {
+			throw SystemError("Cannot open", path);
+		}
+
+		struct stat info { };
+		if (::fstat(fd, &info) != 0) {
+			::close(fd);
+			throw SystemError("Cannot stat", path);
+		}
+
+		const std::size_t size{ static_cast<std::size_t>(info.st_size) };
+		if (size < sizeof(Header)) {
+			::close(fd);
+			throw std::runtime_error("Not a snapshot file: " + path);
+		}
+
+		// The mapping keeps the file alive, the descriptor is not needed after mmap
+		void* data{ ::mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0) };
+		::close(fd);
+		if (data == MAP_FAILED) {
+			throw SystemError("Cannot map", path);
+		}
+		::madvise(data, size, MADV_RANDOM);
+
+		std::shared_ptr<File> file{ new File{ } };
+		file -> m_data = static_cast<const char*>(data);
+		file -> m_size = size;
+		file -> m_device = static_cast<std::uint64_t>(info.st_dev);
+		file -> m_inode = static_cast<std::uint64_t>(info.st_ino);
+
+		const Header& header{ *reinterpret_cast<const Header*>(file -> m_data) };
+		if (!std::equal(std::begin(MAGIC), std::end(MAGIC), header.magic) || header.version != VERSION) {
+			throw std::runtime_error("Not a snapshot file of this version: " + path);
+		}
+
+		if (header.bucketBits < MIN_BUCKET_BITS || header.bucketBits > MAX_BUCKET_BITS
+			|| header.count > size / sizeof(Entry) || header.stringsSize > size) {
+			throw std::runtime_error("Corrupt snapshot header: " + path);
+		}
+
+		const std::uint64_t buckets{ std::uint64_t{ 1 } << header.bucketBits };
+		const std::uint64_t expected{ sizeof(Header) + (buckets + 1) * sizeof(std::uint64_t)
+			+ header.count * sizeof(Entry) + header.stringsSize };
+		if (expected != size) {
+			throw std::runtime_error("Truncated snapshot file: " + path);
+		}
+
+		// Every lookup checks the bounds it reads, the rest of the file is not touched unless asked for
+		if (verifyChecksum
+			&& Fnv1a(FNV_OFFSET, file -> m_data + sizeof(Header), size - sizeof(Header)) != header.checksum) {
+			throw std::runtime_error("Snapshot checksum mismatch: " + path);
+		}
+
+		return file;
+	}
+
+	File::~File() {
+		if (m_data) {
+			::munmap(const_cast<char*>(m_data), m_size);
+		}
+	}
+
+	std::size_t File::Size() const {
+		return static_cast<std::size_t>(reinterpret_cast<const Header*>(m_data) -> count);
+	}
+
+	std::optional<Url> File::Find(std::string_view shortCode) const {
+		const Header& header{ *reinterpret_cast<const Header*>(m_data) };
+		const std::uint64_t buckets{ std::uint64_t{ 1 } << header.bucketBits };
+		const auto* starts{ reinterpret_cast<const std::uint64_t*>(m_data + sizeof(Header)) };
+		const auto* entries{ reinterpret_cast<const Entry*>(starts + buckets + 1) };
+		const char* strings{ reinterpret_cast<const char*>(entries + header.count) };
+
+		const std::uint64_t hash{ HashCode(shortCode) };
+		const std::uint64_t bucket{ hash >> (64 - header.bucketBits) };
+		const std::uint64_t last{ std::min(starts[bucket + 1], header.count) };
+		for (std::uint64_t i{ std::min(starts[bucket], last) }; i < last; ++i) {
+			const Entry& entry{ entries[i] };
+			if (entry.hash != hash || entry.codeLength != shortCode.size()) {
+				continue;
+			}
+			if (entry.offset > header.stringsSize
+				|| header.stringsSize - entry.offset < std::uint64_t{ entry.codeLength } + entry.urlLength) {
+				continue;
+			}
+
+			std::string_view code{ strings + entry.offset, entry.codeLength };
+			if (code != shortCode) {
+				continue;
+			}
+
+			return Url{ static_cast<Id>(entry.id), std::string_view{ code.data() + code.size(), entry.urlLength }, code,
+				FromMicroseconds(entry.createdAt), FromMicroseconds(entry.updatedAt) };
+		}
+
+		return std::nullopt;
+	}
+
+	Store::Store(std::string path, StoreConfig config, LoggerPtr logger)
+		: m_path{ std::move(path) }
+		, m_config{ std::move(config) }
+		, m_logger{ std::move(logger) }
+		, m_file{ File::Open(m_path, m_config.verifyChecksum) }
+	{
+		if (m_config.reloadInterval.count() <= 0) {
+			throw std::invalid_argument("The reload interval has to be positive.");
+		}
+	}
+
+	Store::~Store() {
+		Stop();
+	}
+
+	bool Store::Reload() {
+		std::lock_guard<std::mutex> lock{ m_reloadMutex };
+
+		struct stat info { };
+		if (::stat(m_path.c_str(), &info) != 0) {
+			return false;
+		}
+
+		auto current{ m_file.load() };
+		const auto inode{ static_cast<std::uint64_t>(info.st_ino) };
+		if ((static_cast<std::uint64_t>(info.st_dev) == current -> Device() && inode == current -> Inode())
+			|| inode == m_rejectedInode) {
+			return false;
+		}
+
+		try {
+			auto file{ File::Open(m_path, m_config.verifyChecksum) };
+			if (m_logger) {
+				m_logger -> info("Serving snapshot {} with {} urls", m_path, file -> Size());
+			}
+			m_file.store(std::move(file));
+			return true;
+		}
+		catch (const std::exception& e) {
+			m_rejectedInode = inode;
+			if (m_logger) {
+				m_logger -> error("Exception: snapshot not loaded, keeping the current one: {}", e.what());
+			}
+			return false;
+		}
+	}
+
+	void Store::Start() {
+		std::lock_guard<std::mutex> lock{ m_stopMutex };
+		if (!m_isStopped) {
+			return;
+		}
+
+		m_isStopped = false;
+		m_watcher = std::thread{ &Store::Run, this };
+	}
+
+	void Store::Stop() {
+		{
+			std::lock_guard<std::mutex> lock{ m_stopMutex };
+			if (m_isStopped) {
+				return;
+			}
+
+			m_isStopped = true;
+		}
+
+		m_stopCondition.notify_all();
+		m_watcher.join();
+	}
+
+	void Store::Run() {
+		std::unique_lock<std::mutex> lock{ m_stopMutex };
+		while (!m_isStopped) {
+			m_stopCondition.wait_for(lock, m_config.reloadInterval, [this]() { return m_isStopped; });
+			if (m_isStopped) {
+				break;
+			}
+
+			lock.unlock();
+			Reload();
+			lock.lock();
+		}
+	}
+}
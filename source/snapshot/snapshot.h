@@ -0,0 +1,153 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include <spdlog/spdlog.h>
+
+#include "IDatabase.h"
+#include "url.h"
+
+
+// Immutable files of the urls table for read-only replicas. A file is a hash table laid out so it is
+// read in place from a memory mapping: opening one is a mmap and a header check, and the pages are
+// shared by every process serving the same file.
+//
+// Layout, in the byte order of the host that wrote it:
+//   Header | bucket starts (2^bucketBits + 1 x uint64) | entries (count x Entry, by hash) | strings
+namespace Snapshot {
+	// Writes a snapshot file. The strings of the rows are kept in one buffer until Write.
+	class Builder {
+	public:
+
+		void Add(std::int64_t id, std::string_view shortCode, std::string_view url,
+			TimePointSys createdAt, TimePointSys updatedAt);
+
+		std::size_t Size() const { return m_entries.size(); }
+
+		// Writes to path + ".tmp" and renames it over path, so readers see the old file or the new one.
+		// Throws std::runtime_error if the file cannot be written.
+		void Write(const std::string& path);
+
+	private:
+
+		struct Row {
+			std::uint64_t hash{ };
+			std::int64_t id{ };
+			std::int64_t createdAt{ };
+			std::int64_t updatedAt{ };
+			std::uint64_t offset{ };  // of the code in m_strings, the url follows it
+			std::uint32_t codeLength{ };
+			std::uint32_t urlLength{ };
+		};
+
+		std::vector<Row> m_entries{ };
+		std::string m_strings{ };
+	};
+
+
+	// Writes every row of the urls table to path, read with COPY TO STDOUT. Returns the number of rows.
+	std::size_t BuildFromDatabase(IDatabase& database, const std::string& path, std::size_t chunkSize = 64 * 1024);
+
+
+	// A mapped snapshot file, unmapped with the last reference
+	class File {
+	public:
+
+		// Maps the file and checks its header and size. verifyChecksum also reads the whole file once.
+		// Throws std::runtime_error if it cannot be mapped or is not a valid snapshot.
+		static std::shared_ptr<const File> Open(const std::string& path, bool verifyChecksum = false);
+
+		File(const File&) = delete;
+		File& operator=(const File&) = delete;
+
+		~File();
+
+		std::optional<Url> Find(std::string_view shortCode) const;
+
+		std::size_t Size() const;
+
+		// Device and inode of the mapped file, they change when a new file is renamed over the path
+		std::uint64_t Device() const { return m_device; }
+		std::uint64_t Inode() const { return m_inode; }
+
+	private:
+
+		File() = default;
+
+	private:
+		const char* m_data{ nullptr };
+		std::size_t m_size{ 0 };
+		std::uint64_t m_device{ };
+		std::uint64_t m_inode{ };
+	};
+
+
+	struct StoreConfig {
+		// How often the watcher checks whether the file was replaced
+		std::chrono::milliseconds reloadInterval{ 1000 };
+
+		// Read every page of a new file before it is served
+		bool verifyChecksum{ false };
+	};
+
+
+	// The snapshot being served. A replaced file is mapped and swapped in atomically,
+	// lookups in flight keep the old mapping until they return.
+	class Store {
+	public:
+
+		using LoggerPtr = std::shared_ptr<spdlog::logger>;
+
+		// Opens the file at path, throws as File::Open does
+		Store(std::string path, StoreConfig config = { }, LoggerPtr logger = nullptr);
+
+		Store(const Store&) = delete;
+		Store& operator=(const Store&) = delete;
+
+		~Store();
+
+		std::optional<Url> Find(std::string_view shortCode) const {
+			return m_file.load() -> Find(shortCode);
+		}
+
+		std::shared_ptr<const File> Current() const { return m_file.load(); }
+
+		// Maps the file again if another one was renamed over the path. An invalid file is logged
+		// and the current one stays. Returns true if a new file is served.
+		bool Reload();
+
+		// Starts the watcher calling Reload every StoreConfig::reloadInterval
+		void Start();
+
+		void Stop();
+
+	private:
+
+		void Run();
+
+	private:
+		std::string m_path;
+		StoreConfig m_config;
+		LoggerPtr m_logger;
+		std::atomic<std::shared_ptr<const File>> m_file{ };
+
+		// Serializes reloads, Reload() may be called while the watcher is running
+		std::mutex m_reloadMutex{ };
+		std::uint64_t m_rejectedInode{ 0 }; // an invalid file is not mapped again until it is replaced
+
+		std::mutex m_stopMutex{ };
+		std::condition_variable m_stopCondition{ };
+		bool m_isStopped{ true };
+		std::thread m_watcher{ };
+	};
+}
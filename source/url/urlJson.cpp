@@ -0,0 +1,188 @@
+#include <charconv>
+#include <chrono>
+#include <cstdint>
+#include <string_view>
+
+#include "urlJson.h"
+
+
+namespace UrlJson {
+	namespace {
+		// Counts the characters when out is null, so Size and Write share one code path
+		class Writer {
+		public:
+
+			explicit Writer(char* out)
+				: m_out{ out }
+			{
+			}
+
+			std::size_t Written() const { return m_size; }
+
+			void Put(char c) {
+				if (m_out) {
+					m_out[m_size] = c;
+				}
+				++m_size;
+			}
+
+			void Put(std::string_view text) {
+				if (m_out) {
+					text.copy(m_out + m_size, text.size());
+				}
+				m_size += text.size();
+			}
+
+			void PutInteger(std::int64_t value) {
+				char digits[20]{ };
+				auto [end, ec] { std::to_chars(digits, digits + sizeof(digits), value) };
+				Put(std::string_view{ digits, static_cast<std::size_t>(end - digits) });
+			}
+
+			// Zero padded to width digits
+			void PutPadded(std::int64_t value, int width) {
+				char digits[8]{ };
+				for (int i{ width - 1 }; i >= 0; --i) {
+					digits[i] = static_cast<char>('0' + value % 10);
+					value /= 10;
+				}
+				Put(std::string_view{ digits, static_cast<std::size_t>(width) });
+			}
+
+			void PutString(std::string_view text) {
+				static constexpr const char* HEX{ "0123456789abcdef" };
+
+				Put('"');
+				for (char c : text) {
+					switch (c) {
+					case '"': Put("\\\""); break;
+					case '\\': Put("\\\\"); break;
+					case '\b': Put("\\b"); break;
+					case '\f': Put("\\f"); break;
+					case '\n': Put("\\n"); break;
+					case '\r': Put("\\r"); break;
+					case '\t': Put("\\t"); break;
+					default:
+						if (static_cast<unsigned char>(c) < 0x20) {
+							Put("\\u00");
+							Put(HEX[(c >> 4) & 0x0f]);
+							Put(HEX[c & 0x0f]);
+						}
+						else {
+							Put(c); // UTF-8 passes through unchanged
+						}
+					}
+				}
+				Put('"');
+			}
+
+			// 2024-01-31T12:00:00.5 as to_json of a PostgreSQL timestamp: no zone, fraction without trailing zeros
+			void PutTimestamp(TimePointSys time) {
+				auto day{ std::chrono::floor<std::chrono::days>(time) };
+				std::chrono::year_month_day date{ day };
+				std::chrono::hh_mm_ss clock{ std::chrono::floor<std::chrono::microseconds>(time - day) };
+
+				Put('"');
+				PutPadded(static_cast<int>(date.year()), 4);
+				Put('-');
+				PutPadded(static_cast<unsigned>(date.month()), 2);
+				Put('-');
+				PutPadded(static_cast<unsigned>(date.day()), 2);
+				Put('T');
+				PutPadded(clock.hours().count(), 2);
+				Put(':');
+				PutPadded(clock.minutes().count(), 2);
+				Put(':');
+				PutPadded(clock.seconds().count(), 2);
+				if (std::int64_t micros{ clock.subseconds().count() }; micros != 0) {
+					int width{ 6 };
+					for (; micros % 10 == 0; micros /= 10) {
+						--width;
+					}
+					Put('.');
+					PutPadded(micros, width);
+				}
+				Put('"');
+			}
+
+		private:
+			char* m_out{ };
+			std::size_t m_size{ };
+		};
+
+		class ObjectWriter {
+		public:
+
+			ObjectWriter(Writer& writer, bool pretty)
+				: m_writer{ writer }
+				, m_pretty{ pretty }
+			{
+				m_writer.Put('{');
+			}
+
+			void Key(std::string_view key) {
+				if (!m_isEmpty) {
+					m_writer.Put(',');
+				}
+				m_isEmpty = false;
+
+				if (m_pretty) {
+					m_writer.Put("\n    ");
+				}
+				m_writer.PutString(key);
+				m_writer.Put(m_pretty ? std::string_view{ ": " } : std::string_view{ ":" });
+			}
+
+			void Close() {
+				if (m_pretty && !m_isEmpty) {
+					m_writer.Put('\n');
+				}
+				m_writer.Put('}');
+			}
+
+		private:
+			Writer& m_writer;
+			bool m_pretty{ };
+			bool m_isEmpty{ true };
+		};
+
+		void WriteUrl(Writer& writer, const Url& url, Format format) {
+			ObjectWriter object{ writer, format.pretty };
+
+			object.Key("id");
+			writer.PutInteger(url.GetId());
+			object.Key("url");
+			writer.PutString(url.GetUri());
+			object.Key("shortcode");
+			writer.PutString(url.GetShortCode());
+			object.Key("createdat");
+			writer.PutTimestamp(url.GetCreatedAt());
+			object.Key("updatedat");
+			writer.PutTimestamp(url.GetUpdatedAt());
+			if (format.withAccessCount) {
+				object.Key("accesscount");
+				writer.PutInteger(url.GetAccessCount());
+			}
+
+			object.Close();
+		}
+	}
+
+	std::size_t Size(const Url& url, Format format) {
+		Writer writer{ nullptr };
+		WriteUrl(writer, url, format);
+		return writer.Written();
+	}
+
+	std::size_t Write(const Url& url, Format format, char* out) {
+		Writer writer{ out };
+		WriteUrl(writer, url, format);
+		return writer.Written();
+	}
+
+	void Append(std::string& out, const Url& url, Format format) {
+		std::size_t offset{ out.size() };
+		out.resize(offset + Size(url, format));
+		Write(url, format, out.data() + offset);
+	}
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+#include "url.h"
+
+
+// JSON document of a Url, written straight into a character buffer without building a DOM.
+// Keys are the column names of the urls table, timestamps are ISO 8601 in UTC.
+namespace UrlJson {
+	struct Format {
+		bool withAccessCount{ false };
+		bool pretty{ false }; // 4 spaces per level, as json::dump(4)
+	};
+
+	// Exact length of the document Write produces
+	std::size_t Size(const Url& url, Format format = { });
+
+	// out has to hold at least Size(url, format) characters, nothing is allocated.
+	// Returns the number of characters written.
+	std::size_t Write(const Url& url, Format format, char* out);
+
+	// Appends the document, growing out at most once
+	void Append(std::string& out, const Url& url, Format format = { });
+}
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <gmock/gmock.h> 
+#include <gtest/gtest.h>
+#include "IDatabase.h"
+
+
+class MockDatabase : public IDatabase {
+public:
+    MOCK_METHOD(void,                     Connect,             (),                                                        (override));
+    MOCK_METHOD(void,                     Disconnect,          (),                                                        (override));
+    MOCK_METHOD(StatementHandle,          Prepare,             (std::string_view),                                        (override));
+    MOCK_METHOD(void,                     Execute,             (std::string_view, IDatabase::SqlParams),                  (override));
+    MOCK_METHOD(void,                     Execute,             (StatementHandle, IDatabase::SqlParams),                   (override));
+    MOCK_METHOD(std::vector<std::string>, ExecuteQuery,        (std::string_view, IDatabase::SqlParams),                  (override));
+    MOCK_METHOD(std::vector<std::string>, ExecuteQuery,        (StatementHandle, IDatabase::SqlParams),                   (override));
+    MOCK_METHOD(void,                     ExecuteQueryAsync,   (std::string_view, IDatabase::SqlParams, QueryCallback),   (override));
+    MOCK_METHOD(void,                     ExecuteQueryAsync,   (StatementHandle, IDatabase::SqlParams, QueryCallback),    (override));
+    MOCK_METHOD(ResultViewPtr,            ExecuteQueryView,    (std::string_view, IDatabase::SqlParams),                  (override));
+    MOCK_METHOD(ResultViewPtr,            ExecuteQueryView,    (StatementHandle, IDatabase::SqlParams),                   (override));
+    MOCK_METHOD(void,                     ExecuteQueryViewAsync, (std::string_view, IDatabase::SqlParams, ViewCallback),  (override));
+    MOCK_METHOD(void,                     ExecuteQueryViewAsync, (StatementHandle, IDatabase::SqlParams, ViewCallback),   (override));
+    MOCK_METHOD(CopyOutPtr,               CopyOut,             (std::string_view),                                        (override));
+    MOCK_METHOD(CopyInPtr,                CopyIn,              (std::string_view),                                        (override));
+    MOCK_METHOD(void,                     BeginTransaction,    (),                                                        (override));
+    MOCK_METHOD(void,                     CommitTransaction,   (),                                                        (override));
+    MOCK_METHOD(void,                     RollbackTransaction, (),                                                        (override));
+};
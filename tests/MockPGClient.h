@@ -14,17 +14,37 @@ class MockPGClient : public PostgreSQL::IPGClient {
 public:
     MOCK_METHOD(PGconn*,        PQconnectdbParams,   (const char* const*, const char* const*, int), (override));
     MOCK_METHOD(PGresult*,      PQexecParams,        (PGconn*, const char*, int, const Oid*, const char* const*, const int*, const int*, int), (override));
+    MOCK_METHOD(int,            PQsendQueryParams,   (PGconn*, const char*, int, const Oid*, const char* const*, const int*, const int*, int), (override));
+    MOCK_METHOD(int,            PQsetnonblocking,    (PGconn*, int),    (override));
+    MOCK_METHOD(int,            PQflush,             (PGconn*),         (override));
+    MOCK_METHOD(int,            PQconsumeInput,      (PGconn*),         (override));
+    MOCK_METHOD(int,            PQisBusy,            (PGconn*),         (override));
+    MOCK_METHOD(PGresult*,      PQgetResult,         (PGconn*),         (override));
+    MOCK_METHOD(int,            PQsocket,            (const PGconn*),   (override));
+    MOCK_METHOD(PGresult*,      PQprepare,           (PGconn*, const char*, const char*, int, const Oid*), (override));
+    MOCK_METHOD(PGresult*,      PQexecPrepared,      (PGconn*, const char*, int, const char* const*, const int*, const int*, int), (override));
+    MOCK_METHOD(int,            PQsendQueryPrepared, (PGconn*, const char*, int, const char* const*, const int*, const int*, int), (override));
+    MOCK_METHOD(int,            PQenterPipelineMode, (PGconn*),         (override));
+    MOCK_METHOD(int,            PQexitPipelineMode,  (PGconn*),         (override));
+    MOCK_METHOD(int,            PQpipelineSync,      (PGconn*),         (override));
+    MOCK_METHOD(int,            PQgetCopyData,       (PGconn*, char**, int), (override));
+    MOCK_METHOD(void,           PQfreemem,           (void*),           (override));
+    MOCK_METHOD(int,            PQputCopyData,       (PGconn*, const char*, int), (override));
+    MOCK_METHOD(int,            PQputCopyEnd,        (PGconn*, const char*), (override));
     MOCK_METHOD(ConnStatusType, PQstatus,            (const PGconn*),   (override));
+    MOCK_METHOD(PGTransactionStatusType, PQtransactionStatus, (const PGconn*), (override));
     MOCK_METHOD(char*,          PQerrorMessage,      (const PGconn*),   (override));
     MOCK_METHOD(void,           PQfinish,            (PGconn*),         (override));
     MOCK_METHOD(void,           PQreset,             (PGconn*),         (override));
     MOCK_METHOD(ExecStatusType, PQresultStatus,      (const PGresult*), (override));
+    MOCK_METHOD(char*,          PQresultErrorMessage, (const PGresult*), (override));
     MOCK_METHOD(void,           PQclear,             (PGresult*),       (override));
     MOCK_METHOD(int,            PQntuples,           (const PGresult*), (override));
     MOCK_METHOD(int,            PQnfields,           (const PGresult*), (override));
     MOCK_METHOD(char*,          PQgetvalue,          (const PGresult*, int, int), (override));
     MOCK_METHOD(int,            PQgetisnull,         (const PGresult*, int, int), (override));
     MOCK_METHOD(int,            PQgetlength,         (const PGresult*, int, int), (override));
+    MOCK_METHOD(Oid,            PQftype,             (const PGresult*, int), (override));
 
     ~MockPGClient() = default;
 };
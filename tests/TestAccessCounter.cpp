@@ -0,0 +1,221 @@
+#include <gtest/gtest.h>
+
+#include <map>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+#include "counter.h"
+#include "MockDatabase.h"
+
+
+using ::testing::_;
+using ::testing::An;
+using ::testing::Invoke;
+using ::testing::Throw;
+
+
+// Sums the (shortcode, hits) pairs of every UPDATE the counter sends
+static void CollectWrites(MockDatabase& database, std::map<std::string, std::uint64_t>& written, int& statements) {
+	EXPECT_CALL(database, Execute(An<std::string_view>(), _))
+		.WillRepeatedly(Invoke([&written, &statements](std::string_view query, IDatabase::SqlParams params) {
+			EXPECT_EQ(std::string{ query }, Counter::AccessCounter::BuildUpdateQuery(params.size() / 2));
+			for (std::size_t i{ 0 }; i + 1 < params.size(); i += 2) {
+				written[params[i].second] += std::stoull(params[i + 1].second);
+			}
+			++statements;
+		}));
+}
+
+
+TEST(AccessCounterTest, InvalidParamsThrowInvalidArgument) {
+	EXPECT_THROW(Counter::AccessCounter(nullptr), std::invalid_argument);
+
+	Counter::FlushConfig config{ };
+	config.maxBatchSize = 0;
+	EXPECT_THROW(Counter::AccessCounter(std::make_unique<MockDatabase>(), config), std::invalid_argument);
+}
+
+
+TEST(AccessCounterTest, BuildUpdateQueryNumbersParams) {
+	EXPECT_EQ(Counter::AccessCounter::BuildUpdateQuery(2),
+		"UPDATE urls SET accesscount = urls.accesscount + v.hits FROM (VALUES "
+		"($1::text, $2::bigint), ($3::text, $4::bigint)) "
+		"AS v(shortcode, hits) WHERE urls.shortcode = v.shortcode;");
+}
+
+
+TEST(AccessCounterTest, FlushAggregatesShardsIntoOneStatement) {
+	auto database{ std::make_unique<MockDatabase>() };
+	std::map<std::string, std::uint64_t> written{ };
+	int statements{ 0 };
+	CollectWrites(*database, written, statements);
+
+	Counter::AccessCounter counter{ std::move(database), { }, nullptr, 4 };
+
+	std::vector<std::thread> threads;
+	for (int t{ 0 }; t < 4; ++t) {
+		threads.emplace_back([&counter]() {
+			for (int i{ 0 }; i < 1000; ++i) {
+				counter.Record("hot");
+			}
+			counter.Record("cold");
+		});
+	}
+
+	for (auto& thread : threads) {
+		thread.join();
+	}
+
+	EXPECT_EQ(counter.Pending("hot"), 4000);
+	EXPECT_EQ(counter.Flush(), 2);
+	EXPECT_EQ(statements, 1);
+	EXPECT_EQ(written["hot"], 4000);
+	EXPECT_EQ(written["cold"], 4);
+
+	EXPECT_EQ(counter.Pending("hot"), 0);
+	EXPECT_EQ(counter.Flush(), 0);
+	EXPECT_EQ(statements, 1);
+}
+
+
+TEST(AccessCounterTest, FlushSplitsBatches) {
+	auto database{ std::make_unique<MockDatabase>() };
+	std::map<std::string, std::uint64_t> written{ };
+	int statements{ 0 };
+	CollectWrites(*database, written, statements);
+
+	Counter::FlushConfig config{ };
+	config.maxBatchSize = 2;
+	Counter::AccessCounter counter{ std::move(database), config };
+
+	for (int i{ 0 }; i < 5; ++i) {
+		counter.Record(std::to_string(i));
+	}
+
+	EXPECT_EQ(counter.Flush(), 5);
+	EXPECT_EQ(statements, 3);
+	EXPECT_EQ(written.size(), 5);
+}
+
+
+TEST(AccessCounterTest, FlushWritesInShortCodeOrder) {
+	std::vector<std::string> written{ };
+	Counter::FlushConfig config{ };
+	config.maxBatchSize = 3;
+	Counter::AccessCounter counter{ [&written](const Counter::AccessCounter::Batch& batch) {
+			for (const auto& [shortCode, count] : batch) {
+				written.emplace_back(shortCode);
+			}
+		}, config };
+
+	for (const auto* shortCode : { "e", "b", "g", "a", "f", "c", "d" }) {
+		counter.Record(shortCode);
+	}
+
+	EXPECT_EQ(counter.Flush(), 7);
+	EXPECT_EQ(written, (std::vector<std::string>{ "a", "b", "c", "d", "e", "f", "g" }));
+}
+
+
+TEST(AccessCounterTest, FailedFlushKeepsCounts) {
+	auto database{ std::make_unique<MockDatabase>() };
+	EXPECT_CALL(*database, Execute(An<std::string_view>(), _))
+		.WillOnce(Throw(std::runtime_error("connection lost")))
+		.WillOnce(Invoke([](std::string_view, IDatabase::SqlParams params) {
+			ASSERT_EQ(params.size(), 2);
+			EXPECT_EQ(params[1].second, "3");
+		}));
+
+	Counter::AccessCounter counter{ std::move(database) };
+	counter.Record("abc", 3);
+
+	EXPECT_THROW(counter.Flush(), std::runtime_error);
+	EXPECT_EQ(counter.Pending("abc"), 3);
+	EXPECT_EQ(counter.Flush(), 1);
+}
+
+
+TEST(AccessCounterTest, FailedFlushKeepsOnlyUnwrittenCounts) {
+	std::map<std::string, std::uint64_t> written{ };
+	int calls{ 0 };
+	Counter::FlushConfig config{ };
+	config.maxBatchSize = 2;
+	Counter::AccessCounter counter{ [&written, &calls](const Counter::AccessCounter::Batch& batch) {
+			if (++calls == 2) {
+				throw std::runtime_error("connection lost");
+			}
+			for (const auto& [shortCode, count] : batch) {
+				written[std::string{ shortCode }] += count;
+			}
+		}, config };
+
+	for (int i{ 0 }; i < 5; ++i) {
+		counter.Record(std::to_string(i), 10);
+	}
+
+	// The first batch is stored, the failed one and the one after it stay pending
+	EXPECT_THROW(counter.Flush(), std::runtime_error);
+	ASSERT_EQ(written.size(), 2);
+
+	EXPECT_EQ(counter.Flush(), 3);
+	EXPECT_EQ(written.size(), 5);
+	for (const auto& [shortCode, count] : written) {
+		EXPECT_EQ(count, 10) << shortCode;
+	}
+}
+
+
+TEST(AccessCounterTest, StopFlushesPendingCounts) {
+	auto database{ std::make_unique<MockDatabase>() };
+	std::map<std::string, std::uint64_t> written{ };
+	int statements{ 0 };
+	CollectWrites(*database, written, statements);
+
+	Counter::FlushConfig config{ };
+	config.interval = std::chrono::hours{ 1 };
+	Counter::AccessCounter counter{ std::move(database), config };
+
+	counter.Start();
+	counter.Record("abc");
+	counter.Stop();
+
+	EXPECT_EQ(written["abc"], 1);
+}
+
+
+TEST(AccessCounterTest, StopWithoutDurabilityDropsPendingCounts) {
+	auto database{ std::make_unique<MockDatabase>() };
+	EXPECT_CALL(*database, Execute(An<std::string_view>(), _))
+		.Times(0);
+
+	Counter::FlushConfig config{ };
+	config.interval = std::chrono::hours{ 1 };
+	config.flushOnShutdown = false;
+	Counter::AccessCounter counter{ std::move(database), config };
+
+	counter.Start();
+	counter.Record("abc");
+	counter.Stop();
+}
+
+
+TEST(AccessCounterTest, FlusherWritesEveryInterval) {
+	auto database{ std::make_unique<MockDatabase>() };
+	std::map<std::string, std::uint64_t> written{ };
+	int statements{ 0 };
+	CollectWrites(*database, written, statements);
+
+	Counter::FlushConfig config{ };
+	config.interval = std::chrono::milliseconds{ 10 };
+	config.flushOnShutdown = false;
+	Counter::AccessCounter counter{ std::move(database), config };
+
+	counter.Record("abc");
+	counter.Start();
+	for (int i{ 0 }; i < 100 && counter.Pending("abc") != 0; ++i) {
+		std::this_thread::sleep_for(std::chrono::milliseconds{ 10 });
+	}
+	counter.Stop();
+
+	EXPECT_EQ(written["abc"], 1);
+}
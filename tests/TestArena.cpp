@@ -0,0 +1,154 @@
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <cstdlib>
+#include <deque>
+#include <new>
+#include <random>
+#include <string_view>
+#include <tuple>
+
+#include <boost/asio/buffer.hpp>
+#include <boost/beast/core/flat_static_buffer.hpp>
+#include <boost/beast/http.hpp>
+
+#include "arena.h"
+
+
+// Counts the global allocations of the test binary while enabled
+namespace {
+	std::atomic<bool> isCounting{ false };
+	std::atomic<std::size_t> countAllocations{ 0 };
+}
+
+void* operator new(std::size_t size) {
+	if (isCounting.load(std::memory_order_relaxed)) {
+		countAllocations.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	if (void* ptr{ std::malloc(size == 0 ? 1 : size) }) {
+		return ptr;
+	}
+	throw std::bad_alloc{ };
+}
+
+// Not inlined, or GCC takes the free() for a mismatch with the operator new at the call site
+[[gnu::noinline]] void operator delete(void* ptr) noexcept {
+	std::free(ptr);
+}
+
+[[gnu::noinline]] void operator delete(void* ptr, std::size_t) noexcept {
+	std::free(ptr);
+}
+
+
+namespace {
+	constexpr std::string_view REQUEST{
+		"POST /shorten HTTP/1.1\r\n"
+		"Host: short.example.com\r\n"
+		"User-Agent: benchmark/1.0\r\n"
+		"Accept: application/json\r\n"
+		"Content-Type: application/json\r\n"
+		"Content-Length: 58\r\n"
+		"\r\n"
+		"{\"url\":\"https://www.example.com/some/long/path?query=value\"}" };
+
+	// One keep-alive round the way Session and HttpHandler do it: parse the request, build
+	// the response from its allocator and serialize it. Returns the size of the response.
+	template <class Body, class Fields>
+	std::size_t HandleRequest(std::pmr::memory_resource* arena) {
+		auto parser{ std::make_from_tuple<http::request_parser<Body, typename Fields::allocator_type>>(
+			ArenaMessageArgs<Body, Fields>(arena)) };
+		parser.eager(true);
+
+		beast::error_code ec{ };
+		parser.put(boost::asio::buffer(REQUEST.data(), REQUEST.size()), ec);
+		EXPECT_FALSE(ec) << ec.message();
+		EXPECT_TRUE(parser.is_done());
+
+		http::request<Body, Fields> req{ parser.release() };
+
+		auto res{ std::make_from_tuple<http::response<Body, Fields>>(ArenaMessageArgs<Body, Fields>(arena)) };
+		res.result(http::status::created);
+		res.version(req.version());
+		res.set(http::field::content_type, "application/json");
+		res.set(http::field::server, "url-shortener");
+		res.body() = R"({"id":1,"url":"https://www.example.com/some/long/path?query=value","shortcode":"aZ3kP9q"})";
+		res.prepare_payload();
+
+		beast::flat_static_buffer<1024> out{ };
+		http::serializer<false, Body, Fields> serializer{ res };
+		do {
+			serializer.next(ec, [&](beast::error_code&, const auto& buffers) {
+				std::size_t size{ boost::asio::buffer_copy(out.prepare(beast::buffer_bytes(buffers)), buffers) };
+				out.commit(size);
+				serializer.consume(size);
+			});
+		} while (!ec && !serializer.is_done());
+
+		return out.size();
+	}
+
+	template <class Body, class Fields>
+	std::size_t CountAllocationsPerRequests(std::pmr::memory_resource* arena, int requests) {
+		HandleRequest<Body, Fields>(arena); // the first request fills the arena
+
+		countAllocations = 0;
+		isCounting = true;
+		for (int i{ 0 }; i < requests; ++i) {
+			HandleRequest<Body, Fields>(arena);
+		}
+		isCounting = false;
+
+		return countAllocations.load();
+	}
+}
+
+
+TEST(ArenaTest, ReusesBlocksOnceTheirAllocationsAreFreed) {
+	Arena arena{ 1024 };
+	std::pmr::vector<int> kept{ 100, 1, &arena };
+	EXPECT_EQ(arena.Capacity(), 1024);
+
+	// kept stays alive in the first block, the other rounds take turns in a second one
+	for (int i{ 0 }; i < 1000; ++i) {
+		std::pmr::vector<int> values{ 100, 2, &arena };
+		std::pmr::string text{ "a string that does not fit the small string buffer", &arena };
+		ASSERT_EQ(values.back(), 2);
+	}
+	EXPECT_EQ(arena.Capacity(), 2048);
+
+	// Larger than a block
+	std::pmr::vector<int> large{ 1000, 3, &arena };
+	EXPECT_EQ(large.back(), 3);
+	EXPECT_EQ(kept.back(), 1);
+}
+
+
+TEST(ArenaTest, OverlappingLifetimesKeepTheirContents) {
+	Arena arena{ 512 };
+	std::deque<std::pmr::string> live{ };
+	std::mt19937 random{ 7 };
+
+	for (int i{ 0 }; i < 10'000; ++i) {
+		if (live.size() < 4 && random() % 2 == 0) {
+			live.emplace_back(random() % 300 + 20, static_cast<char>('a' + i % 26), &arena);
+		}
+		else if (!live.empty()) {
+			const std::pmr::string& oldest{ live.front() };
+			ASSERT_EQ(oldest.find_first_not_of(oldest.front()), std::pmr::string::npos);
+			live.pop_front();
+		}
+	}
+
+	EXPECT_LE(arena.Capacity(), 8 * 512);
+}
+
+
+TEST(ArenaTest, SteadyStateRequestsDoNotAllocate) {
+	Arena arena{ };
+	EXPECT_EQ((CountAllocationsPerRequests<ArenaStringBody, ArenaFields>(&arena, 100)), 0);
+
+	// The same round on the default message types allocates the fields and both bodies every time
+	EXPECT_GE((CountAllocationsPerRequests<http::string_body, http::fields>(nullptr, 100)), 300);
+}
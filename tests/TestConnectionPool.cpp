@@ -1,7 +1,12 @@
 #include <gtest/gtest.h>
 
+#include <atomic>
+#include <chrono>
+#include <functional>
 #include <future>
+#include <iostream>
 #include <thread>
+#include <boost/asio/io_context.hpp>
 #include "postgresql.h"
 #include "TestConfig.h"
 #include "MockPGClient.h"
@@ -20,6 +25,18 @@ static PostgreSQL::ConnectionConfig config{
 
 static PostgreSQL::ConnectionParams params{ config.GetConnectionStringParams() };
 
+// Reconnects run on the maintenance thread, tests poll for their outcome
+static bool WaitUntil(const std::function<bool()>& condition) {
+	for (int i{ 0 }; i < 200; ++i) {
+		if (condition()) {
+			return true;
+		}
+		std::this_thread::sleep_for(std::chrono::milliseconds{ 5 });
+	}
+
+	return condition();
+}
+
 
 TEST(ConnectionPoolTest, CreatesPoolWithValidParams) {
 	auto ptr{ std::make_shared<MockPGClient>() };
@@ -292,36 +309,384 @@ TEST(ConnectionPoolTest, ReleaseRecoversInvalidConnection) {
 	auto conn = pool.Acquire();
 	EXPECT_EQ(pool.Count(), 0);
 	pool.Release(std::move(conn));
-	EXPECT_EQ(pool.Count(), 1);
+
+	// The connection keeps its slot while it is reset in the background
+	EXPECT_EQ(pool.Size(), 1);
+	EXPECT_TRUE(WaitUntil([&pool]() { return pool.Count() == 1; }));
 }
 
-TEST(ConnectionPoolTest, ReleaseResetFailsThrowsResetError) {
+TEST(ConnectionPoolTest, ReleaseDoesNotBlockWhileResetFails) {
 	auto ptr = std::make_shared<MockPGClient>();
 	EXPECT_CALL(*ptr, PQconnectdbParams(_, _, 0))
-		.Times(AtLeast(1));
+		.Times(1);
 
 	EXPECT_CALL(*ptr, PQstatus(_))
-		.Times(AtLeast(1))
 		.WillOnce(Return(CONNECTION_OK))
 		.WillRepeatedly(Return(CONNECTION_BAD));
 
+	// A failover: every reset hangs for a while, then fails
+	std::atomic<int> resets{ 0 };
 	EXPECT_CALL(*ptr, PQreset(_))
-		.Times(AtLeast(1));
+		.WillRepeatedly(testing::Invoke([&resets](PGconn*) {
+			std::this_thread::sleep_for(std::chrono::milliseconds{ 20 });
+			++resets;
+		}));
 
+	std::string msg_error{ "server closed the connection unexpectedly" };
 	EXPECT_CALL(*ptr, PQerrorMessage(_))
-		.Times(AtLeast(1));
+		.WillRepeatedly(Return(msg_error.data()));
+
+	EXPECT_CALL(*ptr, PQfinish(_))
+		.Times(AtLeast(0));
+
+	PostgreSQL::PoolConfig poolConfig{ 1, 1, std::chrono::milliseconds{ 10 } };
+	poolConfig.reconnectBackoffMin = std::chrono::milliseconds{ 1 };
+	poolConfig.reconnectBackoffMax = std::chrono::milliseconds{ 4 };
 
 	std::shared_ptr<PostgreSQL::IPGClient> client = ptr;
-	auto pool = PostgreSQL::ConnectionPool(params, client, 1);
+	PostgreSQL::ConnectionPool pool(params, client, poolConfig);
 
 	auto conn = pool.Acquire();
+	const auto start{ std::chrono::steady_clock::now() };
+	EXPECT_NO_THROW(pool.Release(std::move(conn)));
+	EXPECT_LT(std::chrono::steady_clock::now() - start, std::chrono::milliseconds{ 20 });
+
+	// The slot is never given up, the maintenance thread keeps retrying
+	EXPECT_TRUE(WaitUntil([&resets]() { return resets >= 3; }));
+	EXPECT_EQ(pool.Size(), 1);
 	EXPECT_EQ(pool.Count(), 0);
+	EXPECT_THROW(pool.Acquire(), PostgreSQL::ConnectionPoolError);
+}
 
-	EXPECT_THROW({
+TEST(ConnectionPoolTest, HealthCheckResetsClosedIdleConnection) {
+	auto ptr = std::make_shared<MockPGClient>();
+	PGconn* dummyConn = reinterpret_cast<PGconn*>(0x1);
+	EXPECT_CALL(*ptr, PQconnectdbParams(_, _, 0))
+		.WillOnce(Return(dummyConn));
+
+	EXPECT_CALL(*ptr, PQstatus(_))
+		.WillRepeatedly(Return(CONNECTION_OK));
+
+	// The server closed the idle connection once
+	EXPECT_CALL(*ptr, PQconsumeInput(dummyConn))
+		.WillOnce(Return(0))
+		.WillRepeatedly(Return(1));
+
+	std::atomic<int> resets{ 0 };
+	EXPECT_CALL(*ptr, PQreset(dummyConn))
+		.WillOnce(testing::Invoke([&resets](PGconn*) { ++resets; }));
+
+	EXPECT_CALL(*ptr, PQfinish(_))
+		.Times(AtLeast(0));
+
+	PostgreSQL::PoolConfig poolConfig{ 1, 1, std::chrono::milliseconds{ 100 } };
+	poolConfig.healthCheckInterval = std::chrono::milliseconds{ 5 };
+
+	std::shared_ptr<PostgreSQL::IPGClient> client = ptr;
+	PostgreSQL::ConnectionPool pool(params, client, poolConfig);
+
+	EXPECT_TRUE(WaitUntil([&resets]() { return resets == 1; }));
+	EXPECT_TRUE(WaitUntil([&pool]() { return pool.Count() == 1; }));
+	EXPECT_NO_THROW(pool.Release(pool.Acquire()));
+}
+
+TEST(ConnectionPoolTest, PrepareRegistersStatementOnEveryConnection) {
+	auto ptr = std::make_shared<MockPGClient>();
+	PGconn* firstConn = reinterpret_cast<PGconn*>(0x1);
+	PGconn* secondConn = reinterpret_cast<PGconn*>(0x2);
+	PGresult* dummyResult = reinterpret_cast<PGresult*>(0x1);
+	EXPECT_CALL(*ptr, PQconnectdbParams(_, _, 0))
+		.WillOnce(Return(firstConn))
+		.WillOnce(Return(secondConn));
+
+	EXPECT_CALL(*ptr, PQstatus(_))
+		.WillRepeatedly(Return(CONNECTION_OK));
+
+	EXPECT_CALL(*ptr, PQprepare(firstConn, StrEq("stmt_0"), StrEq("SELECT 1;"), 0, nullptr))
+		.WillOnce(Return(dummyResult));
+	EXPECT_CALL(*ptr, PQprepare(secondConn, StrEq("stmt_0"), StrEq("SELECT 1;"), 0, nullptr))
+		.WillOnce(Return(dummyResult));
+
+	EXPECT_CALL(*ptr, PQresultStatus(dummyResult))
+		.WillRepeatedly(Return(PGRES_COMMAND_OK));
+
+	EXPECT_CALL(*ptr, PQclear(_))
+		.Times(AtLeast(0));
+
+	EXPECT_CALL(*ptr, PQfinish(_))
+		.Times(AtLeast(0));
+
+	std::shared_ptr<PostgreSQL::IPGClient> client = ptr;
+	auto pool = PostgreSQL::ConnectionPool(params, client, 2);
+
+	// Busy connections catch up when they are handed out again
+	auto conn = pool.Acquire();
+	auto statement = pool.Prepare("SELECT 1;");
+	EXPECT_EQ(pool.GetStatementName(statement), "stmt_0");
+
+	pool.Release(std::move(conn));
+	auto first = pool.Acquire();
+	auto second = pool.Acquire();
+	pool.Release(std::move(first));
+	pool.Release(std::move(second));
+}
+
+TEST(ConnectionPoolTest, ResetPreparesStatementsAgain) {
+	auto ptr = std::make_shared<MockPGClient>();
+	PGconn* dummyConn = reinterpret_cast<PGconn*>(0x1);
+	PGresult* dummyResult = reinterpret_cast<PGresult*>(0x1);
+	EXPECT_CALL(*ptr, PQconnectdbParams(_, _, 0))
+		.WillOnce(Return(dummyConn));
+
+	EXPECT_CALL(*ptr, PQstatus(_))
+		.WillOnce(Return(CONNECTION_OK))
+		.WillOnce(Return(CONNECTION_BAD))
+		.WillRepeatedly(Return(CONNECTION_OK));
+
+	EXPECT_CALL(*ptr, PQreset(dummyConn))
+		.Times(1);
+
+	// Once on registration, once after the reset
+	EXPECT_CALL(*ptr, PQprepare(dummyConn, StrEq("stmt_0"), _, 0, nullptr))
+		.Times(2)
+		.WillRepeatedly(Return(dummyResult));
+
+	EXPECT_CALL(*ptr, PQresultStatus(dummyResult))
+		.WillRepeatedly(Return(PGRES_COMMAND_OK));
+
+	EXPECT_CALL(*ptr, PQclear(_))
+		.Times(AtLeast(0));
+
+	EXPECT_CALL(*ptr, PQfinish(_))
+		.Times(AtLeast(0));
+
+	std::shared_ptr<PostgreSQL::IPGClient> client = ptr;
+	auto pool = PostgreSQL::ConnectionPool(params, client, 1);
+	pool.Prepare("SELECT 1;");
+
+	auto conn = pool.Acquire();
+	pool.Release(std::move(conn));
+	EXPECT_TRUE(WaitUntil([&pool]() { return pool.Count() == 1; }));
+}
+
+TEST(ConnectionPoolTest, PrepareFailureThrowsPrepareError) {
+	auto ptr = std::make_shared<MockPGClient>();
+	PGconn* dummyConn = reinterpret_cast<PGconn*>(0x1);
+	PGresult* dummyResult = reinterpret_cast<PGresult*>(0x1);
+	EXPECT_CALL(*ptr, PQconnectdbParams(_, _, 0))
+		.WillOnce(Return(dummyConn));
+
+	EXPECT_CALL(*ptr, PQstatus(_))
+		.WillRepeatedly(Return(CONNECTION_OK));
+
+	EXPECT_CALL(*ptr, PQprepare(dummyConn, _, _, 0, nullptr))
+		.WillOnce(Return(dummyResult))
+		.WillOnce(Return(dummyResult));
+
+	EXPECT_CALL(*ptr, PQresultStatus(dummyResult))
+		.WillOnce(Return(PGRES_FATAL_ERROR))
+		.WillOnce(Return(PGRES_COMMAND_OK));
+
+	std::string msg_error{ "syntax error" };
+	EXPECT_CALL(*ptr, PQerrorMessage(_))
+		.WillRepeatedly(Return(msg_error.data()));
+
+	EXPECT_CALL(*ptr, PQclear(_))
+		.Times(AtLeast(0));
+
+	EXPECT_CALL(*ptr, PQfinish(_))
+		.Times(AtLeast(0));
+
+	std::shared_ptr<PostgreSQL::IPGClient> client = ptr;
+	auto pool = PostgreSQL::ConnectionPool(params, client, 1);
+
+	EXPECT_THROW(pool.Prepare("SELEC 1;"), PostgreSQL::PrepareError);
+
+	// The failed statement keeps its slot but is never prepared again, its name is not reused
+	auto statement = pool.Prepare("SELECT 1;");
+	EXPECT_EQ(statement.id, 1);
+	EXPECT_EQ(pool.GetStatementName(statement), "stmt_1");
+	EXPECT_THROW(pool.GetStatementName(StatementHandle{ 0 }), PostgreSQL::PrepareError);
+}
+
+TEST(ConnectionPoolTest, InvalidPoolConfigThrowsConnectionPoolError) {
+	auto ptr = std::make_shared<MockPGClient>();
+	std::shared_ptr<PostgreSQL::IPGClient> client = ptr;
+
+	EXPECT_THROW(PostgreSQL::ConnectionPool(params, client, PostgreSQL::PoolConfig{ 3, 2, std::chrono::milliseconds{ 100 } }),
+		PostgreSQL::ConnectionPoolError);
+	EXPECT_THROW(PostgreSQL::ConnectionPool(params, client, PostgreSQL::PoolConfig{ -1, 2, std::chrono::milliseconds{ 100 } }),
+		PostgreSQL::ConnectionPoolError);
+	EXPECT_THROW(PostgreSQL::ConnectionPool(params, client, PostgreSQL::PoolConfig{ 1, 2, std::chrono::milliseconds{ -1 } }),
+		PostgreSQL::ConnectionPoolError);
+
+	PostgreSQL::PoolConfig poolConfig{ 1, 2, std::chrono::milliseconds{ 100 } };
+	poolConfig.reconnectBackoffMax = poolConfig.reconnectBackoffMin / 2;
+	EXPECT_THROW(PostgreSQL::ConnectionPool(params, client, poolConfig), PostgreSQL::ConnectionPoolError);
+}
+
+TEST(ConnectionPoolTest, AcquireGrowsPoolUpToMaxSize) {
+	auto ptr = std::make_shared<MockPGClient>();
+	EXPECT_CALL(*ptr, PQconnectdbParams(_, _, 0))
+		.Times(3)
+		.WillRepeatedly(Return(reinterpret_cast<PGconn*>(0x1)));
+
+	EXPECT_CALL(*ptr, PQstatus(_))
+		.WillRepeatedly(Return(CONNECTION_OK));
+
+	EXPECT_CALL(*ptr, PQfinish(_))
+		.Times(3);
+
+	std::shared_ptr<PostgreSQL::IPGClient> client = ptr;
+	// New connections are opened by the maintenance thread while Acquire waits
+	PostgreSQL::ConnectionPool pool(params, client, PostgreSQL::PoolConfig{ 1, 3, std::chrono::milliseconds{ 200 } });
+	EXPECT_EQ(pool.Size(), 1);
+
+	auto conn1 = pool.Acquire();
+	auto conn2 = pool.Acquire();
+	auto conn3 = pool.Acquire();
+	EXPECT_EQ(pool.Size(), 3);
+
+	EXPECT_THROW(pool.Acquire(), PostgreSQL::ConnectionPoolError);
+
+	pool.Release(std::move(conn1));
+	pool.Release(std::move(conn2));
+	pool.Release(std::move(conn3));
+	EXPECT_EQ(pool.Count(), 3);
+}
+
+TEST(ConnectionPoolTest, AcquireTimeoutIsConfigurable) {
+	auto ptr = std::make_shared<MockPGClient>();
+	EXPECT_CALL(*ptr, PQconnectdbParams(_, _, 0))
+		.WillOnce(Return(reinterpret_cast<PGconn*>(0x1)));
+
+	EXPECT_CALL(*ptr, PQstatus(_))
+		.WillRepeatedly(Return(CONNECTION_OK));
+
+	EXPECT_CALL(*ptr, PQfinish(_))
+		.Times(AtLeast(1));
+
+	std::shared_ptr<PostgreSQL::IPGClient> client = ptr;
+	PostgreSQL::ConnectionPool pool(params, client, PostgreSQL::PoolConfig{ 1, 1, std::chrono::milliseconds{ 20 } });
+
+	auto conn = pool.Acquire();
+	const auto start{ std::chrono::steady_clock::now() };
+	EXPECT_THROW(pool.Acquire(), PostgreSQL::ConnectionPoolError);
+	const auto elapsed{ std::chrono::steady_clock::now() - start };
+
+	EXPECT_GE(elapsed, std::chrono::milliseconds{ 20 });
+	EXPECT_LT(elapsed, std::chrono::milliseconds{ 400 });
+}
+
+TEST(ConnectionPoolTest, ReleaseWakesWaitersInFifoOrder) {
+	auto ptr = std::make_shared<MockPGClient>();
+	EXPECT_CALL(*ptr, PQconnectdbParams(_, _, 0))
+		.WillOnce(Return(reinterpret_cast<PGconn*>(0x1)));
+
+	EXPECT_CALL(*ptr, PQstatus(_))
+		.WillRepeatedly(Return(CONNECTION_OK));
+
+	EXPECT_CALL(*ptr, PQfinish(_))
+		.Times(AtLeast(1));
+
+	std::shared_ptr<PostgreSQL::IPGClient> client = ptr;
+	PostgreSQL::ConnectionPool pool(params, client, PostgreSQL::PoolConfig{ 1, 1, std::chrono::seconds{ 5 } });
+
+	auto conn = pool.Acquire();
+
+	std::mutex mutex;
+	std::vector<int> order;
+	auto waiter = [&](int id) {
+		auto conn = pool.Acquire();
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			order.push_back(id);
+		}
 		pool.Release(std::move(conn));
-		
-		EXPECT_EQ(pool.Count(), 0);
-	}, PostgreSQL::ResetError);
+	};
+
+	std::thread first{ waiter, 1 };
+	std::this_thread::sleep_for(std::chrono::milliseconds{ 50 });
+	std::thread second{ waiter, 2 };
+	std::this_thread::sleep_for(std::chrono::milliseconds{ 50 });
+
+	// Woken by the release, not by a polling slice
+	const auto start{ std::chrono::steady_clock::now() };
+	pool.Release(std::move(conn));
+	first.join();
+	second.join();
+
+	EXPECT_LT(std::chrono::steady_clock::now() - start, std::chrono::milliseconds{ 50 });
+	EXPECT_EQ(order, (std::vector<int>{ 1, 2 }));
+	EXPECT_EQ(pool.Count(), 1);
+}
+
+TEST(ConnectionPoolTest, AcquireAsyncCompletesOnRelease) {
+	auto ptr = std::make_shared<MockPGClient>();
+	EXPECT_CALL(*ptr, PQconnectdbParams(_, _, 0))
+		.WillOnce(Return(reinterpret_cast<PGconn*>(0x1)));
+
+	EXPECT_CALL(*ptr, PQstatus(_))
+		.WillRepeatedly(Return(CONNECTION_OK));
+
+	EXPECT_CALL(*ptr, PQfinish(_))
+		.Times(AtLeast(1));
+
+	std::shared_ptr<PostgreSQL::IPGClient> client = ptr;
+	PostgreSQL::ConnectionPool pool(params, client, PostgreSQL::PoolConfig{ 1, 1, std::chrono::seconds{ 5 } });
+
+	auto conn = pool.Acquire();
+
+	boost::asio::io_context ioc;
+	bool isAcquired{ false };
+	pool.AcquireAsync(ioc.get_executor(),
+		[&](std::exception_ptr error, PostgreSQL::PGconnPtr conn) {
+			EXPECT_FALSE(error);
+			isAcquired = true;
+			pool.Release(std::move(conn));
+		});
+
+	// The waiter does not park the thread
+	ioc.poll();
+	EXPECT_FALSE(isAcquired);
+
+	pool.Release(std::move(conn));
+	ioc.run();
+
+	EXPECT_TRUE(isAcquired);
+	EXPECT_EQ(pool.Count(), 1);
+}
+
+TEST(ConnectionPoolTest, AcquireAsyncTimeoutReportsConnectionPoolError) {
+	auto ptr = std::make_shared<MockPGClient>();
+	EXPECT_CALL(*ptr, PQconnectdbParams(_, _, 0))
+		.WillOnce(Return(reinterpret_cast<PGconn*>(0x1)));
+
+	EXPECT_CALL(*ptr, PQstatus(_))
+		.WillRepeatedly(Return(CONNECTION_OK));
+
+	EXPECT_CALL(*ptr, PQfinish(_))
+		.Times(AtLeast(1));
+
+	std::shared_ptr<PostgreSQL::IPGClient> client = ptr;
+	PostgreSQL::ConnectionPool pool(params, client, PostgreSQL::PoolConfig{ 1, 1, std::chrono::milliseconds{ 20 } });
+
+	auto conn = pool.Acquire();
+
+	boost::asio::io_context ioc;
+	bool isCalled{ false };
+	pool.AcquireAsync(ioc.get_executor(),
+		[&](std::exception_ptr error, PostgreSQL::PGconnPtr) {
+			isCalled = true;
+			EXPECT_THROW(std::rethrow_exception(error), PostgreSQL::ConnectionPoolError);
+		});
+
+	ioc.run();
+	EXPECT_TRUE(isCalled);
+
+	// The timed out waiter does not take the connection
+	pool.Release(std::move(conn));
+	EXPECT_EQ(pool.Count(), 1);
 }
 
 TEST(ConnectionPoolTest, ConcurrentAcquireReleaseWorksCorrectly) {
@@ -411,4 +776,47 @@ TEST(ConnectionPoolTest, HighLoad) {
 	}
 
 	EXPECT_EQ(pool.Count(), THREADS);
-}
\ No newline at end of file
+}
+
+// Acquire/release throughput with many threads competing for a small pool.
+// Disabled by default: --gtest_also_run_disabled_tests --gtest_filter=ConnectionPoolTest.DISABLED_*
+TEST(ConnectionPoolTest, DISABLED_ContentionBenchmark) {
+	auto ptr = std::make_shared<MockPGClient>();
+	EXPECT_CALL(*ptr, PQconnectdbParams(_, _, 0))
+		.WillRepeatedly(Return(reinterpret_cast<PGconn*>(0x1)));
+
+	EXPECT_CALL(*ptr, PQstatus(_))
+		.WillRepeatedly(Return(CONNECTION_OK));
+
+	EXPECT_CALL(*ptr, PQfinish(_))
+		.Times(AtLeast(0));
+
+	const int THREADS = 4 * std::max(1u, std::thread::hardware_concurrency());
+	const int CONNECTIONS = std::max(1, THREADS / 4);
+	const int ITERATIONS = 100000;
+
+	std::shared_ptr<PostgreSQL::IPGClient> client = ptr;
+	PostgreSQL::ConnectionPool pool(params, client, PostgreSQL::PoolConfig{ CONNECTIONS, CONNECTIONS, std::chrono::seconds{ 10 } });
+
+	const auto start{ std::chrono::steady_clock::now() };
+	std::vector<std::thread> threads;
+	for (int i = 0; i < THREADS; ++i) {
+		threads.emplace_back([&]() {
+			for (int j = 0; j < ITERATIONS; ++j) {
+				pool.Release(pool.Acquire());
+			}
+		});
+	}
+
+	for (auto& t : threads) {
+		t.join();
+	}
+
+	const double seconds{ std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() };
+	const double opsPerSecond{ THREADS * ITERATIONS / seconds };
+	std::cout << THREADS << " threads, " << CONNECTIONS << " connections: "
+		<< opsPerSecond << " acquire/release per second\n";
+
+	RecordProperty("AcquireReleasePerSecond", static_cast<int>(opsPerSecond));
+	EXPECT_EQ(pool.Count(), CONNECTIONS);
+}
@@ -0,0 +1,132 @@
+#include <gtest/gtest.h>
+
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <boost/asio/io_context.hpp>
+#include "export.h"
+
+
+namespace {
+	// Hands out the chunks one per read, then fails if error is set
+	class ChunkStream : public ICopyOutStream {
+	public:
+		ChunkStream(std::vector<std::string> chunks, bool isFailing = false)
+			: m_chunks{ std::move(chunks) }
+			, m_isFailing{ isFailing }
+		{
+		}
+
+		bool Read(std::string& buffer, std::size_t) override {
+			if (m_next == m_chunks.size()) {
+				if (m_isFailing) {
+					throw std::runtime_error("The copy failed.");
+				}
+				return false;
+			}
+
+			buffer += m_chunks[m_next++];
+			return m_isFailing || m_next < m_chunks.size();
+		}
+
+	private:
+		std::vector<std::string> m_chunks;
+		bool m_isFailing;
+		std::size_t m_next{ 0 };
+	};
+
+	// Counts the wakers called, where a session would resume its write
+	class CountingWaiter : public BodyWaiter {
+	public:
+		Waker MakeWaker() override {
+			return [this]() { ++wakes; };
+		}
+
+		int wakes{ 0 };
+	};
+
+	using Response = http::response<Export::CopyBody>;
+}
+
+
+TEST(ExportTest, QueuedBodyWakesTheSessionWhenTheRowsArrive) {
+	boost::asio::io_context ioc;
+	auto queue{ std::make_shared<Export::ChunkQueue>(Export::QUEUED_CHUNKS) };
+	Response res{ http::status::ok, 11 };
+	res.body().reader.emplace(queue);
+
+	Export::CopyBody::writer writer{ res.base(), res.body() };
+	beast::error_code ec{ };
+	writer.init(ec);
+
+	CountingWaiter waiter{ };
+	{
+		BodyWaiter::Scope scope{ waiter };
+		EXPECT_FALSE(writer.get(ec));
+		EXPECT_EQ(ec, http::error::need_buffer);
+	}
+	EXPECT_EQ(waiter.wakes, 0);
+
+	Export::Pump(std::make_shared<ChunkStream>(std::vector<std::string>{ "a\n", "b\n" }), queue, 1024, ioc.get_executor());
+	EXPECT_EQ(waiter.wakes, 1);
+
+	std::string body{ };
+	for (auto chunk{ writer.get(ec) }; chunk; chunk = writer.get(ec)) {
+		body.append(static_cast<const char*>(chunk -> first.data()), chunk -> first.size());
+	}
+	EXPECT_FALSE(ec);
+	EXPECT_EQ(body, "a\nb\n");
+}
+
+TEST(ExportTest, FailedCopyFailsTheBodyAfterItsRows) {
+	boost::asio::io_context ioc;
+	auto queue{ std::make_shared<Export::ChunkQueue>(Export::QUEUED_CHUNKS) };
+	Export::Pump(std::make_shared<ChunkStream>(std::vector<std::string>{ "a\n" }, true), queue, 1024, ioc.get_executor());
+
+	std::string chunk{ };
+	EXPECT_EQ(queue -> Pop(chunk), Export::ChunkQueue::State::Ready);
+	EXPECT_EQ(chunk, "a\n");
+	EXPECT_EQ(queue -> Pop(chunk), Export::ChunkQueue::State::Failed);
+}
+
+TEST(ExportTest, FullQueueGivesTheThreadBack) {
+	boost::asio::io_context ioc;
+	auto queue{ std::make_shared<Export::ChunkQueue>(1) };
+	Export::Pump(std::make_shared<ChunkStream>(std::vector<std::string>{ "a\n", "b\n", "c\n" }), queue, 1024,
+		ioc.get_executor());
+
+	// Nothing runs while the queue is full, taking a chunk posts the turn reading the next
+	EXPECT_EQ(ioc.poll(), 0);
+	std::string chunk{ };
+	for (const char* expected : { "a\n", "b\n" }) {
+		ASSERT_EQ(queue -> Pop(chunk), Export::ChunkQueue::State::Ready);
+		EXPECT_EQ(chunk, expected);
+		ioc.restart();
+		EXPECT_EQ(ioc.poll(), 1);
+	}
+
+	// The copy ended with the last chunk, taking it posts no turn
+	ASSERT_EQ(queue -> Pop(chunk), Export::ChunkQueue::State::Ready);
+	EXPECT_EQ(chunk, "c\n");
+	ioc.restart();
+	EXPECT_EQ(ioc.poll(), 0);
+	EXPECT_EQ(queue -> Pop(chunk), Export::ChunkQueue::State::Done);
+}
+
+TEST(ExportTest, DroppedResponseStopsTheCopy) {
+	boost::asio::io_context ioc;
+	auto queue{ std::make_shared<Export::ChunkQueue>(1) };
+	auto stream{ std::make_shared<ChunkStream>(std::vector<std::string>{ "a\n", "b\n", "c\n" }) };
+	Export::Pump(stream, queue, 1024, ioc.get_executor());
+
+	// The copy waiting for room runs once more and lets go of the stream
+	{
+		Export::QueueReader reader{ queue };
+	}
+	EXPECT_EQ(ioc.poll(), 1);
+	EXPECT_EQ(stream.use_count(), 1);
+
+	std::string chunk{ };
+	EXPECT_EQ(queue -> Pop(chunk), Export::ChunkQueue::State::Waiting);
+}
@@ -1,5 +1,7 @@
 #include <string>
 #include <memory>
+#include <sstream>
+#include <vector>
 
 #include <gtest/gtest.h>
 #include <boost/beast.hpp>
@@ -259,6 +261,36 @@ TEST_F(HttpHandlerTest, HandlerMethodGET) {
 }
 
 
+// TEST endpoint --- GET /..                                              ---  ..  = shortcode
+TEST_F(HttpHandlerTest, HandlerRedirect) {
+	Random::StringGenerator generator{ 40, 70 };
+	std::string url{ "https://www.example.com/" + generator.Generate() };
+
+	json json;
+	json["url"] = url;
+	auto request = Request::CreateStandard(http::verb::post, "/shorten", std::move(json));
+	auto response = Client.Query(std::move(request), Handler);
+	ASSERT_EQ(response.result_int(), 201);
+
+	ParseJSONWithErrorHandling(response.body(), json);
+	auto shortCode{ json.at("shortcode").get<std::string>() };
+
+	// redirect, the query string is ignored
+	request = Request::CreateStandard(http::verb::get, "/" + shortCode + "?utm_source=test");
+	response = Client.Query(std::move(request), Handler);
+
+	EXPECT_EQ(response.result_int(), 302);
+	EXPECT_EQ(response[http::field::location], url);
+	EXPECT_TRUE(response.body().empty());
+
+	// non-existent shortCode
+	request = Request::CreateStandard(http::verb::get, "/" + url.substr(24) + url.substr(24));
+	response = Client.Query(std::move(request), Handler);
+
+	EXPECT_EQ(response.result_int(), 404);
+}
+
+
 // TEST endpoints --- PUT /shorten/..                                    ---  ..  = shortcode
 TEST_F(HttpHandlerTest, HandlerMethodPUT) {
 	std::string errorMessage{ };
@@ -381,4 +413,238 @@ TEST_F(HttpHandlerTest, HandlerMethodDELETE) {
 	response = Client.Query(std::move(request), Handler);
 
 	EXPECT_EQ(response.result_int(), 404);
-}
\ No newline at end of file
+}
+
+// TEST endpoint --- POST /shorten/batch                                 ---
+TEST_F(HttpHandlerTest, HandlerMethodPOSTBatch) {
+	std::string errorMessage{ };
+	Random::StringGenerator generator{ 40, 70 };
+	std::string first{ generator.Generate() };
+	std::string second{ generator.Generate() };
+
+	// json array, the repeated url gets the same code
+	json batch = json::array({ first, json{ { "url", second } }, first });
+	auto request = Request::CreateStandard(http::verb::post, "/shorten/batch", std::move(batch));
+	auto response = Client.Query(std::move(request), Handler);
+	EXPECT_EQ(response.result_int(), 200);
+
+	json body;
+	ParseJSONWithErrorHandling(response.body(), body);
+	ASSERT_TRUE(body.is_array());
+	ASSERT_EQ(body.size(), 3);
+	for (const json& url : body) {
+		errorMessage = CheckStandardBody(url);
+		EXPECT_TRUE(errorMessage.empty()) << errorMessage << "\n";
+	}
+	EXPECT_EQ(body[0].at("url"), first);
+	EXPECT_EQ(body[1].at("url"), second);
+	EXPECT_EQ(body[0].at("shortcode"), body[2].at("shortcode"));
+
+	// NDJSON, the existing urls keep their codes
+	http::request<http::string_body> ndjson{ http::verb::post, "/shorten/batch", 11 };
+	ndjson.body() = "\"" + second + "\"\n{\"url\":\"" + first + "\"}\n";
+	ndjson.prepare_payload();
+	response = Client.Query(std::move(ndjson), Handler);
+	EXPECT_EQ(response.result_int(), 200);
+	EXPECT_EQ(response[http::field::content_type], "application/x-ndjson");
+
+	std::istringstream lines{ response.body() };
+	std::string line{ };
+	std::vector<json> rows{ };
+	while (std::getline(lines, line)) {
+		rows.push_back(json::parse(line));
+	}
+	ASSERT_EQ(rows.size(), 2);
+	EXPECT_EQ(rows[0].at("shortcode"), body[1].at("shortcode"));
+	EXPECT_EQ(rows[1].at("shortcode"), body[0].at("shortcode"));
+
+	// Empty batch
+	request = Request::CreateStandard(http::verb::post, "/shorten/batch", json::array());
+	response = Client.Query(std::move(request), Handler);
+	EXPECT_EQ(response.result_int(), 400);
+
+	ParseJSONWithErrorHandling(response.body(), body);
+	errorMessage = CheckStandardError(body);
+	EXPECT_TRUE(errorMessage.empty()) << errorMessage << "\n";
+}
+
+
+TEST_F(HttpHandlerTest, HandlerMethodResolveBatch) {
+	std::string errorMessage{ };
+	Random::StringGenerator generator{ 40, 70 };
+	std::string first{ generator.Generate() };
+	std::string second{ generator.Generate() };
+
+	auto request = Request::CreateStandard(http::verb::post, "/shorten/batch", json::array({ first, second }));
+	auto response = Client.Query(std::move(request), Handler);
+	ASSERT_EQ(response.result_int(), 200);
+
+	json created;
+	ParseJSONWithErrorHandling(response.body(), created);
+	std::string firstCode{ created[0].at("shortcode") };
+	std::string secondCode{ created[1].at("shortcode") };
+
+	// Unknown codes are null, the repeated code resolves twice
+	json codes = json::array({ secondCode, "0", json{ { "code", firstCode } }, secondCode });
+	request = Request::CreateStandard(http::verb::post, "/resolve/batch", std::move(codes));
+	response = Client.Query(std::move(request), Handler);
+	EXPECT_EQ(response.result_int(), 200);
+
+	json body;
+	ParseJSONWithErrorHandling(response.body(), body);
+	ASSERT_TRUE(body.is_array());
+	ASSERT_EQ(body.size(), 4);
+	errorMessage = CheckStandardBody(body[0]);
+	EXPECT_TRUE(errorMessage.empty()) << errorMessage << "\n";
+	EXPECT_EQ(body[0].at("url"), second);
+	EXPECT_TRUE(body[1].is_null());
+	EXPECT_EQ(body[2].at("url"), first);
+	EXPECT_EQ(body[3], body[0]);
+
+	// The same lookup through the query string
+	request = Request::CreateStandard(http::verb::get, "/resolve/batch?code=" + firstCode + "&code=" + secondCode);
+	response = Client.Query(std::move(request), Handler);
+	EXPECT_EQ(response.result_int(), 200);
+
+	ParseJSONWithErrorHandling(response.body(), body);
+	ASSERT_EQ(body.size(), 2);
+	EXPECT_EQ(body[0].at("url"), first);
+	EXPECT_EQ(body[1].at("url"), second);
+
+	// No codes
+	request = Request::CreateStandard(http::verb::get, "/resolve/batch");
+	response = Client.Query(std::move(request), Handler);
+	EXPECT_EQ(response.result_int(), 400);
+}
+
+
+TEST_F(HttpHandlerTest, HandlerMethodGETExport) {
+	Random::StringGenerator generator{ 40, 70 };
+	std::string url{ generator.Generate() };
+
+	auto request = Request::CreateStandard(http::verb::post, "/shorten", json{ { "url", url } });
+	auto response = Client.Query(std::move(request), Handler);
+	ASSERT_EQ(response.result_int(), 201);
+
+	// NDJSON by default, a document per row
+	request = Request::CreateStandard(http::verb::get, "/admin/export");
+	response = Client.Query(Admin(std::move(request)), Handler);
+	EXPECT_EQ(response.result_int(), 200);
+	EXPECT_EQ(response[http::field::content_type], "application/x-ndjson");
+
+	std::istringstream lines{ response.body() };
+	std::string line{ };
+	bool isFound{ false };
+	while (std::getline(lines, line)) {
+		json row = json::parse(line);
+		isFound = isFound || row.at("url") == url;
+	}
+	EXPECT_TRUE(isFound);
+
+	request = Request::CreateStandard(http::verb::get, "/admin/export?format=csv");
+	response = Client.Query(Admin(std::move(request)), Handler);
+	EXPECT_EQ(response.result_int(), 200);
+	EXPECT_TRUE(response.body().starts_with("id,url,shortcode,createdat,updatedat,accesscount\n"));
+	EXPECT_NE(response.body().find(url), std::string::npos);
+
+	request = Request::CreateStandard(http::verb::get, "/admin/export?format=xml");
+	response = Client.Query(Admin(std::move(request)), Handler);
+	EXPECT_EQ(response.result_int(), 400);
+}
+
+TEST_F(HttpHandlerTest, HandlerMethodPOSTImport) {
+	Random::StringGenerator generator{ 40, 70 };
+	std::string url{ "https://example.com/" + generator.Generate() };
+	std::string code{ generator.Generate().substr(0, 12) };
+
+	// The second row repeats the code, the third is not json
+	std::string rows{
+		json{ { "url", url }, { "shortcode", code } }.dump() + "\n" +
+		json{ { "url", url + "/other" }, { "shortcode", code } }.dump() + "\n" +
+		"not json\n" };
+
+	http::request<http::string_body> request{ http::verb::post, "/admin/import?format=ndjson", 11 };
+	request.body() = rows;
+	request.prepare_payload();
+	auto response = Client.Query(Admin(std::move(request)), Handler);
+	ASSERT_EQ(response.result_int(), 200);
+
+	json body = json::parse(response.body());
+	EXPECT_EQ(body.at("rows"), 3);
+	EXPECT_EQ(body.at("imported"), 1);
+	EXPECT_EQ(body.at("rejected"), 2);
+	ASSERT_EQ(body.at("rejects").size(), 2);
+	EXPECT_EQ(body.at("rejects")[0].at("line"), 3);
+	EXPECT_EQ(body.at("rejects")[0].at("reason"), "invalid json");
+	EXPECT_EQ(body.at("rejects")[1].at("line"), 2);
+	EXPECT_EQ(body.at("rejects")[1].at("reason"), "duplicate code");
+
+	// The url keeps the imported code
+	auto lookup = Request::CreateStandard(http::verb::get, "/shorten/" + code);
+	response = Client.Query(std::move(lookup), Handler);
+	EXPECT_EQ(response.result_int(), 200);
+	EXPECT_EQ(json::parse(response.body()).at("url"), url);
+
+	// Importing it again finds the code taken
+	request = http::request<http::string_body>{ http::verb::post, "/admin/import", 11 };
+	request.body() = rows;
+	request.prepare_payload();
+	response = Client.Query(Admin(std::move(request)), Handler);
+	ASSERT_EQ(response.result_int(), 200);
+	body = json::parse(response.body());
+	EXPECT_EQ(body.at("imported"), 0);
+
+	request = http::request<http::string_body>{ http::verb::post, "/admin/import?format=csv", 11 };
+	request.body() = "id,url\n1,https://example.com\n";
+	request.prepare_payload();
+	response = Client.Query(Admin(std::move(request)), Handler);
+	EXPECT_EQ(response.result_int(), 400);
+}
+
+TEST_F(HttpHandlerTest, HandlerMethodPOSTImportListsAtMostTheMaxRejects) {
+	HandlerConfig handlerConfig{ };
+	handlerConfig.importMaxRejects = 1;
+	handlerConfig.adminToken = AdminToken;
+	auto handler{ std::make_shared<HttpHandler<http::string_body>>(
+		std::make_unique<PostgreSQL::Database>(config, std::make_shared<PostgreSQL::PGClient>()),
+		"tests_handler",
+		std::make_shared<ShortCode::Allocator>(
+			std::make_unique<PostgreSQL::Database>(config, std::make_shared<PostgreSQL::PGClient>()),
+			ShortCode::Encoder{ 0x2545'f491'4f6c'dd1d }),
+		nullptr,
+		nullptr,
+		handlerConfig) };
+
+	http::request<http::string_body> request{ http::verb::post, "/admin/import", 11 };
+	request.body() = "not json\nnot json\nnot json\n";
+	request.prepare_payload();
+	auto response = Client.Query(Admin(std::move(request)), handler);
+	ASSERT_EQ(response.result_int(), 200);
+
+	json body = json::parse(response.body());
+	EXPECT_EQ(body.at("rejected"), 3);
+	ASSERT_EQ(body.at("rejects").size(), 1);
+	EXPECT_EQ(body.at("rejects")[0].at("line"), 1);
+}
+
+TEST_F(HttpHandlerTest, HandlerAdminEndpointsNeedTheToken) {
+	auto request = Request::CreateStandard(http::verb::get, "/admin/export");
+	auto response = Client.Query(std::move(request), Handler);
+	EXPECT_EQ(response.result_int(), 403);
+
+	request = Request::CreateStandard(http::verb::get, "/admin/export");
+	request.set(http::field::authorization, "Bearer wrong-token");
+	response = Client.Query(std::move(request), Handler);
+	EXPECT_EQ(response.result_int(), 403);
+
+	http::request<http::string_body> importRequest{ http::verb::post, "/admin/import", 11 };
+	importRequest.body() = "not json\n";
+	importRequest.prepare_payload();
+	response = Client.Query(std::move(importRequest), Handler);
+	EXPECT_EQ(response.result_int(), 403);
+
+	// With the token the export is served
+	auto exportRequest = Request::CreateStandard(http::verb::get, "/admin/export");
+	response = Client.Query(Admin(std::move(exportRequest)), Handler);
+	EXPECT_EQ(response.result_int(), 200);
+}
@@ -13,6 +13,7 @@
 
 
 #include "random.h"
+#include "shortcode.h"
 #include "handler.h"
 #include "postgresql.h"
 #include "TestConfig.h"
@@ -167,11 +168,24 @@ public:
 	inline static PostgreSQL::ConnectionConfig config{ __HOST_DATABASE,
 					  __USER_DATABASE, __PASSWORD_DATABASE, __NAME_DATABASE, __PORT_DATABASE };
 
+	inline static const std::string AdminToken{ "tests-admin-token" };
+
 	inline static std::shared_ptr<HttpHandler<http::string_body>> Handler{
 		std::make_shared<HttpHandler<http::string_body>>(
 				std::make_unique<PostgreSQL::Database>(config, std::make_shared<PostgreSQL::PGClient>()),
 				"tests_handler",
-				Random::StringGenerator()) };
+				std::make_shared<ShortCode::Allocator>(
+					std::make_unique<PostgreSQL::Database>(config, std::make_shared<PostgreSQL::PGClient>()),
+					ShortCode::Encoder{ 0x2545'f491'4f6c'dd1d }),
+				nullptr,
+				nullptr,
+				HandlerConfig{ .adminToken = AdminToken }) };
+
+	// Requests to /admin/* carry the token of the handler
+	static http::request<http::string_body> Admin(http::request<http::string_body>&& req) {
+		req.set(http::field::authorization, "Bearer " + AdminToken);
+		return std::move(req);
+	}
 
 	inline static Client Client{ 
 		tcp::endpoint{
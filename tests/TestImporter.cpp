@@ -0,0 +1,234 @@
+#include <gtest/gtest.h>
+
+#include <format>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "importer.h"
+#include "MockDatabase.h"
+
+
+using ::testing::_;
+using ::testing::An;
+using ::testing::HasSubstr;
+using ::testing::Invoke;
+using ::testing::Return;
+
+
+// Collects what the importer copies into the staging table
+class RecordingCopyIn : public ICopyInStream {
+public:
+	explicit RecordingCopyIn(std::vector<std::string>& writes) : m_writes{ writes } { }
+
+	void Write(std::string_view data) override { m_writes.emplace_back(data); }
+	void Finish() override { }
+
+private:
+	std::vector<std::string>& m_writes;
+};
+
+
+// Hands out the rows at once, as one read of a short COPY TO STDOUT would
+class FixedCopyOut : public ICopyOutStream {
+public:
+	explicit FixedCopyOut(std::string rows) : m_rows{ std::move(rows) } { }
+
+	bool Read(std::string& buffer, std::size_t) override {
+		buffer += m_rows;
+		return false;
+	}
+
+private:
+	std::string m_rows{ };
+};
+
+
+// Single int8 value, as the count of the inserted rows
+class CountResult : public IResultView {
+public:
+	explicit CountResult(std::int64_t count) : m_count{ count } { }
+
+	int Rows() const override { return 1; }
+	int Columns() const override { return 2; }
+	bool IsNull(int, int) const override { return false; }
+	std::string_view GetString(int, int) const override { throw std::logic_error("not a string"); }
+	std::int64_t GetInt64(int, int) const override { return m_count; }
+	std::chrono::system_clock::time_point GetTimestamp(int, int) const override { throw std::logic_error("not a timestamp"); }
+
+private:
+	std::int64_t m_count{ };
+};
+
+
+class ImporterTest : public ::testing::Test {
+protected:
+	void SetUp() override {
+		EXPECT_CALL(database, Execute(An<std::string_view>(), _))
+			.WillRepeatedly(Invoke([this](std::string_view query, IDatabase::SqlParams) {
+				executed.emplace_back(query);
+			}));
+		EXPECT_CALL(database, CopyIn(std::string_view{ "COPY url_imports (import, line, url, shortcode) FROM STDIN;" }))
+			.WillOnce(Invoke([this](std::string_view) { return std::make_unique<RecordingCopyIn>(writes); }));
+	}
+
+	Import::RejectCallback Collect() {
+		return [this](const Import::Reject& reject) { rejects.push_back(reject); };
+	}
+
+	// Staged rows without the import id: "line\turl\tcode"
+	std::vector<std::string> StagedRows() const {
+		std::string data{ };
+		for (const auto& write : writes) {
+			data += write;
+		}
+
+		std::vector<std::string> rows{ };
+		for (std::size_t start{ 0 }, end{ data.find('\n') }; end != std::string::npos; start = end + 1, end = data.find('\n', start)) {
+			std::string row{ data.substr(start, end - start) };
+			rows.push_back(row.substr(row.find('\t') + 1));
+		}
+		return rows;
+	}
+
+	// Nothing rejected by the database, every staged row inserted
+	void ExpectInsert(std::int64_t imported, std::string rejected = "") {
+		EXPECT_CALL(database, ExecuteQueryView(An<std::string_view>(), _))
+			.WillOnce(Invoke([imported](std::string_view query, IDatabase::SqlParams) {
+				EXPECT_THAT(std::string{ query }, HasSubstr("INSERT INTO urls (url, shortcode)"));
+				return std::make_unique<CountResult>(imported);
+			}));
+		EXPECT_CALL(database, CopyOut(An<std::string_view>()))
+			.WillOnce(Invoke([rejected](std::string_view) { return std::make_unique<FixedCopyOut>(rejected); }));
+	}
+
+	MockDatabase database{ };
+	std::vector<std::string> executed{ };
+	std::vector<std::string> writes{ };
+	std::vector<Import::Reject> rejects{ };
+};
+
+
+TEST(ImportFormatTest, ParseFormat) {
+	EXPECT_EQ(Import::ParseFormat("ndjson"), Import::Format::Ndjson);
+	EXPECT_EQ(Import::ParseFormat("csv"), Import::Format::Csv);
+	EXPECT_EQ(Import::ParseFormat("xml"), std::nullopt);
+}
+
+TEST_F(ImporterTest, NdjsonSplitAnywhereIsStagedWithItsLines) {
+	ExpectInsert(2);
+	const std::string input{
+		"{\"url\":\"https://example.com/a\",\"shortcode\":\"old-a\"}\n"
+		"\n"
+		"{\"id\":7,\"url\":\"https://example.com/b\\\\c\",\"shortcode\":\"old_b\"}\r\n"
+		"not json\n"
+		"{\"url\":\"https://example.com/c\"}\n"
+		"{\"url\":\"https://exa mple.com\",\"shortcode\":\"x\"}\n"
+		"{\"url\":\"https://example.com/d\",\"shortcode\":\"no/slash\"}" };
+
+	Import::Importer importer{ database, Import::Format::Ndjson, Collect() };
+	for (char c : input) {
+		importer.Write(std::string_view{ &c, 1 });
+	}
+	auto summary{ importer.Finish() };
+
+	EXPECT_EQ(StagedRows(), (std::vector<std::string>{
+		"1\thttps://example.com/a\told-a",
+		"3\thttps://example.com/b\\\\c\told_b" }));
+
+	ASSERT_EQ(rejects.size(), 4);
+	EXPECT_EQ(rejects[0].line, 4);
+	EXPECT_EQ(rejects[0].reason, "invalid json");
+	EXPECT_EQ(rejects[1].line, 5);
+	EXPECT_EQ(rejects[1].reason, "missing field");
+	EXPECT_EQ(rejects[2].line, 6);
+	EXPECT_EQ(rejects[2].reason, "invalid url");
+	EXPECT_EQ(rejects[3].line, 7);
+	EXPECT_EQ(rejects[3].reason, "invalid code");
+	EXPECT_EQ(rejects[3].value, "no/slash");
+
+	EXPECT_EQ(summary.rows, 6);
+	EXPECT_EQ(summary.imported, 2);
+	EXPECT_EQ(summary.rejected, 4);
+}
+
+TEST_F(ImporterTest, CsvUsesTheHeaderAndKeepsQuotedNewlines) {
+	ExpectInsert(2);
+
+	Import::Importer importer{ database, Import::Format::Csv, Collect() };
+	importer.Write("id,shortcode,url\r\n1,abc,\"https://example.com/?q=a,b\"\r\n2,\"de");
+	importer.Write("f\",\"https://example.com/\"\"x\"\"\"\n3,ghi,\"https://exa\nmple.com\"\n4,jkl,\"https://");
+	auto summary{ importer.Finish() };
+
+	EXPECT_EQ(StagedRows(), (std::vector<std::string>{
+		"2\thttps://example.com/?q=a,b\tabc",
+		"3\thttps://example.com/\"x\"\tdef" }));
+
+	ASSERT_EQ(rejects.size(), 2);
+	EXPECT_EQ(rejects[0].line, 4);
+	EXPECT_EQ(rejects[0].reason, "invalid url");
+	EXPECT_EQ(rejects[1].line, 6);
+	EXPECT_EQ(rejects[1].reason, "invalid csv");
+	EXPECT_EQ(summary.rows, 4);
+}
+
+TEST_F(ImporterTest, CsvWithoutCodeColumnThrowsInvalidArgument) {
+	Import::Importer importer{ database, Import::Format::Csv, Collect() };
+	EXPECT_THROW(importer.Write("id,url\n1,https://example.com\n"), std::invalid_argument);
+}
+
+TEST_F(ImporterTest, CodesOfTheEncoderAreReserved) {
+	ExpectInsert(1);
+	ShortCode::Encoder encoder{ 42, 16 };
+
+	Import::Importer importer{ database, Import::Format::Ndjson, Collect(), &encoder };
+	importer.Write(std::format("{{\"url\":\"https://example.com/a\",\"shortcode\":\"{}\"}}\n", encoder.Encode(5)));
+	importer.Write("{\"url\":\"https://example.com/b\",\"shortcode\":\"custom\"}\n");
+	importer.Finish();
+
+	ASSERT_EQ(rejects.size(), 1);
+	EXPECT_EQ(rejects[0].reason, "reserved code");
+	EXPECT_EQ(rejects[0].value, encoder.Encode(5));
+}
+
+TEST_F(ImporterTest, FinishReportsTheRowsTheDatabaseRejected) {
+	ExpectInsert(1, "2\tduplicate code\tabc\n3\tcode exists\tdef\n");
+
+	Import::Importer importer{ database, Import::Format::Ndjson, Collect() };
+	importer.Write(
+		"{\"url\":\"https://example.com/a\",\"shortcode\":\"abc\"}\n"
+		"{\"url\":\"https://example.com/b\",\"shortcode\":\"abc\"}\n"
+		"{\"url\":\"https://example.com/c\",\"shortcode\":\"def\"}\n");
+	auto summary{ importer.Finish() };
+
+	ASSERT_EQ(rejects.size(), 2);
+	EXPECT_EQ(rejects[0].line, 2);
+	EXPECT_EQ(rejects[0].reason, "duplicate code");
+	EXPECT_EQ(rejects[1].line, 3);
+	EXPECT_EQ(rejects[1].reason, "code exists");
+	EXPECT_EQ(rejects[1].value, "def");
+	EXPECT_EQ(summary.rows, 3);
+	EXPECT_EQ(summary.imported, 1);
+	EXPECT_EQ(summary.rejected, 2);
+
+	// The staged rows are dropped once the import is over
+	ASSERT_FALSE(executed.empty());
+	EXPECT_THAT(executed.back(), HasSubstr("DELETE FROM url_imports WHERE import = $1;"));
+}
+
+TEST_F(ImporterTest, RowsAreCopiedInChunks) {
+	ExpectInsert(100);
+
+	Import::Importer importer{ database, Import::Format::Ndjson, Collect(), nullptr, Import::ImportConfig{ .chunkSize = 256 } };
+	for (int i{ 0 }; i < 100; ++i) {
+		importer.Write(std::format("{{\"url\":\"https://example.com/{}\",\"shortcode\":\"c{}\"}}\n", i, i));
+	}
+	importer.Finish();
+
+	EXPECT_GT(writes.size(), 10);
+	for (std::size_t i{ 0 }; i + 1 < writes.size(); ++i) {
+		EXPECT_GE(writes[i].size(), 256);
+		EXPECT_EQ(writes[i].back(), '\n');
+	}
+	EXPECT_EQ(StagedRows().size(), 100);
+}
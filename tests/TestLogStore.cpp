@@ -0,0 +1,247 @@
+#include <gtest/gtest.h>
+
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "logStore.h"
+
+
+class LogStoreTest : public ::testing::Test {
+protected:
+	void SetUp() override {
+		const auto* test{ ::testing::UnitTest::GetInstance() -> current_test_info() };
+		directory = std::filesystem::temp_directory_path() / std::format("logstore_{}_{}", test -> name(), ::getpid());
+		std::filesystem::create_directories(directory);
+		path = (directory / "urls.log").string();
+	}
+
+	void TearDown() override {
+		std::filesystem::remove_all(directory);
+	}
+
+	LogStore::UrlRepository Open(LogStore::StoreConfig config = { }) {
+		return LogStore::UrlRepository{ path, ShortCode::Encoder{ 0x2545'f491'4f6c'dd1d }, config };
+	}
+
+	std::filesystem::path directory{ };
+	std::string path{ };
+};
+
+
+TEST_F(LogStoreTest, CreateResolveUpdateDelete) {
+	auto store{ Open() };
+
+	CreatedUrl created{ store.Create("https://example.com/a") };
+	EXPECT_TRUE(created.isCreated);
+	std::string code{ created.url.GetShortCode() };
+
+	// The same url gets its existing code
+	CreatedUrl again{ store.Create("https://example.com/a") };
+	EXPECT_FALSE(again.isCreated);
+	EXPECT_EQ(again.url.GetShortCode(), code);
+
+	auto url{ store.Resolve(code) };
+	ASSERT_TRUE(url);
+	EXPECT_EQ(url -> GetUri(), "https://example.com/a");
+	EXPECT_EQ(url -> GetCreatedAt(), created.url.GetCreatedAt());
+
+	auto updated{ store.Update(code, "https://example.com/b") };
+	ASSERT_TRUE(updated);
+	EXPECT_EQ(updated -> GetUri(), "https://example.com/b");
+	EXPECT_EQ(store.Resolve(code) -> GetUri(), "https://example.com/b");
+	EXPECT_FALSE(store.Update("missing", "https://example.com/c"));
+
+	EXPECT_TRUE(store.Delete(code));
+	EXPECT_FALSE(store.Delete(code));
+	EXPECT_FALSE(store.Resolve(code));
+	EXPECT_EQ(store.Size(), 0);
+}
+
+TEST_F(LogStoreTest, BatchCreateAndResolve) {
+	auto store{ Open() };
+	CreatedUrl existing{ store.Create("https://example.com/0") };
+
+	std::vector<std::string> urls{ };
+	for (int i{ 0 }; i < 100; ++i) {
+		urls.push_back(std::format("https://example.com/{}", i));
+	}
+
+	std::vector<Url> rows{ store.Create(IUrlRepository::Strings{ urls }) };
+	ASSERT_EQ(rows.size(), urls.size());
+
+	std::vector<std::string> codes{ "missing" };
+	for (const Url& row : rows) {
+		if (row.GetUri() == "https://example.com/0") {
+			EXPECT_EQ(row.GetShortCode(), existing.url.GetShortCode());
+		}
+		codes.emplace_back(row.GetShortCode());
+	}
+
+	std::vector<Url> resolved{ store.BatchResolve(IUrlRepository::Strings{ codes }) };
+	EXPECT_EQ(resolved.size(), urls.size());
+	EXPECT_EQ(store.Size(), urls.size());
+}
+
+TEST_F(LogStoreTest, BatchCreateStoresARepeatedUrlOnce) {
+	auto store{ Open() };
+	std::vector<std::string> urls{ "https://example.com/a", "https://example.com/b", "https://example.com/a" };
+
+	std::vector<Url> rows{ store.Create(IUrlRepository::Strings{ urls }) };
+	ASSERT_EQ(rows.size(), urls.size());
+	EXPECT_EQ(store.Size(), 2);
+
+	std::vector<std::string> codes{ };
+	for (const Url& row : rows) {
+		if (row.GetUri() == "https://example.com/a") {
+			codes.emplace_back(row.GetShortCode());
+		}
+	}
+	ASSERT_EQ(codes.size(), 2);
+	EXPECT_EQ(codes[0], codes[1]);
+}
+
+TEST_F(LogStoreTest, ReopenReplaysTheLog) {
+	std::string kept{ };
+	std::string deleted{ };
+	{
+		auto store{ Open() };
+		kept = std::string{ store.Create("https://example.com/kept").url.GetShortCode() };
+		deleted = std::string{ store.Create("https://example.com/deleted").url.GetShortCode() };
+		store.Update(kept, "https://example.com/updated");
+		store.Delete(deleted);
+
+		store.RecordAccess(kept);
+		store.RecordAccess(kept);
+		EXPECT_EQ(store.Stats(kept) -> GetAccessCount(), 3); // the update counts as well
+	}
+
+	auto store{ Open() };
+	EXPECT_EQ(store.Size(), 1);
+	EXPECT_EQ(store.Resolve(kept) -> GetUri(), "https://example.com/updated");
+	EXPECT_FALSE(store.Resolve(deleted));
+	EXPECT_EQ(store.Stats(kept) -> GetAccessCount(), 3);
+
+	// Ids are not handed out again, so neither are the codes of deleted rows
+	std::string code{ store.Create("https://example.com/new").url.GetShortCode() };
+	EXPECT_NE(code, kept);
+	EXPECT_NE(code, deleted);
+}
+
+TEST_F(LogStoreTest, TornRecordIsCutOff) {
+	std::string code{ };
+	{
+		auto store{ Open() };
+		code = std::string{ store.Create("https://example.com/a").url.GetShortCode() };
+		store.Create("https://example.com/b");
+	}
+
+	// A crash in the middle of the second append
+	std::filesystem::resize_file(path, std::filesystem::file_size(path) - 3);
+
+	{
+		auto store{ Open() };
+		EXPECT_EQ(store.Size(), 1);
+		EXPECT_TRUE(store.Resolve(code));
+		store.Create("https://example.com/c");
+	}
+
+	auto store{ Open() };
+	EXPECT_EQ(store.Size(), 2);
+}
+
+TEST_F(LogStoreTest, CorruptRecordInTheMiddleIsRejected) {
+	{
+		auto store{ Open() };
+		store.Create("https://example.com/a");
+		store.Create("https://example.com/b");
+	}
+
+	// Flips a byte of the first url, the second record is still valid
+	std::uintmax_t size{ std::filesystem::file_size(path) };
+	{
+		std::fstream file{ path, std::ios::in | std::ios::out | std::ios::binary };
+		file.seekp(static_cast<std::streamoff>(size / 2 - 10));
+		file.put('#');
+	}
+
+	EXPECT_THROW(Open(), std::runtime_error);
+	EXPECT_EQ(std::filesystem::file_size(path), size);
+}
+
+TEST_F(LogStoreTest, BadSizeInTheMiddleIsRejected) {
+	{
+		auto store{ Open() };
+		store.Create("https://example.com/a");
+		store.Create("https://example.com/b");
+	}
+
+	// The size field of the first record follows the 24 byte file header and its 8 byte checksum
+	const std::uintmax_t size{ std::filesystem::file_size(path) };
+	for (std::streamoff position{ 32 }; position < 36; ++position) {
+		char byte{ };
+		{
+			std::fstream file{ path, std::ios::in | std::ios::out | std::ios::binary };
+			file.seekg(position);
+			file.get(byte);
+			file.seekp(position);
+			file.put(static_cast<char>(byte ^ 0x40));
+		}
+
+		EXPECT_THROW(Open(), std::runtime_error) << "size byte " << position - 32;
+		EXPECT_EQ(std::filesystem::file_size(path), size);
+
+		std::fstream file{ path, std::ios::in | std::ios::out | std::ios::binary };
+		file.seekp(position);
+		file.put(byte);
+	}
+}
+
+TEST_F(LogStoreTest, ZeroFilledTailIsCutOff) {
+	std::string code{ };
+	{
+		auto store{ Open() };
+		code = std::string{ store.Create("https://example.com/a").url.GetShortCode() };
+	}
+
+	// The size of an append reached the disk, its data did not
+	const auto size{ std::filesystem::file_size(path) };
+	std::filesystem::resize_file(path, size + 100);
+
+	auto store{ Open() };
+	EXPECT_EQ(store.Size(), 1);
+	EXPECT_TRUE(store.Resolve(code));
+	EXPECT_EQ(std::filesystem::file_size(path), size);
+}
+
+TEST_F(LogStoreTest, CompactKeepsLiveRows) {
+	std::string code{ };
+	{
+		auto store{ Open(LogStore::StoreConfig{ .compactOnOpen = false }) };
+		code = std::string{ store.Create("https://example.com/a").url.GetShortCode() };
+		for (int i{ 0 }; i < 100; ++i) {
+			store.Update(code, std::format("https://example.com/{}", i));
+		}
+	}
+
+	const auto before{ std::filesystem::file_size(path) };
+	{
+		auto store{ Open() };
+		EXPECT_LT(std::filesystem::file_size(path), before);
+		EXPECT_FALSE(std::filesystem::exists(path + ".tmp"));
+		EXPECT_EQ(store.Resolve(code) -> GetUri(), "https://example.com/99");
+		EXPECT_EQ(store.Stats(code) -> GetAccessCount(), 100);
+		store.Create("https://example.com/b");
+	}
+
+	auto store{ Open() };
+	EXPECT_EQ(store.Size(), 2);
+	EXPECT_EQ(store.Resolve(code) -> GetUri(), "https://example.com/99");
+}
+
+TEST_F(LogStoreTest, InvalidFileIsRejected) {
+	std::ofstream{ path } << "not a url log";
+	EXPECT_THROW(Open(), std::runtime_error);
+}
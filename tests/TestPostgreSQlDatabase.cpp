@@ -1,8 +1,15 @@
 #include <gtest/gtest.h>
 #include <memory>
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/post.hpp>
 #include "TestConfig.h"
 #include "MockPGClient.h"
 
+#if defined(BOOST_ASIO_HAS_POSIX_STREAM_DESCRIPTOR)
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
 
 using ::testing::_;
 using ::testing::AtLeast;
@@ -103,13 +110,14 @@ TEST(PostgresDatabaseTest, SyntaxErrorQueryThrowsExecuteError) {
 		.Times(AtLeast(1));
 
 	EXPECT_CALL(*ptr, PQstatus(_))
-		.Times(AtLeast(3))
+		.Times(AtLeast(2))
 		.WillOnce(Return(CONNECTION_OK))
 		.WillOnce(Return(CONNECTION_BAD))
-		.WillOnce(Return(CONNECTION_OK));
+		.WillRepeatedly(Return(CONNECTION_OK));
 
+	// The broken connection is reset by the pool maintenance thread, which may not get to it before the pool is destroyed
 	EXPECT_CALL(*ptr, PQreset(_))
-		.Times(AtLeast(1));
+		.Times(AtLeast(0));
 
 	EXPECT_CALL(*ptr, PQclear(_))
 		.Times(AtLeast(1));
@@ -147,13 +155,14 @@ TEST(PostgresDatabaseTest, DataTypeErrorQueryThrowsExecuteError) {
 		.Times(AtLeast(1));
 
 	EXPECT_CALL(*ptr, PQstatus(_))
-		.Times(AtLeast(3))
+		.Times(AtLeast(2))
 		.WillOnce(Return(CONNECTION_OK))
 		.WillOnce(Return(CONNECTION_BAD))
-		.WillOnce(Return(CONNECTION_OK));
+		.WillRepeatedly(Return(CONNECTION_OK));
 
+	// The broken connection is reset by the pool maintenance thread, which may not get to it before the pool is destroyed
 	EXPECT_CALL(*ptr, PQreset(_))
-		.Times(AtLeast(1));
+		.Times(AtLeast(0));
 
 	EXPECT_CALL(*ptr, PQclear(_))
 		.Times(AtLeast(1));
@@ -252,13 +261,18 @@ TEST(PostgresDatabaseTest, ReadPostgresResultWithNull) {
 		.Times(AtLeast(1))
 		.WillRepeatedly(Return(3));
 
-	std::vector<std::string> values{ std::string{ "First" },  std::string{ "NOTNULL" },  std::string{ "" }, };
-	// PQgetvalue function returns an empty string if the field value is NULL.
-	EXPECT_CALL(*ptr, PQgetvalue(_, _, _))
-		.Times(AtLeast(3))
+	// PQgetvalue returns an empty string for NULL as well, only PQgetisnull tells them apart
+	std::vector<std::string> values{ std::string{ "First" },  std::string{ "" } };
+	EXPECT_CALL(*ptr, PQgetisnull(_, 0, _))
+		.WillRepeatedly(Return(0));
+
+	EXPECT_CALL(*ptr, PQgetisnull(_, 0, 2))
+		.WillRepeatedly(Return(1));
+
+	EXPECT_CALL(*ptr, PQgetvalue(_, 0, _))
+		.Times(2)
 		.WillOnce(Return(values[0].data()))
-		.WillOnce(Return(values[1].data()))
-		.WillOnce(Return(values[2].data())); 
+		.WillOnce(Return(values[1].data()));
 
 	EXPECT_CALL(*ptr, PQclear(_))
 		.Times(AtLeast(1));
@@ -268,7 +282,86 @@ TEST(PostgresDatabaseTest, ReadPostgresResultWithNull) {
 
 	auto res = database.ExecuteQuery("SELECT * FROM tests;", { });
 
-	EXPECT_EQ(std::string{ "NULL" }, res.back());
+	EXPECT_EQ(res, (std::vector<std::string>{ "First", "", "NULL" }));
+}
+
+TEST(PostgresDatabaseTest, ExecuteQueryViewDecodesBinaryValues) {
+	auto ptr = std::make_shared<MockPGClient>();
+
+	PGconn* dummyConn = reinterpret_cast<PGconn*>(0x1);
+	PGresult* dummyResult = reinterpret_cast<PGresult*>(0x1);
+	EXPECT_CALL(*ptr, PQconnectdbParams(_, _, 0))
+		.WillOnce(Return(dummyConn));
+
+	EXPECT_CALL(*ptr, PQstatus(_))
+		.WillRepeatedly(Return(CONNECTION_OK));
+
+	// Results are requested in binary format
+	EXPECT_CALL(*ptr, PQexecParams(dummyConn, _, 0, _, _, _, _, 1))
+		.WillOnce(Return(dummyResult));
+
+	std::string msg_error{ };
+	EXPECT_CALL(*ptr, PQerrorMessage(_))
+		.WillRepeatedly(Return(msg_error.data()));
+
+	EXPECT_CALL(*ptr, PQresultStatus(dummyResult))
+		.WillOnce(Return(PGRES_TUPLES_OK));
+
+	EXPECT_CALL(*ptr, PQntuples(dummyResult))
+		.WillRepeatedly(Return(1));
+
+	EXPECT_CALL(*ptr, PQnfields(dummyResult))
+		.WillRepeatedly(Return(6));
+
+	// id int8, balance int4, url text, doc jsonb, createdat timestamptz, updatedat timestamp (NULL)
+	std::vector<std::string> values{
+		std::string{ "\x00\x00\x00\x00\x00\x00\x01\x00", 8 },
+		std::string{ "\xff\xff\xff\xfe", 4 },
+		std::string{ "https://www.example.com" },
+		std::string{ "\x01{\"a\": 1}" },
+		std::string{ "\x00\x00\x00\x00\x00\x0f\x42\x40", 8 },
+		std::string{ } };
+	std::vector<Oid> types{ 20, 23, 25, 3802, 1184, 1114 };
+	for (int col{ 0 }; col < 6; ++col) {
+		EXPECT_CALL(*ptr, PQgetvalue(dummyResult, 0, col))
+			.WillRepeatedly(Return(values[col].data()));
+		EXPECT_CALL(*ptr, PQgetlength(dummyResult, 0, col))
+			.WillRepeatedly(Return(static_cast<int>(values[col].size())));
+		EXPECT_CALL(*ptr, PQftype(dummyResult, col))
+			.WillRepeatedly(Return(types[col]));
+		EXPECT_CALL(*ptr, PQgetisnull(dummyResult, 0, col))
+			.WillRepeatedly(Return(col == 5 ? 1 : 0));
+	}
+
+	EXPECT_CALL(*ptr, PQclear(dummyResult))
+		.Times(1);
+
+	EXPECT_CALL(*ptr, PQfinish(_))
+		.Times(AtLeast(1));
+
+	std::shared_ptr<IPGClient> client = ptr;
+	Database database{ config, client };
+
+	auto view = database.ExecuteQueryView("SELECT * FROM tests;", { });
+	ASSERT_EQ(view -> Rows(), 1);
+	ASSERT_EQ(view -> Columns(), 6);
+
+	EXPECT_EQ(view -> GetInt64(0, 0), 256);
+	EXPECT_EQ(view -> GetInt64(0, 1), -2);
+	EXPECT_EQ(view -> GetString(0, 2), "https://www.example.com");
+	EXPECT_EQ(view -> GetString(0, 3), "{\"a\": 1}");
+
+	// One second after 2000-01-01 00:00:00 UTC
+	EXPECT_EQ(view -> GetTimestamp(0, 4), std::chrono::system_clock::time_point{ std::chrono::seconds{ 946'684'801 } });
+
+	EXPECT_TRUE(view -> IsNull(0, 5));
+	EXPECT_THROW(view -> GetTimestamp(0, 5), ResultError);
+	EXPECT_THROW(view -> GetInt64(0, 2), ResultError);
+	EXPECT_THROW(view -> GetString(0, 0), ResultError);
+	EXPECT_THROW(view -> GetString(1, 0), ResultError);
+
+	// The string views point into the result, nothing was copied
+	EXPECT_EQ(view -> GetString(0, 2).data(), values[2].data());
 }
 
 TEST(PostgresDatabaseTest, ConnectionReuse) {
@@ -391,6 +484,81 @@ TEST(PostgresDatabaseTest, ExecuteQueryMultipleColumns) {
 	EXPECT_EQ(res.size(), colums * rows);
 }
 
+TEST(PostgresDatabaseTest, ExecuteQueryPreparedRunsStatementByName) {
+	auto ptr = std::make_shared<MockPGClient>();
+	PGconn* dummyConn = reinterpret_cast<PGconn*>(0x1);
+	PGresult* prepareResult = reinterpret_cast<PGresult*>(0x1);
+	PGresult* queryResult = reinterpret_cast<PGresult*>(0x2);
+	EXPECT_CALL(*ptr, PQconnectdbParams(_, _, 0))
+		.WillOnce(Return(dummyConn));
+
+	EXPECT_CALL(*ptr, PQstatus(_))
+		.WillRepeatedly(Return(CONNECTION_OK));
+
+	EXPECT_CALL(*ptr, PQprepare(dummyConn, StrEq("stmt_0"), StrEq("SELECT url FROM urls WHERE shortcode = $1;"), 0, nullptr))
+		.WillOnce(Return(prepareResult));
+
+	EXPECT_CALL(*ptr, PQresultStatus(prepareResult))
+		.WillOnce(Return(PGRES_COMMAND_OK));
+
+	const char* expectedParams[] = { "abc" };
+	EXPECT_CALL(*ptr, PQexecPrepared(dummyConn, StrEq("stmt_0"), 1, ConstCharPtrArrayEq(expectedParams, 1), _, _, 0))
+		.WillOnce(Return(queryResult));
+
+	EXPECT_CALL(*ptr, PQexecParams(_, _, _, _, _, _, _, _))
+		.Times(0);
+
+	std::string msg_error{ };
+	EXPECT_CALL(*ptr, PQerrorMessage(_))
+		.WillRepeatedly(Return(msg_error.data()));
+
+	EXPECT_CALL(*ptr, PQresultStatus(queryResult))
+		.WillOnce(Return(PGRES_TUPLES_OK));
+
+	EXPECT_CALL(*ptr, PQntuples(queryResult))
+		.WillRepeatedly(Return(1));
+
+	EXPECT_CALL(*ptr, PQnfields(queryResult))
+		.WillRepeatedly(Return(1));
+
+	std::string value{ "https://www.example.com" };
+	EXPECT_CALL(*ptr, PQgetvalue(queryResult, 0, 0))
+		.WillOnce(Return(value.data()));
+
+	EXPECT_CALL(*ptr, PQclear(_))
+		.Times(2);
+
+	EXPECT_CALL(*ptr, PQfinish(_))
+		.Times(AtLeast(1));
+
+	std::shared_ptr<IPGClient> client = ptr;
+	auto database{ Database{ config, client } };
+
+	auto statement{ database.Prepare("SELECT url FROM urls WHERE shortcode = $1;") };
+	std::vector<std::pair<std::string, std::string>> params{ std::make_pair(std::string{ "$1" }, std::string{ "abc" }) };
+	auto res{ database.ExecuteQuery(statement, params) };
+
+	ASSERT_EQ(res.size(), 1);
+	EXPECT_EQ(res.front(), value);
+}
+
+TEST(PostgresDatabaseTest, UnknownStatementThrowsPrepareError) {
+	auto ptr = std::make_shared<MockPGClient>();
+	EXPECT_CALL(*ptr, PQconnectdbParams(_, _, 0))
+		.Times(AtLeast(1));
+
+	EXPECT_CALL(*ptr, PQstatus(_))
+		.WillRepeatedly(Return(CONNECTION_OK));
+
+	EXPECT_CALL(*ptr, PQfinish(_))
+		.Times(AtLeast(0));
+
+	std::shared_ptr<IPGClient> client = ptr;
+	auto database{ Database{ config, client } };
+
+	EXPECT_THROW(database.ExecuteQuery(StatementHandle{ 42 }, { }), PrepareError);
+}
+
 TEST(PostgresDatabaseTest, TransactionsNotImplemented) {
 	auto ptr = std::make_shared<PGClient>();
 
@@ -402,6 +570,448 @@ TEST(PostgresDatabaseTest, TransactionsNotImplemented) {
 	EXPECT_THROW(database.RollbackTransaction(), std::runtime_error);
 }
 
+TEST(PostgresDatabaseTest, CopyOutReadsRowsUntilTheCommandCompletes) {
+	auto ptr = std::make_shared<MockPGClient>();
+	PGconn* dummyConn = reinterpret_cast<PGconn*>(0x1);
+	PGresult* copyResult = reinterpret_cast<PGresult*>(0x1);
+	PGresult* commandResult = reinterpret_cast<PGresult*>(0x2);
+	EXPECT_CALL(*ptr, PQconnectdbParams(_, _, 0))
+		.Times(AtLeast(1))
+		.WillOnce(Return(dummyConn));
+
+	EXPECT_CALL(*ptr, PQstatus(_))
+		.WillRepeatedly(Return(CONNECTION_OK));
+
+	EXPECT_CALL(*ptr, PQfinish(_))
+		.Times(AtLeast(1));
+
+	EXPECT_CALL(*ptr, PQexecParams(_, _, 0, _, _, _, _, _))
+		.WillOnce(Return(copyResult));
+
+	EXPECT_CALL(*ptr, PQresultStatus(copyResult))
+		.WillOnce(Return(PGRES_COPY_OUT));
+
+	EXPECT_CALL(*ptr, PQresultStatus(commandResult))
+		.WillOnce(Return(PGRES_COMMAND_OK));
+
+	// Every row is a buffer of its own, -1 ends the copy
+	std::vector<std::string> rows{ "1,a\n", "2,b\n", "3,c\n" };
+	std::size_t next{ 0 };
+	EXPECT_CALL(*ptr, PQgetCopyData(dummyConn, _, 0))
+		.Times(4)
+		.WillRepeatedly([&](PGconn*, char** buffer, int) {
+			if (next == rows.size()) {
+				return -1;
+			}
+			*buffer = rows[next].data();
+			return static_cast<int>(rows[next++].size());
+		});
+
+	EXPECT_CALL(*ptr, PQfreemem(_))
+		.Times(3);
+
+	EXPECT_CALL(*ptr, PQgetResult(dummyConn))
+		.WillOnce(Return(commandResult))
+		.WillOnce(Return(nullptr));
+
+	EXPECT_CALL(*ptr, PQclear(_))
+		.Times(2);
+
+	std::shared_ptr<IPGClient> client = ptr;
+	auto database{ Database{ config, client } };
+	auto stream{ database.CopyOut("COPY tests TO STDOUT;") };
+
+	std::string buffer{ };
+	EXPECT_TRUE(stream -> Read(buffer, 8));
+	EXPECT_EQ(buffer, "1,a\n2,b\n");
+
+	buffer.clear();
+	EXPECT_FALSE(stream -> Read(buffer, 8));
+	EXPECT_EQ(buffer, "3,c\n");
+}
+
+TEST(PostgresDatabaseTest, CopyInSendsDataAndChecksTheCommand) {
+	auto ptr = std::make_shared<MockPGClient>();
+	PGconn* dummyConn = reinterpret_cast<PGconn*>(0x1);
+	PGresult* copyResult = reinterpret_cast<PGresult*>(0x1);
+	PGresult* commandResult = reinterpret_cast<PGresult*>(0x2);
+	EXPECT_CALL(*ptr, PQconnectdbParams(_, _, 0))
+		.Times(AtLeast(1))
+		.WillOnce(Return(dummyConn));
+
+	EXPECT_CALL(*ptr, PQstatus(_))
+		.WillRepeatedly(Return(CONNECTION_OK));
+
+	EXPECT_CALL(*ptr, PQfinish(_))
+		.Times(AtLeast(1));
+
+	EXPECT_CALL(*ptr, PQexecParams(_, _, 0, _, _, _, _, _))
+		.WillOnce(Return(copyResult));
+
+	EXPECT_CALL(*ptr, PQresultStatus(copyResult))
+		.WillOnce(Return(PGRES_COPY_IN));
+
+	EXPECT_CALL(*ptr, PQresultStatus(commandResult))
+		.WillOnce(Return(PGRES_COMMAND_OK));
+
+	std::string sent{ };
+	EXPECT_CALL(*ptr, PQputCopyData(dummyConn, _, _))
+		.Times(2)
+		.WillRepeatedly([&](PGconn*, const char* buffer, int size) {
+			sent.append(buffer, size);
+			return 1;
+		});
+
+	EXPECT_CALL(*ptr, PQputCopyEnd(dummyConn, nullptr))
+		.WillOnce(Return(1));
+
+	EXPECT_CALL(*ptr, PQgetResult(dummyConn))
+		.WillOnce(Return(commandResult))
+		.WillOnce(Return(nullptr));
+
+	EXPECT_CALL(*ptr, PQclear(_))
+		.Times(2);
+
+	std::shared_ptr<IPGClient> client = ptr;
+	auto database{ Database{ config, client } };
+	auto stream{ database.CopyIn("COPY tests FROM STDIN;") };
+
+	stream -> Write("1\ta\n2\t");
+	stream -> Write("b\n");
+	stream -> Finish();
+	EXPECT_EQ(sent, "1\ta\n2\tb\n");
+}
+
+TEST(PostgresDatabaseTest, ExecuteQueryAsyncWithoutExecutorRunsSynchronously) {
+	auto ptr = std::make_shared<MockPGClient>();
+
+	SetupPostgresTestEnvironment(ptr.get(), PGRES_TUPLES_OK);
+
+	EXPECT_CALL(*ptr, PQntuples(_))
+		.Times(AtLeast(2))
+		.WillRepeatedly(Return(1));
+
+	EXPECT_CALL(*ptr, PQnfields(_))
+		.Times(AtLeast(1))
+		.WillRepeatedly(Return(1));
+
+	std::vector<std::string> expected{ std::string{ "First" } };
+	EXPECT_CALL(*ptr, PQgetvalue(_, _, _))
+		.Times(AtLeast(1))
+		.WillOnce(Return(expected[0].data()));
+
+	EXPECT_CALL(*ptr, PQclear(_))
+		.Times(AtLeast(1));
+
+	std::shared_ptr<IPGClient> client = ptr;
+	auto database{ Database{ config, client } };
+
+	bool isCalled{ false };
+	database.AsyncQuery<std::size_t>("SELECT * FROM tests;", { },
+		[](std::vector<std::string>&& data) { return data.size(); },
+		[&](std::exception_ptr error, std::size_t count) {
+			isCalled = true;
+			EXPECT_FALSE(error);
+			EXPECT_EQ(count, expected.size());
+		});
+
+	EXPECT_TRUE(isCalled);
+}
+
+#if defined(BOOST_ASIO_HAS_POSIX_STREAM_DESCRIPTOR)
+TEST(PostgresDatabaseTest, ExecuteQueryAsyncReadsResultWhenSocketIsReadable) {
+	auto ptr = std::make_shared<MockPGClient>();
+
+	// The first end plays the role of the libpq socket
+	int fds[2]{ };
+	ASSERT_EQ(::socketpair(AF_UNIX, SOCK_STREAM, 0, fds), 0);
+
+	PGconn* dummyConn = reinterpret_cast<PGconn*>(0x1);
+	PGresult* dummyResult = reinterpret_cast<PGresult*>(0x1);
+	EXPECT_CALL(*ptr, PQconnectdbParams(_, _, 0))
+		.WillOnce(Return(dummyConn));
+
+	EXPECT_CALL(*ptr, PQstatus(_))
+		.WillRepeatedly(Return(CONNECTION_OK));
+
+	EXPECT_CALL(*ptr, PQsetnonblocking(dummyConn, 1))
+		.Times(1);
+
+	EXPECT_CALL(*ptr, PQsetnonblocking(dummyConn, 0))
+		.Times(1);
+
+	EXPECT_CALL(*ptr, PQsendQueryParams(dummyConn, _, _, _, _, _, _, _))
+		.WillOnce(Return(1));
+
+	EXPECT_CALL(*ptr, PQsocket(_))
+		.WillOnce(Return(fds[0]));
+
+	EXPECT_CALL(*ptr, PQflush(_))
+		.WillOnce(Return(0));
+
+	EXPECT_CALL(*ptr, PQconsumeInput(_))
+		.WillOnce(Return(1));
+
+	EXPECT_CALL(*ptr, PQisBusy(_))
+		.WillRepeatedly(Return(0));
+
+	EXPECT_CALL(*ptr, PQgetResult(_))
+		.WillOnce(Return(dummyResult))
+		.WillOnce(Return(nullptr));
+
+	std::string msg_error{ };
+	EXPECT_CALL(*ptr, PQerrorMessage(_))
+		.WillRepeatedly(Return(msg_error.data()));
+
+	EXPECT_CALL(*ptr, PQresultStatus(_))
+		.WillOnce(Return(PGRES_TUPLES_OK));
+
+	EXPECT_CALL(*ptr, PQntuples(_))
+		.WillRepeatedly(Return(1));
+
+	EXPECT_CALL(*ptr, PQnfields(_))
+		.WillRepeatedly(Return(1));
+
+	std::vector<std::string> expected{ std::string{ "{\"id\": 1}" } };
+	EXPECT_CALL(*ptr, PQgetvalue(_, _, _))
+		.WillOnce(Return(expected[0].data()));
+
+	EXPECT_CALL(*ptr, PQclear(_))
+		.Times(AtLeast(1));
+
+	EXPECT_CALL(*ptr, PQfinish(_))
+		.Times(AtLeast(1));
+
+	net::io_context ioc;
+	std::shared_ptr<IPGClient> client = ptr;
+	Database database{ config, client, ioc.get_executor() };
+
+	std::vector<std::string> result{ };
+	database.ExecuteQueryAsync("SELECT to_json(urls.*) FROM urls;", { },
+		[&](std::exception_ptr error, std::vector<std::string> data) {
+			EXPECT_FALSE(error);
+			result = std::move(data);
+		});
+
+	// Nothing is read until the socket becomes readable
+	ioc.poll();
+	EXPECT_TRUE(result.empty());
+
+	ASSERT_EQ(::write(fds[1], "x", 1), 1);
+	ioc.run();
+
+	EXPECT_EQ(expected, result);
+
+	::close(fds[0]);
+	::close(fds[1]);
+}
+
+TEST(PostgresDatabaseTest, ExecuteQueryAsyncSendFailureReportsExecuteError) {
+	auto ptr = std::make_shared<MockPGClient>();
+
+	PGconn* dummyConn = reinterpret_cast<PGconn*>(0x1);
+	EXPECT_CALL(*ptr, PQconnectdbParams(_, _, 0))
+		.WillOnce(Return(dummyConn));
+
+	EXPECT_CALL(*ptr, PQstatus(_))
+		.WillRepeatedly(Return(CONNECTION_OK));
+
+	EXPECT_CALL(*ptr, PQsetnonblocking(_, _))
+		.Times(2);
+
+	EXPECT_CALL(*ptr, PQsendQueryParams(_, _, _, _, _, _, _, _))
+		.WillOnce(Return(0));
+
+	std::string msg_error{ "another command is already in progress" };
+	EXPECT_CALL(*ptr, PQerrorMessage(_))
+		.WillRepeatedly(Return(msg_error.data()));
+
+	EXPECT_CALL(*ptr, PQfinish(_))
+		.Times(AtLeast(1));
+
+	net::io_context ioc;
+	std::shared_ptr<IPGClient> client = ptr;
+	Database database{ config, client, ioc.get_executor() };
+
+	bool isCalled{ false };
+	database.ExecuteQueryAsync("SELECT 1;", { },
+		[&](std::exception_ptr error, std::vector<std::string> data) {
+			isCalled = true;
+			EXPECT_THROW(std::rethrow_exception(error), ExecuteError);
+			EXPECT_TRUE(data.empty());
+		});
+
+	ioc.run();
+
+	EXPECT_TRUE(isCalled);
+}
+
+TEST(PostgresDatabaseTest, ExecuteQueryAsyncStaysOnTheCallingContext) {
+	auto ptr = std::make_shared<MockPGClient>();
+
+	PGconn* dummyConn = reinterpret_cast<PGconn*>(0x1);
+	EXPECT_CALL(*ptr, PQconnectdbParams(_, _, 0))
+		.WillOnce(Return(dummyConn));
+
+	EXPECT_CALL(*ptr, PQstatus(_))
+		.WillRepeatedly(Return(CONNECTION_OK));
+
+	EXPECT_CALL(*ptr, PQsetnonblocking(_, _))
+		.Times(2);
+
+	EXPECT_CALL(*ptr, PQsendQueryParams(_, _, _, _, _, _, _, _))
+		.WillOnce(Return(0));
+
+	std::string msg_error{ "another command is already in progress" };
+	EXPECT_CALL(*ptr, PQerrorMessage(_))
+		.WillRepeatedly(Return(msg_error.data()));
+
+	EXPECT_CALL(*ptr, PQfinish(_))
+		.Times(AtLeast(1));
+
+	net::io_context first;
+	net::io_context second;
+	std::shared_ptr<IPGClient> client = ptr;
+	Database database{ config, client, std::vector<net::any_io_executor>{ first.get_executor(), second.get_executor() } };
+
+	bool isCalled{ false };
+	net::post(second, [&]() {
+		database.ExecuteQueryAsync("SELECT 1;", { },
+			[&](std::exception_ptr error, std::vector<std::string>) {
+				isCalled = true;
+				EXPECT_TRUE(second.get_executor().running_in_this_thread());
+				EXPECT_THROW(std::rethrow_exception(error), ExecuteError);
+			});
+	});
+
+	second.run();
+	EXPECT_TRUE(isCalled);
+	EXPECT_EQ(first.poll(), 0);
+}
+
+TEST(PostgresDatabaseTest, PipelineDemultiplexesResultsInOrder) {
+	auto ptr = std::make_shared<MockPGClient>();
+
+	int fds[2]{ };
+	ASSERT_EQ(::socketpair(AF_UNIX, SOCK_STREAM, 0, fds), 0);
+
+	PGconn* dummyConn = reinterpret_cast<PGconn*>(0x1);
+	PGresult* failedResult = reinterpret_cast<PGresult*>(0x1);
+	PGresult* rowsResult = reinterpret_cast<PGresult*>(0x2);
+	PGresult* syncResult = reinterpret_cast<PGresult*>(0x3);
+	EXPECT_CALL(*ptr, PQconnectdbParams(_, _, 0))
+		.WillOnce(Return(dummyConn));
+
+	EXPECT_CALL(*ptr, PQstatus(_))
+		.WillRepeatedly(Return(CONNECTION_OK));
+
+	EXPECT_CALL(*ptr, PQsetnonblocking(dummyConn, _))
+		.Times(AtLeast(1));
+
+	EXPECT_CALL(*ptr, PQenterPipelineMode(dummyConn))
+		.WillOnce(Return(1));
+
+	EXPECT_CALL(*ptr, PQexitPipelineMode(dummyConn))
+		.WillOnce(Return(1));
+
+	// Both queries share the connection, each one is followed by its own sync point
+	EXPECT_CALL(*ptr, PQsendQueryParams(dummyConn, StrEq("SELECT 1/0;"), _, _, _, _, _, _))
+		.WillOnce(Return(1));
+
+	EXPECT_CALL(*ptr, PQsendQueryParams(dummyConn, StrEq("SELECT 'b';"), _, _, _, _, _, _))
+		.WillOnce(Return(1));
+
+	EXPECT_CALL(*ptr, PQpipelineSync(dummyConn))
+		.Times(2)
+		.WillRepeatedly(Return(1));
+
+	EXPECT_CALL(*ptr, PQsocket(_))
+		.WillOnce(Return(fds[0]));
+
+	EXPECT_CALL(*ptr, PQflush(_))
+		.WillRepeatedly(Return(0));
+
+	EXPECT_CALL(*ptr, PQconsumeInput(_))
+		.WillRepeatedly(Return(1));
+
+	EXPECT_CALL(*ptr, PQisBusy(_))
+		.WillRepeatedly(Return(0));
+
+	EXPECT_CALL(*ptr, PQgetResult(_))
+		.WillOnce(Return(failedResult))
+		.WillOnce(Return(nullptr))
+		.WillOnce(Return(syncResult))
+		.WillOnce(Return(rowsResult))
+		.WillOnce(Return(nullptr))
+		.WillOnce(Return(syncResult));
+
+	EXPECT_CALL(*ptr, PQresultStatus(failedResult))
+		.WillRepeatedly(Return(PGRES_FATAL_ERROR));
+
+	EXPECT_CALL(*ptr, PQresultStatus(rowsResult))
+		.WillRepeatedly(Return(PGRES_TUPLES_OK));
+
+	EXPECT_CALL(*ptr, PQresultStatus(syncResult))
+		.WillRepeatedly(Return(PGRES_PIPELINE_SYNC));
+
+	std::string msg_error{ "division by zero" };
+	EXPECT_CALL(*ptr, PQresultErrorMessage(failedResult))
+		.WillOnce(Return(msg_error.data()));
+
+	EXPECT_CALL(*ptr, PQntuples(rowsResult))
+		.WillRepeatedly(Return(1));
+
+	EXPECT_CALL(*ptr, PQnfields(rowsResult))
+		.WillRepeatedly(Return(1));
+
+	std::string value{ "b" };
+	EXPECT_CALL(*ptr, PQgetvalue(rowsResult, 0, 0))
+		.WillOnce(Return(value.data()));
+
+	EXPECT_CALL(*ptr, PQclear(_))
+		.Times(AtLeast(1));
+
+	EXPECT_CALL(*ptr, PQfinish(_))
+		.Times(AtLeast(1));
+
+	net::io_context ioc;
+	std::shared_ptr<IPGClient> client = ptr;
+	PipelineConfig pipelineConfig{ };
+	pipelineConfig.connections = 1;
+	Database database{ config, client, ioc.get_executor(), PoolConfig{ }, pipelineConfig };
+
+	std::vector<std::string> order{ };
+	database.ExecuteQueryAsync("SELECT 1/0;", { },
+		[&](std::exception_ptr error, std::vector<std::string> data) {
+			order.emplace_back("first");
+			EXPECT_THROW(std::rethrow_exception(error), ExecuteError);
+		});
+
+	database.ExecuteQueryAsync("SELECT 'b';", { },
+		[&](std::exception_ptr error, std::vector<std::string> data) {
+			order.emplace_back("second");
+			EXPECT_FALSE(error);
+			EXPECT_EQ(data, std::vector<std::string>{ "b" });
+		});
+
+	// Both queries are sent before anything is read
+	ioc.poll();
+	EXPECT_TRUE(order.empty());
+
+	ASSERT_EQ(::write(fds[1], "x", 1), 1);
+	ioc.run();
+
+	// The failed query does not abort the one queued behind it
+	EXPECT_EQ(order, (std::vector<std::string>{ "first", "second" }));
+
+	// The pipelined connection would never prepare a statement registered now
+	EXPECT_THROW(database.Prepare("SELECT 1;"), PrepareError);
+
+	::close(fds[0]);
+	::close(fds[1]);
+}
+#endif
+
 
 void SetupPostgresTestEnvironment(MockPGClient* ptr, ExecStatusType status) {
 	PGconn* dummyConn = reinterpret_cast<PGconn*>(0x1);
@@ -0,0 +1,53 @@
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <random>
+#include <string>
+
+#include "random.h"
+
+
+// Codes/sec on one core: Random::StringGenerator against a per-character std::mt19937 distribution,
+// the way the generator worked before it drew whole 64-bit words.
+// Disabled by default: --gtest_also_run_disabled_tests --gtest_filter=RandomBenchmark.*
+namespace Benchmark {
+	constexpr int CODES{ 10'000'000 };
+	constexpr int CODE_LENGTH{ 8 };
+
+	template <typename Func>
+	double CodesPerSecond(Func generate) {
+		std::size_t checksum{ 0 }; // keeps the codes from being optimized away
+
+		auto start{ std::chrono::steady_clock::now() };
+		for (int i{ 0 }; i < CODES; ++i) {
+			checksum += static_cast<unsigned char>(generate()[0]);
+		}
+		std::chrono::duration<double> elapsed{ std::chrono::steady_clock::now() - start };
+
+		EXPECT_NE(checksum, 0);
+		return CODES / elapsed.count();
+	}
+}
+
+
+TEST(RandomBenchmark, DISABLED_StringGeneratorCodesPerSecond) {
+	Random::StringGenerator generator{ Benchmark::CODE_LENGTH, Benchmark::CODE_LENGTH };
+	double words{ Benchmark::CodesPerSecond([&generator]() { return generator.Generate(); }) };
+
+	std::mt19937 mt{ std::random_device{ }() };
+	const auto& chars{ Random::StringGenerator::baseChars };
+	double perChar{ Benchmark::CodesPerSecond([&mt, &chars]() {
+		std::string code{ };
+		for (int i{ 0 }; i < Benchmark::CODE_LENGTH; ++i) {
+			code += chars[std::uniform_int_distribution<std::size_t>{ 0, chars.size() - 1 }(mt)];
+		}
+		return code;
+	}) };
+
+	std::cout << "xoshiro256**, 64-bit words:    " << static_cast<std::uint64_t>(words) << " codes/sec\n"
+		<< "mt19937, distribution per char: " << static_cast<std::uint64_t>(perChar) << " codes/sec\n";
+
+	EXPECT_GT(words, perChar);
+}
@@ -0,0 +1,70 @@
+#include <gtest/gtest.h>
+
+#include <string>
+#include "router.h"
+
+
+namespace {
+	enum class Endpoint { Create, Cache, Find, Stats, Update, Redirect };
+
+	constexpr Routing::Router ROUTER{ std::array{
+		Routing::Route<Endpoint>{ Routing::Verb::post, "/shorten", Endpoint::Create },
+		Routing::Route<Endpoint>{ Routing::Verb::get, "/admin/cache", Endpoint::Cache },
+		Routing::Route<Endpoint>{ Routing::Verb::get, "/shorten/{}", Endpoint::Find },
+		Routing::Route<Endpoint>{ Routing::Verb::get, "/shorten/{}/stats", Endpoint::Stats },
+		Routing::Route<Endpoint>{ Routing::Verb::put, "/shorten/{}", Endpoint::Update },
+		Routing::Route<Endpoint>{ Routing::Verb::get, "/{}", Endpoint::Redirect } } };
+}
+
+
+// Routes are resolved at compile time as well
+static_assert(ROUTER.Find(Routing::Verb::get, "/shorten/abc/stats").endpoint == Endpoint::Stats);
+static_assert(ROUTER.Find(Routing::Verb::get, "/shorten/abc/stats").param == "abc");
+static_assert(!Routing::IsValidPattern("/shorten//stats"));
+static_assert(!Routing::IsValidPattern("/{}/{}"));
+static_assert(!Routing::IsValidPattern("shorten"));
+
+
+TEST(RouterTest, ExtractsShortCodeAsView) {
+	std::string target{ "/shorten/abc123" };
+	auto match{ ROUTER.Find(Routing::Verb::put, target) };
+
+	ASSERT_EQ(match.status, Routing::Status::Found);
+	EXPECT_EQ(match.endpoint, Endpoint::Update);
+	EXPECT_EQ(match.param, "abc123");
+	EXPECT_EQ(match.param.data(), target.data() + 9);
+}
+
+
+TEST(RouterTest, LiteralSegmentsWinOverParameter) {
+	auto match{ ROUTER.Find(Routing::Verb::get, "/admin/cache") };
+	EXPECT_EQ(match.endpoint, Endpoint::Cache);
+
+	// "/shorten" is a literal route for POST only, GET takes it as a short code
+	match = ROUTER.Find(Routing::Verb::get, "/shorten");
+	EXPECT_EQ(match.endpoint, Endpoint::Redirect);
+	EXPECT_EQ(match.param, "shorten");
+}
+
+
+TEST(RouterTest, IgnoresQueryString) {
+	auto match{ ROUTER.Find(Routing::Verb::get, "/abc?utm_source=mail&x=/y") };
+
+	ASSERT_EQ(match.status, Routing::Status::Found);
+	EXPECT_EQ(match.endpoint, Endpoint::Redirect);
+	EXPECT_EQ(match.param, "abc");
+}
+
+
+TEST(RouterTest, KnownPathWithOtherMethodIsNotAllowed) {
+	EXPECT_EQ(ROUTER.Find(Routing::Verb::delete_, "/shorten/abc").status, Routing::Status::MethodNotAllowed);
+	EXPECT_EQ(ROUTER.Find(Routing::Verb::post, "/admin/cache").status, Routing::Status::MethodNotAllowed);
+	EXPECT_EQ(ROUTER.Find(Routing::Verb::patch, "/abc").status, Routing::Status::MethodNotAllowed);
+}
+
+
+TEST(RouterTest, UnknownPathIsNotFound) {
+	for (std::string_view target : { "/", "", "abc", "/shorten/", "/shorten/abc/", "/shorten/abc/stats/x", "/a/b" }) {
+		EXPECT_EQ(ROUTER.Find(Routing::Verb::get, target).status, Routing::Status::NotFound) << target;
+	}
+}
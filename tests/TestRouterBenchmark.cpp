@@ -0,0 +1,84 @@
+#include <gtest/gtest.h>
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <string_view>
+
+#include "router.h"
+
+
+// Nanoseconds per request to find the endpoint and short code of a target:
+// Routing::Router against the string copies and starts_with/ends_with/substr dispatch it replaced.
+// Disabled by default: --gtest_also_run_disabled_tests --gtest_filter=RouterBenchmark.*
+namespace Benchmark {
+	constexpr int ROUNDS{ 2'000'000 };
+
+	enum class Endpoint { Create, Cache, Find, Stats, Update, Delete, Redirect, NotFound };
+
+	constexpr Routing::Router ROUTER{ std::array{
+		Routing::Route<Endpoint>{ Routing::Verb::post, "/shorten", Endpoint::Create },
+		Routing::Route<Endpoint>{ Routing::Verb::get, "/admin/cache", Endpoint::Cache },
+		Routing::Route<Endpoint>{ Routing::Verb::get, "/shorten/{}", Endpoint::Find },
+		Routing::Route<Endpoint>{ Routing::Verb::get, "/shorten/{}/stats", Endpoint::Stats },
+		Routing::Route<Endpoint>{ Routing::Verb::put, "/shorten/{}", Endpoint::Update },
+		Routing::Route<Endpoint>{ Routing::Verb::delete_, "/shorten/{}", Endpoint::Delete },
+		Routing::Route<Endpoint>{ Routing::Verb::get, "/{}", Endpoint::Redirect } } };
+
+	// The GET branch of the handler before the route table
+	inline std::pair<Endpoint, std::string> StringDispatch(std::string_view requestTarget) {
+		std::string target{ requestTarget };
+
+		const std::string patternStart{ "/shorten/" };
+		const std::string patternEnd{ "/stats" };
+		if (target == "/admin/cache") {
+			return { Endpoint::Cache, { } };
+		}
+		else if (target.starts_with(patternStart) && !target.ends_with(patternEnd)) {
+			return { Endpoint::Find, target.substr(patternStart.size()) };
+		}
+		else if (target.starts_with(patternStart) && target.ends_with(patternEnd)) {
+			return { Endpoint::Stats, target.substr(patternStart.size(),
+				target.size() - (patternStart.size() + patternEnd.size())) };
+		}
+
+		return { Endpoint::NotFound, { } };
+	}
+
+	constexpr std::array<std::string_view, 3> TARGETS{
+		"/shorten/aZ3kP9qLmN0x7Yw2Rt", "/shorten/aZ3kP9qLmN0x7Yw2Rt/stats", "/admin/cache" };
+
+	template <typename Func>
+	double NanosecondsPerRequest(Func route) {
+		std::size_t checksum{ 0 }; // keeps the lookups from being optimized away
+
+		auto start{ std::chrono::steady_clock::now() };
+		for (int i{ 0 }; i < ROUNDS; ++i) {
+			checksum += route(TARGETS[i % TARGETS.size()]);
+		}
+		std::chrono::duration<double, std::nano> elapsed{ std::chrono::steady_clock::now() - start };
+
+		EXPECT_NE(checksum, 0);
+		return elapsed.count() / ROUNDS;
+	}
+}
+
+
+TEST(RouterBenchmark, DISABLED_RoutingCostPerRequest) {
+	double router{ Benchmark::NanosecondsPerRequest([](std::string_view target) {
+		auto match{ Benchmark::ROUTER.Find(Routing::Verb::get, target) };
+		return static_cast<std::size_t>(match.endpoint) + match.param.size();
+	}) };
+
+	double strings{ Benchmark::NanosecondsPerRequest([](std::string_view target) {
+		auto [endpoint, shortCode] { Benchmark::StringDispatch(target) };
+		return static_cast<std::size_t>(endpoint) + shortCode.size();
+	}) };
+
+	std::cout << "route table:      " << router << " ns/request\n"
+		<< "string dispatch:  " << strings << " ns/request\n";
+
+	EXPECT_LT(router, strings);
+}
@@ -0,0 +1,260 @@
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <boost/asio.hpp>
+#include <boost/beast.hpp>
+#include <boost/beast/http.hpp>
+
+#include "server.h"
+
+
+namespace beast = boost::beast;
+namespace http = beast::http;
+namespace net = boost::asio;
+using tcp = boost::asio::ip::tcp;
+
+
+// Requests/sec at 1k concurrent keep-alive connections: std::function handler vs coroutine handler.
+// Both handlers simulate a database round trip, the first one blocks the io thread, the second one suspends.
+// Disabled by default: --gtest_also_run_disabled_tests --gtest_filter=ServerBenchmark.*
+// The process needs more than 2 * CONNECTIONS file descriptors (ulimit -n).
+namespace Benchmark {
+	constexpr int CONNECTIONS{ 1000 };
+	constexpr int SERVER_THREADS{ 2 };
+	constexpr auto DATABASE_LATENCY{ std::chrono::milliseconds{ 1 } };
+	constexpr auto DURATION{ std::chrono::seconds{ 5 } };
+
+	inline http::message_generator CreateResponse(const http::request<http::string_body>& req) {
+		http::response<http::string_body> res{ http::status::ok, req.version() };
+		res.set(http::field::content_type, "application/json");
+		res.keep_alive(req.keep_alive());
+		res.body() = R"({"url":"https://www.example.com/some/long/url"})";
+		res.prepare_payload();
+
+		return res;
+	}
+
+	// Keeps one keep-alive connection busy and counts the completed requests
+	class Connection : public std::enable_shared_from_this<Connection> {
+	public:
+		// Sends depth pipelined requests at a time, then reads their responses
+		Connection(net::io_context& ioc, std::atomic<std::size_t>& completed, std::atomic<bool>& isStopped, int depth = 1)
+			: m_stream{ ioc }
+			, m_completed{ completed }
+			, m_isStopped{ isStopped }
+			, m_depth{ depth }
+		{
+			http::request<http::empty_body> req{ http::verb::get, "/shorten/benchmark", 11 };
+			req.keep_alive(true);
+
+			std::ostringstream stream{ };
+			for (int i{ 0 }; i < depth; ++i) {
+				stream << req;
+			}
+			m_requests = stream.str();
+		}
+
+		void Run(const tcp::endpoint& endpoint) {
+			m_stream.async_connect(endpoint,
+				beast::bind_front_handler(&Connection::OnConnect, shared_from_this()));
+		}
+
+	private:
+
+		void OnConnect(beast::error_code ec) {
+			if (ec) {
+				return;
+			}
+
+			DoWrite();
+		}
+
+		void DoWrite() {
+			m_pending = m_depth;
+			net::async_write(m_stream, net::buffer(m_requests),
+				beast::bind_front_handler(&Connection::OnWrite, shared_from_this()));
+		}
+
+		void OnWrite(beast::error_code ec, std::size_t) {
+			if (ec) {
+				return;
+			}
+
+			DoRead();
+		}
+
+		void DoRead() {
+			m_res = { };
+			http::async_read(m_stream, m_buffer, m_res,
+				beast::bind_front_handler(&Connection::OnRead, shared_from_this()));
+		}
+
+		void OnRead(beast::error_code ec, std::size_t) {
+			if (ec) {
+				return;
+			}
+
+			++m_completed;
+			if (--m_pending > 0) {
+				return DoRead();
+			}
+
+			if (!m_isStopped) {
+				DoWrite();
+			}
+		}
+
+	private:
+		beast::tcp_stream m_stream;
+		beast::flat_buffer m_buffer;
+		std::string m_requests;
+		http::response<http::string_body> m_res;
+		std::atomic<std::size_t>& m_completed;
+		std::atomic<bool>& m_isStopped;
+		int m_depth;
+		int m_pending{ 0 };
+	};
+
+	inline double MeasureRequestsPerSecond(const tcp::endpoint& endpoint, int clientThreads = 1, int depth = 1) {
+		net::io_context ioc{ clientThreads };
+		std::atomic<std::size_t> completed{ 0 };
+		std::atomic<bool> isStopped{ false };
+
+		for (int i{ 0 }; i < CONNECTIONS; ++i) {
+			std::make_shared<Connection>(ioc, completed, isStopped, depth) -> Run(endpoint);
+		}
+
+		std::vector<std::thread> clients{ };
+		for (int i{ 0 }; i < clientThreads; ++i) {
+			clients.emplace_back([&ioc]() { ioc.run(); });
+		}
+
+		// Skip the connection storm, then measure the steady state
+		std::this_thread::sleep_for(std::chrono::seconds{ 1 });
+		const std::size_t start{ completed.load() };
+		std::this_thread::sleep_for(DURATION);
+		const std::size_t finish{ completed.load() };
+
+		isStopped = true;
+		ioc.stop();
+		for (auto& client : clients) {
+			client.join();
+		}
+
+		return static_cast<double>(finish - start) / std::chrono::duration<double>(DURATION).count();
+	}
+
+	template <typename Handler>
+	double RunServer(unsigned short port, const Handler& handler,
+		ServerConfig config = { SERVER_THREADS }, int clientThreads = 1, int depth = 1)
+	{
+		const auto address{ net::ip::make_address("127.0.0.1") };
+
+		// The clients stop reading at the end, their connections are not worth waiting for
+		config.drainTimeout = std::chrono::milliseconds{ 100 };
+		Server<http::string_body> server{ address, port, config };
+
+		std::thread thread{ [&]() { server.Run(handler); } };
+
+		// Let the listener bind before the clients connect
+		std::this_thread::sleep_for(std::chrono::milliseconds{ 200 });
+		double rps{ MeasureRequestsPerSecond(tcp::endpoint{ address, port }, clientThreads, depth) };
+
+		server.Stop();
+		thread.join();
+
+		return rps;
+	}
+}
+
+
+TEST(ServerBenchmark, DISABLED_FunctionVsCoroutineHandler) {
+	Server<http::string_body>::Handler function{
+		[](http::request<http::string_body> req) -> http::message_generator {
+			std::this_thread::sleep_for(Benchmark::DATABASE_LATENCY);
+			return Benchmark::CreateResponse(req);
+		} };
+
+	Server<http::string_body>::CoroutineHandler coroutine{
+		[](http::request<http::string_body> req) -> net::awaitable<http::message_generator> {
+			net::steady_timer timer{ co_await net::this_coro::executor, Benchmark::DATABASE_LATENCY };
+			co_await timer.async_wait(net::use_awaitable);
+			co_return Benchmark::CreateResponse(req);
+		} };
+
+	double functionRps{ Benchmark::RunServer(18081, function) };
+	double coroutineRps{ Benchmark::RunServer(18082, coroutine) };
+
+	std::cout << "std::function handler: " << functionRps << " requests/sec\n"
+		<< "coroutine handler:     " << coroutineRps << " requests/sec\n";
+
+	RecordProperty("FunctionRequestsPerSecond", static_cast<int>(functionRps));
+	RecordProperty("CoroutineRequestsPerSecond", static_cast<int>(coroutineRps));
+
+	EXPECT_GT(coroutineRps, functionRps);
+}
+
+
+// Requests/sec of a handler without database latency, so the io scheduler is the bottleneck:
+// one io_context shared by all threads against an io_context and SO_REUSEPORT listener per thread.
+// Half of the cores serve, the other half run the clients (meant for a 16-core box).
+TEST(ServerBenchmark, DISABLED_SharedVsPerThreadContext) {
+	Server<http::string_body>::CoroutineHandler coroutine{
+		[](http::request<http::string_body> req) -> net::awaitable<http::message_generator> {
+			co_return Benchmark::CreateResponse(req);
+		} };
+
+	const int cores{ static_cast<int>(std::max(2u, std::thread::hardware_concurrency())) };
+
+	ServerConfig shared{ cores / 2 };
+	ServerConfig perThread{ cores / 2, IoMode::PerThread, true };
+
+	double sharedRps{ Benchmark::RunServer(18083, coroutine, shared, cores - cores / 2) };
+	double perThreadRps{ Benchmark::RunServer(18084, coroutine, perThread, cores - cores / 2) };
+
+	std::cout << "shared io_context:      " << sharedRps << " requests/sec\n"
+		<< "io_context per thread:  " << perThreadRps << " requests/sec\n";
+
+	RecordProperty("SharedRequestsPerSecond", static_cast<int>(sharedRps));
+	RecordProperty("PerThreadRequestsPerSecond", static_cast<int>(perThreadRps));
+
+	EXPECT_GT(perThreadRps, sharedRps);
+}
+
+
+// Requests/sec of clients that pipeline 16 requests per connection: a session that handles
+// one request at a time against one that handles the 16 together and coalesces their responses.
+TEST(ServerBenchmark, DISABLED_SequentialVsPipelinedSession) {
+	Server<http::string_body>::CoroutineHandler coroutine{
+		[](http::request<http::string_body> req) -> net::awaitable<http::message_generator> {
+			net::steady_timer timer{ co_await net::this_coro::executor, Benchmark::DATABASE_LATENCY };
+			co_await timer.async_wait(net::use_awaitable);
+			co_return Benchmark::CreateResponse(req);
+		} };
+
+	constexpr int DEPTH{ 16 };
+	ServerConfig sequential{ Benchmark::SERVER_THREADS };
+	sequential.session.pipelineLimit = 1;
+	ServerConfig pipelined{ Benchmark::SERVER_THREADS };
+	pipelined.session.pipelineLimit = DEPTH;
+
+	double sequentialRps{ Benchmark::RunServer(18085, coroutine, sequential, 1, DEPTH) };
+	double pipelinedRps{ Benchmark::RunServer(18086, coroutine, pipelined, 1, DEPTH) };
+
+	std::cout << "one request at a time:  " << sequentialRps << " requests/sec\n"
+		<< "pipelined requests:     " << pipelinedRps << " requests/sec\n";
+
+	RecordProperty("SequentialRequestsPerSecond", static_cast<int>(sequentialRps));
+	RecordProperty("PipelinedRequestsPerSecond", static_cast<int>(pipelinedRps));
+
+	EXPECT_GT(pipelinedRps, sequentialRps);
+}
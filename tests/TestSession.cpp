@@ -0,0 +1,155 @@
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <string>
+#include <thread>
+
+#include <boost/asio.hpp>
+#include <boost/beast.hpp>
+#include <boost/beast/http.hpp>
+
+#include "server.h"
+
+
+namespace beast = boost::beast;
+namespace http = beast::http;
+namespace net = boost::asio;
+using tcp = boost::asio::ip::tcp;
+
+
+namespace {
+	// Answers with the target, /slow after a delay, so its response is ready after the ones behind it.
+	// /late waits longer, for the deadline tests.
+	Server<http::string_body>::CoroutineHandler EchoTarget() {
+		return [](http::request<http::string_body> req) -> net::awaitable<http::message_generator> {
+			if (req.target() == "/slow" || req.target() == "/late") {
+				std::chrono::milliseconds delay{ req.target() == "/slow" ? 100 : 400 };
+				net::steady_timer timer{ co_await net::this_coro::executor, delay };
+				co_await timer.async_wait(net::use_awaitable);
+			}
+
+			http::response<http::string_body> res{ http::status::ok, req.version() };
+			res.keep_alive(req.keep_alive());
+			res.body() = std::string{ req.target() };
+			res.prepare_payload();
+			co_return res;
+		};
+	}
+
+	std::string PipelinedRequests(const std::string& last) {
+		return "GET /slow HTTP/1.1\r\nHost: localhost\r\n\r\n"
+			"GET /a HTTP/1.1\r\nHost: localhost\r\n\r\n"
+			"GET /b HTTP/1.1\r\nHost: localhost\r\n\r\n"
+			"GET " + last + " HTTP/1.1\r\nHost: localhost\r\nConnection: close\r\n\r\n";
+	}
+}
+
+
+TEST(SessionTest, PipelinedResponsesKeepTheRequestOrder) {
+	const auto address{ net::ip::make_address("127.0.0.1") };
+	Server<http::string_body> server{ address, 18087, ServerConfig{ 2 } };
+	std::thread thread{ [&]() { server.Run(EchoTarget()); } };
+	std::this_thread::sleep_for(std::chrono::milliseconds{ 200 });
+
+	net::io_context ioc{ };
+	beast::tcp_stream stream{ ioc };
+	stream.connect(tcp::endpoint{ address, 18087 });
+	net::write(stream, net::buffer(PipelinedRequests("/c")));
+
+	beast::flat_buffer buffer{ };
+	for (const char* target : { "/slow", "/a", "/b", "/c" }) {
+		http::response<http::string_body> res{ };
+		http::read(stream, buffer, res);
+		EXPECT_EQ(res.body(), target);
+	}
+
+	// The last request asked to close the connection
+	beast::error_code ec{ };
+	http::response<http::string_body> res{ };
+	http::read(stream, buffer, res, ec);
+	EXPECT_EQ(ec, http::error::end_of_stream);
+
+	server.Stop();
+	thread.join();
+}
+
+
+TEST(SessionTest, ShutdownAnswersInFlightRequestsWithConnectionClose) {
+	const auto address{ net::ip::make_address("127.0.0.1") };
+	Server<http::string_body> server{ address, 18088, ServerConfig{ 2 } };
+	std::thread thread{ [&]() { server.Run(EchoTarget()); } };
+	std::this_thread::sleep_for(std::chrono::milliseconds{ 200 });
+
+	net::io_context ioc{ };
+	beast::tcp_stream busy{ ioc };
+	busy.connect(tcp::endpoint{ address, 18088 });
+	beast::tcp_stream idle{ ioc };
+	idle.connect(tcp::endpoint{ address, 18088 });
+
+	// The idle connection has had its response and waits for the next request
+	beast::flat_buffer idleBuffer{ };
+	http::request<http::empty_body> req{ http::verb::get, "/a", 11 };
+	http::write(idle, req);
+	http::response<http::string_body> res{ };
+	http::read(idle, idleBuffer, res);
+	EXPECT_TRUE(res.keep_alive());
+
+	req.target("/slow");
+	http::write(busy, req);
+	std::this_thread::sleep_for(std::chrono::milliseconds{ 20 });
+	server.Shutdown();
+
+	// The request that was being handled still gets its response
+	beast::flat_buffer buffer{ };
+	res = { };
+	http::read(busy, buffer, res);
+	EXPECT_EQ(res.result(), http::status::ok);
+	EXPECT_EQ(res.body(), "/slow");
+	EXPECT_FALSE(res.keep_alive());
+
+	beast::error_code ec{ };
+	http::read(busy, buffer, res, ec);
+	EXPECT_EQ(ec, http::error::end_of_stream);
+
+	http::read(idle, idleBuffer, res, ec);
+	EXPECT_EQ(ec, http::error::end_of_stream);
+
+	// Run returns once both connections are closed
+	thread.join();
+
+	beast::tcp_stream late{ ioc };
+	late.connect(tcp::endpoint{ address, 18088 }, ec);
+	EXPECT_TRUE(ec);
+}
+
+
+TEST(SessionTest, WriteKeepsTheDeadlineOfAPendingRead) {
+	const auto address{ net::ip::make_address("127.0.0.1") };
+	ServerConfig config{ 2 };
+	config.session.readTimeout = std::chrono::milliseconds{ 500 };
+	Server<http::string_body> server{ address, 18089, config };
+	std::thread thread{ [&]() { server.Run(EchoTarget()); } };
+	std::this_thread::sleep_for(std::chrono::milliseconds{ 200 });
+
+	net::io_context ioc{ };
+	beast::tcp_stream stream{ ioc };
+	stream.connect(tcp::endpoint{ address, 18089 });
+
+	// The header of the second request never completes, its read is pending while /late is written
+	const auto start{ std::chrono::steady_clock::now() };
+	net::write(stream, net::buffer(std::string{ "GET /late HTTP/1.1\r\nHost: localhost\r\n\r\nGET /a HTTP/1.1\r\n" }));
+
+	beast::flat_buffer buffer{ };
+	http::response<http::string_body> res{ };
+	http::read(stream, buffer, res);
+	EXPECT_EQ(res.body(), "/late");
+
+	// Closed at the read deadline, not at the deadline of the write started after it
+	beast::error_code ec{ };
+	http::read(stream, buffer, res, ec);
+	EXPECT_TRUE(ec);
+	EXPECT_LT(std::chrono::steady_clock::now() - start, std::chrono::milliseconds{ 750 });
+
+	server.Stop();
+	thread.join();
+}
@@ -0,0 +1,97 @@
+#include <gtest/gtest.h>
+
+#include <map>
+#include <stdexcept>
+#include <string>
+#include "settings.h"
+
+
+namespace {
+	// Stands in for the process environment
+	Settings::Environment MakeEnvironment(const std::map<std::string, std::string>& variables) {
+		return [variables](const char* name) -> const char* {
+			auto it{ variables.find(name) };
+			return it == variables.end() ? nullptr : it -> second.c_str();
+		};
+	}
+}
+
+
+TEST(SettingsTest, DefaultsFollowTheNumberOfCores) {
+	auto config{ Settings::Defaults(16) };
+	EXPECT_EQ(config.server.threads, 16);
+	EXPECT_EQ(config.database.poolMin, 16);
+	EXPECT_EQ(config.database.poolMax, 64);
+	EXPECT_EQ(config.database.pipelineConnections, 4);
+
+	// hardware_concurrency may report zero
+	config = Settings::Defaults(0);
+	EXPECT_EQ(config.server.threads, 1);
+	EXPECT_EQ(config.database.pipelineConnections, 1);
+	EXPECT_NO_THROW(Settings::Validate(config));
+}
+
+
+TEST(SettingsTest, EnvironmentOverridesFileOverridesDefaults) {
+	auto config{ Settings::Defaults(4) };
+	Settings::ApplyJson(config, R"({
+		"server": { "threads": 8, "io_mode": "per_thread", "read_timeout_ms": 5000, "body_limit": 65536 },
+		"database": { "host": "db.local", "pool_max": 32 },
+		"handler": { "pretty_print": true }
+	})");
+
+	Settings::ApplyEnvironment(config, MakeEnvironment({
+		{ "URL_SHORTENER_SERVER_THREADS", "12" },
+		{ "URL_SHORTENER_SERVER_KEEP_ALIVE_TIMEOUT_MS", "2000" },
+		{ "URL_SHORTENER_CODE_KEY", "0x2a" },
+		{ "URL_SHORTENER_CACHE_CAPACITY", "5000" } }));
+
+	EXPECT_EQ(config.server.threads, 12);
+	EXPECT_EQ(config.server.ioMode, "per_thread");
+	EXPECT_EQ(config.server.readTimeout, std::chrono::milliseconds{ 5000 });
+	EXPECT_EQ(config.server.keepAliveTimeout, std::chrono::milliseconds{ 2000 });
+	EXPECT_EQ(config.server.bodyLimit, 65536);
+	EXPECT_EQ(config.database.host, "db.local");
+	EXPECT_EQ(config.database.poolMin, 4);
+	EXPECT_EQ(config.database.poolMax, 32);
+	EXPECT_EQ(config.cache.capacity, 5000);
+	EXPECT_EQ(config.code.key, 42);
+	EXPECT_TRUE(config.handler.prettyPrint);
+	EXPECT_NO_THROW(Settings::Validate(config));
+}
+
+
+TEST(SettingsTest, InvalidSettingsThrowInvalidArgument) {
+	auto config{ Settings::Defaults(4) };
+
+	EXPECT_THROW(Settings::ApplyJson(config, R"({ "server": { "thread": 2 } })"), std::invalid_argument);
+	EXPECT_THROW(Settings::ApplyJson(config, R"({ "server": { "threads": "many" } })"), std::invalid_argument);
+	EXPECT_THROW(Settings::ApplyJson(config, R"({ "server": { "port": 70000 } })"), std::invalid_argument);
+	EXPECT_THROW(Settings::ApplyJson(config, R"({ "database": { "host": 5 } })"), std::invalid_argument);
+	EXPECT_THROW(Settings::ApplyJson(config, R"({ "server": [ ] })"), std::invalid_argument);
+	EXPECT_THROW(Settings::ApplyJson(config, "{ server"), std::invalid_argument);
+
+	EXPECT_THROW(Settings::ApplyEnvironment(config, MakeEnvironment({ { "URL_SHORTENER_SERVER_PIN_THREADS", "maybe" } })),
+		std::invalid_argument);
+	EXPECT_THROW(Settings::ApplyEnvironment(config, MakeEnvironment({ { "URL_SHORTENER_CACHE_CAPACITY", "-1" } })),
+		std::invalid_argument);
+
+	config = Settings::Defaults(4);
+	config.database.poolMax = 2;
+	EXPECT_THROW(Settings::Validate(config), std::invalid_argument);
+
+	config = Settings::Defaults(4);
+	config.handler.redirectStatus = 303;
+	EXPECT_THROW(Settings::Validate(config), std::invalid_argument);
+
+	config = Settings::Defaults(4);
+	config.storage.backend = "log";
+	EXPECT_THROW(Settings::Validate(config), std::invalid_argument);
+	config.storage.path = "urls.log";
+	EXPECT_NO_THROW(Settings::Validate(config));
+	config.storage.backend = "sqlite";
+	EXPECT_THROW(Settings::Validate(config), std::invalid_argument);
+
+	EXPECT_THROW(Settings::Load(Settings::Defaults(4), "/nonexistent/settings.json", MakeEnvironment({ })),
+		std::runtime_error);
+}
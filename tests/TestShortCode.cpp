@@ -0,0 +1,261 @@
+#include <gtest/gtest.h>
+
+#include <mutex>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+#include "shortcode.h"
+#include "MockDatabase.h"
+
+
+using ::testing::_;
+using ::testing::An;
+using ::testing::Invoke;
+using ::testing::Return;
+
+
+// Single int8 value, as SELECT nextval(...) returns it
+class BlockResult : public IResultView {
+public:
+	explicit BlockResult(std::int64_t block) : m_block{ block } { }
+
+	int Rows() const override { return 1; }
+	int Columns() const override { return 1; }
+	bool IsNull(int, int) const override { return false; }
+	std::string_view GetString(int, int) const override { throw std::logic_error("not a string"); }
+	std::int64_t GetInt64(int, int) const override { return m_block; }
+	std::chrono::system_clock::time_point GetTimestamp(int, int) const override { throw std::logic_error("not a timestamp"); }
+
+private:
+	std::int64_t m_block{ };
+};
+
+
+// Hands out the blocks 1, 2, 3, ... as a fresh sequence would
+static std::unique_ptr<MockDatabase> MakeSequence(int& leases) {
+	auto database{ std::make_unique<MockDatabase>() };
+	EXPECT_CALL(*database, Execute(An<std::string_view>(), _))
+		.WillOnce(Invoke([](std::string_view query, IDatabase::SqlParams) {
+			EXPECT_EQ(query, "CREATE SEQUENCE IF NOT EXISTS urls_code_block;");
+		}));
+	EXPECT_CALL(*database, Prepare(std::string_view{ "SELECT nextval('urls_code_block');" }))
+		.WillOnce(Return(StatementHandle{ 3 }));
+	EXPECT_CALL(*database, ExecuteQueryView(An<StatementHandle>(), _))
+		.WillRepeatedly(Invoke([&leases](StatementHandle statement, IDatabase::SqlParams) {
+			EXPECT_EQ(statement.id, 3);
+			return std::make_unique<BlockResult>(++leases);
+		}));
+
+	return database;
+}
+
+
+// Keeps the leases of NextAsync, the test completes them with the block it picks
+static std::unique_ptr<MockDatabase> MakeAsyncSequence(std::vector<IDatabase::ViewCallback>& leases) {
+	auto database{ std::make_unique<MockDatabase>() };
+	EXPECT_CALL(*database, Execute(An<std::string_view>(), _));
+	EXPECT_CALL(*database, Prepare(An<std::string_view>()))
+		.WillOnce(Return(StatementHandle{ 3 }));
+	EXPECT_CALL(*database, ExecuteQueryView(An<StatementHandle>(), _))
+		.Times(0);
+	EXPECT_CALL(*database, ExecuteQueryViewAsync(An<StatementHandle>(), _, _))
+		.WillRepeatedly(Invoke([&leases](StatementHandle statement, IDatabase::SqlParams, IDatabase::ViewCallback callback) {
+			EXPECT_EQ(statement.id, 3);
+			leases.push_back(std::move(callback));
+		}));
+
+	return database;
+}
+
+
+TEST(ShortCodeTest, InvalidParamsThrowInvalidArgument) {
+	EXPECT_THROW(ShortCode::Encoder(1, 15), std::invalid_argument);
+	EXPECT_THROW(ShortCode::Encoder(1, 60), std::invalid_argument);
+	EXPECT_THROW(ShortCode::Allocator(nullptr, ShortCode::Encoder{ 1 }), std::invalid_argument);
+
+	ShortCode::LeaseConfig config{ };
+	config.blockSize = 0;
+	EXPECT_THROW(ShortCode::Allocator(std::make_unique<MockDatabase>(), ShortCode::Encoder{ 1 }, config),
+		std::invalid_argument);
+}
+
+
+TEST(ShortCodeTest, EncoderIsBijective) {
+	ShortCode::Encoder encoder{ 42, 16 };
+	ASSERT_EQ(encoder.Length(), 3); // 62^3 >= 2^16
+
+	std::unordered_set<std::string> codes{ };
+	for (std::uint64_t id{ 0 }; id < encoder.Capacity(); ++id) {
+		std::string code{ encoder.Encode(id) };
+		ASSERT_EQ(code.size(), encoder.Length());
+		ASSERT_TRUE(codes.insert(code).second) << "duplicate code " << code;
+		ASSERT_EQ(encoder.Decode(code), id);
+	}
+
+	EXPECT_THROW(encoder.Encode(encoder.Capacity()), std::out_of_range);
+	EXPECT_THROW(encoder.Decode("zzz"), std::invalid_argument); // above 2^16
+	EXPECT_THROW(encoder.Decode("a-b"), std::invalid_argument);
+	EXPECT_THROW(encoder.Decode("abcd"), std::invalid_argument);
+}
+
+
+TEST(ShortCodeTest, KeyChangesThePermutation) {
+	ShortCode::Encoder first{ 1 };
+	ShortCode::Encoder second{ 2 };
+	EXPECT_EQ(first.Length(), 7);
+
+	int same{ 0 };
+	for (std::uint64_t id{ 0 }; id < 100; ++id) {
+		same += first.Encode(id) == second.Encode(id);
+	}
+	EXPECT_EQ(same, 0);
+
+	// Consecutive ids do not give neighbouring codes
+	EXPECT_NE(first.Encode(0).substr(0, 5), first.Encode(1).substr(0, 5));
+}
+
+
+TEST(ShortCodeTest, AllocatorLeasesBlocks) {
+	int leases{ 0 };
+	ShortCode::LeaseConfig config{ };
+	config.blockSize = 10;
+	ShortCode::Allocator allocator{ MakeSequence(leases), ShortCode::Encoder{ 7 }, config };
+
+	for (std::uint64_t id{ 0 }; id < 25; ++id) {
+		EXPECT_EQ(allocator.NextId(), id);
+	}
+	EXPECT_EQ(leases, 3);
+
+	EXPECT_EQ(allocator.GetEncoder().Decode(allocator.Next()), 25);
+}
+
+
+TEST(ShortCodeTest, AllocatorHandsOutCodesInBulk) {
+	int leases{ 0 };
+	ShortCode::LeaseConfig config{ };
+	config.blockSize = 10;
+	ShortCode::Allocator allocator{ MakeSequence(leases), ShortCode::Encoder{ 7 }, config };
+
+	EXPECT_EQ(allocator.NextId(), 0);
+
+	// The rest of the first block, then two more
+	std::vector<std::string> codes{ allocator.Next(25) };
+	ASSERT_EQ(codes.size(), 25);
+	for (std::uint64_t i{ 0 }; i < codes.size(); ++i) {
+		EXPECT_EQ(allocator.GetEncoder().Decode(codes[i]), i + 1);
+	}
+	EXPECT_EQ(leases, 3);
+
+	EXPECT_TRUE(allocator.Next(0).empty());
+	EXPECT_EQ(allocator.NextId(), 26);
+}
+
+
+TEST(ShortCodeTest, ConcurrentAllocationNeverRepeats) {
+	int leases{ 0 };
+	ShortCode::LeaseConfig config{ };
+	config.blockSize = 64;
+	ShortCode::Allocator allocator{ MakeSequence(leases), ShortCode::Encoder{ 7 }, config };
+
+	std::mutex mutex{ };
+	std::set<std::string> codes{ };
+	std::vector<std::thread> threads{ };
+	for (int t{ 0 }; t < 4; ++t) {
+		threads.emplace_back([&]() {
+			std::vector<std::string> local{ };
+			for (int i{ 0 }; i < 1000; ++i) {
+				local.push_back(allocator.Next());
+			}
+
+			std::lock_guard<std::mutex> lock{ mutex };
+			codes.insert(local.begin(), local.end());
+		});
+	}
+
+	for (auto& thread : threads) {
+		thread.join();
+	}
+
+	EXPECT_EQ(codes.size(), 4000);
+	EXPECT_EQ(leases, 63); // ceil(4000 / 64)
+}
+
+
+TEST(ShortCodeTest, AllocatorThrowsWhenCodeSpaceIsExhausted) {
+	int leases{ 1 << 16 }; // the next lease is past the last block of a 2^16 code space with one-id blocks
+	ShortCode::LeaseConfig config{ };
+	config.blockSize = 1;
+	ShortCode::Allocator allocator{ MakeSequence(leases), ShortCode::Encoder{ 7, 16 }, config };
+
+	EXPECT_THROW(allocator.Next(), std::out_of_range);
+}
+
+
+TEST(ShortCodeTest, AllocatorLeasesAheadWithoutBlocking) {
+	std::vector<IDatabase::ViewCallback> leases{ };
+	ShortCode::LeaseConfig config{ };
+	config.blockSize = 10;
+	ShortCode::Allocator allocator{ MakeAsyncSequence(leases), ShortCode::Encoder{ 7 }, config };
+
+	std::vector<std::uint64_t> ids{ };
+	const auto collect{ [&allocator, &ids](std::exception_ptr error, std::vector<std::string> codes) {
+		EXPECT_FALSE(error);
+		for (const std::string& code : codes) {
+			ids.push_back(allocator.GetEncoder().Decode(code));
+		}
+	} };
+
+	// The first call waits for the lease
+	allocator.NextAsync(3, collect);
+	ASSERT_EQ(leases.size(), 1);
+	EXPECT_TRUE(ids.empty());
+
+	leases[0](nullptr, std::make_unique<BlockResult>(1));
+	EXPECT_EQ(ids, (std::vector<std::uint64_t>{ 0, 1, 2 }));
+
+	// Half of the block is used, the next one is leased meanwhile
+	allocator.NextAsync(3, collect);
+	EXPECT_EQ(ids.size(), 6);
+	ASSERT_EQ(leases.size(), 2);
+
+	// The rest of the block and the first id of the next one, the later call waits behind it
+	allocator.NextAsync(5, collect);
+	allocator.NextAsync(1, collect);
+	EXPECT_EQ(ids.size(), 6);
+
+	leases[1](nullptr, std::make_unique<BlockResult>(2));
+	EXPECT_EQ(ids, (std::vector<std::uint64_t>{ 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11 }));
+	EXPECT_EQ(leases.size(), 2);
+}
+
+
+TEST(ShortCodeTest, FailedLeaseFailsTheWaiters) {
+	std::vector<IDatabase::ViewCallback> leases{ };
+	ShortCode::Allocator allocator{ MakeAsyncSequence(leases), ShortCode::Encoder{ 7 } };
+
+	int failures{ 0 };
+	const auto expectError{ [&failures](std::exception_ptr error, std::vector<std::string> codes) {
+		EXPECT_TRUE(error);
+		EXPECT_TRUE(codes.empty());
+		++failures;
+	} };
+
+	allocator.NextAsync(1, expectError);
+	allocator.NextAsync(2, expectError);
+	ASSERT_EQ(leases.size(), 1);
+
+	leases[0](std::make_exception_ptr(std::runtime_error("connection lost")), nullptr);
+	EXPECT_EQ(failures, 2);
+
+	// Not leased again until the next call
+	EXPECT_EQ(leases.size(), 1);
+	allocator.NextAsync(1, [](std::exception_ptr error, std::vector<std::string> codes) {
+		EXPECT_FALSE(error);
+		EXPECT_EQ(codes.size(), 1);
+	});
+	ASSERT_EQ(leases.size(), 2);
+	leases[1](nullptr, std::make_unique<BlockResult>(1));
+}
@@ -0,0 +1,181 @@
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include "snapshot.h"
+#include "MockDatabase.h"
+
+
+using ::testing::An;
+using ::testing::HasSubstr;
+using ::testing::Invoke;
+
+
+// Hands out the rows at once, as one read of a short COPY TO STDOUT would
+class SnapshotCopyOut : public ICopyOutStream {
+public:
+	explicit SnapshotCopyOut(std::string rows) : m_rows{ std::move(rows) } { }
+
+	bool Read(std::string& buffer, std::size_t) override {
+		buffer += m_rows;
+		return false;
+	}
+
+private:
+	std::string m_rows{ };
+};
+
+
+class SnapshotTest : public ::testing::Test {
+protected:
+	void SetUp() override {
+		const auto* test{ ::testing::UnitTest::GetInstance() -> current_test_info() };
+		directory = std::filesystem::temp_directory_path() / std::format("snapshot_{}_{}", test -> name(), ::getpid());
+		std::filesystem::create_directories(directory);
+		path = (directory / "urls.snapshot").string();
+	}
+
+	void TearDown() override {
+		std::filesystem::remove_all(directory);
+	}
+
+	static TimePointSys At(int seconds) {
+		return TimePointSys{ std::chrono::seconds{ seconds } };
+	}
+
+	std::filesystem::path directory{ };
+	std::string path{ };
+};
+
+
+TEST_F(SnapshotTest, FindsEveryCodeOfTheFile) {
+	Snapshot::Builder builder{ };
+	for (int i{ 0 }; i < 1000; ++i) {
+		builder.Add(i + 1, std::format("code{}", i), std::format("https://example.com/{}", i), At(i), At(i + 1));
+	}
+	builder.Write(path);
+	EXPECT_FALSE(std::filesystem::exists(path + ".tmp"));
+
+	auto file{ Snapshot::File::Open(path, true) };
+	EXPECT_EQ(file -> Size(), 1000);
+	for (int i{ 0 }; i < 1000; ++i) {
+		auto url{ file -> Find(std::format("code{}", i)) };
+		ASSERT_TRUE(url) << i;
+		EXPECT_EQ(url -> GetId(), i + 1);
+		EXPECT_EQ(url -> GetUri(), std::format("https://example.com/{}", i));
+		EXPECT_EQ(url -> GetShortCode(), std::format("code{}", i));
+		EXPECT_EQ(url -> GetCreatedAt(), At(i));
+		EXPECT_EQ(url -> GetUpdatedAt(), At(i + 1));
+	}
+
+	EXPECT_FALSE(file -> Find("code1000"));
+	EXPECT_FALSE(file -> Find(""));
+}
+
+TEST_F(SnapshotTest, EmptySnapshotFindsNothing) {
+	Snapshot::Builder{ }.Write(path);
+
+	auto file{ Snapshot::File::Open(path) };
+	EXPECT_EQ(file -> Size(), 0);
+	EXPECT_FALSE(file -> Find("abc"));
+}
+
+TEST_F(SnapshotTest, InvalidFilesAreRejected) {
+	EXPECT_THROW(Snapshot::File::Open(path), std::runtime_error);
+
+	std::ofstream{ path } << "not a snapshot";
+	EXPECT_THROW(Snapshot::File::Open(path), std::runtime_error);
+
+	Snapshot::Builder builder{ };
+	builder.Add(1, "abc", "https://example.com", At(0), At(0));
+	builder.Write(path);
+	std::filesystem::resize_file(path, std::filesystem::file_size(path) - 1);
+	EXPECT_THROW(Snapshot::File::Open(path), std::runtime_error);
+
+	// A flipped byte is only found by the checksum
+	builder.Write(path);
+	{
+		std::fstream file{ path, std::ios::in | std::ios::out | std::ios::binary };
+		file.seekp(-1, std::ios::end);
+		file.put('X');
+	}
+	EXPECT_NO_THROW(Snapshot::File::Open(path));
+	EXPECT_THROW(Snapshot::File::Open(path, true), std::runtime_error);
+}
+
+TEST_F(SnapshotTest, StoreSwapsInAReplacedFile) {
+	Snapshot::Builder first{ };
+	first.Add(1, "abc", "https://example.com/first", At(0), At(0));
+	first.Write(path);
+
+	Snapshot::Store store{ path };
+	auto old{ store.Current() };
+	EXPECT_FALSE(store.Reload());
+	EXPECT_EQ(store.Find("abc") -> GetUri(), "https://example.com/first");
+
+	Snapshot::Builder second{ };
+	second.Add(1, "abc", "https://example.com/second", At(0), At(0));
+	second.Add(2, "def", "https://example.com/other", At(0), At(0));
+	second.Write(path);
+
+	EXPECT_TRUE(store.Reload());
+	EXPECT_EQ(store.Find("abc") -> GetUri(), "https://example.com/second");
+	EXPECT_TRUE(store.Find("def"));
+
+	// The old mapping stays valid while it is referenced
+	EXPECT_EQ(old -> Find("abc") -> GetUri(), "https://example.com/first");
+
+	// An invalid file does not replace the served one
+	std::ofstream{ path + ".bad" } << "not a snapshot";
+	std::filesystem::rename(path + ".bad", path);
+	EXPECT_FALSE(store.Reload());
+	EXPECT_TRUE(store.Find("def"));
+}
+
+TEST_F(SnapshotTest, WatcherReloadsTheFile) {
+	Snapshot::Builder first{ };
+	first.Add(1, "abc", "https://example.com/first", At(0), At(0));
+	first.Write(path);
+
+	Snapshot::Store store{ path, Snapshot::StoreConfig{ .reloadInterval = std::chrono::milliseconds{ 10 } } };
+	store.Start();
+
+	Snapshot::Builder second{ };
+	second.Add(2, "def", "https://example.com/second", At(0), At(0));
+	second.Write(path);
+
+	auto deadline{ std::chrono::steady_clock::now() + std::chrono::seconds{ 5 } };
+	while (!store.Find("def") && std::chrono::steady_clock::now() < deadline) {
+		std::this_thread::sleep_for(std::chrono::milliseconds{ 5 });
+	}
+	store.Stop();
+
+	EXPECT_TRUE(store.Find("def"));
+	EXPECT_FALSE(store.Find("abc"));
+}
+
+TEST_F(SnapshotTest, BuildFromDatabaseReadsTheCopy) {
+	MockDatabase database{ };
+	EXPECT_CALL(database, CopyOut(An<std::string_view>()))
+		.WillOnce(Invoke([](std::string_view query) {
+			EXPECT_THAT(std::string{ query }, HasSubstr("FROM urls) TO STDOUT"));
+			return std::make_unique<SnapshotCopyOut>(
+				"1\tabc\thttps://example.com/a\\\\b\\tc\t1000000\t2000000\n"
+				"2\tdef\thttps://example.com/d\t3000000\t3000000\n");
+		}));
+
+	EXPECT_EQ(Snapshot::BuildFromDatabase(database, path), 2);
+
+	auto file{ Snapshot::File::Open(path, true) };
+	auto url{ file -> Find("abc") };
+	ASSERT_TRUE(url);
+	EXPECT_EQ(url -> GetUri(), "https://example.com/a\\b\tc");
+	EXPECT_EQ(url -> GetCreatedAt(), At(1));
+	EXPECT_EQ(url -> GetUpdatedAt(), At(2));
+	EXPECT_EQ(file -> Find("def") -> GetId(), 2);
+}
@@ -1,5 +1,8 @@
 #include <gtest/gtest.h>
 
+#include <set>
+#include <thread>
+
 #include "TestStringGenerator.h"
 
 
@@ -47,4 +50,44 @@ TEST_F(StringGeneratorTest, GenerateStringWithCustomChars) {
             customChars.end(), ch), 
             customChars.end());
     }
-}
\ No newline at end of file
+}
+TEST_F(StringGeneratorTest, GenerateCoversLengthsAndAlphabet) {
+    std::set<std::size_t> lengths{ };
+    std::set<char> chars{ };
+    for (int i{ 0 }; i < 2000; ++i) {
+        std::string str{ sg -> Generate() };
+        lengths.insert(str.size());
+        chars.insert(str.begin(), str.end());
+    }
+
+    EXPECT_EQ(lengths, (std::set<std::size_t>{ 5, 6, 7, 8, 9, 10 }));
+    EXPECT_EQ(chars.size(), sg -> baseChars.size());
+}
+
+TEST_F(StringGeneratorTest, SingleCharAlphabet) {
+    Random::StringGenerator generator{ 3, 3, { 'x' } };
+
+    EXPECT_EQ(generator.Generate(), "xxx");
+}
+
+TEST(RandomEngineTest, SameSeedSameSequence) {
+    Random::Xoshiro256 first{ 42 };
+    Random::Xoshiro256 second{ 42 };
+    Random::Xoshiro256 other{ 43 };
+
+    for (int i{ 0 }; i < 100; ++i) {
+        std::uint64_t value{ first() };
+        EXPECT_EQ(value, second());
+        EXPECT_NE(value, other());
+    }
+}
+
+TEST(RandomEngineTest, EveryThreadHasItsOwnEngine) {
+    Random::Xoshiro256* main{ &Random::Engine() };
+    Random::Xoshiro256* worker{ };
+    std::thread thread{ [&worker]() { worker = &Random::Engine(); } };
+    thread.join();
+
+    EXPECT_EQ(main, &Random::Engine());
+    EXPECT_NE(main, worker);
+}
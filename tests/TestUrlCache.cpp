@@ -0,0 +1,145 @@
+#include <gtest/gtest.h>
+
+#include <string>
+#include <thread>
+#include <vector>
+#include "cache.h"
+
+
+using TestCache = Cache::ShardedLruCache<std::string>;
+
+
+TEST(UrlCacheTest, InvalidParamsThrowInvalidArgument) {
+	EXPECT_THROW(TestCache(10, 0), std::invalid_argument);
+	EXPECT_THROW(TestCache(3, 4), std::invalid_argument);
+	EXPECT_NO_THROW(TestCache(4, 4));
+}
+
+
+TEST(UrlCacheTest, GetCountsHitsAndMisses) {
+	TestCache cache{ 8, 2 };
+
+	EXPECT_FALSE(cache.Get("abc").has_value());
+
+	cache.Put("abc", "https://www.example.com");
+	auto value{ cache.Get("abc") };
+	ASSERT_TRUE(value.has_value());
+	EXPECT_EQ(*value, "https://www.example.com");
+
+	Cache::Stats stats{ cache.GetStats() };
+	EXPECT_EQ(stats.hits, 1);
+	EXPECT_EQ(stats.misses, 1);
+	EXPECT_EQ(stats.size, 1);
+	EXPECT_EQ(stats.capacity, 8);
+}
+
+
+TEST(UrlCacheTest, PutReplacesValue) {
+	TestCache cache{ 4, 1 };
+
+	cache.Put("abc", "https://www.example.com");
+	cache.Put("abc", "https://www.example.com/updated");
+
+	EXPECT_EQ(cache.Get("abc").value_or(""), "https://www.example.com/updated");
+	EXPECT_EQ(cache.GetStats().size, 1);
+}
+
+
+TEST(UrlCacheTest, SizeNeverExceedsCapacity) {
+	TestCache cache{ 16, 4 };
+
+	for (int i{ 0 }; i < 1000; ++i) {
+		cache.Put(std::to_string(i), "https://www.example.com");
+	}
+
+	Cache::Stats stats{ cache.GetStats() };
+	EXPECT_LE(stats.size, 16);
+	EXPECT_EQ(stats.evictions, 1000 - stats.size);
+}
+
+
+TEST(UrlCacheTest, ScanDoesNotEvictHotEntries) {
+	TestCache cache{ 10, 1 };
+
+	cache.Put("hot", "https://www.example.com");
+	cache.Get("hot"); // promoted to the protected segment
+
+	for (int i{ 0 }; i < 100; ++i) {
+		cache.Put(std::to_string(i), "https://www.example.com/cold");
+	}
+
+	EXPECT_TRUE(cache.Get("hot").has_value());
+}
+
+
+TEST(UrlCacheTest, EraseInvalidatesEntry) {
+	TestCache cache{ 4, 1 };
+
+	cache.Put("abc", "https://www.example.com");
+	cache.Get("abc");
+	cache.Erase("abc");
+	cache.Erase("missing");
+
+	EXPECT_FALSE(cache.Get("abc").has_value());
+	EXPECT_EQ(cache.GetStats().size, 0);
+}
+
+
+TEST(UrlCacheTest, PutIfUnchangedDropsValuesReadBeforeAnErase) {
+	TestCache cache{ 8, 2 };
+
+	// A lookup misses and reads the old row, an update changes it and invalidates the code,
+	// then the lookup tries to cache what it read
+	std::uint64_t version{ cache.GetVersion("abc") };
+	cache.Erase("abc");
+	EXPECT_FALSE(cache.PutIfUnchanged("abc", "https://www.example.com/old", version));
+	EXPECT_FALSE(cache.Get("abc").has_value());
+
+	// A lookup that started after the invalidation caches its row
+	version = cache.GetVersion("abc");
+	EXPECT_TRUE(cache.PutIfUnchanged("abc", "https://www.example.com/new", version));
+	EXPECT_EQ(cache.Get("abc").value_or(""), "https://www.example.com/new");
+
+	version = cache.GetVersion("abc");
+	cache.Clear();
+	EXPECT_FALSE(cache.PutIfUnchanged("abc", "https://www.example.com/old", version));
+}
+
+
+TEST(UrlCacheTest, ClearRemovesAllEntries) {
+	TestCache cache{ 8, 2 };
+
+	cache.Put("a", "1");
+	cache.Put("b", "2");
+	cache.Clear();
+
+	EXPECT_EQ(cache.GetStats().size, 0);
+	EXPECT_FALSE(cache.Get("a").has_value());
+}
+
+
+TEST(UrlCacheTest, ConcurrentAccessKeepsCountersConsistent) {
+	TestCache cache{ 64, 8 };
+	constexpr int THREADS{ 8 };
+	constexpr int ITERATIONS{ 10000 };
+
+	std::vector<std::thread> threads;
+	for (int t{ 0 }; t < THREADS; ++t) {
+		threads.emplace_back([&cache, t]() {
+			for (int i{ 0 }; i < ITERATIONS; ++i) {
+				std::string key{ std::to_string((t * ITERATIONS + i) % 128) };
+				if (!cache.Get(key)) {
+					cache.Put(key, key);
+				}
+			}
+		});
+	}
+
+	for (auto& thread : threads) {
+		thread.join();
+	}
+
+	Cache::Stats stats{ cache.GetStats() };
+	EXPECT_EQ(stats.hits + stats.misses, static_cast<std::uint64_t>(THREADS * ITERATIONS));
+	EXPECT_LE(stats.size, 64);
+}
@@ -0,0 +1,60 @@
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <string>
+#include <nlohmann/json.hpp>
+#include "urlJson.h"
+
+
+using json = nlohmann::json;
+
+
+// 2021-09-01T12:00:00
+static const TimePointSys CREATED_AT{ std::chrono::seconds{ 1'630'497'600 } };
+
+
+TEST(UrlJsonTest, WritesCompactDocument) {
+	Url url{ 7, "https://www.example.com", "abc123", CREATED_AT, CREATED_AT + std::chrono::microseconds{ 1500 }, 42 };
+
+	std::string body{ };
+	UrlJson::Append(body, url);
+
+	EXPECT_EQ(body,
+		"{\"id\":7,\"url\":\"https://www.example.com\",\"shortcode\":\"abc123\","
+		"\"createdat\":\"2021-09-01T12:00:00\",\"updatedat\":\"2021-09-01T12:00:00.0015\"}");
+}
+
+
+TEST(UrlJsonTest, PrettyMatchesJsonDump) {
+	Url url{ 7, "https://www.example.com", "abc123", CREATED_AT, CREATED_AT, 42 };
+
+	std::string body{ };
+	UrlJson::Append(body, url, UrlJson::Format{ true, true });
+
+	EXPECT_EQ(body, nlohmann::ordered_json::parse(body).dump(4));
+	EXPECT_EQ(json::parse(body).at("accesscount").get<int>(), 42);
+}
+
+
+TEST(UrlJsonTest, EscapesStrings) {
+	Url url{ 1, "https://example.com/?q=\"a\\b\"\n\x01\xc3\xa9", "code", CREATED_AT, CREATED_AT };
+
+	std::string body{ };
+	UrlJson::Append(body, url);
+
+	EXPECT_NE(body.find("\"https://example.com/?q=\\\"a\\\\b\\\"\\n\\u0001\xc3\xa9\""), std::string::npos);
+	EXPECT_EQ(json::parse(body).at("url").get<std::string>(), url.GetUri());
+}
+
+
+TEST(UrlJsonTest, SizeMatchesWrite) {
+	Url url{ -12, "https://www.example.com/\t", "abc", CREATED_AT, CREATED_AT, 5 };
+
+	for (bool pretty : { false, true }) {
+		UrlJson::Format format{ true, pretty };
+		std::string buffer(UrlJson::Size(url, format) + 1, '#');
+
+		EXPECT_EQ(UrlJson::Write(url, format, buffer.data()), buffer.size() - 1);
+		EXPECT_EQ(buffer.back(), '#'); // Nothing was written past the reported size
+	}
+}
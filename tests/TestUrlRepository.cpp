@@ -0,0 +1,169 @@
+#include <gtest/gtest.h>
+
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "postgresqlRepository.h"
+#include "postgresqlError.h"
+#include "MockDatabase.h"
+
+
+using ::testing::_;
+using ::testing::An;
+using ::testing::Invoke;
+using ::testing::Return;
+
+
+// Rows of id, url, shortcode, createdat, updatedat and the created flag, as the create statements return them
+class UrlRows : public IResultView {
+public:
+	struct Row {
+		std::string url;
+		std::string shortCode;
+	};
+
+	explicit UrlRows(std::vector<Row> rows) : m_rows{ std::move(rows) } { }
+
+	int Rows() const override { return static_cast<int>(m_rows.size()); }
+	int Columns() const override { return 6; }
+	bool IsNull(int, int) const override { return false; }
+	std::string_view GetString(int row, int col) const override { return col == 1 ? m_rows[row].url : m_rows[row].shortCode; }
+	std::int64_t GetInt64(int row, int) const override { return row + 1; }
+	std::chrono::system_clock::time_point GetTimestamp(int, int) const override { return { }; }
+
+private:
+	std::vector<Row> m_rows{ };
+};
+
+
+enum Statement : std::size_t { CreateUrl, CreateUrls, Sequence = 100 };
+
+// Hands out the statement handles in the order the repository prepares them
+static std::unique_ptr<MockDatabase> MakeDatabase() {
+	auto database{ std::make_unique<MockDatabase>() };
+	EXPECT_CALL(*database, Execute(An<std::string_view>(), _))
+		.WillOnce(Invoke([](std::string_view query, IDatabase::SqlParams) {
+			EXPECT_TRUE(query.starts_with("CREATE OR REPLACE FUNCTION urls_create("));
+		}));
+
+	auto next{ std::make_shared<std::size_t>(0) };
+	EXPECT_CALL(*database, Prepare(_))
+		.WillRepeatedly(Invoke([next](std::string_view) { return StatementHandle{ (*next)++ }; }));
+
+	return database;
+}
+
+// Codes of a sequence that always leases block 1
+static std::shared_ptr<ShortCode::Allocator> MakeCodes() {
+	auto database{ std::make_unique<MockDatabase>() };
+	EXPECT_CALL(*database, Execute(An<std::string_view>(), _));
+	EXPECT_CALL(*database, Prepare(_)).WillOnce(Return(StatementHandle{ Sequence }));
+	EXPECT_CALL(*database, ExecuteQueryView(An<StatementHandle>(), _))
+		.WillRepeatedly(Invoke([](StatementHandle, IDatabase::SqlParams) {
+			return std::make_unique<UrlRows>(std::vector<UrlRows::Row>{ { } });
+		}));
+
+	return std::make_shared<ShortCode::Allocator>(std::move(database), ShortCode::Encoder{ 7 });
+}
+
+
+TEST(UrlRepositoryTest, CreateRetriesWithTheNextCodeAfterAConflict) {
+	auto database{ MakeDatabase() };
+	std::vector<std::string> codes{ };
+	EXPECT_CALL(*database, ExecuteQueryView(An<StatementHandle>(), _))
+		.WillRepeatedly(Invoke([&codes](StatementHandle statement, IDatabase::SqlParams params) {
+			EXPECT_EQ(statement.id, CreateUrl);
+			codes.push_back(params[1].second);
+
+			// The first code is taken by a row of the old generator
+			std::vector<UrlRows::Row> rows{ };
+			if (codes.size() == 2) {
+				rows.push_back({ params[0].second, params[1].second });
+			}
+			return std::make_unique<UrlRows>(std::move(rows));
+		}));
+
+	PostgreSQL::UrlRepository repository{ std::move(database), MakeCodes() };
+	CreatedUrl created{ repository.Create("https://example.com") };
+
+	ASSERT_EQ(codes.size(), 2);
+	EXPECT_NE(codes[0], codes[1]);
+	EXPECT_EQ(created.url.GetShortCode(), codes[1]);
+}
+
+
+TEST(UrlRepositoryTest, CreateGivesUpAfterRepeatedConflicts) {
+	auto database{ MakeDatabase() };
+	int statements{ 0 };
+	EXPECT_CALL(*database, ExecuteQueryView(An<StatementHandle>(), _))
+		.WillRepeatedly(Invoke([&statements](StatementHandle, IDatabase::SqlParams) {
+			++statements;
+			return std::make_unique<UrlRows>(std::vector<UrlRows::Row>{ });
+		}));
+
+	PostgreSQL::UrlRepository repository{ std::move(database), MakeCodes() };
+	EXPECT_THROW(repository.Create("https://example.com"), PostgreSQL::ExecuteError);
+	EXPECT_EQ(statements, 3);
+}
+
+
+TEST(UrlRepositoryTest, BatchCreateRetriesOnlyTheConflictingUrls) {
+	auto database{ MakeDatabase() };
+	std::vector<std::string> inputs{ };
+	EXPECT_CALL(*database, ExecuteQueryView(An<StatementHandle>(), _))
+		.WillRepeatedly(Invoke([&inputs](StatementHandle statement, IDatabase::SqlParams params) {
+			EXPECT_EQ(statement.id, CreateUrls);
+			inputs.push_back(params[0].second);
+
+			// A concurrent request created the second url first, the retry selects its row
+			std::vector<UrlRows::Row> rows{ };
+			if (inputs.size() == 1) {
+				rows.push_back({ "https://example.com/a", "a" });
+			}
+			else {
+				rows.push_back({ "https://example.com/b", "b" });
+			}
+			return std::make_unique<UrlRows>(std::move(rows));
+		}));
+
+	PostgreSQL::UrlRepository repository{ std::move(database), MakeCodes() };
+	std::vector<std::string> urls{ "https://example.com/a", "https://example.com/b" };
+	std::vector<Url> rows{ repository.Create(IUrlRepository::Strings{ urls }) };
+
+	EXPECT_EQ(rows.size(), 2);
+	ASSERT_EQ(inputs.size(), 2);
+	EXPECT_EQ(inputs[1], "{\"https://example.com/b\"}");
+}
+
+
+TEST(UrlRepositoryTest, CreateAsyncLeasesTheCodeWithoutBlocking) {
+	auto codesDatabase{ std::make_unique<MockDatabase>() };
+	EXPECT_CALL(*codesDatabase, Execute(An<std::string_view>(), _));
+	EXPECT_CALL(*codesDatabase, Prepare(_)).WillOnce(Return(StatementHandle{ Sequence }));
+	EXPECT_CALL(*codesDatabase, ExecuteQueryView(An<StatementHandle>(), _))
+		.Times(0);
+	EXPECT_CALL(*codesDatabase, ExecuteQueryViewAsync(An<StatementHandle>(), _, _))
+		.WillOnce(Invoke([](StatementHandle, IDatabase::SqlParams, IDatabase::ViewCallback callback) {
+			callback(nullptr, std::make_unique<UrlRows>(std::vector<UrlRows::Row>{ { } }));
+		}));
+	auto codes{ std::make_shared<ShortCode::Allocator>(std::move(codesDatabase), ShortCode::Encoder{ 7 }) };
+
+	auto database{ MakeDatabase() };
+	EXPECT_CALL(*database, ExecuteQueryViewAsync(An<StatementHandle>(), _, _))
+		.WillOnce(Invoke([](StatementHandle statement, IDatabase::SqlParams params, IDatabase::ViewCallback callback) {
+			EXPECT_EQ(statement.id, CreateUrl);
+			callback(nullptr, std::make_unique<UrlRows>(std::vector<UrlRows::Row>{ { params[0].second, params[1].second } }));
+		}));
+
+	PostgreSQL::UrlRepository repository{ std::move(database), codes };
+	bool isCalled{ false };
+	repository.CreateAsync("https://example.com", [&](std::exception_ptr error, std::optional<CreatedUrl> created) {
+		isCalled = true;
+		EXPECT_FALSE(error);
+		ASSERT_TRUE(created);
+		EXPECT_EQ(codes -> GetEncoder().Decode(created -> url.GetShortCode()), 0);
+	});
+
+	EXPECT_TRUE(isCalled);
+}